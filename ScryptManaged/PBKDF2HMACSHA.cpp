@@ -4,52 +4,11 @@ using namespace System;
 
 namespace ScryptManaged
 {
-#define SHA1BLOCKSIZE		20
-#define SHA256BLOCKSIZE		32
-#define SHA512BLOCKSIZE		64
+	// Signature shared by ScryptNative::PBKDF2::HMACSHA1/256/512
+	typedef void(*NativePBKDF2)(const uint8_t*, size_t, const uint8_t*, size_t, uint32_t, uint8_t*, size_t, uint32_t);
 
-	static array<Byte>^ IntToBytes(UInt32 i)
-	{
-		array<Byte>^ bytes = BitConverter::GetBytes(i);
-		if (!BitConverter::IsLittleEndian)
-		{
-			return bytes;
-		}
-		else
-		{
-			Array::Reverse(bytes);
-			return bytes;
-		}
-	}
-
-	// the core function of the PBKDF which does all the iterations
-	// per the spec section 5.2 step 3
-	array<Byte>^ ScryptManaged::PBKDF2::_F(System::Security::Cryptography::HMAC^ hmac, array<const Byte>^ P, array<Byte>^ S, UInt32 TT, UInt32 I)
-	{
-		//NOTE: SPEC IS MISLEADING!!!
-		//THE HMAC FUNCTIONS ARE KEYED BY THE PASSWORD! NEVER THE SALT!
-		array<Byte>^ bufferU = nullptr;
-		array<Byte>^ bufferOut = nullptr;
-		array<Byte>^ _int = IntToBytes(TT);
-		hmac->Initialize();
-		hmac->Key = (array<Byte>^)P; // KEY BY THE PASSWORD!!!
-		hmac->TransformBlock(S, 0, S->Length, S, 0);
-		hmac->TransformFinalBlock(_int, 0, _int->Length);
-		bufferU = hmac->Hash;
-		bufferOut = (array<Byte>^)bufferU->Clone();
-		for (UInt32 c = 1; c < I; c++)
-		{
-			hmac->Initialize();
-			hmac->Key = (array<Byte>^)P;  // KEY BY THE PASSWORD!
-			bufferU = hmac->ComputeHash(bufferU);
-			//Xor step
-			for (int i = 0; i < bufferOut->Length; i++)
-				bufferOut[i] ^= bufferU[i];
-		}
-		return bufferOut;
-	}
-
-	array<Byte>^ ScryptManaged::PBKDF2::HMACSHA1(array<const Byte>^ Password, array<const Byte>^ Salt, int Iterations, int OutputByteCount)
+	// validates the managed arguments, pins them, and lets the native core do all the iterations
+	static array<Byte>^ _PBKDF2(NativePBKDF2 F, array<const Byte>^ Password, array<const Byte>^ Salt, int Iterations, int OutputByteCount, int MaxThreads)
 	{
 		if (Salt == nullptr || Password == nullptr)
 			throw gcnew InvalidOperationException("Object not Initialized!");
@@ -57,92 +16,127 @@ namespace ScryptManaged
 			throw gcnew ArgumentOutOfRangeException("Iterations");
 		if (OutputByteCount < 1)// || OutputByteCount > uint.MaxValue * blockSize)
 			throw gcnew ArgumentOutOfRangeException("OutputByteCount");
+		if (MaxThreads < 0)
+			throw gcnew ArgumentOutOfRangeException("MaxThreads", "MaxThreads cannot be negative.");
 
-		int totalBlocks = (int)Math::Ceiling((Decimal)OutputByteCount / SHA1BLOCKSIZE);
-		int partialBlock = (int)(OutputByteCount % SHA1BLOCKSIZE);
 		array<Byte>^ result = gcnew array<Byte>(OutputByteCount);
-		array<Byte>^ buffer = nullptr;
-		array<Byte>^ _s = (array<Byte>^)Salt;
-		System::Security::Cryptography::HMAC^ h = gcnew System::Security::Cryptography::HMACSHA1();
-		for (int T = 1; T <= totalBlocks; T++)
+		pin_ptr<const Byte> pP = nullptr;
+		if (Password->Length > 0) pP = &Password[0];
+		pin_ptr<const Byte> pS = nullptr;
+		if (Salt->Length > 0) pS = &Salt[0];
+		pin_ptr<Byte> pOut = &result[0];
+		try
 		{
-			// run the F function with the _C number of iterations for block number TT
-			buffer = _F(h, Password, _s, (UInt32)T, Iterations);
-			//IF we're not at the last block requested
-			//OR the last block requested is whole (not partial)
-			//  then take everything from the result of F for this block number TT
-			//ELSE only take the needed bytes from F
-			if (T != totalBlocks || (T == totalBlocks && partialBlock == 0))
-				Buffer::BlockCopy(buffer, 0, result, SHA512BLOCKSIZE * (T - 1), SHA512BLOCKSIZE);
-			else
-				Buffer::BlockCopy(buffer, 0, result, SHA512BLOCKSIZE * (T - 1), partialBlock);
+			F(pP, Password->Length, pS, Salt->Length, (uint32_t)Iterations, pOut, OutputByteCount, (uint32_t)MaxThreads);
+		}
+		catch (const std::bad_alloc&)
+		{
+			throw gcnew OutOfMemoryException("Not enough memory for the PBKDF2 output.");
+		}
+		catch (const std::out_of_range& ex)
+		{
+			throw gcnew ArgumentOutOfRangeException("*", gcnew String(ex.what()));
+		}
+		catch (const std::exception& ex) // std::system_error when a worker thread cannot be started
+		{
+			throw gcnew InvalidOperationException(gcnew String(ex.what()));
 		}
 		return result;
 	}
 
+	array<Byte>^ ScryptManaged::PBKDF2::HMACSHA1(array<const Byte>^ Password, array<const Byte>^ Salt, int Iterations, int OutputByteCount)
+	{
+		return _PBKDF2(ScryptNative::PBKDF2::HMACSHA1, Password, Salt, Iterations, OutputByteCount, 1);
+	}
+
+	array<Byte>^ ScryptManaged::PBKDF2::HMACSHA1(array<const Byte>^ Password, array<const Byte>^ Salt, int Iterations, int OutputByteCount, int MaxThreads)
+	{
+		return _PBKDF2(ScryptNative::PBKDF2::HMACSHA1, Password, Salt, Iterations, OutputByteCount, MaxThreads);
+	}
+
 	array<Byte>^ ScryptManaged::PBKDF2::HMACSHA256(array<const Byte>^ Password, array<const Byte>^ Salt, int Iterations, int OutputByteCount)
 	{
-		if (Salt == nullptr || Password == nullptr)
-			throw gcnew InvalidOperationException("Object not Initialized!");
-		if (Iterations < 1)
-			throw gcnew ArgumentOutOfRangeException("Iterations");
-		if (OutputByteCount < 1)// || OutputByteCount > uint.MaxValue * blockSize)
-			throw gcnew ArgumentOutOfRangeException("OutputByteCount");
+		return _PBKDF2(ScryptNative::PBKDF2::HMACSHA256, Password, Salt, Iterations, OutputByteCount, 1);
+	}
 
-		int totalBlocks = (int)Math::Ceiling((Decimal)OutputByteCount / SHA256BLOCKSIZE);
-		int partialBlock = (int)(OutputByteCount % SHA256BLOCKSIZE);
-		array<Byte>^ result = gcnew array<Byte>(OutputByteCount);
-		array<Byte>^ buffer = nullptr;
-		array<Byte>^ _s = (array<Byte>^)Salt;
-		System::Security::Cryptography::HMAC^ h = gcnew System::Security::Cryptography::HMACSHA256();
-		for (int T = 1; T <= totalBlocks; T++)
-		{
-			// run the F function with the _C number of iterations for block number TT
-			buffer = _F(h, Password, _s, T, Iterations);
-			//IF we're not at the last block requested
-			//OR the last block requested is whole (not partial)
-			//  then take everything from the result of F for this block number TT
-			//ELSE only take the needed bytes from F
-			if (T != totalBlocks || (T == totalBlocks && partialBlock == 0))
-				Buffer::BlockCopy(buffer, 0, result, SHA256BLOCKSIZE * (T - 1), SHA256BLOCKSIZE);
-			else
-				Buffer::BlockCopy(buffer, 0, result, SHA256BLOCKSIZE * (T - 1), partialBlock);
-		}
-		return result;
+	array<Byte>^ ScryptManaged::PBKDF2::HMACSHA256(array<const Byte>^ Password, array<const Byte>^ Salt, int Iterations, int OutputByteCount, int MaxThreads)
+	{
+		return _PBKDF2(ScryptNative::PBKDF2::HMACSHA256, Password, Salt, Iterations, OutputByteCount, MaxThreads);
 	}
 
 	array<Byte>^ ScryptManaged::PBKDF2::HMACSHA512(array<const Byte>^ Password, array<const Byte>^ Salt, int Iterations, int OutputByteCount)
+	{
+		return _PBKDF2(ScryptNative::PBKDF2::HMACSHA512, Password, Salt, Iterations, OutputByteCount, 1);
+	}
+
+	array<Byte>^ ScryptManaged::PBKDF2::HMACSHA512(array<const Byte>^ Password, array<const Byte>^ Salt, int Iterations, int OutputByteCount, int MaxThreads)
+	{
+		return _PBKDF2(ScryptNative::PBKDF2::HMACSHA512, Password, Salt, Iterations, OutputByteCount, MaxThreads);
+	}
+
+	PBKDF2Stream::PBKDF2Stream(const int Hash, array<const Byte>^ Password, array<const Byte>^ Salt, const int Iterations)
+		: native(nullptr)
 	{
 		if (Salt == nullptr || Password == nullptr)
 			throw gcnew InvalidOperationException("Object not Initialized!");
+		if (Hash != 1 && Hash != 256 && Hash != 512)
+			throw gcnew ArgumentOutOfRangeException("Hash", "Hash must be 1, 256 or 512.");
 		if (Iterations < 1)
 			throw gcnew ArgumentOutOfRangeException("Iterations");
-		if (OutputByteCount < 1)// || OutputByteCount > uint.MaxValue * blockSize)
-			throw gcnew ArgumentOutOfRangeException("OutputByteCount");
+		pin_ptr<const Byte> pP = nullptr;
+		if (Password->Length > 0) pP = &Password[0];
+		pin_ptr<const Byte> pS = nullptr;
+		if (Salt->Length > 0) pS = &Salt[0];
+		native = new ScryptNative::PBKDF2Stream(Hash, pP, Password->Length, pS, Salt->Length, Iterations);
+	}
 
-		int totalBlocks = (int)Math::Ceiling((Decimal)OutputByteCount / SHA512BLOCKSIZE);
-		int partialBlock = (int)(OutputByteCount % SHA512BLOCKSIZE);
-		array<Byte>^ result = gcnew array<Byte>(OutputByteCount);
-		array<Byte>^ buffer = nullptr;
-		array<Byte>^ _s = (array<Byte>^)Salt;
-		System::Security::Cryptography::HMAC^ h = gcnew System::Security::Cryptography::HMACSHA512();
-		for (int T = 1; T <= totalBlocks; T++)
+	PBKDF2Stream::~PBKDF2Stream()
+	{
+		this->!PBKDF2Stream();
+	}
+
+	PBKDF2Stream::!PBKDF2Stream()
+	{
+		delete native; // wipes the keyed state
+		native = nullptr;
+	}
+
+	// checks Buffer[Offset .. Offset+Count) and pins it
+	static void StreamRead(ScryptNative::PBKDF2Stream* native, Int64 Position, array<Byte>^ Buffer, int Offset, int Count, int MaxThreads, bool Sequential)
+	{
+		if (native == nullptr)
+			throw gcnew ObjectDisposedException("PBKDF2Stream");
+		if (Buffer == nullptr)
+			throw gcnew ArgumentNullException("Buffer");
+		if (Offset < 0 || Count < 0 || Offset > Buffer->Length - Count)
+			throw gcnew ArgumentOutOfRangeException("Offset", "Offset and Count must lie inside Buffer.");
+		if (Position < 0)
+			throw gcnew ArgumentOutOfRangeException("Position");
+		if (MaxThreads < 0)
+			throw gcnew ArgumentOutOfRangeException("MaxThreads", "MaxThreads cannot be negative.");
+		if (Count == 0)
+			return;
+		pin_ptr<Byte> pOut = &Buffer[Offset];
+		try
 		{
-			// run the F function with the _C number of iterations for block number TT
-			buffer = _F(h, Password, _s, (UInt32)T, Iterations);
-			//IF we're not at the last block requested
-			//OR the last block requested is whole (not partial)
-			//  then take everything from the result of F for this block number TT
-			//ELSE only take the needed bytes from F
-			if (T != totalBlocks || (T == totalBlocks && partialBlock == 0))
-				Buffer::BlockCopy(buffer, 0, result, SHA512BLOCKSIZE * (T - 1), SHA512BLOCKSIZE);
+			if (Sequential)
+				native->Read(pOut, Count);
 			else
-				Buffer::BlockCopy(buffer, 0, result, SHA512BLOCKSIZE * (T - 1), partialBlock);
+				native->ReadAt(Position, pOut, Count, MaxThreads);
+		}
+		catch (const std::out_of_range&)
+		{
+			throw gcnew ArgumentOutOfRangeException("OutputByteCount");
 		}
-		return result;
 	}
 
-	
+	void PBKDF2Stream::Read(array<Byte>^ Buffer, const int Offset, const int Count)
+	{
+		StreamRead(native, 0, Buffer, Offset, Count, 1, true);
+	}
 
-	
-}
\ No newline at end of file
+	void PBKDF2Stream::ReadAt(const Int64 Position, array<Byte>^ Buffer, const int Offset, const int Count, const int MaxThreads)
+	{
+		StreamRead(native, Position, Buffer, Offset, Count, MaxThreads, false);
+	}
+}
@@ -22,17 +22,47 @@
 * limitations under the License.
 */
 
+#include <new>
+#include <stdexcept>
+#include <vector>
+#include <vcclr.h>
+#include "../ScryptNative/Common.h"
 #include "ScryptManaged.h"
 #include "PBKDF2HMACSHA.cpp"
 
 using namespace System;
 using namespace System::Text;
+using namespace System::Runtime::InteropServices;
 
 namespace ScryptManaged
 {
+	// UTF-8 bytes of a UTF-16 password without a managed array: short passwords are encoded on the stack, longer ones into
+	// a native buffer, and either is wiped when this goes out of scope
+	class Utf8Password
+	{
+		uint8_t stack[256];
+		std::vector<uint8_t> heap;
+	public:
+		uint8_t* Data;
+		int Length;
+		Utf8Password(const wchar_t* Chars, const int Count) : Data(stack), Length(0)
+		{
+			if (Count == 0)
+				return;
+			int length = Encoding::UTF8->GetByteCount(const_cast<wchar_t*>(Chars), Count);
+			if (length > (int)sizeof(stack))
+			{
+				heap.resize(length);
+				Data = heap.data();
+			}
+			Length = Encoding::UTF8->GetBytes(const_cast<wchar_t*>(Chars), Count, Data, length);
+		}
+		~Utf8Password() { ScryptNative::SecureZero(Data, Length); }
+	};
+
 	String^ Scrypt::Encode(String^ Password, const int Iterations, const short BlockSize, const short Parallelism)
 	{
-		return Encode((array<const Byte>^)Encoding::UTF8->GetBytes(Password), nullptr, Iterations, BlockSize, Parallelism, 32);
+		return Encode(Password, nullptr, Iterations, BlockSize, Parallelism, 32);
 	}
 
 	String^ Scrypt::Encode(array<const Byte>^ Password, const int Iterations, const short BlockSize, const short Parallelism)
@@ -42,7 +72,7 @@ namespace ScryptManaged
 
 	String^ Scrypt::Encode(String^ Password, array<const Byte>^ Salt, const int Iterations, const short BlockSize, const short Parallelism)
 	{
-		return Encode((array<const Byte>^)Encoding::UTF8->GetBytes(Password), Salt, Iterations, BlockSize, Parallelism, 32);
+		return Encode(Password, Salt, Iterations, BlockSize, Parallelism, 32);
 	}
 
 	String^ Scrypt::Encode(array<const Byte>^ Password, array<const Byte>^ Salt, const int Iterations, const short BlockSize, const short Parallelism)
@@ -53,12 +83,16 @@ namespace ScryptManaged
 	String^ Scrypt::Encode(String^ Password, array<const Byte>^ Salt,
 		const int Iterations, const short BlockSize, const short Parallelism, const int OutputByteLength)
 	{
-		return Encode((array<const Byte>^)Encoding::UTF8->GetBytes(Password), Salt, Iterations, BlockSize, Parallelism, OutputByteLength);
+		if (Password == nullptr)
+			throw gcnew ArgumentNullException("password");
+		pin_ptr<const wchar_t> chars = PtrToStringChars(Password);
+		Utf8Password P(chars, Password->Length);
+		return EncodeString(P.Data, P.Length, Salt, Iterations, BlockSize, Parallelism, OutputByteLength);
 	}
 
 	String^ Scrypt::Encode(String^ Password, const int Iterations, const short BlockSize, const short Parallelism, const int OutputByteLength) 
 	{
-		return Encode((array<const Byte>^)Encoding::UTF8->GetBytes(Password), nullptr, Iterations, BlockSize, Parallelism, OutputByteLength);
+		return Encode(Password, nullptr, Iterations, BlockSize, Parallelism, OutputByteLength);
 	}
 
 	String^ Scrypt::Encode(array<const Byte>^ Password, const int Iterations, const short BlockSize, const short Parallelism, const int OutputByteLength) 
@@ -69,46 +103,269 @@ namespace ScryptManaged
 	String^ Scrypt::Encode(array<const Byte>^ Password, array<const Byte>^ Salt,
 		const int Iterations, const short BlockSize, const short Parallelism, const int OutputByteLength)
 	{
-		array<const Byte>^ salt;
+		pin_ptr<const Byte> pP = nullptr;
+		if (Password != nullptr && Password->Length > 0) pP = &Password[0];
+		return EncodeString(pP, Password == nullptr ? 0 : Password->Length, Salt, Iterations, BlockSize, Parallelism, OutputByteLength);
+	}
+
+	String^ Scrypt::EncodeString(const uint8_t* Password, const int PasswordLength, array<const Byte>^ Salt,
+		const int Iterations, const short BlockSize, const short Parallelism, const int OutputByteLength)
+	{
+		if (Salt != nullptr && Salt->Length == 0)
+			throw gcnew ArgumentOutOfRangeException("Salt", "Salt cannot be null or zero length.");
+		ValidateParameters(Iterations, BlockSize, Parallelism, OutputByteLength, 1);
+		pin_ptr<const Byte> pS = nullptr;
+		if (Salt != nullptr) pS = &Salt[0];
+		ScryptNative::HashFields f = { 2, (uint64_t)Iterations, (uint32_t)BlockSize, (uint32_t)Parallelism, nullptr, Salt == nullptr ? 32u : (size_t)Salt->Length, nullptr, (size_t)OutputByteLength };
+		char text[MaxEncodedLength];
+		std::vector<char> large;
+		char* out = text;
+		size_t length = ScryptNative::HashCodec::EncodedLength(f);
+		if (length > sizeof(text))
+		{
+			large.resize(length);
+			out = large.data();
+		}
+		int written = EncodeInto(Password, PasswordLength, pS, Salt == nullptr ? 0 : Salt->Length, Iterations, BlockSize, Parallelism, OutputByteLength, out, (int)length);
+		return gcnew String(out, 0, written);
+	}
+
+	// The salt and the derived hash stay on the stack (the hash in a native buffer when longer than MaxEncodedLength) and
+	// only the text form leaves; the RNG is the OS one behind ScryptNative::Scrypt::RandomSalt
+	int Scrypt::EncodeInto(const uint8_t* Password, const int PasswordLength, const uint8_t* Salt, const int SaltLength,
+		const int Iterations, const short BlockSize, const short Parallelism, const int OutputByteLength, char* Encoded, const int EncodedCapacity)
+	{
+		ValidateParameters(Iterations, BlockSize, Parallelism, OutputByteLength, 1);
+		uint8_t salt[32];
+		ScryptNative::HashFields f = { 2, (uint64_t)Iterations, (uint32_t)BlockSize, (uint32_t)Parallelism, Salt, (size_t)SaltLength, nullptr, (size_t)OutputByteLength };
 		if (Salt == nullptr) // if they didn't provide one, we will
 		{
-			array<Byte>^ _salt = gcnew array<Byte>(32);
-			(gcnew System::Security::Cryptography::RNGCryptoServiceProvider())->GetBytes(_salt);
-			salt = (array<const Byte>^)_salt;
+			f.Salt = salt;
+			f.SaltLength = sizeof(salt);
+		}
+		size_t length = ScryptNative::HashCodec::EncodedLength(f);
+		if (EncodedCapacity < 0 || length > (size_t)EncodedCapacity)
+			throw gcnew ArgumentException("The buffer is too small for the encoded hash, see EncodedLength.", "Encoded");
+		uint8_t stackHash[MaxEncodedLength];
+		std::vector<uint8_t> large;
+		uint8_t* hash = stackHash;
+		if (OutputByteLength > MaxEncodedLength)
+		{
+			large.resize(OutputByteLength);
+			hash = large.data();
+		}
+		try
+		{
+			if (Salt == nullptr)
+				ScryptNative::Scrypt::RandomSalt(salt, sizeof(salt));
+			ScryptNative::Scrypt::ComputeDerivedHash(Password, PasswordLength, f.Salt, f.SaltLength, Iterations, BlockSize, Parallelism, hash, OutputByteLength);
 		}
-		else
-			salt = Salt;
-		array<Byte>^ stuff = ComputeDerivedHash(Password, salt, Iterations, BlockSize, Parallelism, OutputByteLength);
-		Header^ h = gcnew Header(2, Salt, Iterations, BlockSize, Parallelism, stuff);
-		return h->ToString();
+		catch (const std::bad_alloc&)
+		{
+			throw gcnew OutOfMemoryException("Not enough memory for the requested CPUCost, BlockSize and Parallelism.");
+		}
+		catch (const std::runtime_error& ex)
+		{
+			throw gcnew Security::Cryptography::CryptographicException(gcnew String(ex.what()));
+		}
+		f.Hash = hash;
+		length = ScryptNative::HashCodec::Encode(f, Encoded, EncodedCapacity);
+		ScryptNative::SecureZero(hash, OutputByteLength);
+		return (int)length;
+	}
+
+	int Scrypt::EncodedLength(const int Iterations, const short BlockSize, const short Parallelism, const int OutputByteLength)
+	{
+		ValidateParameters(Iterations, BlockSize, Parallelism, OutputByteLength, 1);
+		ScryptNative::HashFields f = { 2, (uint64_t)Iterations, (uint32_t)BlockSize, (uint32_t)Parallelism, nullptr, 32, nullptr, (size_t)OutputByteLength };
+		return (int)ScryptNative::HashCodec::EncodedLength(f);
+	}
+
+	int Scrypt::Encode(const Byte* Password, const int PasswordLength,
+		const int Iterations, const short BlockSize, const short Parallelism, const int OutputByteLength, Byte* Encoded, const int EncodedCapacity)
+	{
+		if (PasswordLength < 0 || (Password == nullptr && PasswordLength > 0))
+			throw gcnew ArgumentOutOfRangeException("passwordLength", "password cannot be null unless passwordLength is zero.");
+		if (Encoded == nullptr)
+			throw gcnew ArgumentNullException("Encoded");
+		return EncodeInto(Password, PasswordLength, nullptr, 0, Iterations, BlockSize, Parallelism, OutputByteLength, (char*)Encoded, EncodedCapacity);
+	}
+
+	int Scrypt::Encode(const Char* Password, const int PasswordLength,
+		const int Iterations, const short BlockSize, const short Parallelism, const int OutputByteLength, Byte* Encoded, const int EncodedCapacity)
+	{
+		if (PasswordLength < 0 || (Password == nullptr && PasswordLength > 0))
+			throw gcnew ArgumentOutOfRangeException("passwordLength", "password cannot be null unless passwordLength is zero.");
+		if (Encoded == nullptr)
+			throw gcnew ArgumentNullException("Encoded");
+		Utf8Password P(Password, PasswordLength);
+		return EncodeInto(P.Data, P.Length, nullptr, 0, Iterations, BlockSize, Parallelism, OutputByteLength, (char*)Encoded, EncodedCapacity);
 	}
-	
+
 	bool Scrypt::Compare(const String^ encodedHash, const String^ password)
 	{
 		String^ pass = password == nullptr ? "" : const_cast<String^>(password);
-		return Scrypt::Compare(encodedHash, (array<const Byte>^)(gcnew Text::UTF8Encoding())->GetBytes(pass));
+		pin_ptr<const wchar_t> chars = PtrToStringChars(pass);
+		return Scrypt::Compare(encodedHash, chars, pass->Length);
 	}
 
+	// Decodes, hashes and compares without touching the GC heap: the encoded chars are narrowed onto the stack,
+	// salt, expected and computed hash live there too
 	bool Scrypt::Compare(const String^ encodedHash, array<const Byte>^ password)
 	{
 		if (String::IsNullOrWhiteSpace(const_cast<String^>(encodedHash)))
 			throw gcnew ArgumentNullException("encodedHash");
 		if (password == nullptr || password->Length == 0)
 			throw gcnew ArgumentNullException("password");
-		Scrypt::Header^ h = Scrypt::Header::FromString(encodedHash); // exceptions will be raised from here as necessary
-		array<Byte>^ stuff;
-		if (h->v >= 2)
+		char text[MaxEncodedLength];
+		uint8_t storage[MaxEncodedLength];
+		ScryptNative::HashFields h;
+		DecodeEncoded(const_cast<String^>(encodedHash), text, storage, h); // exceptions will be raised from here as necessary
+		pin_ptr<const Byte> pP = &password[0];
+		return CompareDecoded(h, pP, password->Length);
+	}
+
+	bool Scrypt::Compare(const String^ encodedHash, const Char* password, const int passwordLength)
+	{
+		if (String::IsNullOrWhiteSpace(const_cast<String^>(encodedHash)))
+			throw gcnew ArgumentNullException("encodedHash");
+		if (password == nullptr || passwordLength <= 0)
+			throw gcnew ArgumentNullException("password");
+		char text[MaxEncodedLength];
+		uint8_t storage[MaxEncodedLength];
+		ScryptNative::HashFields h;
+		DecodeEncoded(const_cast<String^>(encodedHash), text, storage, h);
+		Utf8Password P(password, passwordLength);
+		return CompareDecoded(h, P.Data, P.Length);
+	}
+
+	bool Scrypt::Compare(const Byte* encodedHash, const int encodedLength, const Byte* password, const int passwordLength)
+	{
+		if (encodedHash == nullptr || encodedLength <= 0)
+			throw gcnew ArgumentNullException("encodedHash");
+		uint8_t storage[MaxEncodedLength];
+		ScryptNative::HashFields h;
+		DecodeText((const char*)encodedHash, encodedLength, storage, h);
+		return CompareDecoded(h, password, passwordLength);
+	}
+
+	bool Scrypt::Compare(const Byte* encodedHash, const int encodedLength, const Char* password, const int passwordLength)
+	{
+		if (encodedHash == nullptr || encodedLength <= 0)
+			throw gcnew ArgumentNullException("encodedHash");
+		if (password == nullptr || passwordLength <= 0)
+			throw gcnew ArgumentNullException("password");
+		uint8_t storage[MaxEncodedLength];
+		ScryptNative::HashFields h;
+		DecodeText((const char*)encodedHash, encodedLength, storage, h);
+		Utf8Password P(password, passwordLength);
+		return CompareDecoded(h, P.Data, P.Length);
+	}
+
+	bool Scrypt::CompareDecoded(const ScryptNative::HashFields& h, const uint8_t* Password, const int PasswordLength)
+	{
+		if (Password == nullptr || PasswordLength <= 0)
+			throw gcnew ArgumentNullException("password");
+		ValidateParameters((int)h.CPUCost, (short)h.BlockSize, (short)h.Parallelism, (int)h.HashLength, 1);
+		uint8_t computed[MaxEncodedLength];
+		try
 		{
-			stuff = Scrypt::ComputeDerivedHash(password, (array<const Byte>^)h->s, h->cc, h->b, h->p, h->olen);
+			ScryptNative::Scrypt::ComputeDerivedHash(Password, PasswordLength, h.Salt, h.SaltLength, h.CPUCost, h.BlockSize, h.Parallelism, computed, h.HashLength);
 		}
-		else if (h->v == 1)
+		catch (const std::bad_alloc&)
 		{
-			stuff = Scrypt::ComputeDerivedHash(password, (array<const Byte>^)h->s, h->cc, h->b, h->p, h->olen);
+			throw gcnew OutOfMemoryException("Not enough memory for the requested CPUCost, BlockSize and Parallelism.");
 		}
-		else
-			stuff = Scrypt::ComputeDerivedHash(password, (array<const Byte>^)h->s, h->cc, h->b, h->p, h->olen);
+		bool equal = ScryptNative::Scrypt::SafeEquals(computed, h.Hash, h.HashLength);
+		ScryptNative::SecureZero(computed, h.HashLength);
+		return equal;
+	}
+
+	void Scrypt::DecodeEncoded(String^ value, char* Text, uint8_t* Storage, ScryptNative::HashFields& Fields)
+	{
+		// the encoded form is plain ASCII, anything else cannot be a hash we wrote
+		if (value->Length > MaxEncodedLength)
+			throw gcnew FormatException("The encoded hash is too long.");
+		pin_ptr<const wchar_t> chars = PtrToStringChars(value);
+		for (int i = 0; i < value->Length; i++)
+		{
+			if (chars[i] > 0x7f)
+				throw gcnew FormatException("The encoded hash is not a valid scrypt hash.");
+			Text[i] = (char)chars[i];
+		}
+		DecodeText(Text, value->Length, Storage, Fields);
+	}
 
-		return Scrypt::SafeEquals(stuff, h->Hash);
+	void Scrypt::DecodeText(const char* Text, const int Length, uint8_t* Storage, ScryptNative::HashFields& Fields)
+	{
+		if (Length > MaxEncodedLength)
+			throw gcnew FormatException("The encoded hash is too long.");
+		if (!ScryptNative::HashCodec::Decode(Text, Length, Fields, Storage, MaxEncodedLength) ||
+			Fields.CPUCost > 0x7fffffff || Fields.BlockSize > 0x7fff || Fields.Parallelism > 0x7fff || Fields.HashLength > 0x7fffffff)
+			throw gcnew FormatException("The encoded hash is not a valid scrypt hash.");
+	}
+
+	Scrypt::Header^ Scrypt::Header::FromString(const String^ value)
+	{
+		if (String::IsNullOrWhiteSpace(const_cast<String^>(value)))
+			return nullptr;
+		char text[MaxEncodedLength];
+		uint8_t storage[MaxEncodedLength];
+		ScryptNative::HashFields f;
+		DecodeEncoded(const_cast<String^>(value), text, storage, f);
+		Header^ result = gcnew Header();
+		result->v = (Byte)f.Version;
+		result->cc = (int)f.CPUCost;
+		result->b = (short)f.BlockSize;
+		result->p = (short)f.Parallelism;
+		result->s = gcnew array<Byte>((int)f.SaltLength);
+		Marshal::Copy(IntPtr((void*)f.Salt), result->s, 0, (int)f.SaltLength);
+		result->Hash = gcnew array<Byte>((int)f.HashLength);
+		Marshal::Copy(IntPtr((void*)f.Hash), result->Hash, 0, (int)f.HashLength);
+		result->olen = result->Hash->Length;
+		return result;
+	}
+
+	String^ Scrypt::Header::ToString()
+	{
+		if (s == nullptr || Hash == nullptr)
+			throw gcnew InvalidOperationException("The header has no salt or no hash to encode.");
+		if (v < 2 && (cc > 0xff || b > 0xff || p > 0xff)) // DEPRECATED!!!! versions only hold 8 bit parameters
+			throw gcnew System::ArithmeticException("Parameter Overflow on Deprecated ToString() method call");
+		pin_ptr<Byte> pS = nullptr;
+		if (s->Length > 0) pS = &s[0];
+		pin_ptr<Byte> pH = nullptr;
+		if (Hash->Length > 0) pH = &Hash[0];
+		ScryptNative::HashFields f = { v >= 2 ? 2u : v, (uint64_t)cc, (uint32_t)b, (uint32_t)p, pS, (size_t)s->Length, pH, (size_t)Hash->Length };
+		char text[MaxEncodedLength];
+		std::vector<char> large;
+		char* out = text;
+		size_t length = ScryptNative::HashCodec::EncodedLength(f);
+		if (length > sizeof(text))
+		{
+			large.resize(length);
+			out = large.data();
+		}
+		length = ScryptNative::HashCodec::Encode(f, out, length);
+		if (length == 0)
+			throw gcnew InvalidOperationException("The header cannot be encoded.");
+		return gcnew String(out, 0, (int)length);
+	}
+
+	void Scrypt::ValidateParameters(const int Iterations, const short BlockSize, const short Parallelism, const int OutputByteLength, const int MaxThreads)
+	{
+		if (Iterations < 2 || (Iterations & 1L) == 1 || (Iterations & (Iterations - 1)) != 0L)
+			throw gcnew ArgumentOutOfRangeException("Iterations", "Iterations must be a power of 2, and greater than 1.");
+		if (BlockSize < 1 || Parallelism < 1 ||
+			(UInt64)BlockSize*(UInt64)Parallelism > 1 << 30 ||
+			BlockSize > 0x7fffffff / 128 / Parallelism ||
+			BlockSize > 0x7fffffff / 256 ||
+			Iterations > 0x7fffffff / 128 / BlockSize)
+			throw gcnew ArgumentOutOfRangeException("*", "Combined Parameter Values are too large.");
+		if (OutputByteLength == 0 || OutputByteLength % 32 != 0)
+			throw gcnew ArgumentOutOfRangeException("OutputByteLength", "OutputByteLength must be a multiple of 32, and greater than 0.");
+		if (MaxThreads < 0)
+			throw gcnew ArgumentOutOfRangeException("MaxThreads", "MaxThreads cannot be negative.");
 	}
 
 	array<Byte>^ Scrypt::ComputeDerivedHash(
@@ -122,77 +379,467 @@ namespace ScryptManaged
 		array<const Byte>^ Password, array<const Byte>^ Salt,
 		const int Iterations, const short BlockSize, const short Parallelism,
 		const int OutputByteLength)
+	{
+		return ComputeDerivedHash(Password, Salt, Iterations, BlockSize, Parallelism, OutputByteLength, 1);
+	}
+
+	array<Byte>^ Scrypt::ComputeDerivedHash(
+		array<const Byte>^ Password, array<const Byte>^ Salt,
+		const int Iterations, const short BlockSize, const short Parallelism,
+		const int OutputByteLength, const int MaxThreads)
+	{
+		if (Salt == nullptr || Salt->Length == 0)
+			throw gcnew ArgumentOutOfRangeException("Salt", "Salt cannot be null or zero length.");
+		ValidateParameters(Iterations, BlockSize, Parallelism, OutputByteLength, MaxThreads);
+		array<Byte>^ output = gcnew array<Byte>(OutputByteLength);
+		ComputeDerivedHash(Password, Salt, Iterations, BlockSize, Parallelism, output, 0, OutputByteLength, MaxThreads);
+		return output;
+	}
+
+	void Scrypt::ComputeDerivedHash(
+		array<const Byte>^ Password, array<const Byte>^ Salt,
+		const int Iterations, const short BlockSize, const short Parallelism,
+		array<Byte>^ Output, const int OutputOffset, const int OutputByteLength, const int MaxThreads)
+	{
+		if (Salt == nullptr || Salt->Length == 0)
+			throw gcnew ArgumentOutOfRangeException("Salt", "Salt cannot be null or zero length.");
+		if (Output == nullptr)
+			throw gcnew ArgumentNullException("Output");
+		if (OutputOffset < 0 || OutputByteLength < 0 || OutputOffset > Output->Length - OutputByteLength)
+			throw gcnew ArgumentOutOfRangeException("OutputOffset", "OutputOffset and OutputByteLength must lie inside Output.");
+		ValidateParameters(Iterations, BlockSize, Parallelism, OutputByteLength, MaxThreads);
+		// pin everything for the duration of the native call, the GC cannot move these while ROMix is running
+		pin_ptr<const Byte> pP = nullptr;
+		if (Password != nullptr && Password->Length > 0) pP = &Password[0];
+		pin_ptr<const Byte> pS = &Salt[0];
+		pin_ptr<Byte> pOut = &Output[OutputOffset];
+		ComputeDerivedHash(pP, Password == nullptr ? 0 : Password->Length, pS, Salt->Length, Iterations, BlockSize, Parallelism, pOut, OutputByteLength, MaxThreads);
+	}
+
+	void Scrypt::ComputeDerivedHash(
+		const Byte* Password, const int PasswordLength, const Byte* Salt, const int SaltLength,
+		const int Iterations, const short BlockSize, const short Parallelism,
+		Byte* Output, const int OutputByteLength, const int MaxThreads)
+	{
+		if (Salt == nullptr || SaltLength <= 0)
+			throw gcnew ArgumentOutOfRangeException("Salt", "Salt cannot be null or zero length.");
+		if (PasswordLength < 0 || (Password == nullptr && PasswordLength > 0))
+			throw gcnew ArgumentOutOfRangeException("passwordLength", "password cannot be null unless passwordLength is zero.");
+		ValidateParameters(Iterations, BlockSize, Parallelism, OutputByteLength, MaxThreads);
+		if (Output == nullptr)
+			throw gcnew ArgumentNullException("Output");
+		try
+		{
+			ScryptNative::Scrypt::ComputeDerivedHash(Password, PasswordLength, Salt, SaltLength, Iterations, BlockSize, Parallelism, Output, OutputByteLength, MaxThreads);
+		}
+		catch (const std::bad_alloc&)
+		{
+			throw gcnew OutOfMemoryException("Not enough memory for the requested CPUCost, BlockSize and Parallelism.");
+		}
+	}
+
+	array<array<Byte>^>^ Scrypt::ComputeDerivedHashBatch(
+		array<array<const Byte>^>^ Passwords, array<array<const Byte>^>^ Salts,
+		const int Iterations, const short BlockSize, const short Parallelism,
+		const int OutputByteLength, const int MaxThreads)
+	{
+		if (Passwords == nullptr)
+			throw gcnew ArgumentNullException("Passwords");
+		if (Salts == nullptr || Salts->Length != Passwords->Length)
+			throw gcnew ArgumentOutOfRangeException("Salts", "There must be one salt per password.");
+		ValidateParameters(Iterations, BlockSize, Parallelism, OutputByteLength, MaxThreads);
+		int count = Passwords->Length;
+		array<array<Byte>^>^ outputs = gcnew array<array<Byte>^>(count);
+		for (int i = 0; i < count; i++)
+		{
+			if (Salts[i] == nullptr || Salts[i]->Length == 0)
+				throw gcnew ArgumentOutOfRangeException("Salts", "Salt cannot be null or zero length.");
+			outputs[i] = gcnew array<Byte>(OutputByteLength);
+		}
+		if (count == 0)
+			return outputs;
+
+		// pin_ptr only covers a fixed number of locals, so every array is pinned through a GCHandle until the native call returns
+		array<GCHandle>^ pins = gcnew array<GCHandle>(3 * count);
+		std::vector<const uint8_t*> p(count), s(count);
+		std::vector<uint8_t*> out(count);
+		std::vector<size_t> pl(count), sl(count);
+		try
+		{
+			for (int i = 0; i < count; i++)
+			{
+				array<const Byte>^ P = Passwords[i] == nullptr ? (array<const Byte>^)gcnew array<Byte>(0) : Passwords[i];
+				pins[3 * i] = GCHandle::Alloc((Object^)P, GCHandleType::Pinned);
+				pins[3 * i + 1] = GCHandle::Alloc((Object^)Salts[i], GCHandleType::Pinned);
+				pins[3 * i + 2] = GCHandle::Alloc(outputs[i], GCHandleType::Pinned);
+				p[i] = (const uint8_t*)pins[3 * i].AddrOfPinnedObject().ToPointer(); pl[i] = P->Length;
+				s[i] = (const uint8_t*)pins[3 * i + 1].AddrOfPinnedObject().ToPointer(); sl[i] = Salts[i]->Length;
+				out[i] = (uint8_t*)pins[3 * i + 2].AddrOfPinnedObject().ToPointer();
+			}
+			ScryptNative::Scrypt::ComputeDerivedHashBatch(p.data(), pl.data(), s.data(), sl.data(), count,
+				Iterations, BlockSize, Parallelism, out.data(), OutputByteLength, MaxThreads);
+		}
+		catch (const std::bad_alloc&)
+		{
+			throw gcnew OutOfMemoryException("Not enough memory for the requested CPUCost, BlockSize and Parallelism.");
+		}
+		finally
+		{
+			for (int i = 0; i < pins->Length; i++)
+				if (pins[i].IsAllocated)
+					pins[i].Free();
+		}
+		return outputs;
+	}
+
+	array<bool>^ Scrypt::CompareBatch(
+		array<array<const Byte>^>^ Passwords, array<array<const Byte>^>^ Salts, array<array<const Byte>^>^ ExpectedHashes,
+		const int Iterations, const short BlockSize, const short Parallelism, const int MaxThreads)
+	{
+		if (Passwords == nullptr || ExpectedHashes == nullptr || ExpectedHashes->Length != Passwords->Length)
+			throw gcnew ArgumentOutOfRangeException("ExpectedHashes", "There must be one expected hash per password.");
+		array<bool>^ results = gcnew array<bool>(ExpectedHashes->Length);
+		if (ExpectedHashes->Length == 0)
+			return results;
+		int hashLength = ExpectedHashes[0] == nullptr ? 0 : ExpectedHashes[0]->Length;
+		for (int i = 0; i < ExpectedHashes->Length; i++)
+			if (ExpectedHashes[i] == nullptr || ExpectedHashes[i]->Length != hashLength)
+				throw gcnew ArgumentOutOfRangeException("ExpectedHashes", "All expected hashes must have the same length.");
+		array<array<Byte>^>^ computed = ComputeDerivedHashBatch(Passwords, Salts, Iterations, BlockSize, Parallelism, hashLength, MaxThreads);
+		for (int i = 0; i < results->Length; i++)
+			results[i] = SafeEquals(computed[i], (array<Byte>^)ExpectedHashes[i]);
+		return results;
+	}
+
+	Collections::Generic::Dictionary<String^, Int64>^ ScryptMetrics::Snapshot()
+	{
+		ScryptNative::Metrics::Counters m = ScryptNative::Metrics::Snapshot();
+		Collections::Generic::Dictionary<String^, Int64>^ d = gcnew Collections::Generic::Dictionary<String^, Int64>();
+		array<String^>^ phases = { "pbkdf2_in", "romix_fill", "romix_mix", "pbkdf2_out" };
+		d["calls"] = m.Calls;
+		d["hashes"] = m.Hashes;
+		for (int p = 0; p < ScryptNative::Metrics::PhaseCount; p++)
+		{
+			d[phases[p] + "_ns"] = m.Nanoseconds[p];
+			d[phases[p] + "_cycles"] = m.Cycles[p];
+		}
+		d["wall_ns"] = m.WallNanoseconds;
+		d["blockmix_calls"] = m.BlockMixCalls;
+		d["salsa_calls"] = m.SalsaCalls;
+		d["pbkdf2_calls"] = m.PBKDF2Calls;
+		d["pbkdf2_ns"] = m.PBKDF2Nanoseconds;
+		d["vbytes_allocated"] = m.VBytesAllocated;
+		d["vbytes_wiped"] = m.VBytesWiped;
+		d["vbytes_in_use"] = m.VBytesInUse;
+		d["vbytes_high_water"] = m.VBytesHighWater;
+		d["jobs_queued"] = m.JobsQueued;
+		d["queue_ns"] = m.QueueNanoseconds;
+		d["queue_high_water"] = m.QueueHighWater;
+		return d;
+	}
+
+	ScryptCalibration^ Scrypt::Calibrate(const int TargetMilliseconds, const Int64 MaxMemoryBytes, const int MaxThreads)
+	{
+		if (TargetMilliseconds < 1)
+			throw gcnew ArgumentOutOfRangeException("TargetMilliseconds", "TargetMilliseconds must be greater than 0.");
+		if (MaxMemoryBytes < 1)
+			throw gcnew ArgumentOutOfRangeException("MaxMemoryBytes", "MaxMemoryBytes must be greater than 0.");
+		if (MaxThreads < 0)
+			throw gcnew ArgumentOutOfRangeException("MaxThreads", "MaxThreads cannot be negative.");
+		try
+		{
+			return gcnew ScryptCalibration(ScryptNative::Scrypt::Calibrate(TargetMilliseconds, MaxMemoryBytes, MaxThreads));
+		}
+		catch (const std::out_of_range& ex)
+		{
+			throw gcnew ArgumentOutOfRangeException("*", gcnew String(ex.what()));
+		}
+		catch (const std::bad_alloc&)
+		{
+			throw gcnew OutOfMemoryException("Not enough memory to probe the requested MaxMemoryBytes.");
+		}
+	}
+
+	ScryptComputation::ScryptComputation(array<const Byte>^ Password, array<const Byte>^ Salt, const int Iterations, const short BlockSize, const short Parallelism, const int OutputByteLength)
+		: native(nullptr)
 	{
 		if (Salt == nullptr || Salt->Length == 0)
 			throw gcnew ArgumentOutOfRangeException("Salt", "Salt cannot be null or zero length.");
 		array<Byte>^ P = (array<Byte>^)Password;
 		if (P == nullptr) { P = gcnew array<Byte>(0); };
-		if (Iterations < 2 || (Iterations & 1L) == 1 || (Iterations & (Iterations - 1)) != 0L)
-			throw gcnew ArgumentOutOfRangeException("Iterations", "Iterations must be a power of 2, and greater than 1.");
-		if ((UInt64)BlockSize*(UInt64)Parallelism > 1 << 30 ||
-			BlockSize > 0x7fffffff / 128 / Parallelism ||
-			BlockSize > 0x7fffffff / 256 ||
-			Iterations > 0x7fffffff / 128 / BlockSize)
-			throw gcnew ArgumentOutOfRangeException("*", "Combined Parameter Values are too large.");
-		if (OutputByteLength == 0 || OutputByteLength % 32 != 0)
-			throw gcnew ArgumentOutOfRangeException("OutputByteLength", "OutputByteLength must be a multiple of 32, and greater than 0.");
-		int r128 = BlockSize * 128; // precompute for speed
-		
-		array<Byte>^ B = PBKDF2::HMACSHA256((array<const Byte>^)P, Salt, 1, Parallelism * r128);
-
-		// these are defined here rather than in the ROMix loop to prevent a lot of memory allocation and disposal operations
-		array<UInt32>^ seqMem = gcnew array<UInt32>(Iterations * r128 / 4); 
-		array<UInt32>^ X = gcnew array<UInt32>(r128 / 4);
-		array<UInt32>^ T = gcnew array<UInt32>(r128 / 4);
-		// should be 64 bytes, 16*4 for blockMix, defined here to prevent a lot of memory allocation and disposal operations
-		array<UInt32>^ scratch = gcnew array<UInt32>(16); 
-	
-		for (Int32 p = 0; p < Parallelism; p++)
-		{
-			//ROmix
-			
-			Buffer::BlockCopy(B, p * r128, X, 0, r128); // X = B[p]
-			//TODO:  This operation could be made as a worker process or thread so long as each thread is given the X
-			//       value and returns the updated X value to be written to the main array in it's representative slot. 
-			// The main array B is expanded to include a slot for each thread's output (implied per the spec).
-
-			for (int i = 0; i < Iterations; i += 2) // data independant iterations
+		Scrypt::ValidateParameters(Iterations, BlockSize, Parallelism, OutputByteLength, 1);
+		pin_ptr<const Byte> pP = nullptr;
+		if (P->Length > 0) pP = &P[0];
+		pin_ptr<const Byte> pS = &Salt[0];
+		native = new ScryptNative::ScryptComputation(pP, P->Length, pS, Salt->Length, Iterations, BlockSize, Parallelism, OutputByteLength);
+	}
+
+	ScryptComputation::~ScryptComputation()
+	{
+		this->!ScryptComputation();
+	}
+
+	ScryptComputation::!ScryptComputation()
+	{
+		delete native;
+		native = nullptr;
+	}
+
+	ScryptComputationStatus ScryptComputation::Step(const Int64 MaxSteps)
+	{
+		if (native == nullptr)
+			throw gcnew ObjectDisposedException("ScryptComputation");
+		if (MaxSteps < 0)
+			throw gcnew ArgumentOutOfRangeException("MaxSteps", "MaxSteps cannot be negative.");
+		try
+		{
+			return (ScryptComputationStatus)native->Step((uint64_t)MaxSteps);
+		}
+		catch (const std::bad_alloc&)
+		{
+			throw gcnew OutOfMemoryException("Not enough memory for the requested CPUCost and BlockSize.");
+		}
+	}
+
+	ScryptComputationStatus ScryptComputation::Step(const Int64 MaxSteps, Threading::CancellationToken Token)
+	{
+		if (Token.IsCancellationRequested)
+			Cancel();
+		return Step(MaxSteps);
+	}
+
+	void ScryptComputation::Cancel()
+	{
+		if (native == nullptr)
+			throw gcnew ObjectDisposedException("ScryptComputation");
+		native->Cancel();
+	}
+
+	ScryptComputationStatus ScryptComputation::Status::get()
+	{
+		if (native == nullptr)
+			throw gcnew ObjectDisposedException("ScryptComputation");
+		return (ScryptComputationStatus)native->CurrentStatus();
+	}
+
+	array<Byte>^ ScryptComputation::GetResult()
+	{
+		if (native == nullptr)
+			throw gcnew ObjectDisposedException("ScryptComputation");
+		if (native->CurrentStatus() != ScryptNative::ScryptComputation::Done)
+			throw gcnew InvalidOperationException("The computation has not finished.");
+		array<Byte>^ output = gcnew array<Byte>((int)native->OutputByteLength());
+		pin_ptr<Byte> pOut = &output[0];
+		native->Result(pOut, output->Length);
+		return output;
+	}
+
+	ScryptContext::ScryptContext(const int Iterations, const short BlockSize, const int MaxThreads, const bool HugePages, const bool LockMemory)
+		: native(nullptr)
+	{
+		Scrypt::ValidateParameters(Iterations, BlockSize, 1, 32, MaxThreads);
+		uint32_t flags = (HugePages ? ScryptNative::ScryptContext::HugePages : 0) | (LockMemory ? ScryptNative::ScryptContext::LockMemory : 0);
+		try
+		{
+			native = new ScryptNative::ScryptContext(Iterations, BlockSize, MaxThreads, flags);
+		}
+		catch (const std::bad_alloc&)
+		{
+			throw gcnew OutOfMemoryException("Not enough memory for the requested CPUCost, BlockSize and MaxThreads.");
+		}
+	}
+
+	ScryptContext::~ScryptContext()
+	{
+		this->!ScryptContext();
+	}
+
+	ScryptContext::!ScryptContext()
+	{
+		delete native;
+		native = nullptr;
+	}
+
+	array<Byte>^ ScryptContext::ComputeDerivedHash(array<const Byte>^ Password, array<const Byte>^ Salt, const short Parallelism, const int OutputByteLength)
+	{
+		if (native == nullptr)
+			throw gcnew ObjectDisposedException("ScryptContext");
+		if (Salt == nullptr || Salt->Length == 0)
+			throw gcnew ArgumentOutOfRangeException("Salt", "Salt cannot be null or zero length.");
+		array<Byte>^ P = (array<Byte>^)Password;
+		if (P == nullptr) { P = gcnew array<Byte>(0); };
+		Scrypt::ValidateParameters((int)native->CPUCost(), (short)native->BlockSize(), Parallelism, OutputByteLength, 0);
+		array<Byte>^ output = gcnew array<Byte>(OutputByteLength);
+		pin_ptr<const Byte> pP = nullptr;
+		if (P->Length > 0) pP = &P[0];
+		pin_ptr<const Byte> pS = &Salt[0];
+		pin_ptr<Byte> pOut = &output[0];
+		try
+		{
+			native->ComputeDerivedHash(pP, P->Length, pS, Salt->Length, Parallelism, pOut, OutputByteLength);
+		}
+		catch (const std::bad_alloc&)
+		{
+			throw gcnew OutOfMemoryException("Not enough memory for the requested Parallelism.");
+		}
+		return output;
+	}
+
+	ScryptScheduler::ScryptScheduler(const int MaxThreads, const Int64 MemoryBudget, const int MaxQueued)
+		: native(nullptr)
+	{
+		if (MaxThreads < 0)
+			throw gcnew ArgumentOutOfRangeException("MaxThreads", "MaxThreads cannot be negative.");
+		if (MemoryBudget < 1)
+			throw gcnew ArgumentOutOfRangeException("MemoryBudget", "MemoryBudget must be greater than 0.");
+		if (MaxQueued < 0)
+			throw gcnew ArgumentOutOfRangeException("MaxQueued", "MaxQueued cannot be negative.");
+		native = new ScryptNative::ScryptScheduler(MaxThreads, MemoryBudget, MaxQueued);
+	}
+
+	ScryptScheduler::~ScryptScheduler()
+	{
+		this->!ScryptScheduler();
+	}
+
+	ScryptScheduler::!ScryptScheduler()
+	{
+		delete native; // fails whatever is still queued
+		native = nullptr;
+	}
+
+	// Turns the error a scheduler job finished with into the managed exception the synchronous API would have thrown
+	static Exception^ JobException(std::exception_ptr error)
+	{
+		try { std::rethrow_exception(error); }
+		catch (const std::bad_alloc&) { return gcnew OutOfMemoryException("Not enough memory for the requested CPUCost, BlockSize and Parallelism."); }
+		catch (const std::out_of_range& ex) { return gcnew ArgumentOutOfRangeException("*", gcnew String(ex.what())); }
+		catch (const std::exception& ex) { return gcnew InvalidOperationException(gcnew String(ex.what())); }
+		catch (...) { return gcnew InvalidOperationException("Unknown native error."); }
+	}
+
+	// Completion callbacks, they run on a scheduler worker thread.  The tasks are created with RunContinuationsAsynchronously,
+	// so awaiting code continues on the thread pool instead of holding (or, by disposing the scheduler, joining) the worker.
+	static void EncodeDone(gcroot<Threading::Tasks::TaskCompletionSource<String^>^> done, gcroot<Scrypt::Header^> header,
+		const uint8_t* output, size_t length, std::exception_ptr error)
+	{
+		if (error) { done->SetException(JobException(error)); return; }
+		array<Byte>^ hash = gcnew array<Byte>((int)length);
+		Runtime::InteropServices::Marshal::Copy(IntPtr((void*)output), hash, 0, (int)length);
+		header->Hash = hash;
+		done->SetResult(header->ToString());
+	}
+
+	static void CompareDone(gcroot<Threading::Tasks::TaskCompletionSource<bool>^> done, gcroot<array<Byte>^> expected,
+		const uint8_t* output, size_t length, std::exception_ptr error)
+	{
+		if (error) { done->SetException(JobException(error)); return; }
+		array<Byte>^ hash = gcnew array<Byte>((int)length);
+		Runtime::InteropServices::Marshal::Copy(IntPtr((void*)output), hash, 0, (int)length);
+		done->SetResult(Scrypt::SafeEquals(hash, expected));
+		Array::Clear(hash, 0, hash->Length);
+	}
+
+	// Copies password and salt to native memory and hands the job to the scheduler; false when the queue is full
+	static bool SubmitJob(ScryptNative::ScryptScheduler* native, array<const Byte>^ Password, array<const Byte>^ Salt,
+		const int Iterations, const short BlockSize, const short Parallelism, const int OutputByteLength, const ScryptNative::ScryptScheduler::Completion& Done)
+	{
+		if (native == nullptr)
+			throw gcnew ObjectDisposedException("ScryptScheduler");
+		array<Byte>^ P = (array<Byte>^)Password;
+		if (P == nullptr) { P = gcnew array<Byte>(0); };
+		pin_ptr<const Byte> pP = nullptr;
+		if (P->Length > 0) pP = &P[0];
+		pin_ptr<const Byte> pS = &Salt[0];
+		try
+		{
+			return native->Submit(pP, P->Length, pS, Salt->Length, Iterations, BlockSize, Parallelism, OutputByteLength, Done);
+		}
+		catch (const std::length_error& ex)
+		{
+			throw gcnew ArgumentOutOfRangeException("*", gcnew String(ex.what()));
+		}
+		catch (const std::out_of_range& ex)
+		{
+			throw gcnew ArgumentOutOfRangeException("*", gcnew String(ex.what()));
+		}
+		catch (const std::invalid_argument& ex)
+		{
+			throw gcnew ArgumentException(gcnew String(ex.what()));
+		}
+	}
+
+	Threading::Tasks::Task<String^>^ ScryptScheduler::EncodeAsync(String^ Password, const int Iterations, const short BlockSize, const short Parallelism, const int OutputByteLength)
+	{
+		array<Byte>^ P = Encoding::UTF8->GetBytes(Password);
+		try
+		{
+			return EncodeAsync((array<const Byte>^)P, nullptr, Iterations, BlockSize, Parallelism, OutputByteLength);
+		}
+		finally
+		{
+			Array::Clear(P, 0, P->Length); // the queued job holds its own native copy
+		}
+	}
+
+	Threading::Tasks::Task<String^>^ ScryptScheduler::EncodeAsync(array<const Byte>^ Password, array<const Byte>^ Salt,
+		const int Iterations, const short BlockSize, const short Parallelism, const int OutputByteLength)
+	{
+		array<const Byte>^ salt = Salt;
+		if (salt == nullptr) // if they didn't provide one, we will
+		{
+			array<Byte>^ _salt = gcnew array<Byte>(32);
+			pin_ptr<Byte> pSalt = &_salt[0];
+			try
 			{
-				// the Sequential Memory array is defined here, after this loop it does not change and is isolated between parallel operations (thread safe)
-				//NOTE: blockMix overwrites the output in a different pattern than it reads the input.  
-				//The input and output arrays MUST be different, hence the X <-> T mixing
-				Buffer::BlockCopy(X, 0, seqMem, i * r128, r128); // Vi = X
-				blockMix((array<const UInt32>^)X, T, BlockSize, scratch);
-				Buffer::BlockCopy(T, 0, seqMem, (i + 1) * r128, r128); // Vi = X
-				blockMix((array<const UInt32>^)T, X, BlockSize, scratch);
+				ScryptNative::Scrypt::RandomSalt(pSalt, _salt->Length);
 			}
-
-			for (int i = 0; i < Iterations; i++) // data dependant iterations, blocks called out by the J value will get an extra mix
+			catch (const std::runtime_error& ex)
 			{
-				UInt64 J = 
-					integerify(X, BlockSize) & 
-					(Iterations - 1);
-				Buffer::BlockCopy(seqMem, (int)J * r128, T, 0, r128); // why is J UInt64 when it is only used as Int here?!  (this is from the original spec)
-				for (int x = 0; x < T->Length; x++) 
-				{ T[x] ^= X[x]; } // T = X xor V[j]
-				blockMix((array<const UInt32>^)T, X, BlockSize, scratch); // X = Salsa T
+				throw gcnew Security::Cryptography::CryptographicException(gcnew String(ex.what()));
 			}
-			// end of thread
-
-			Buffer::BlockCopy(X, 0, B, p * r128, r128); // B[p] = X
-		}
-		Array::Clear(seqMem, 0, seqMem->Length); // secure memory (or at least try)
-		Array::Clear(X, 0, X->Length);
-		Array::Clear(T, 0, T->Length);
-		array<Byte>^ output = PBKDF2::HMACSHA256((array<const Byte>^)P, (array<const Byte>^)B, 1, OutputByteLength);
-		Array::Clear(B, 0, B->Length);
-		B[0] ^= seqMem[0] ^ X[0] ^ output[0]; // should all be zero, but these calls keep the Clears from being optimized out (ideally) 
-		output[0] ^= T[0] + seqMem[0];
-		seqMem = nullptr;
-		X = nullptr;
-		T = nullptr;
-		scratch = nullptr;
-		B = nullptr;
-		return output;
+			salt = (array<const Byte>^)_salt;
+		}
+		else if (salt->Length == 0)
+			throw gcnew ArgumentOutOfRangeException("Salt", "Salt cannot be null or zero length.");
+		Scrypt::ValidateParameters(Iterations, BlockSize, Parallelism, OutputByteLength, 0);
+		Threading::Tasks::TaskCompletionSource<String^>^ tcs = gcnew Threading::Tasks::TaskCompletionSource<String^>(Threading::Tasks::TaskCreationOptions::RunContinuationsAsynchronously);
+		gcroot<Threading::Tasks::TaskCompletionSource<String^>^> done = tcs;
+		gcroot<Scrypt::Header^> header = gcnew Scrypt::Header(2, salt, Iterations, BlockSize, Parallelism, OutputByteLength);
+		if (!SubmitJob(native, Password, salt, Iterations, BlockSize, Parallelism, OutputByteLength,
+			[done, header](const uint8_t* output, size_t length, std::exception_ptr error) { EncodeDone(done, header, output, length, error); }))
+			tcs->SetException(gcnew InvalidOperationException("Scheduler queue is full."));
+		return tcs->Task;
+	}
+
+	Threading::Tasks::Task<bool>^ ScryptScheduler::CompareAsync(const String^ encodedHash, const String^ password)
+	{
+		String^ pass = password == nullptr ? "" : const_cast<String^>(password);
+		array<Byte>^ P = (gcnew Text::UTF8Encoding())->GetBytes(pass);
+		try
+		{
+			return CompareAsync(encodedHash, (array<const Byte>^)P);
+		}
+		finally
+		{
+			Array::Clear(P, 0, P->Length); // the queued job holds its own native copy
+		}
+	}
+
+	Threading::Tasks::Task<bool>^ ScryptScheduler::CompareAsync(const String^ encodedHash, array<const Byte>^ password)
+	{
+		if (String::IsNullOrWhiteSpace(const_cast<String^>(encodedHash)))
+			throw gcnew ArgumentNullException("encodedHash");
+		if (password == nullptr || password->Length == 0)
+			throw gcnew ArgumentNullException("password");
+		Scrypt::Header^ h = Scrypt::Header::FromString(encodedHash); // exceptions will be raised from here as necessary
+		Scrypt::ValidateParameters(h->cc, h->b, h->p, h->olen, 0); // a well formed hash can still carry parameters scrypt rejects
+		Threading::Tasks::TaskCompletionSource<bool>^ tcs = gcnew Threading::Tasks::TaskCompletionSource<bool>(Threading::Tasks::TaskCreationOptions::RunContinuationsAsynchronously);
+		gcroot<Threading::Tasks::TaskCompletionSource<bool>^> done = tcs;
+		gcroot<array<Byte>^> expected = h->Hash;
+		if (!SubmitJob(native, password, (array<const Byte>^)h->s, h->cc, h->b, h->p, h->olen,
+			[done, expected](const uint8_t* output, size_t length, std::exception_ptr error) { CompareDone(done, expected, output, length, error); }))
+			tcs->SetException(gcnew InvalidOperationException("Scheduler queue is full."));
+		return tcs->Task;
 	}
 }
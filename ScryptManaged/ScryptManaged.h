@@ -22,6 +22,8 @@
 * limitations under the License.
 */
 
+#include "../ScryptNative/ScryptNative.h"
+
 using namespace System;
 
 namespace ScryptManaged {
@@ -29,8 +31,6 @@ namespace ScryptManaged {
 	public ref class PBKDF2
 	{
 	internal:
-		// The interal F method used by PBKFD2
-		static array<Byte>^ _F(System::Security::Cryptography::HMAC^ hmac, array<const Byte>^ P, array<Byte>^ S, UInt32 TT, UInt32 I);
 		// Checks if two strings are equal. Compares every char to prevent timing attacks. Returns True if both strings are equal
 		static __inline bool SafeEquals(String^ a, String^ b)
 		{
@@ -45,6 +45,7 @@ namespace ScryptManaged {
 		}
 
 	public:
+		// All of the PBKDF2 work is done by ScryptNative::PBKDF2 (see ../ScryptNative), these only validate and pin
 		// RFC 2898 Password Based Key Derivation Function # 2, using SHA1 in an HMAC configuration.  
 		// This is functionally equivalent to MS .NET System::Security::Cryptography::Rfc2898DeriveBytes
 		static array<Byte>^ HMACSHA1(array<const Byte>^ Password, array<const Byte>^ Salt, int Iterations, int OutputByteCount);
@@ -52,12 +53,67 @@ namespace ScryptManaged {
 		static array<Byte>^ HMACSHA256(array<const Byte>^ Password, array<const Byte>^ Salt, int Iterations, int OutputByteCount);
 		// RFC 2898 Password Based Key Derivation Function # 2, using SHA512 in an HMAC configuration.
 		static array<Byte>^ HMACSHA512(array<const Byte>^ Password, array<const Byte>^ Salt, int Iterations, int OutputByteCount);
+		// Same as above, computing the independent output blocks on up to MaxThreads threads (0 = one per hardware thread, 1 = serial).
+		// Threads only start when the output is long enough or Iterations high enough to pay for them; HMACSHA256 also uses multi-buffer SHA-256.
+		static array<Byte>^ HMACSHA1(array<const Byte>^ Password, array<const Byte>^ Salt, int Iterations, int OutputByteCount, int MaxThreads);
+		static array<Byte>^ HMACSHA256(array<const Byte>^ Password, array<const Byte>^ Salt, int Iterations, int OutputByteCount, int MaxThreads);
+		static array<Byte>^ HMACSHA512(array<const Byte>^ Password, array<const Byte>^ Salt, int Iterations, int OutputByteCount, int MaxThreads);
+	};
+
+	// PBKDF2 output produced on demand straight into caller buffers (see ScryptNative::PBKDF2Stream): the password and salt are
+	// absorbed once, and long key material is derived piece by piece without a dkLen sized array. Dispose to wipe the key state.
+	public ref class PBKDF2Stream
+	{
+		ScryptNative::PBKDF2Stream* native;
+	public:
+		// Hash=1, 256 or 512 for HMAC-SHA1/SHA256/SHA512
+		PBKDF2Stream(const int Hash, array<const Byte>^ Password, array<const Byte>^ Salt, const int Iterations);
+		~PBKDF2Stream();
+		!PBKDF2Stream();
+		// Fills Buffer[Offset .. Offset+Count) with the next Count bytes of the derived key
+		void Read(array<Byte>^ Buffer, const int Offset, const int Count);
+		// Same, starting at byte Position of the derived key, blocks spread over up to MaxThreads threads (0 = all)
+		void ReadAt(const Int64 Position, array<Byte>^ Buffer, const int Offset, const int Count, const int MaxThreads);
+		property Int64 Position { Int64 get() { return native == nullptr ? 0 : (Int64)native->Position(); } }
+	};
+
+	// Opt-in hot path counters of the native core (see ScryptNative::Metrics), off by default and free while off.
+	// Snapshot returns every counter by name (e.g. "romix_fill_ns", "vbytes_high_water") for a metrics pipeline to scrape.
+	public ref class ScryptMetrics abstract sealed
+	{
+	public:
+		static property bool Enabled { bool get() { return ScryptNative::Metrics::Enabled(); } void set(bool value) { ScryptNative::Metrics::Enable(value); } }
+		// Salsa20/8 kernel compiled into this build
+		static property String^ Kernel { String^ get() { return gcnew String(ScryptNative::Metrics::Kernel()); } }
+		static Collections::Generic::Dictionary<String^, Int64>^ Snapshot();
+		static void Reset() { ScryptNative::Metrics::Reset(); }
+	};
+
+	// Parameters picked by Scrypt::Calibrate for this host, and what one hash costs with them
+	public ref class ScryptCalibration
+	{
+	internal:
+		ScryptCalibration(const ScryptNative::Scrypt::Calibration& c)
+			: cc((int)c.CPUCost), b((short)c.BlockSize), p((short)c.Parallelism), threads((int)c.MaxThreads), memory((Int64)c.MemoryBytes),
+			ms(c.Milliseconds), hps(c.HashesPerSecond), nodeHps(c.NodeHashesPerSecond) {}
+	private:
+		int cc; short b; short p; int threads; Int64 memory; double ms; double hps; double nodeHps;
+	public:
+		property int CPUCost { int get() { return cc; } }
+		property short BlockSize { short get() { return b; } }
+		property short Parallelism { short get() { return p; } }
+		// pass as MaxThreads to ComputeDerivedHash / ScryptContext
+		property int MaxThreads { int get() { return threads; } }
+		property Int64 MemoryBytes { Int64 get() { return memory; } }
+		property double Milliseconds { double get() { return ms; } }
+		property double HashesPerSecond { double get() { return hps; } }
+		// estimate with every hardware thread hashing, for capacity planning
+		property double NodeHashesPerSecond { double get() { return nodeHps; } }
 	};
 
 	public ref class Scrypt
 	{
 	internal:
-#define R32(a,b) (((UInt32)(a) << (b)) | ((a) >> (32 - (b))))
 		ref struct Header
 		{
 		internal:
@@ -75,123 +131,30 @@ namespace ScryptManaged {
 			Header(const int version, array<const Byte>^ salt, const int CPUCost, const short BlockSize, const short Parallelism, array<Byte>^ Hash)
 				: v(version), s((array<Byte>^)salt->Clone()), cc(CPUCost), b(BlockSize), p(Parallelism), olen(Hash->Length), Hash(Hash) {}
 
-			String^ ToString() override
-			{
-				Text::StringBuilder^ sb = gcnew Text::StringBuilder("$s");
-				if (v >= 2)
-				{
-					// $s$cc$b$p$<salt>$<result>
-					sb->Append("2$");
-					sb->Append(cc.ToString())->Append("$");
-					sb->Append(b.ToString())->Append("$");
-					sb->Append(p.ToString())->Append("$");
-					sb->Append(Convert::ToBase64String((array<Byte>^)s))->Append("$");
-					sb->Append(Convert::ToBase64String((array<Byte>^)Hash));
-				}
-				else // DEPRECATED!!!!
-				{
-					// $s<1 or 0>$0x0b0p$<salt>$<result>
-					if (cc > 256 || b > 256 || p > 256) throw gcnew System::ArithmeticException("Parameter Overflow on Deprecated ToString() method call");
-					if (v == 1) sb->Append("1$"); else sb->Append("0$");
-					String^ config = Convert::ToString((Byte)cc << 16 | (Byte)b << 8 | (Byte)p, 16);
-					sb->Append(config)->Append("$");
-					sb->Append(Convert::ToBase64String((array<Byte>^)s))->Append("$");
-					sb->Append(Convert::ToBase64String((array<Byte>^)Hash));
-				}
-				return sb->ToString();
-			}
-
-			static Header^ FromString(const String^ value)
-			{
-				if (String::IsNullOrWhiteSpace(const_cast<String^>(value)))
-					return nullptr;
-				array<String^>^ splitit = gcnew array<String^>(1); splitit[0] = "$";
-				array<String^>^ pieces = const_cast<String^>(value)->Split(splitit, StringSplitOptions::RemoveEmptyEntries);
-				Header^ result = gcnew Header();
-				result->v = int::Parse(pieces[0]->Replace("s",""));
-				if (result->v == 2)
-				{   //  0     1  2 3 4      5
-					// $s<2+>$cc$b$p$<salt>$<result>
-					result->cc = Convert::ToInt32(pieces[1]);
-					result->b = Convert::ToUInt16(pieces[2]);
-					result->p = Convert::ToUInt16(pieces[3]);
-					result->s = Convert::FromBase64String(pieces[4]);
-					result->Hash = Convert::FromBase64String(pieces[5]);
-					result->olen = result->Hash->Length;
-				}
-				else
-				{
-					//  0         1 hex    2      3
-					// $s<1 or 0>$000c0b0p$<salt>$<result>
-					UInt64 config = Convert::ToUInt64(pieces[1], 16);
-					result->cc = (config >> 16) & 0xffff;
-					result->b = (config >> 8) & 0xff;
-					result->p = (config & 0xff);
-					result->s = Convert::FromBase64String(pieces[2]);
-					result->Hash = Convert::FromBase64String(pieces[3]);
-					result->olen = result->Hash->Length;
-				}
-				return result;
-			}		
+			// $s2$cc$b$p$<salt>$<result>, or the deprecated $s<1 or 0>$<hex 0c0b0p>$<salt>$<result> for versions below 2
+			String^ ToString() override;
+			// Either form, parsed by ScryptNative::HashCodec (FormatException if malformed)
+			static Header^ FromString(const String^ value);
 		};
 
-		static __inline void salsa20_8(array<UInt32>^ data)
-		{
-			// from Dan Bernstein, adapted direct from the RFC document
-			UInt32 x0 = data[0], x1 = data[1], x2 = data[2], x3 = data[3], x4 = data[4], x5 = data[5], x6 = data[6], x7 = data[7],
-				x8 = data[8], x9 = data[9], xA = data[10], xB = data[11], xC = data[12], xD = data[13], xE = data[14], xF = data[15];
-			for (Byte i = 8; 0 < i && i < 16; i -= 2) { // the in-between nomenclature is for underflow protection
-				x4 ^= R32(x0 + xC, 7); x8 ^= R32(x4 + x0, 9);
-				xC ^= R32(x8 + x4, 13); x0 ^= R32(xC + x8, 18);
-				x9 ^= R32(x5 + x1, 7); xD ^= R32(x9 + x5, 9);
-				x1 ^= R32(xD + x9, 13); x5 ^= R32(x1 + xD, 18);
-				xE ^= R32(xA + x6, 7); x2 ^= R32(xE + xA, 9);
-				x6 ^= R32(x2 + xE, 13); xA ^= R32(x6 + x2, 18);
-				x3 ^= R32(xF + xB, 7); x7 ^= R32(x3 + xF, 9);
-				xB ^= R32(x7 + x3, 13); xF ^= R32(xB + x7, 18);
-				x1 ^= R32(x0 + x3, 7); x2 ^= R32(x1 + x0, 9);
-				x3 ^= R32(x2 + x1, 13); x0 ^= R32(x3 + x2, 18);
-				x6 ^= R32(x5 + x4, 7); x7 ^= R32(x6 + x5, 9);
-				x4 ^= R32(x7 + x6, 13); x5 ^= R32(x4 + x7, 18);
-				xB ^= R32(xA + x9, 7); x8 ^= R32(xB + xA, 9);
-				x9 ^= R32(x8 + xB, 13); xA ^= R32(x9 + x8, 18);
-				xC ^= R32(xF + xE, 7); xD ^= R32(xC + xF, 9);
-				xE ^= R32(xD + xC, 13); xF ^= R32(xE + xD, 18);
-			}
-			data[0] += x0; data[1] += x1; data[2] += x2; data[3] += x3; data[4] += x4; data[5] += x5; data[6] += x6; data[7] += x7;
-			data[8] += x8; data[9] += x9; data[10] += xA; data[11] += xB; data[12] += xC; data[13] += xD; data[14] += xE; data[15] += xF;
-		}
+		// Longest encoded hash Compare decodes on the stack
+		literal int MaxEncodedLength = 1024;
 
-		static __inline void blockMix(array<const UInt32>^ data, array<UInt32>^ dataOut, int blocksize, array<UInt32>^ scratch)
-		{
-			Buffer::BlockCopy(data, (2 * blocksize - 1) * 64, scratch, 0, 64); // 1. X = B
-			array<UInt32>^ buffer = gcnew array<UInt32>(16);
-			for (Int32 i = 0; i < (2 * blocksize); i += 2)
-			{
-				// NOTE that the output is written as:
-				// B'={Y[0],Y[2],...Y[2*r-2],Y[1],Y[3]...Y[2*r-1]}
-				// The first Salsa operation is written starting from the "front" of B',
-				//   while the second Salsa operation is written starting from the "middle". 
-				// This is per the spec, and the reason for separate input and output arrays.
-				// This is also why the specification REQUIRES 'N' to be an even number!
-				Buffer::BlockCopy(data, i * 64, buffer, 0, 64);
-				for (int x = 0; x < buffer->Length; x++) { scratch[x] ^= buffer[x]; } // 2.  T= X xor B[i]
-				salsa20_8(scratch); // X = Salsa T
-				Buffer::BlockCopy(scratch, 0, dataOut, i * 32, 64); // Y[i] = X for all even I
-
-				Buffer::BlockCopy(data, i * 64 + 64, buffer, 0, 64);
-				for (int x = 0; x < buffer->Length; x++) { scratch[x] ^= buffer[x]; } // 2.  T= X xor B[i]
-				salsa20_8(scratch); // X = Salsa T
-				Buffer::BlockCopy(scratch, 0, dataOut, (i * 32) + (blocksize * 64), 64); // Y[i] = X for all odd I
-			}
-			buffer = nullptr;
-		}
+		// Narrows the encoded hash into Text and decodes it into Storage (both MaxEncodedLength long), FormatException if malformed
+		static void DecodeEncoded(String^ value, char* Text, uint8_t* Storage, ScryptNative::HashFields& Fields);
+		// Decodes Length ASCII chars of Text into Storage (MaxEncodedLength long), FormatException if malformed
+		static void DecodeText(const char* Text, const int Length, uint8_t* Storage, ScryptNative::HashFields& Fields);
+		// Hashes Password with the decoded parameters and salt and compares against the decoded hash, nothing on the GC heap
+		static bool CompareDecoded(const ScryptNative::HashFields& Fields, const uint8_t* Password, const int PasswordLength);
+		// Hashes Password with Salt (a fresh 32 byte one when null) and writes the $s2 form into Encoded, returns its length
+		static int EncodeInto(const uint8_t* Password, const int PasswordLength, const uint8_t* Salt, const int SaltLength,
+			const int CPUCost, const short BlockSize, const short Parallelism, const int OutputByteLength, char* Encoded, const int EncodedCapacity);
+		// EncodeInto on a stack buffer, the returned String is the only managed allocation
+		static String^ EncodeString(const uint8_t* Password, const int PasswordLength, array<const Byte>^ Salt,
+			const int CPUCost, const short BlockSize, const short Parallelism, const int OutputByteLength);
 
-		static __inline UInt64 integerify(array<UInt32>^ data, int blocksize)
-		{
-			UInt32 j = ((2 * blocksize) - 1) * 16;
-			return ((UInt64)(data[j + 1]) << 32) | data[j];
-		}
+		// Throws the managed exceptions for out of range scrypt parameters (the salt itself is checked by the callers)
+		static void ValidateParameters(const int CPUCost, const short BlockSize, const short Parallelism, const int OutputByteLength, const int MaxThreads);
 
 		// Checks if two arrays are equal. Compares every byte to prevent timing attacks. Returns True if both arrays are equal
 		static __inline bool SafeEquals(array<Byte>^ a, array<Byte>^ b)
@@ -205,14 +168,25 @@ namespace ScryptManaged {
 		}
 
 	public:
-		// RFC 7914 The scrypt Password-Based Key Derivation Function
+		// RFC 7914 The scrypt Password-Based Key Derivation Function, computed by ScryptNative::Scrypt on the pinned arrays
 		// Password=Byte Array of password('P'), Salt=Byte Array of salt ('S', cannot be null or empty), CPUCost=Iterations('N'), 
-		// BlockSize=Blocks used Internally('r', memory cost), Parallelism=Number of threads used ('p', also a memory cost [not currently implemented as actual threads!])
+		// BlockSize=Blocks used Internally('r', memory cost), Parallelism=Number of lanes ('p', also a memory cost, run serially unless MaxThreads is given)
 		static array<Byte>^ ComputeDerivedHash(array<const Byte>^ password, array<const Byte>^ salt, const int CPUCost, const short BlockSize, const short Parallelism);
 		static array<Byte>^ ComputeDerivedHash(array<const Byte>^ password, array<const Byte>^ salt, const int CPUCost, const short BlockSize, const short Parallelism, const int OutputByteLength);
+		// MaxThreads=Cap on the threads used for the 'p' lanes (1 is serial, 0 is one per hardware thread). Each thread needs its own CPUCost*BlockSize*128 bytes.
+		// Output is bit-identical to the serial overloads.
+		static array<Byte>^ ComputeDerivedHash(array<const Byte>^ password, array<const Byte>^ salt, const int CPUCost, const short BlockSize, const short Parallelism, const int OutputByteLength, const int MaxThreads);
+		// Writes the derived hash into Output[OutputOffset .. OutputOffset+OutputByteLength) instead of a new array
+		static void ComputeDerivedHash(array<const Byte>^ password, array<const Byte>^ salt, const int CPUCost, const short BlockSize, const short Parallelism, array<Byte>^ Output, const int OutputOffset, const int OutputByteLength, const int MaxThreads);
+		// Batch form for many hashes sharing CPUCost, BlockSize, Parallelism and OutputByteLength (Passwords[i] and Salts[i] make hash i).
+		// Independent hashes run in lockstep, one per vector lane (see ScryptNative::Scrypt::BatchLanes), which gives far more hashes per
+		// second per core than calling ComputeDerivedHash in a loop. Results are identical to the single hash overloads.
+		static array<array<Byte>^>^ ComputeDerivedHashBatch(array<array<const Byte>^>^ Passwords, array<array<const Byte>^>^ Salts, const int CPUCost, const short BlockSize, const short Parallelism, const int OutputByteLength, const int MaxThreads);
+		// Batch verification, element i is TRUE when Passwords[i] with Salts[i] reproduces ExpectedHashes[i] (all hashes must be the same length)
+		static array<bool>^ CompareBatch(array<array<const Byte>^>^ Passwords, array<array<const Byte>^>^ Salts, array<array<const Byte>^>^ ExpectedHashes, const int CPUCost, const short BlockSize, const short Parallelism, const int MaxThreads);
 		// RFC 7914 The scrypt Password-Based Key Derivation Function
 		// Password=Byte Array of password('P'), Salt=Byte Array of salt ('S', cannot be null or empty), CPUCost=Iterations('N'), 
-		// BlockSize=Blocks used Internally('r', memory cost), Parallelism=Number of threads used ('p', also a memory cost [not currently implemented as actual threads!])
+		// BlockSize=Blocks used Internally('r', memory cost), Parallelism=Number of lanes ('p', also a memory cost)
 		// Outputs encoded string with result and all variables included
 		static String^ Encode(String^ password, array<const Byte>^ salt, const int CPUCost, const short BlockSize, const short Parallelism, const int OutputByteLength);
 		static String^ Encode(array<const Byte>^ password, array<const Byte>^ salt, const int CPUCost, const short BlockSize, const short Parallelism, const int OutputByteLength);
@@ -224,9 +198,85 @@ namespace ScryptManaged {
 		static String^ Encode(array<const Byte>^ password, const int CPUCost, const short BlockSize, const short Parallelism);
 		// RFC 7914 The scrypt Password-Based Key Derivation Function
 		// Password=Byte Array of password('P'), Salt=Byte Array of salt ('S', cannot be null or empty), CPUCost=Iterations('N'), 
-		// BlockSize=Blocks used Internally('r', memory cost), Parallelism=Number of threads used ('p', also a memory cost [not currently implemented as actual threads!])
+		// BlockSize=Blocks used Internally('r', memory cost), Parallelism=Number of lanes ('p', also a memory cost)
 		// Decodes hashed and encoded string and compares against supplied password (FALSE if no match)
 		static bool Compare(const String^ hash, const String^ password);
 		static bool Compare(const String^ hash, array<const Byte>^ password);
+		// Allocation free forms for hot paths.  C++/CLI cannot declare Span<T> parameters (byref-like types), so these take
+		// pointers and lengths: from C# pass fixed (byte* p = span), a fixed array or a stackalloc buffer.  The bytes go straight
+		// to ScryptNative::Scrypt without managed copies, UTF-16 passwords are encoded to UTF-8 on the stack and wiped after.
+		static void ComputeDerivedHash(const Byte* password, const int passwordLength, const Byte* salt, const int saltLength, const int CPUCost, const short BlockSize, const short Parallelism, Byte* Output, const int OutputByteLength, const int MaxThreads);
+		// Chars the pointer Encode overloads write for these parameters (a 32 byte salt is generated)
+		static int EncodedLength(const int CPUCost, const short BlockSize, const short Parallelism, const int OutputByteLength);
+		// Writes the ASCII encoded hash with a fresh 32 byte salt into Encoded and returns its length (ArgumentException if EncodedCapacity is too small)
+		static int Encode(const Byte* password, const int passwordLength, const int CPUCost, const short BlockSize, const short Parallelism, const int OutputByteLength, Byte* Encoded, const int EncodedCapacity);
+		static int Encode(const Char* password, const int passwordLength, const int CPUCost, const short BlockSize, const short Parallelism, const int OutputByteLength, Byte* Encoded, const int EncodedCapacity);
+		// encodedHash=encodedLength ASCII bytes of the encoded form
+		static bool Compare(const Byte* encodedHash, const int encodedLength, const Byte* password, const int passwordLength);
+		static bool Compare(const Byte* encodedHash, const int encodedLength, const Char* password, const int passwordLength);
+		static bool Compare(const String^ hash, const Char* password, const int passwordLength);
+		// Times short ROMix runs on this host and returns the strongest CPUCost/BlockSize/Parallelism that hash within TargetMilliseconds
+		// using at most MaxMemoryBytes (see ScryptNative::Scrypt::Calibrate). Takes a few times TargetMilliseconds, call it once at start up.
+		static ScryptCalibration^ Calibrate(const int TargetMilliseconds, const Int64 MaxMemoryBytes, const int MaxThreads);
+	};
+
+	// Keeps the scrypt scratch memory for one CPUCost/BlockSize pair alive between calls (see ScryptNative::ScryptContext):
+	// V, X, Y and B are allocated once outside the GC heap, optionally on huge pages and locked in RAM, and wiped after every call.
+	// Not thread safe, give each thread its own context and Dispose it (or let the finalizer free it) when done.
+	public ref class ScryptContext
+	{
+		ScryptNative::ScryptContext* native;
+	public:
+		// MaxThreads=Threads (and scratch sets) for the 'p' lanes, 0 is one per hardware thread. Each needs CPUCost*BlockSize*128 bytes.
+		ScryptContext(const int CPUCost, const short BlockSize, const int MaxThreads, const bool HugePages, const bool LockMemory);
+		~ScryptContext();
+		!ScryptContext();
+		// Same result as Scrypt::ComputeDerivedHash with this context's CPUCost and BlockSize
+		array<Byte>^ ComputeDerivedHash(array<const Byte>^ password, array<const Byte>^ salt, const short Parallelism, const int OutputByteLength);
+		property bool UsesHugePages { bool get() { return native != nullptr && native->UsesHugePages(); } }
+		property bool IsLocked { bool get() { return native != nullptr && native->IsLocked(); } }
+	};
+
+	public enum class ScryptComputationStatus { Running, Done, Cancelled };
+
+	// One scrypt hash computed in slices of at most MaxSteps ROMix iterations (see ScryptNative::ScryptComputation), for event
+	// loops that interleave many hashes and drop the ones whose request went away.  V lives outside the GC heap from the first
+	// Step until the hash is done or cancelled.  Cancel may be called from any thread; Dispose it (or let the finalizer free it).
+	public ref class ScryptComputation
+	{
+		ScryptNative::ScryptComputation* native;
+	public:
+		ScryptComputation(array<const Byte>^ Password, array<const Byte>^ Salt, const int CPUCost, const short BlockSize, const short Parallelism, const int OutputByteLength);
+		~ScryptComputation();
+		!ScryptComputation();
+		ScryptComputationStatus Step(const Int64 MaxSteps);
+		// Cancels first when Token is cancelled, so the slice is dropped instead of run
+		ScryptComputationStatus Step(const Int64 MaxSteps, Threading::CancellationToken Token);
+		void Cancel();
+		// Derived hash once Status is Done, InvalidOperationException otherwise
+		array<Byte>^ GetResult();
+		property ScryptComputationStatus Status { ScryptComputationStatus get(); }
+		property Int64 StepsDone { Int64 get() { return native == nullptr ? 0 : (Int64)native->StepsDone(); } }
+		property Int64 Steps { Int64 get() { return native == nullptr ? 0 : (Int64)native->Steps(); } }
+	};
+
+	// Asynchronous Encode/Compare on a bounded pool with admission control (see ScryptNative::ScryptScheduler).
+	// A job only starts once its real footprint (CPUCost*BlockSize*128 + Parallelism*BlockSize*128 bytes, from the parameters or
+	// the encoded header) fits in what the running jobs leave of MemoryBudget; bursts wait in a queue of at most MaxQueued jobs.
+	// When the queue is full the returned Task fails with InvalidOperationException right away (backpressure, nothing is queued).
+	public ref class ScryptScheduler
+	{
+		ScryptNative::ScryptScheduler* native;
+	public:
+		// MaxThreads=workers (0 = one per hardware thread), MemoryBudget=bytes all running jobs may hold together
+		ScryptScheduler(const int MaxThreads, const Int64 MemoryBudget, const int MaxQueued);
+		~ScryptScheduler();
+		!ScryptScheduler();
+		Threading::Tasks::Task<String^>^ EncodeAsync(String^ password, const int CPUCost, const short BlockSize, const short Parallelism, const int OutputByteLength);
+		Threading::Tasks::Task<String^>^ EncodeAsync(array<const Byte>^ password, array<const Byte>^ salt, const int CPUCost, const short BlockSize, const short Parallelism, const int OutputByteLength);
+		Threading::Tasks::Task<bool>^ CompareAsync(const String^ hash, const String^ password);
+		Threading::Tasks::Task<bool>^ CompareAsync(const String^ hash, array<const Byte>^ password);
+		property Int64 MemoryInUse { Int64 get() { return native == nullptr ? 0 : (Int64)native->MemoryInUse(); } }
+		property int Queued { int get() { return native == nullptr ? 0 : (int)native->Queued(); } }
 	};
 }
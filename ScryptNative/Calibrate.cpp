@@ -0,0 +1,131 @@
+/* Copyright (c) 2017, Dustin J Sparks
+*
+* PUBLIC DOMAIN MARK
+*
+* While this work is free from any patent or intellectual property claims, the algorithm, pseudo-code, and test vectors were derived from
+* RFC 7914 "The scrypt Password-Based Key Derivation Function" (C. Percival, August 2016, ISSN: 2070-1721)
+*
+* From the RFC:
+* Copyright (c) 2016 IETF Trust and the persons identified as the
+* document authors. All rights reserved.
+* This document is subject to BCP 78 and the IETF Trusts Legal Provisions Relating to IETF Documents (http://trustee.ietf.org/license-info)
+* in effect on the date of publication of this document. Please review these documents carefully, as they describe your rights and restrictions
+* with respect to this document. Code Components extracted from this document must include Simplified BSD License text as described in Section 4.e of
+* the Trust Legal Provisions and are provided without warranty as described in the Simplified BSD License.
+*
+* Unless required by applicable law or agreed to in writing, software
+* distributed under the License is distributed on an "AS IS" BASIS,
+* WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+* See the License for the specific language governing permissions and
+* limitations under the License.
+*/
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <limits>
+#include <stdexcept>
+#include <thread>
+#include <vector>
+#include "ROMix.h"
+
+namespace ScryptNative
+{
+	// Bytes one hash holds: a V/X/Y set per thread and B for all lanes
+	static uint64_t HashMemory(uint64_t N, uint32_t BlockSize, uint32_t Threads, uint32_t Parallelism)
+	{
+		uint64_t r128 = (uint64_t)BlockSize * 128;
+		return Threads * (N + 2) * r128 + Parallelism * r128;
+	}
+
+	static double Since(std::chrono::steady_clock::time_point start)
+	{
+		return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+	}
+
+	// Best of two runs of one ROMix lane (the first one also pays for faulting the scratch in)
+	static double TimeLane(size_t N, uint32_t BlockSize)
+	{
+		size_t r32 = (size_t)BlockSize * 32;
+		BlockBuffer scratch((N + 2) * r32);
+		std::vector<uint8_t> B(r32 * 4, 0x5c);
+		double best = std::numeric_limits<double>::max();
+		for (int run = 0; run < 2; run++)
+		{
+			auto start = std::chrono::steady_clock::now();
+			ROMix(B.data(), BlockSize, N, scratch.data, scratch.data + N * r32);
+			best = std::min(best, Since(start));
+		}
+		return best;
+	}
+
+	// Best of two real calls with the chosen parameters
+	static double TimeHash(uint64_t N, uint32_t BlockSize, uint32_t Parallelism, uint32_t Threads)
+	{
+		const uint8_t password[8] = { 'p', 'a', 's', 's', 'w', 'o', 'r', 'd' }, salt[16] = { 0 };
+		uint8_t output[32];
+		double best = std::numeric_limits<double>::max();
+		for (int run = 0; run < 2; run++)
+		{
+			auto start = std::chrono::steady_clock::now();
+			Scrypt::ComputeDerivedHash(password, sizeof(password), salt, sizeof(salt), N, BlockSize, Parallelism, output, sizeof(output), Threads);
+			best = std::min(best, Since(start));
+		}
+		SecureZero(output, sizeof(output));
+		return best;
+	}
+
+	Scrypt::Calibration Scrypt::Calibrate(double TargetMilliseconds, uint64_t MaxMemoryBytes, uint32_t MaxThreads)
+	{
+		if (!(TargetMilliseconds > 0))
+			throw std::out_of_range("TargetMilliseconds must be greater than 0.");
+		const uint32_t r = 8;
+		const uint32_t maxParallelism = 0x7fff; // the managed API takes a short
+		uint64_t N = 0;
+		double laneMs = 0;
+		// double N while one lane fits the target and one thread's V fits the memory
+		for (uint64_t n = 16; n <= 0x7fffffff / 128 / r && HashMemory(n, r, 1, 1) <= MaxMemoryBytes; n *= 2)
+		{
+			double ms = TimeLane((size_t)n, r);
+			if (ms > TargetMilliseconds)
+				break;
+			N = n;
+			laneMs = ms;
+		}
+		if (N == 0)
+			throw std::out_of_range("No parameters meet TargetMilliseconds within MaxMemoryBytes.");
+
+		// lanes use the rest of the target, every thread needs its own V
+		uint32_t threads = ResolveThreads(MaxThreads, maxParallelism);
+		while (threads > 1 && HashMemory(N, r, threads, threads) > MaxMemoryBytes)
+			threads--;
+		uint64_t rounds = std::max((uint64_t)1, (uint64_t)(TargetMilliseconds / std::max(laneMs, 0.001)));
+		uint32_t p = (uint32_t)std::min((uint64_t)maxParallelism, rounds * threads);
+		while (p > 1 && HashMemory(N, r, std::min(threads, p), p) > MaxMemoryBytes)
+			p--;
+
+		// the probes ignore PBKDF2, thread start up and memory bandwidth shared between threads, so measure and scale back
+		double ms = TimeHash(N, r, p, threads);
+		while (ms > TargetMilliseconds && (p > 1 || N > 16))
+		{
+			if (p > 1)
+				p = std::max(1u, std::min(p - 1, (uint32_t)(p * TargetMilliseconds / ms)));
+			else
+				N /= 2;
+			ms = TimeHash(N, r, p, threads);
+		}
+		if (ms > TargetMilliseconds)
+			throw std::out_of_range("No parameters meet TargetMilliseconds within MaxMemoryBytes.");
+
+		Calibration result;
+		result.CPUCost = N;
+		result.BlockSize = r;
+		result.Parallelism = p;
+		result.MaxThreads = std::min(threads, p);
+		result.MemoryBytes = HashMemory(N, r, result.MaxThreads, p);
+		result.Milliseconds = ms;
+		result.HashesPerSecond = 1000.0 / std::max(ms, 0.001);
+		result.NodeHashesPerSecond = result.HashesPerSecond * std::max(1u, std::thread::hardware_concurrency()) / result.MaxThreads;
+		return result;
+	}
+}
@@ -0,0 +1,70 @@
+#pragma once
+
+/* Copyright (c) 2017, Dustin J Sparks
+*
+* PUBLIC DOMAIN MARK
+*
+* While this work is free from any patent or intellectual property claims, the algorithm, pseudo-code, and test vectors were derived from
+* RFC 7914 "The scrypt Password-Based Key Derivation Function" (C. Percival, August 2016, ISSN: 2070-1721)
+*
+* From the RFC:
+* Copyright (c) 2016 IETF Trust and the persons identified as the
+* document authors. All rights reserved.
+* This document is subject to BCP 78 and the IETF Trusts Legal Provisions Relating to IETF Documents (http://trustee.ietf.org/license-info)
+* in effect on the date of publication of this document. Please review these documents carefully, as they describe your rights and restrictions
+* with respect to this document. Code Components extracted from this document must include Simplified BSD License text as described in Section 4.e of
+* the Trust Legal Provisions and are provided without warranty as described in the Simplified BSD License.
+*
+* Unless required by applicable law or agreed to in writing, software
+* distributed under the License is distributed on an "AS IS" BASIS,
+* WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+* See the License for the specific language governing permissions and
+* limitations under the License.
+*/
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+
+namespace ScryptNative
+{
+	// RFC 7914 defines every 32 bit word of B as little endian, while RFC 2898 (and the SHA family) are big endian.
+	// These helpers do the conversion byte by byte so the core does not care what the host byte order is.
+	static inline uint32_t le32dec(const uint8_t* p)
+	{
+		return (uint32_t)p[0] | ((uint32_t)p[1] << 8) | ((uint32_t)p[2] << 16) | ((uint32_t)p[3] << 24);
+	}
+
+	static inline void le32enc(uint8_t* p, uint32_t x)
+	{
+		p[0] = (uint8_t)x; p[1] = (uint8_t)(x >> 8); p[2] = (uint8_t)(x >> 16); p[3] = (uint8_t)(x >> 24);
+	}
+
+	static inline uint32_t be32dec(const uint8_t* p)
+	{
+		return ((uint32_t)p[0] << 24) | ((uint32_t)p[1] << 16) | ((uint32_t)p[2] << 8) | (uint32_t)p[3];
+	}
+
+	static inline void be32enc(uint8_t* p, uint32_t x)
+	{
+		p[0] = (uint8_t)(x >> 24); p[1] = (uint8_t)(x >> 16); p[2] = (uint8_t)(x >> 8); p[3] = (uint8_t)x;
+	}
+
+	static inline uint64_t be64dec(const uint8_t* p)
+	{
+		return ((uint64_t)be32dec(p) << 32) | be32dec(p + 4);
+	}
+
+	static inline void be64enc(uint8_t* p, uint64_t x)
+	{
+		be32enc(p, (uint32_t)(x >> 32)); be32enc(p + 4, (uint32_t)x);
+	}
+
+	// Zeroes a buffer through a volatile function pointer so the compiler cannot drop the stores as dead (secure memory, or at least try).
+	// Going through memset keeps the wipe at full store bandwidth, which matters for multi-MB V buffers.
+	static void* (*const volatile secureMemset)(void*, int, size_t) = memset;
+	static inline void SecureZero(void* data, size_t length)
+	{
+		secureMemset(data, 0, length);
+	}
+}
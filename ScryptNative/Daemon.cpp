@@ -0,0 +1,670 @@
+/* Copyright (c) 2017, Dustin J Sparks
+*
+* PUBLIC DOMAIN MARK
+*
+* While this work is free from any patent or intellectual property claims, the algorithm, pseudo-code, and test vectors were derived from
+* RFC 7914 "The scrypt Password-Based Key Derivation Function" (C. Percival, August 2016, ISSN: 2070-1721)
+*
+* From the RFC:
+* Copyright (c) 2016 IETF Trust and the persons identified as the
+* document authors. All rights reserved.
+* This document is subject to BCP 78 and the IETF Trusts Legal Provisions Relating to IETF Documents (http://trustee.ietf.org/license-info)
+* in effect on the date of publication of this document. Please review these documents carefully, as they describe your rights and restrictions
+* with respect to this document. Code Components extracted from this document must include Simplified BSD License text as described in Section 4.e of
+* the Trust Legal Provisions and are provided without warranty as described in the Simplified BSD License.
+*
+* Unless required by applicable law or agreed to in writing, software
+* distributed under the License is distributed on an "AS IS" BASIS,
+* WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+* See the License for the specific language governing permissions and
+* limitations under the License.
+*/
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstring>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+#if !defined(_WIN32)
+#include <cerrno>
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+#endif
+#include "Common.h"
+#include "ROMix.h"
+
+namespace ScryptNative
+{
+#if !defined(_WIN32)
+	static inline uint16_t le16dec(const uint8_t* p)
+	{
+		return (uint16_t)(p[0] | p[1] << 8);
+	}
+
+	static inline void le16enc(uint8_t* p, uint16_t x)
+	{
+		p[0] = (uint8_t)x;
+		p[1] = (uint8_t)(x >> 8);
+	}
+
+	static bool SocketAddress(const char* Path, sockaddr_un& Address)
+	{
+		memset(&Address, 0, sizeof(Address));
+		Address.sun_family = AF_UNIX;
+		if (Path == nullptr || Path[0] == '\0' || strlen(Path) >= sizeof(Address.sun_path))
+			return false;
+		strcpy(Address.sun_path, Path);
+		return true;
+	}
+
+	// Writes all Length bytes, false once the peer is gone (or stopped reading for longer than the send timeout)
+	static bool SendAll(int fd, const uint8_t* data, size_t length)
+	{
+		while (length > 0)
+		{
+			ssize_t n = send(fd, data, length, MSG_NOSIGNAL);
+			if (n < 0 && errno == EINTR)
+				continue;
+			if (n <= 0)
+				return false;
+			data += n;
+			length -= (size_t)n;
+		}
+		return true;
+	}
+
+	static bool ReceiveAll(int fd, uint8_t* data, size_t length)
+	{
+		while (length > 0)
+		{
+			ssize_t n = recv(fd, data, length, 0);
+			if (n < 0 && errno == EINTR)
+				continue;
+			if (n <= 0)
+				return false;
+			data += n;
+			length -= (size_t)n;
+		}
+		return true;
+	}
+
+	// One client connection.  Queued jobs share ownership, so the descriptor is only closed (and only then reused by the
+	// kernel) after the last answer for it has been sent or dropped.
+	struct Connection
+	{
+		int fd;
+		std::mutex sendLock;
+		std::vector<uint8_t> pending; // received bytes that do not make a whole frame yet
+
+		explicit Connection(int fd) : fd(fd) {}
+		~Connection()
+		{
+			SecureZero(pending.data(), pending.size());
+			close(fd);
+		}
+
+		void Answer(uint32_t Id, uint8_t Status, const char* Text, size_t TextLength)
+		{
+			std::vector<uint8_t> frame(HashDaemon::ResponseHeader + TextLength);
+			le32enc(&frame[0], (uint32_t)(frame.size() - 4));
+			le32enc(&frame[4], Id);
+			frame[8] = Status;
+			if (TextLength > 0)
+				memcpy(&frame[HashDaemon::ResponseHeader], Text, TextLength);
+			std::lock_guard<std::mutex> guard(sendLock);
+			if (!SendAll(fd, frame.data(), frame.size()))
+				shutdown(fd, SHUT_RDWR); // the reading side sees the end and drops the connection
+		}
+
+		void Answer(uint32_t Id, uint8_t Status, const char* Message)
+		{
+			Answer(Id, Status, Message, strlen(Message));
+		}
+	};
+
+	struct Job
+	{
+		std::shared_ptr<Connection> client;
+		uint32_t id;
+		uint8_t op;
+		uint64_t cpuCost;
+		uint32_t blockSize;
+		uint32_t parallelism;
+		size_t hashLength;
+		std::vector<uint8_t> password;
+		std::vector<uint8_t> salt; // Verify: from the encoded hash, Encode: drawn by the worker
+		std::vector<uint8_t> expected;
+		std::chrono::steady_clock::time_point arrived;
+
+		~Job()
+		{
+			SecureZero(password.data(), password.size());
+		}
+
+		bool SameShape(const Job& other) const
+		{
+			return cpuCost == other.cpuCost && blockSize == other.blockSize && parallelism == other.parallelism && hashLength == other.hashLength;
+		}
+	};
+
+	struct HashDaemon::State
+	{
+		Options opts;
+		std::string path;
+		int listener = -1;
+		int wake[2] = { -1, -1 };
+		std::vector<std::thread> workers;
+		std::atomic<uint64_t> requests{ 0 };
+		std::atomic<uint64_t> batches{ 0 };
+
+		std::mutex lock;
+		std::condition_variable changed;
+		std::deque<std::unique_ptr<Job>> queue;
+		uint64_t inUse = 0;
+		size_t running = 0;
+		bool stopping = false;
+
+		~State()
+		{
+			if (listener >= 0)
+			{
+				close(listener);
+				unlink(path.c_str());
+			}
+			for (int fd : wake)
+				if (fd >= 0)
+					close(fd);
+		}
+
+		uint64_t Footprint(const Job& Shape, size_t Count) const
+		{
+			return Scrypt::BatchFootprint(Shape.cpuCost, Shape.blockSize, Shape.parallelism, Count, 1) + Count * Shape.hashLength;
+		}
+
+		// Turns one request (Frame = everything after its Length field) into a queued job, or answers it right away when it
+		// is malformed or the queue is full
+		void Accept(const std::shared_ptr<Connection>& Client, const uint8_t* Frame, size_t Length)
+		{
+			requests++;
+			uint32_t id = le32dec(Frame);
+			size_t passwordLength = le16dec(Frame + 12);
+			size_t encodedLength = le16dec(Frame + 14);
+			if (RequestHeader - 4 + encodedLength + passwordLength != Length)
+				return Client->Answer(id, Invalid, "The lengths in the request do not add up.");
+			const uint8_t* encoded = Frame + RequestHeader - 4;
+			const uint8_t* password = encoded + encodedLength;
+
+			std::unique_ptr<Job> job(new Job());
+			job->client = Client;
+			job->id = id;
+			job->op = Frame[4];
+			if (job->op == Verify)
+			{
+				std::vector<uint8_t> storage(encodedLength);
+				HashFields h;
+				if (!HashCodec::Decode((const char*)encoded, encodedLength, h, storage.data(), storage.size()))
+					return Client->Answer(id, Invalid, "The encoded hash is not a valid scrypt hash.");
+				job->cpuCost = h.CPUCost;
+				job->blockSize = h.BlockSize;
+				job->parallelism = h.Parallelism;
+				job->hashLength = h.HashLength;
+				job->salt.assign(h.Salt, h.Salt + h.SaltLength);
+				job->expected.assign(h.Hash, h.Hash + h.HashLength);
+			}
+			else if (job->op == Encode)
+			{
+				if (Frame[5] >= 64)
+					return Client->Answer(id, Invalid, "Iterations must be a power of 2, and greater than 1.");
+				job->cpuCost = 1ULL << Frame[5];
+				job->blockSize = le16dec(Frame + 6);
+				job->parallelism = le16dec(Frame + 8);
+				job->hashLength = le16dec(Frame + 10);
+				job->salt.resize(opts.SaltLength);
+			}
+			else
+				return Client->Answer(id, Invalid, "Unknown operation.");
+			job->password.assign(password, password + passwordLength);
+
+			uint8_t probe = 0;
+			try
+			{
+				ValidateParameters(job->password.data(), passwordLength, &probe, 1, job->cpuCost, job->blockSize, job->parallelism, &probe, job->hashLength);
+			}
+			catch (const std::exception& ex)
+			{
+				return Client->Answer(id, Invalid, ex.what());
+			}
+			if (Footprint(*job, 1) > opts.MemoryBudget)
+				return Client->Answer(id, Invalid, "The request needs more memory than the daemon's whole budget.");
+
+			job->arrived = std::chrono::steady_clock::now();
+			{
+				std::lock_guard<std::mutex> guard(lock);
+				if (!stopping && queue.size() < opts.MaxQueued)
+				{
+					queue.push_back(std::move(job));
+					changed.notify_all();
+					return;
+				}
+			}
+			Client->Answer(id, Busy, "The hashing daemon is at capacity.");
+		}
+
+		// Splits Client's pending bytes into whole requests, false on a frame that breaks the protocol
+		bool Drain(const std::shared_ptr<Connection>& Client)
+		{
+			std::vector<uint8_t>& in = Client->pending;
+			size_t at = 0;
+			bool valid = true;
+			while (in.size() - at >= 4)
+			{
+				uint32_t length = le32dec(&in[at]);
+				if (length < RequestHeader - 4 || length > MaxFrame)
+				{
+					valid = false;
+					break;
+				}
+				if (in.size() - at - 4 < length)
+					break;
+				Accept(Client, &in[at + 4], length);
+				at += 4 + length;
+			}
+			SecureZero(in.data(), at);
+			in.erase(in.begin(), in.begin() + at);
+			return valid;
+		}
+
+		// Takes the oldest request and up to MaxBatch - 1 later ones of the same shape, once the batch is full or the oldest
+		// has waited BatchWindowMicroseconds, and once the batch fits in the memory budget
+		void Work()
+		{
+			std::unique_lock<std::mutex> guard(lock);
+			for (;;)
+			{
+				if (stopping)
+					return;
+				if (queue.empty())
+				{
+					changed.wait(guard);
+					continue;
+				}
+				const Job& head = *queue.front();
+				size_t count = 0;
+				for (size_t i = 0; i < queue.size() && count < opts.MaxBatch; i++)
+					if (queue[i]->SameShape(head))
+						count++;
+				std::chrono::steady_clock::time_point due = head.arrived + std::chrono::microseconds(opts.BatchWindowMicroseconds);
+				if (count < opts.MaxBatch && std::chrono::steady_clock::now() < due)
+				{
+					changed.wait_until(guard, due);
+					continue;
+				}
+				while (count > 1 && Footprint(head, count) > opts.MemoryBudget)
+					count--;
+				uint64_t footprint = Footprint(head, count);
+				if (running > 0 && inUse + footprint > opts.MemoryBudget)
+				{
+					changed.wait(guard);
+					continue;
+				}
+
+				std::vector<std::unique_ptr<Job>> batch;
+				batch.push_back(std::move(queue.front()));
+				queue.pop_front();
+				for (size_t i = 0; i < queue.size() && batch.size() < count; )
+				{
+					if (queue[i]->SameShape(*batch[0]))
+					{
+						batch.push_back(std::move(queue[i]));
+						queue.erase(queue.begin() + i);
+					}
+					else
+						i++;
+				}
+				inUse += footprint;
+				running++;
+				guard.unlock();
+				RunBatch(batch);
+				batch.clear();
+				guard.lock();
+				inUse -= footprint;
+				running--;
+				changed.notify_all();
+			}
+		}
+
+		void RunBatch(std::vector<std::unique_ptr<Job>>& Batch)
+		{
+			batches++;
+			const Job& shape = *Batch[0];
+			size_t count = Batch.size();
+			std::vector<const uint8_t*> passwords(count), salts(count);
+			std::vector<size_t> passwordLengths(count), saltLengths(count);
+			std::vector<uint8_t> computed(count * shape.hashLength);
+			std::vector<uint8_t*> outputs(count);
+			try
+			{
+				for (size_t i = 0; i < count; i++)
+				{
+					Job& job = *Batch[i];
+					if (job.op == Encode)
+						Scrypt::RandomSalt(job.salt.data(), job.salt.size());
+					passwords[i] = job.password.data();
+					passwordLengths[i] = job.password.size();
+					salts[i] = job.salt.data();
+					saltLengths[i] = job.salt.size();
+					outputs[i] = computed.data() + i * shape.hashLength;
+				}
+				Scrypt::ComputeDerivedHashBatch(passwords.data(), passwordLengths.data(), salts.data(), saltLengths.data(), count,
+					shape.cpuCost, shape.blockSize, shape.parallelism, outputs.data(), shape.hashLength, 1);
+			}
+			catch (const std::exception& ex)
+			{
+				// not Busy: the same batch would fail again, a client told to retry would loop
+				SecureZero(computed.data(), computed.size());
+				uint8_t status = dynamic_cast<const std::logic_error*>(&ex) != nullptr ? Invalid : Failed;
+				for (std::unique_ptr<Job>& job : Batch)
+					job->client->Answer(job->id, status, ex.what());
+				return;
+			}
+			for (size_t i = 0; i < count; i++)
+			{
+				Job& job = *Batch[i];
+				if (job.op == Verify)
+				{
+					job.client->Answer(job.id, Scrypt::SafeEquals(outputs[i], job.expected.data(), job.hashLength) ? Ok : Mismatch, "", 0);
+					continue;
+				}
+				HashFields h = { 2, job.cpuCost, job.blockSize, job.parallelism, job.salt.data(), job.salt.size(), outputs[i], job.hashLength };
+				std::string text(HashCodec::EncodedLength(h), '\0');
+				text.resize(HashCodec::Encode(h, &text[0], text.size()));
+				job.client->Answer(job.id, Ok, text.data(), text.size());
+			}
+			SecureZero(computed.data(), computed.size());
+		}
+	};
+
+	HashDaemon::HashDaemon(const Options& Opts) : state(nullptr)
+	{
+		std::unique_ptr<State> s(new State());
+		s->opts = Opts;
+		if (s->opts.Threads == 0)
+			s->opts.Threads = std::max(1u, std::thread::hardware_concurrency());
+		if (s->opts.MemoryBudget == 0)
+			s->opts.MemoryBudget = 1ULL << 30;
+		if (s->opts.MaxQueued == 0)
+			s->opts.MaxQueued = 4096;
+		if (s->opts.MaxBatch == 0)
+			s->opts.MaxBatch = 4 * (size_t)Scrypt::BatchLanes();
+		if (s->opts.SaltLength == 0)
+			s->opts.SaltLength = 32;
+
+		sockaddr_un address;
+		if (!SocketAddress(Opts.SocketPath, address))
+			throw std::invalid_argument("SocketPath must be a non empty path shorter than sun_path.");
+		// a socket file nobody answers on is left over from a daemon that died, one that answers belongs to a live daemon
+		int probe = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+		if (probe >= 0)
+		{
+			bool live = connect(probe, (sockaddr*)&address, sizeof(address)) == 0;
+			close(probe);
+			if (live)
+				throw std::runtime_error("Another daemon is already listening on SocketPath.");
+		}
+		unlink(Opts.SocketPath);
+		s->listener = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+		if (s->listener < 0)
+			throw std::runtime_error("Cannot create the daemon socket.");
+		if (bind(s->listener, (sockaddr*)&address, sizeof(address)) != 0)
+		{
+			close(s->listener);
+			s->listener = -1;
+			throw std::runtime_error("Cannot bind the daemon socket.");
+		}
+		s->path = Opts.SocketPath;
+		if (listen(s->listener, SOMAXCONN) != 0 || pipe(s->wake) != 0)
+			throw std::runtime_error("Cannot listen on the daemon socket.");
+		fcntl(s->wake[0], F_SETFD, FD_CLOEXEC);
+		fcntl(s->wake[1], F_SETFD, FD_CLOEXEC);
+		fcntl(s->wake[1], F_SETFL, O_NONBLOCK);
+
+		State* st = s.get();
+		try
+		{
+			for (uint32_t t = 0; t < s->opts.Threads; t++)
+				s->workers.emplace_back([st] { st->Work(); });
+		}
+		catch (...)
+		{
+			{
+				std::lock_guard<std::mutex> guard(s->lock);
+				s->stopping = true;
+			}
+			s->changed.notify_all();
+			for (std::thread& w : s->workers)
+				w.join();
+			throw;
+		}
+		state = s.release();
+	}
+
+	HashDaemon::~HashDaemon()
+	{
+		std::deque<std::unique_ptr<Job>> left;
+		{
+			std::lock_guard<std::mutex> guard(state->lock);
+			state->stopping = true;
+			left.swap(state->queue);
+		}
+		state->changed.notify_all();
+		for (std::unique_ptr<Job>& job : left)
+			job->client->Answer(job->id, Busy, "The hashing daemon is shutting down.");
+		left.clear();
+		for (std::thread& w : state->workers)
+			w.join();
+		delete state;
+	}
+
+	void HashDaemon::Run()
+	{
+		std::vector<std::shared_ptr<Connection>> clients;
+		std::vector<pollfd> fds;
+		uint8_t buffer[16384];
+		for (;;)
+		{
+			fds.clear();
+			fds.push_back({ state->wake[0], POLLIN, 0 });
+			fds.push_back({ state->listener, POLLIN, 0 });
+			for (const std::shared_ptr<Connection>& c : clients)
+				fds.push_back({ c->fd, POLLIN, 0 });
+			if (poll(fds.data(), fds.size(), -1) < 0)
+			{
+				if (errno == EINTR)
+					continue;
+				throw std::runtime_error("poll failed on the daemon sockets.");
+			}
+			if (fds[0].revents != 0)
+			{
+				char drained;
+				while (read(state->wake[0], &drained, 1) < 0 && errno == EINTR) {}
+				return; // running batches still answer, the connections close once their last job is done
+			}
+			for (size_t i = clients.size(); i-- > 0; )
+			{
+				if (fds[i + 2].revents == 0)
+					continue;
+				ssize_t n = recv(clients[i]->fd, buffer, sizeof(buffer), 0);
+				bool keep = n > 0 || (n < 0 && (errno == EINTR || errno == EAGAIN));
+				if (n > 0)
+				{
+					clients[i]->pending.insert(clients[i]->pending.end(), buffer, buffer + n);
+					SecureZero(buffer, (size_t)n);
+					keep = state->Drain(clients[i]);
+				}
+				if (!keep)
+				{
+					shutdown(clients[i]->fd, SHUT_RDWR);
+					clients.erase(clients.begin() + i);
+				}
+			}
+			if (fds[1].revents & POLLIN)
+			{
+				int fd = accept(state->listener, nullptr, nullptr);
+				if (fd >= 0)
+				{
+					fcntl(fd, F_SETFD, FD_CLOEXEC);
+					timeval timeout = { 1, 0 }; // a client that stops reading cannot stall a worker for long
+					setsockopt(fd, SOL_SOCKET, SO_SNDTIMEO, &timeout, sizeof(timeout));
+					clients.push_back(std::make_shared<Connection>(fd));
+				}
+			}
+		}
+	}
+
+	void HashDaemon::Stop()
+	{
+		char wake = 1;
+		ssize_t written = write(state->wake[1], &wake, 1); // a full pipe already holds a wake up
+		(void)written;
+	}
+
+	uint64_t HashDaemon::Requests() const
+	{
+		return state->requests;
+	}
+
+	uint64_t HashDaemon::Batches() const
+	{
+		return state->batches;
+	}
+
+	uint64_t HashDaemon::MemoryInUse() const
+	{
+		std::lock_guard<std::mutex> guard(state->lock);
+		return state->inUse;
+	}
+
+	HashDaemonClient::HashDaemonClient(const char* SocketPath) : fd(-1), nextId(1)
+	{
+		sockaddr_un address;
+		if (!SocketAddress(SocketPath, address))
+			throw std::invalid_argument("SocketPath must be a non empty path shorter than sun_path.");
+		fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+		if (fd < 0 || connect(fd, (sockaddr*)&address, sizeof(address)) != 0)
+		{
+			if (fd >= 0)
+				close(fd);
+			throw std::runtime_error("Cannot connect to the hashing daemon.");
+		}
+	}
+
+	HashDaemonClient::~HashDaemonClient()
+	{
+		close(fd);
+	}
+
+	static std::vector<uint8_t> RequestFrame(uint8_t Op, uint8_t Log2CPUCost, uint32_t BlockSize, uint32_t Parallelism, size_t HashLength,
+		const char* Encoded, size_t EncodedLength, const uint8_t* Password, size_t PasswordLength)
+	{
+		if (BlockSize > 0xffff || Parallelism > 0xffff || HashLength > 0xffff || EncodedLength > 0xffff || PasswordLength > 0xffff ||
+			HashDaemon::RequestHeader - 4 + EncodedLength + PasswordLength > HashDaemon::MaxFrame)
+			throw std::invalid_argument("The request does not fit the daemon protocol.");
+		if (Password == nullptr && PasswordLength != 0)
+			throw std::invalid_argument("Password cannot be null unless its length is zero.");
+		std::vector<uint8_t> frame(HashDaemon::RequestHeader + EncodedLength + PasswordLength);
+		le32enc(&frame[0], (uint32_t)(frame.size() - 4));
+		frame[8] = Op;
+		frame[9] = Log2CPUCost;
+		le16enc(&frame[10], (uint16_t)BlockSize);
+		le16enc(&frame[12], (uint16_t)Parallelism);
+		le16enc(&frame[14], (uint16_t)HashLength);
+		le16enc(&frame[16], (uint16_t)PasswordLength);
+		le16enc(&frame[18], (uint16_t)EncodedLength);
+		if (EncodedLength > 0)
+			memcpy(&frame[HashDaemon::RequestHeader], Encoded, EncodedLength);
+		if (PasswordLength > 0)
+			memcpy(&frame[HashDaemon::RequestHeader + EncodedLength], Password, PasswordLength);
+		return frame;
+	}
+
+	uint8_t HashDaemonClient::Call(std::vector<uint8_t>& Frame, std::string& Text)
+	{
+		uint32_t id = nextId++;
+		le32enc(&Frame[4], id);
+		bool sent = SendAll(fd, Frame.data(), Frame.size());
+		SecureZero(Frame.data(), Frame.size());
+		uint8_t header[HashDaemon::ResponseHeader];
+		if (!sent || !ReceiveAll(fd, header, sizeof(header)))
+			throw std::runtime_error("The connection to the hashing daemon was lost.");
+		uint32_t length = le32dec(header);
+		if (length < HashDaemon::ResponseHeader - 4 || length > HashDaemon::MaxFrame || le32dec(header + 4) != id)
+			throw std::runtime_error("Unexpected answer from the hashing daemon.");
+		Text.resize(length - (HashDaemon::ResponseHeader - 4));
+		if (!Text.empty() && !ReceiveAll(fd, (uint8_t*)&Text[0], Text.size()))
+			throw std::runtime_error("The connection to the hashing daemon was lost.");
+		if (header[8] == HashDaemon::Busy)
+			throw BusyError(Text);
+		if (header[8] == HashDaemon::Invalid)
+			throw std::invalid_argument(Text);
+		if (header[8] == HashDaemon::Failed)
+			throw std::runtime_error(Text);
+		return header[8];
+	}
+
+	std::string HashDaemonClient::Encode(const uint8_t* Password, size_t PasswordLength, uint64_t CPUCost, uint32_t BlockSize, uint32_t Parallelism, size_t HashLength)
+	{
+		if (CPUCost < 2 || (CPUCost & (CPUCost - 1)) != 0)
+			throw std::invalid_argument("Iterations must be a power of 2, and greater than 1.");
+		uint8_t log2 = 0;
+		while ((1ULL << log2) < CPUCost)
+			log2++;
+		std::vector<uint8_t> frame = RequestFrame(HashDaemon::Encode, log2, BlockSize, Parallelism, HashLength, nullptr, 0, Password, PasswordLength);
+		std::string text;
+		Call(frame, text);
+		return text;
+	}
+
+	bool HashDaemonClient::Verify(const char* Encoded, size_t EncodedLength, const uint8_t* Password, size_t PasswordLength)
+	{
+		if (Encoded == nullptr || EncodedLength == 0)
+			throw std::invalid_argument("The encoded hash cannot be empty.");
+		std::vector<uint8_t> frame = RequestFrame(HashDaemon::Verify, 0, 0, 0, 0, Encoded, EncodedLength, Password, PasswordLength);
+		std::string text;
+		return Call(frame, text) == HashDaemon::Ok;
+	}
+#else
+	struct HashDaemon::State {};
+
+	HashDaemon::HashDaemon(const Options&) : state(nullptr)
+	{
+		throw std::runtime_error("HashDaemon needs Unix domain sockets, which this build does not support.");
+	}
+
+	HashDaemon::~HashDaemon() {}
+	void HashDaemon::Run() {}
+	void HashDaemon::Stop() {}
+	uint64_t HashDaemon::Requests() const { return 0; }
+	uint64_t HashDaemon::Batches() const { return 0; }
+	uint64_t HashDaemon::MemoryInUse() const { return 0; }
+
+	HashDaemonClient::HashDaemonClient(const char*) : fd(-1), nextId(0)
+	{
+		throw std::runtime_error("HashDaemonClient needs Unix domain sockets, which this build does not support.");
+	}
+
+	HashDaemonClient::~HashDaemonClient() {}
+	uint8_t HashDaemonClient::Call(std::vector<uint8_t>&, std::string&) { return 0; }
+	std::string HashDaemonClient::Encode(const uint8_t*, size_t, uint64_t, uint32_t, uint32_t, size_t) { return std::string(); }
+	bool HashDaemonClient::Verify(const char*, size_t, const uint8_t*, size_t) { return false; }
+#endif
+}
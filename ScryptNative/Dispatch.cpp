@@ -0,0 +1,210 @@
+/* Copyright (c) 2017, Dustin J Sparks
+*
+* PUBLIC DOMAIN MARK
+*
+* While this work is free from any patent or intellectual property claims, the algorithm, pseudo-code, and test vectors were derived from
+* RFC 7914 "The scrypt Password-Based Key Derivation Function" (C. Percival, August 2016, ISSN: 2070-1721)
+*
+* From the RFC:
+* Copyright (c) 2016 IETF Trust and the persons identified as the
+* document authors. All rights reserved.
+* This document is subject to BCP 78 and the IETF Trusts Legal Provisions Relating to IETF Documents (http://trustee.ietf.org/license-info)
+* in effect on the date of publication of this document. Please review these documents carefully, as they describe your rights and restrictions
+* with respect to this document. Code Components extracted from this document must include Simplified BSD License text as described in Section 4.e of
+* the Trust Legal Provisions and are provided without warranty as described in the Simplified BSD License.
+*
+* Unless required by applicable law or agreed to in writing, software
+* distributed under the License is distributed on an "AS IS" BASIS,
+* WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+* See the License for the specific language governing permissions and
+* limitations under the License.
+*/
+
+#include <algorithm>
+#include <atomic>
+#include <cctype>
+#include <cstdlib>
+#include <string>
+#include "Dispatch.h"
+#include "ScryptNative.h"
+#if defined(_M_IX86) || defined(_M_X64)
+#include <intrin.h>
+#define SCRYPT_X86 1
+#elif defined(__i386__) || defined(__x86_64__)
+#include <cpuid.h>
+#define SCRYPT_X86 1
+#endif
+
+namespace ScryptNative
+{
+	struct Host
+	{
+		Dispatch::Level level;
+		bool sha;
+	};
+
+#if SCRYPT_X86
+	static void cpuid(uint32_t leaf, uint32_t subleaf, uint32_t* regs)
+	{
+#if defined(_MSC_VER)
+		int r[4];
+		__cpuidex(r, (int)leaf, (int)subleaf);
+		for (int i = 0; i < 4; i++) regs[i] = (uint32_t)r[i];
+#else
+		__cpuid_count(leaf, subleaf, regs[0], regs[1], regs[2], regs[3]);
+#endif
+	}
+
+	// XCR0, which register states the OS saves on a context switch
+	static uint64_t xgetbv0()
+	{
+#if defined(_MSC_VER)
+		return _xgetbv(0);
+#else
+		uint32_t lo, hi;
+		__asm__ __volatile__("xgetbv" : "=a"(lo), "=d"(hi) : "c"(0));
+		return ((uint64_t)hi << 32) | lo;
+#endif
+	}
+#endif
+
+	// What this CPU (and its OS) can run, limited to the kernels this build has
+	static Host detect()
+	{
+		Host host = { Dispatch::Portable, false };
+#if SCRYPT_X86
+		uint32_t r1[4], r7[4] = { 0, 0, 0, 0 };
+		cpuid(0, 0, r1);
+		uint32_t maxLeaf = r1[0];
+		cpuid(1, 0, r1);
+		if (maxLeaf >= 7)
+			cpuid(7, 0, r7);
+		bool osxsave = (r1[2] & (1u << 27)) != 0;
+		uint64_t xcr0 = osxsave ? xgetbv0() : 0;
+		bool avx = osxsave && (r1[2] & (1u << 28)) != 0 && (xcr0 & 0x6) == 0x6; // XMM and YMM state
+		bool avx2 = avx && (r7[1] & (1u << 5)) != 0;
+		bool avx512 = avx2 && (r7[1] & (1u << 16)) != 0 && (xcr0 & 0xE6) == 0xE6; // and opmask, ZMM0-15 upper halves, ZMM16-31
+
+		if ((r1[3] & (1u << 26)) != 0 && LaneKernelsSSE2() != nullptr) host.level = Dispatch::SSE2;
+		if (avx2 && LaneKernelsAVX2() != nullptr) host.level = Dispatch::AVX2;
+		if (avx512 && LaneKernelsAVX512() != nullptr) host.level = Dispatch::AVX512;
+		// SHA-NI plus the SSSE3 byte shuffle and SSE4.1 blend its kernel uses
+		host.sha = (r7[1] & (1u << 29)) != 0 && (r1[2] & (1u << 9)) != 0 && (r1[2] & (1u << 19)) != 0 && SHA256KernelSHANI() != nullptr;
+#endif
+		return host;
+	}
+
+	static const Host& host()
+	{
+		static const Host h = detect();
+		return h;
+	}
+
+	static std::atomic<const LaneKernelSet*> lanes(nullptr);
+	static std::atomic<int> boundLevel(Dispatch::Portable);
+
+	const LaneKernelSet* BatchKernels()
+	{
+		return lanes.load(std::memory_order_acquire);
+	}
+
+	static const LaneKernelSet* kernelsFor(Dispatch::Level Level)
+	{
+		switch (Level)
+		{
+		case Dispatch::SSE2: return LaneKernelsSSE2();
+		case Dispatch::AVX2: return LaneKernelsAVX2();
+		case Dispatch::AVX512: return LaneKernelsAVX512();
+		default: return nullptr;
+		}
+	}
+
+	static std::string environment(const char* name)
+	{
+		std::string result;
+#if defined(_MSC_VER)
+		char* value = nullptr;
+		size_t length = 0;
+		if (_dupenv_s(&value, &length, name) == 0 && value != nullptr)
+		{
+			result = value;
+			free(value);
+		}
+#else
+		const char* value = getenv(name);
+		if (value != nullptr)
+			result = value;
+#endif
+		return result;
+	}
+
+	Dispatch::Level Dispatch::HostLevel()
+	{
+		return host().level;
+	}
+
+	bool Dispatch::HostSHAExtensions()
+	{
+		return host().sha;
+	}
+
+	Dispatch::Level Dispatch::CurrentLevel()
+	{
+		return (Level)boundLevel.load(std::memory_order_relaxed);
+	}
+
+	bool Dispatch::SHAExtensions()
+	{
+		return BoundSHA256() != SHA256KernelPortable();
+	}
+
+	Dispatch::Level Dispatch::Force(Level MaxLevel, bool UseSHAExtensions)
+	{
+		Level level = std::min(MaxLevel, host().level);
+		boundLevel.store(level, std::memory_order_relaxed);
+		lanes.store(kernelsFor(level), std::memory_order_release);
+		BindSHA256(UseSHAExtensions && host().sha ? SHA256KernelSHANI() : SHA256KernelPortable());
+		return level;
+	}
+
+	void Dispatch::Reset()
+	{
+		Level cap = AVX512;
+		bool sha = true;
+		std::string spec = environment("SCRYPT_KERNEL");
+		for (char& c : spec)
+			c = (char)tolower((unsigned char)c);
+		for (size_t start = 0; start < spec.size();)
+		{
+			size_t end = spec.find(',', start);
+			if (end == std::string::npos)
+				end = spec.size();
+			std::string token = spec.substr(start, end - start);
+			if (token == "portable") cap = Portable;
+			else if (token == "sse2") cap = SSE2;
+			else if (token == "avx2") cap = AVX2;
+			else if (token == "avx512") cap = AVX512;
+			else if (token == "nosha") sha = false;
+			start = end + 1;
+		}
+		Force(cap, sha);
+	}
+
+	std::string Dispatch::Describe()
+	{
+		const LaneKernelSet* set = BatchKernels();
+		std::string text = "batch ";
+		text += set != nullptr ? std::string(set->Name) + " x" + std::to_string(set->L) : std::string("portable");
+		text += ", SHA-256 ";
+		text += BoundSHA256()->Name;
+		text += ", Salsa20/8 ";
+		text += Metrics::Kernel();
+		return text;
+	}
+
+	// The cpuid choice is bound before main(); until then (static initializers of other units) everything runs portable
+	static struct Binder
+	{
+		Binder() { Dispatch::Reset(); }
+	} binder;
+}
@@ -0,0 +1,71 @@
+#pragma once
+
+/* Copyright (c) 2017, Dustin J Sparks
+*
+* PUBLIC DOMAIN MARK
+*
+* While this work is free from any patent or intellectual property claims, the algorithm, pseudo-code, and test vectors were derived from
+* RFC 7914 "The scrypt Password-Based Key Derivation Function" (C. Percival, August 2016, ISSN: 2070-1721)
+*
+* From the RFC:
+* Copyright (c) 2016 IETF Trust and the persons identified as the
+* document authors. All rights reserved.
+* This document is subject to BCP 78 and the IETF Trusts Legal Provisions Relating to IETF Documents (http://trustee.ietf.org/license-info)
+* in effect on the date of publication of this document. Please review these documents carefully, as they describe your rights and restrictions
+* with respect to this document. Code Components extracted from this document must include Simplified BSD License text as described in Section 4.e of
+* the Trust Legal Provisions and are provided without warranty as described in the Simplified BSD License.
+*
+* Unless required by applicable law or agreed to in writing, software
+* distributed under the License is distributed on an "AS IS" BASIS,
+* WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+* See the License for the specific language governing permissions and
+* limitations under the License.
+*/
+
+#include "Common.h"
+
+// Kernels bound at load time from cpuid (Dispatch.cpp, public side: Dispatch in ScryptNative.h).
+// Every kernel that needs more than the baseline instruction set lives in its own translation unit compiled with that
+// unit's target flags (LanesAVX2.cpp, LanesAVX512.cpp, SHANI.cpp) and exports only the plain tables below, so no inline
+// or template code built for a wider target can be shared with, and picked by the linker for, the baseline code.
+
+namespace ScryptNative
+{
+	// Widest multi-buffer kernel: AVX-512, 16 lanes of 32 bits
+	static const uint32_t MaxBatchLanes = 16;
+
+	// The multi-buffer kernels of one vector width: L ROMix instances, or L PBKDF2-HMAC-SHA256 blocks, in lockstep
+	struct LaneKernelSet
+	{
+		const char* Name;
+		uint32_t L;
+		// LaneKernels<Lanes>::Fill / Mix, Scratch holds (N + 2) * BlockSize * 32 * L words (V, X and Y), 64 byte aligned
+		void (*ROMixFill)(uint8_t* const* Bp, uint32_t BlockSize, size_t N, uint32_t* Scratch);
+		void (*ROMixMix)(uint8_t* const* Bp, uint32_t BlockSize, size_t N, uint32_t* Scratch);
+		// SHA256Lanes<Lanes>::F
+		void (*PBKDF2F)(const uint32_t* InnerKeyed, const uint32_t* OuterKeyed, const uint32_t* States, const uint8_t* Tails,
+			size_t Blocks, uint32_t Iterations, uint8_t* Out);
+	};
+
+	// nullptr when the compiler cannot target that width
+	const LaneKernelSet* LaneKernelsSSE2();
+	const LaneKernelSet* LaneKernelsAVX2();
+	const LaneKernelSet* LaneKernelsAVX512();
+	// The set in use, nullptr when none is (Dispatch::Portable).  Read it once per call, so a call never mixes widths.
+	const LaneKernelSet* BatchKernels();
+
+	// Single stream SHA-256 compression of one 64 byte block, or of 16 message words already in host order
+	struct SHA256Kernel
+	{
+		const char* Name;
+		void (*Compress)(uint32_t* state, const uint8_t* block);
+		void (*CompressWords)(uint32_t* state, const uint32_t* W);
+	};
+
+	const SHA256Kernel* SHA256KernelPortable();
+	// SHA extensions (SHA-NI), nullptr when the compiler cannot target them
+	const SHA256Kernel* SHA256KernelSHANI();
+	// Kernel behind SHA256Compress / SHA256CompressWords (SHA.cpp)
+	const SHA256Kernel* BoundSHA256();
+	void BindSHA256(const SHA256Kernel* Kernel);
+}
@@ -0,0 +1,287 @@
+/* Copyright (c) 2017, Dustin J Sparks
+*
+* PUBLIC DOMAIN MARK
+*
+* While this work is free from any patent or intellectual property claims, the algorithm, pseudo-code, and test vectors were derived from
+* RFC 7914 "The scrypt Password-Based Key Derivation Function" (C. Percival, August 2016, ISSN: 2070-1721)
+*
+* From the RFC:
+* Copyright (c) 2016 IETF Trust and the persons identified as the
+* document authors. All rights reserved.
+* This document is subject to BCP 78 and the IETF Trusts Legal Provisions Relating to IETF Documents (http://trustee.ietf.org/license-info)
+* in effect on the date of publication of this document. Please review these documents carefully, as they describe your rights and restrictions
+* with respect to this document. Code Components extracted from this document must include Simplified BSD License text as described in Section 4.e of
+* the Trust Legal Provisions and are provided without warranty as described in the Simplified BSD License.
+*
+* Unless required by applicable law or agreed to in writing, software
+* distributed under the License is distributed on an "AS IS" BASIS,
+* WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+* See the License for the specific language governing permissions and
+* limitations under the License.
+*/
+
+#include <cstdint>
+#include <cstring>
+#include "ScryptNative.h"
+
+namespace ScryptNative
+{
+	static const char Base64Chars[] = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+
+	static int Base64Value(char c)
+	{
+		if (c >= 'A' && c <= 'Z') return c - 'A';
+		if (c >= 'a' && c <= 'z') return c - 'a' + 26;
+		if (c >= '0' && c <= '9') return c - '0' + 52;
+		if (c == '+') return 62;
+		if (c == '/') return 63;
+		return -1;
+	}
+
+	static size_t Base64Length(size_t bytes)
+	{
+		return (bytes + 2) / 3 * 4;
+	}
+
+	// Padded base64 as Convert::ToBase64String writes it
+	static char* Base64Encode(const uint8_t* data, size_t length, char* out)
+	{
+		for (size_t i = 0; i < length; i += 3)
+		{
+			uint32_t v = (uint32_t)data[i] << 16;
+			if (i + 1 < length) v |= (uint32_t)data[i + 1] << 8;
+			if (i + 2 < length) v |= data[i + 2];
+			*out++ = Base64Chars[v >> 18];
+			*out++ = Base64Chars[(v >> 12) & 63];
+			*out++ = i + 1 < length ? Base64Chars[(v >> 6) & 63] : '=';
+			*out++ = i + 2 < length ? Base64Chars[v & 63] : '=';
+		}
+		return out;
+	}
+
+	// Decodes padded base64 into out (capacity bytes), returns the decoded length or SIZE_MAX
+	static size_t Base64Decode(const char* text, size_t length, uint8_t* out, size_t capacity)
+	{
+		if (length == 0 || length % 4 != 0)
+			return SIZE_MAX;
+		size_t pad = text[length - 1] == '=' ? (text[length - 2] == '=' ? 2 : 1) : 0;
+		size_t decoded = length / 4 * 3 - pad;
+		if (decoded > capacity)
+			return SIZE_MAX;
+		size_t o = 0;
+		for (size_t i = 0; i < length; i += 4)
+		{
+			uint32_t v = 0;
+			for (size_t k = 0; k < 4; k++)
+			{
+				int d = i + k >= length - pad ? 0 : Base64Value(text[i + k]);
+				if (d < 0)
+					return SIZE_MAX;
+				v = (v << 6) | (uint32_t)d;
+			}
+			for (size_t k = 0; k < 3 && o < decoded; k++)
+				out[o++] = (uint8_t)(v >> (16 - 8 * k));
+		}
+		return decoded;
+	}
+
+	// Unsigned number in base 10 or 16, the whole field must be digits and fit 64 bits
+	static bool ParseNumber(const char* text, size_t length, uint32_t base, uint64_t& value)
+	{
+		if (length == 0)
+			return false;
+		value = 0;
+		for (size_t i = 0; i < length; i++)
+		{
+			char c = text[i];
+			uint32_t d;
+			if (c >= '0' && c <= '9') d = (uint32_t)(c - '0');
+			else if (base == 16 && (c | 0x20) >= 'a' && (c | 0x20) <= 'f') d = (uint32_t)((c | 0x20) - 'a' + 10);
+			else return false;
+			if (value > (UINT64_MAX - d) / base)
+				return false;
+			value = value * base + d;
+		}
+		return true;
+	}
+
+	static char* WriteNumber(uint64_t value, uint32_t base, char* out)
+	{
+		char digits[20];
+		size_t n = 0;
+		do
+		{
+			digits[n++] = "0123456789abcdef"[value % base];
+			value /= base;
+		} while (value != 0);
+		while (n > 0)
+			*out++ = digits[--n];
+		return out;
+	}
+
+	static size_t NumberLength(uint64_t value, uint32_t base)
+	{
+		size_t n = 1;
+		while (value >= base)
+		{
+			value /= base;
+			n++;
+		}
+		return n;
+	}
+
+	bool HashCodec::Decode(const char* Text, size_t TextLength, HashFields& Fields, uint8_t* Storage, size_t StorageCapacity)
+	{
+		// split on '$', the text starts with one so field 0 is empty
+		const char* field[8];
+		size_t length[8];
+		size_t count = 0;
+		if (Text == nullptr || TextLength < 2 || Text[0] != '$' || Text[1] != 's')
+			return false;
+		for (size_t i = 1, start = 1; i <= TextLength; i++)
+		{
+			if (i < TextLength && Text[i] != '$')
+				continue;
+			if (count == 6)
+				return false;
+			field[count] = Text + start;
+			length[count++] = i - start;
+			start = i + 1;
+		}
+		uint64_t version, config;
+		if (!ParseNumber(field[0] + 1, length[0] - 1, 10, version))
+			return false;
+		size_t saltField;
+		if (version == 2 && count == 6)
+		{
+			uint64_t b, p;
+			if (!ParseNumber(field[1], length[1], 10, Fields.CPUCost) || !ParseNumber(field[2], length[2], 10, b) ||
+				!ParseNumber(field[3], length[3], 10, p) || b > UINT32_MAX || p > UINT32_MAX)
+				return false;
+			Fields.BlockSize = (uint32_t)b;
+			Fields.Parallelism = (uint32_t)p;
+			saltField = 4;
+		}
+		else if (version < 2 && count == 4 && ParseNumber(field[1], length[1], 16, config))
+		{
+			Fields.CPUCost = (config >> 16) & 0xffff;
+			Fields.BlockSize = (config >> 8) & 0xff;
+			Fields.Parallelism = config & 0xff;
+			saltField = 2;
+		}
+		else
+			return false;
+		Fields.Version = (uint32_t)version;
+
+		size_t saltLength = Base64Decode(field[saltField], length[saltField], Storage, StorageCapacity);
+		if (saltLength == SIZE_MAX)
+			return false;
+		size_t hashLength = Base64Decode(field[saltField + 1], length[saltField + 1], Storage + saltLength, StorageCapacity - saltLength);
+		if (hashLength == SIZE_MAX)
+			return false;
+		Fields.Salt = Storage;
+		Fields.SaltLength = saltLength;
+		Fields.Hash = Storage + saltLength;
+		Fields.HashLength = hashLength;
+		return true;
+	}
+
+	size_t HashCodec::EncodedLength(const HashFields& Fields)
+	{
+		size_t length = 2 + NumberLength(Fields.Version, 10) + 1; // "$s2$"
+		if (Fields.Version >= 2)
+			length += NumberLength(Fields.CPUCost, 10) + 1 + NumberLength(Fields.BlockSize, 10) + 1 + NumberLength(Fields.Parallelism, 10) + 1;
+		else
+			length += NumberLength(Fields.CPUCost << 16 | Fields.BlockSize << 8 | Fields.Parallelism, 16) + 1;
+		return length + Base64Length(Fields.SaltLength) + 1 + Base64Length(Fields.HashLength);
+	}
+
+	size_t HashCodec::Encode(const HashFields& Fields, char* Text, size_t TextCapacity)
+	{
+		if (Fields.Version > 2 || (Fields.Salt == nullptr && Fields.SaltLength != 0) || (Fields.Hash == nullptr && Fields.HashLength != 0))
+			return 0;
+		if (Fields.Version < 2 && (Fields.CPUCost > 0xff || Fields.BlockSize > 0xff || Fields.Parallelism > 0xff))
+			return 0;
+		size_t length = EncodedLength(Fields);
+		if (Text == nullptr || length > TextCapacity)
+			return 0;
+		char* out = Text;
+		*out++ = '$';
+		*out++ = 's';
+		out = WriteNumber(Fields.Version, 10, out);
+		*out++ = '$';
+		if (Fields.Version >= 2)
+		{
+			out = WriteNumber(Fields.CPUCost, 10, out);
+			*out++ = '$';
+			out = WriteNumber(Fields.BlockSize, 10, out);
+			*out++ = '$';
+			out = WriteNumber(Fields.Parallelism, 10, out);
+		}
+		else
+			out = WriteNumber(Fields.CPUCost << 16 | Fields.BlockSize << 8 | Fields.Parallelism, 16, out);
+		*out++ = '$';
+		out = Base64Encode(Fields.Salt, Fields.SaltLength, out);
+		*out++ = '$';
+		out = Base64Encode(Fields.Hash, Fields.HashLength, out);
+		return (size_t)(out - Text);
+	}
+
+	static void Put32(uint8_t* p, uint32_t v)
+	{
+		p[0] = (uint8_t)v; p[1] = (uint8_t)(v >> 8); p[2] = (uint8_t)(v >> 16); p[3] = (uint8_t)(v >> 24);
+	}
+
+	static uint32_t Get32(const uint8_t* p)
+	{
+		return (uint32_t)p[0] | (uint32_t)p[1] << 8 | (uint32_t)p[2] << 16 | (uint32_t)p[3] << 24;
+	}
+
+	bool HashCodec::WriteRecord(const HashFields& Fields, uint8_t* Record)
+	{
+		if (Record == nullptr || Fields.Version > 0xff || Fields.CPUCost < 2 || (Fields.CPUCost & (Fields.CPUCost - 1)) != 0 ||
+			Fields.Salt == nullptr || Fields.SaltLength == 0 || Fields.SaltLength > RecordMaxSalt ||
+			Fields.Hash == nullptr || Fields.HashLength == 0 || Fields.HashLength > RecordMaxHash)
+			return false;
+		uint8_t log2N = 0;
+		while (((uint64_t)1 << log2N) != Fields.CPUCost)
+			log2N++;
+		memset(Record, 0, RecordSize);
+		Record[0] = (uint8_t)Fields.Version;
+		Record[1] = log2N;
+		Record[2] = (uint8_t)Fields.SaltLength;
+		Record[3] = (uint8_t)Fields.HashLength;
+		Put32(Record + 4, Fields.BlockSize);
+		Put32(Record + 8, Fields.Parallelism);
+		memcpy(Record + 16, Fields.Salt, Fields.SaltLength);
+		memcpy(Record + 16 + RecordMaxSalt, Fields.Hash, Fields.HashLength);
+		return true;
+	}
+
+	bool HashCodec::ReadRecord(const uint8_t* Record, HashFields& Fields)
+	{
+		if (Record == nullptr || Record[1] == 0 || Record[1] > 63 || Record[2] == 0 || Record[2] > RecordMaxSalt ||
+			Record[3] == 0 || Record[3] > RecordMaxHash || Get32(Record + 12) != 0)
+			return false;
+		Fields.Version = Record[0];
+		Fields.CPUCost = (uint64_t)1 << Record[1];
+		Fields.BlockSize = Get32(Record + 4);
+		Fields.Parallelism = Get32(Record + 8);
+		Fields.Salt = Record + 16;
+		Fields.SaltLength = Record[2];
+		Fields.Hash = Record + 16 + RecordMaxSalt;
+		Fields.HashLength = Record[3];
+		return true;
+	}
+
+	size_t HashCodec::ReadRecords(const uint8_t* Records, size_t Count, HashFields* Fields, bool* Valid)
+	{
+		size_t read = 0;
+		for (size_t i = 0; i < Count; i++)
+		{
+			Valid[i] = ReadRecord(Records + i * RecordSize, Fields[i]);
+			read += Valid[i];
+		}
+		return read;
+	}
+}
@@ -0,0 +1,69 @@
+#pragma once
+
+/* Copyright (c) 2017, Dustin J Sparks
+*
+* PUBLIC DOMAIN MARK
+*
+* While this work is free from any patent or intellectual property claims, the algorithm, pseudo-code, and test vectors were derived from
+* RFC 7914 "The scrypt Password-Based Key Derivation Function" (C. Percival, August 2016, ISSN: 2070-1721)
+*
+* From the RFC:
+* Copyright (c) 2016 IETF Trust and the persons identified as the
+* document authors. All rights reserved.
+* This document is subject to BCP 78 and the IETF Trusts Legal Provisions Relating to IETF Documents (http://trustee.ietf.org/license-info)
+* in effect on the date of publication of this document. Please review these documents carefully, as they describe your rights and restrictions
+* with respect to this document. Code Components extracted from this document must include Simplified BSD License text as described in Section 4.e of
+* the Trust Legal Provisions and are provided without warranty as described in the Simplified BSD License.
+*
+* Unless required by applicable law or agreed to in writing, software
+* distributed under the License is distributed on an "AS IS" BASIS,
+* WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+* See the License for the specific language governing permissions and
+* limitations under the License.
+*/
+
+#include <atomic>
+#include <cstdint>
+#include "ScryptNative.h"
+
+// Internal side of ScryptNative::Metrics, included by the translation units that feed it
+namespace ScryptNative
+{
+	extern std::atomic<bool> metricsEnabled;
+
+	static inline bool MetricsOn()
+	{
+		return metricsEnabled.load(std::memory_order_relaxed);
+	}
+
+	// A point in time on the steady clock and the time stamp counter
+	struct Stamp
+	{
+		uint64_t ns;
+		uint64_t cycles;
+		static Stamp Now();
+	};
+
+	// Gathers one call's phase times from every thread working on it, and publishes them (counters and callback) in Finish
+	class CallRecorder
+	{
+		std::atomic<uint64_t> ns[Metrics::PhaseCount];
+		std::atomic<uint64_t> cycles[Metrics::PhaseCount];
+		Metrics::Call call;
+		Stamp start;
+	public:
+		CallRecorder(uint64_t N, uint32_t BlockSize, uint32_t Parallelism, uint64_t Hashes, uint32_t Threads, bool Batch, uint64_t VBytes);
+		// Adds the time since From to Phase and returns now, so phases can be chained
+		Stamp Add(Metrics::Phase Phase, const Stamp& From);
+		void Finish();
+	};
+
+	// Time the current thread's job waited in a scheduler queue, picked up (and cleared) by the next CallRecorder on that thread
+	void SetQueueWait(uint64_t Nanoseconds);
+
+	void RecordVAllocated(size_t Bytes);
+	void RecordVReleased(size_t Bytes);
+	void RecordVWiped(size_t Bytes);
+	void RecordQueued(size_t Depth);
+	void RecordPBKDF2(const Stamp& From);
+}
@@ -0,0 +1,68 @@
+/* Copyright (c) 2017, Dustin J Sparks
+*
+* PUBLIC DOMAIN MARK
+*
+* While this work is free from any patent or intellectual property claims, the algorithm, pseudo-code, and test vectors were derived from
+* RFC 7914 "The scrypt Password-Based Key Derivation Function" (C. Percival, August 2016, ISSN: 2070-1721)
+*
+* From the RFC:
+* Copyright (c) 2016 IETF Trust and the persons identified as the
+* document authors. All rights reserved.
+* This document is subject to BCP 78 and the IETF Trusts Legal Provisions Relating to IETF Documents (http://trustee.ietf.org/license-info)
+* in effect on the date of publication of this document. Please review these documents carefully, as they describe your rights and restrictions
+* with respect to this document. Code Components extracted from this document must include Simplified BSD License text as described in Section 4.e of
+* the Trust Legal Provisions and are provided without warranty as described in the Simplified BSD License.
+*
+* Unless required by applicable law or agreed to in writing, software
+* distributed under the License is distributed on an "AS IS" BASIS,
+* WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+* See the License for the specific language governing permissions and
+* limitations under the License.
+*/
+
+#include "Dispatch.h"
+#if defined(__AVX2__) || (defined(_MSC_VER) && (defined(_M_X64) || defined(_M_IX86)))
+#include <immintrin.h>
+#include "SalsaLanes.h"
+#include "SHALanes.h"
+
+// 8 lanes, built with -mavx2 (CMakeLists.txt) or /arch:AVX2 (ScryptManaged.vcxproj), run only when cpuid reports AVX2
+
+namespace ScryptNative
+{
+	struct LanesAVX2
+	{
+		typedef __m256i V;
+		static const uint32_t L = 8;
+		static const uint32_t VStride = 1;
+		static inline V add(V a, V b) { return _mm256_add_epi32(a, b); }
+		static inline V xor_(V a, V b) { return _mm256_xor_si256(a, b); }
+		static inline V and_(V a, V b) { return _mm256_and_si256(a, b); }
+		static inline V andnot(V a, V b) { return _mm256_andnot_si256(a, b); }
+		static inline V set1(uint32_t a) { return _mm256_set1_epi32((int)a); }
+		template <int n> static inline V shr(V a) { return _mm256_srli_epi32(a, n); }
+		template <int n> static inline V rotl(V a) { return _mm256_xor_si256(_mm256_slli_epi32(a, n), _mm256_srli_epi32(a, 32 - n)); }
+		static inline V load(const V* p) { return _mm256_load_si256(p); }
+		static inline void store(V* p, V a) { _mm256_store_si256(p, a); }
+		static inline V gather(const uint32_t* base, const uint32_t* idx)
+		{
+			return _mm256_i32gather_epi32((const int*)base, _mm256_loadu_si256((const __m256i*)idx), 4);
+		}
+		static inline void scatter(uint32_t* base, const uint32_t* idx, V a) // AVX2 has no scatter
+		{
+			alignas(32) uint32_t w[8];
+			_mm256_store_si256((V*)w, a);
+			for (int k = 0; k < 8; k++) base[idx[k]] = w[k];
+		}
+	};
+
+	static const LaneKernelSet kernels = { "AVX2", LanesAVX2::L, LaneKernels<LanesAVX2>::Fill, LaneKernels<LanesAVX2>::Mix, SHA256Lanes<LanesAVX2>::F };
+
+	const LaneKernelSet* LaneKernelsAVX2() { return &kernels; }
+}
+#else
+namespace ScryptNative
+{
+	const LaneKernelSet* LaneKernelsAVX2() { return nullptr; }
+}
+#endif
@@ -0,0 +1,70 @@
+/* Copyright (c) 2017, Dustin J Sparks
+*
+* PUBLIC DOMAIN MARK
+*
+* While this work is free from any patent or intellectual property claims, the algorithm, pseudo-code, and test vectors were derived from
+* RFC 7914 "The scrypt Password-Based Key Derivation Function" (C. Percival, August 2016, ISSN: 2070-1721)
+*
+* From the RFC:
+* Copyright (c) 2016 IETF Trust and the persons identified as the
+* document authors. All rights reserved.
+* This document is subject to BCP 78 and the IETF Trusts Legal Provisions Relating to IETF Documents (http://trustee.ietf.org/license-info)
+* in effect on the date of publication of this document. Please review these documents carefully, as they describe your rights and restrictions
+* with respect to this document. Code Components extracted from this document must include Simplified BSD License text as described in Section 4.e of
+* the Trust Legal Provisions and are provided without warranty as described in the Simplified BSD License.
+*
+* Unless required by applicable law or agreed to in writing, software
+* distributed under the License is distributed on an "AS IS" BASIS,
+* WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+* See the License for the specific language governing permissions and
+* limitations under the License.
+*/
+
+#include "Dispatch.h"
+#if defined(__AVX512F__) || (defined(_MSC_VER) && _MSC_VER >= 1911 && defined(_M_X64))
+#include <immintrin.h>
+#if defined(__GNUC__) && !defined(__clang__)
+#pragma GCC diagnostic ignored "-Wuninitialized" // GCC 12 flags the _mm512_undefined_epi32() inside the gather / scatter intrinsics
+#pragma GCC diagnostic ignored "-Wmaybe-uninitialized"
+#endif
+#include "SalsaLanes.h"
+#include "SHALanes.h"
+
+// 16 lanes with native rotates and scatters, built with -mavx512f, run only when cpuid reports AVX-512F
+
+namespace ScryptNative
+{
+	struct LanesAVX512
+	{
+		typedef __m512i V;
+		static const uint32_t L = 16;
+		static const uint32_t VStride = 1;
+		static inline V add(V a, V b) { return _mm512_add_epi32(a, b); }
+		static inline V xor_(V a, V b) { return _mm512_xor_si512(a, b); }
+		static inline V and_(V a, V b) { return _mm512_and_si512(a, b); }
+		static inline V andnot(V a, V b) { return _mm512_andnot_si512(a, b); }
+		static inline V set1(uint32_t a) { return _mm512_set1_epi32((int)a); }
+		template <int n> static inline V shr(V a) { return _mm512_srli_epi32(a, n); }
+		template <int n> static inline V rotl(V a) { return _mm512_rol_epi32(a, n); }
+		static inline V load(const V* p) { return _mm512_load_si512(p); }
+		static inline void store(V* p, V a) { _mm512_store_si512(p, a); }
+		static inline V gather(const uint32_t* base, const uint32_t* idx)
+		{
+			return _mm512_i32gather_epi32(_mm512_loadu_si512(idx), base, 4);
+		}
+		static inline void scatter(uint32_t* base, const uint32_t* idx, V a)
+		{
+			_mm512_i32scatter_epi32(base, _mm512_loadu_si512(idx), a, 4);
+		}
+	};
+
+	static const LaneKernelSet kernels = { "AVX-512", LanesAVX512::L, LaneKernels<LanesAVX512>::Fill, LaneKernels<LanesAVX512>::Mix, SHA256Lanes<LanesAVX512>::F };
+
+	const LaneKernelSet* LaneKernelsAVX512() { return &kernels; }
+}
+#else
+namespace ScryptNative
+{
+	const LaneKernelSet* LaneKernelsAVX512() { return nullptr; }
+}
+#endif
@@ -0,0 +1,63 @@
+/* Copyright (c) 2017, Dustin J Sparks
+*
+* PUBLIC DOMAIN MARK
+*
+* While this work is free from any patent or intellectual property claims, the algorithm, pseudo-code, and test vectors were derived from
+* RFC 7914 "The scrypt Password-Based Key Derivation Function" (C. Percival, August 2016, ISSN: 2070-1721)
+*
+* From the RFC:
+* Copyright (c) 2016 IETF Trust and the persons identified as the
+* document authors. All rights reserved.
+* This document is subject to BCP 78 and the IETF Trusts Legal Provisions Relating to IETF Documents (http://trustee.ietf.org/license-info)
+* in effect on the date of publication of this document. Please review these documents carefully, as they describe your rights and restrictions
+* with respect to this document. Code Components extracted from this document must include Simplified BSD License text as described in Section 4.e of
+* the Trust Legal Provisions and are provided without warranty as described in the Simplified BSD License.
+*
+* Unless required by applicable law or agreed to in writing, software
+* distributed under the License is distributed on an "AS IS" BASIS,
+* WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+* See the License for the specific language governing permissions and
+* limitations under the License.
+*/
+
+#include "Dispatch.h"
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#include "SalsaLanes.h"
+#include "SHALanes.h"
+
+// 4 lanes, part of every x64 target
+
+namespace ScryptNative
+{
+	struct LanesSSE2
+	{
+		typedef __m128i V;
+		static const uint32_t L = 4;
+		static const uint32_t VStride = 4;
+		static inline V add(V a, V b) { return _mm_add_epi32(a, b); }
+		static inline V xor_(V a, V b) { return _mm_xor_si128(a, b); }
+		static inline V and_(V a, V b) { return _mm_and_si128(a, b); }
+		static inline V andnot(V a, V b) { return _mm_andnot_si128(a, b); } // ~a & b
+		static inline V set1(uint32_t a) { return _mm_set1_epi32((int)a); }
+		template <int n> static inline V shr(V a) { return _mm_srli_epi32(a, n); }
+		template <int n> static inline V rotl(V a) { return _mm_xor_si128(_mm_slli_epi32(a, n), _mm_srli_epi32(a, 32 - n)); }
+		static inline V load(const V* p) { return _mm_load_si128(p); }
+		static inline void store(V* p, V a) { _mm_store_si128(p, a); }
+		static inline V gather(const uint32_t* base, const uint32_t* idx)
+		{
+			return _mm_set_epi32((int)base[idx[3]], (int)base[idx[2]], (int)base[idx[1]], (int)base[idx[0]]);
+		}
+		static inline void scatter(uint32_t* base, const uint32_t*, V a) { _mm_store_si128((V*)base, a); } // transposed V
+	};
+
+	static const LaneKernelSet kernels = { "SSE2", LanesSSE2::L, LaneKernels<LanesSSE2>::Fill, LaneKernels<LanesSSE2>::Mix, SHA256Lanes<LanesSSE2>::F };
+
+	const LaneKernelSet* LaneKernelsSSE2() { return &kernels; }
+}
+#else
+namespace ScryptNative
+{
+	const LaneKernelSet* LaneKernelsSSE2() { return nullptr; }
+}
+#endif
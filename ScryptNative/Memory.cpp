@@ -0,0 +1,299 @@
+/* Copyright (c) 2017, Dustin J Sparks
+*
+* PUBLIC DOMAIN MARK
+*
+* While this work is free from any patent or intellectual property claims, the algorithm, pseudo-code, and test vectors were derived from
+* RFC 7914 "The scrypt Password-Based Key Derivation Function" (C. Percival, August 2016, ISSN: 2070-1721)
+*
+* From the RFC:
+* Copyright (c) 2016 IETF Trust and the persons identified as the
+* document authors. All rights reserved.
+* This document is subject to BCP 78 and the IETF Trusts Legal Provisions Relating to IETF Documents (http://trustee.ietf.org/license-info)
+* in effect on the date of publication of this document. Please review these documents carefully, as they describe your rights and restrictions
+* with respect to this document. Code Components extracted from this document must include Simplified BSD License text as described in Section 4.e of
+* the Trust Legal Provisions and are provided without warranty as described in the Simplified BSD License.
+*
+* Unless required by applicable law or agreed to in writing, software
+* distributed under the License is distributed on an "AS IS" BASIS,
+* WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+* See the License for the specific language governing permissions and
+* limitations under the License.
+*/
+
+#include <cerrno>
+#include <new>
+#include <stdexcept>
+#include <string>
+#include <system_error>
+#if defined(_WIN32)
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <stdlib.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
+#include "Instrument.h"
+#include "Memory.h"
+#include "Numa.h"
+#include "Salsa.h" // SCRYPT_SSE2
+#include "ScryptNative.h"
+
+namespace ScryptNative
+{
+	static const size_t HugePageBytes = 2 * 1024 * 1024;
+
+	static inline size_t RoundUp(size_t value, size_t unit)
+	{
+		return (value + unit - 1) / unit * unit;
+	}
+
+	void StreamZero(void* data, size_t length)
+	{
+#if SCRYPT_SSE2
+		__m128i zero = _mm_setzero_si128();
+		__m128i* p = (__m128i*)data;
+		for (size_t i = 0; i < length / 64; i++, p += 4)
+		{
+			_mm_stream_si128(p, zero); _mm_stream_si128(p + 1, zero); _mm_stream_si128(p + 2, zero); _mm_stream_si128(p + 3, zero);
+		}
+		_mm_sfence(); // the streaming stores are weakly ordered, finish them before the memory is reused or released
+		SecureZero((uint8_t*)data + (length & ~(size_t)63), length & 63);
+#else
+		SecureZero(data, length);
+#endif
+	}
+
+#if defined(_WIN32)
+	// On the node of the allocating thread's NodePin, if any
+	static void* allocate(size_t size, DWORD type)
+	{
+		int node = PinnedNode();
+		if (node >= 0)
+			return VirtualAllocExNuma(GetCurrentProcess(), nullptr, size, type, PAGE_READWRITE, NodeId(node));
+		return VirtualAlloc(nullptr, size, type, PAGE_READWRITE);
+	}
+#endif
+
+	BlockBuffer::BlockBuffer(size_t words, uint32_t flags) : raw(nullptr), size(0), huge(false), locked(false), data(nullptr), words(words)
+	{
+		size_t bytes = words * sizeof(uint32_t);
+#if defined(_WIN32)
+		SIZE_T large = GetLargePageMinimum();
+		if ((flags & ScryptContext::HugePages) && large != 0) // needs SeLockMemoryPrivilege, quietly falls back without it
+		{
+			size = RoundUp(bytes, large);
+			raw = allocate(size, MEM_COMMIT | MEM_RESERVE | MEM_LARGE_PAGES);
+			huge = raw != nullptr;
+		}
+		if (raw == nullptr)
+		{
+			size = RoundUp(bytes, 4096);
+			raw = allocate(size, MEM_COMMIT | MEM_RESERVE);
+		}
+		if (raw == nullptr)
+			throw std::bad_alloc();
+		data = (uint32_t*)raw;
+		if (flags & ScryptContext::LockMemory)
+			locked = VirtualLock(raw, size) != 0;
+#else
+		size_t page = (size_t)sysconf(_SC_PAGESIZE);
+#ifdef MAP_HUGETLB
+		if (flags & ScryptContext::HugePages) // needs pages reserved in /proc/sys/vm/nr_hugepages, quietly falls back without them
+		{
+			size = RoundUp(bytes, HugePageBytes);
+			raw = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+			huge = raw != MAP_FAILED;
+			if (!huge) raw = nullptr;
+		}
+#endif
+		if (raw == nullptr)
+		{
+			// large buffers are reserved in whole huge pages plus one, so data can start on a 2 MiB boundary and the huge pages
+			// advised below (the last one included) lie inside the mapping; that is what lets the kernel back V with transparent
+			// huge pages (the slack is address space only, never touched)
+			bool thp = bytes >= HugePageBytes;
+			size = thp ? RoundUp(bytes, HugePageBytes) + HugePageBytes : RoundUp(bytes, page);
+			raw = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+			if (raw == MAP_FAILED)
+			{
+				raw = nullptr;
+				throw std::bad_alloc();
+			}
+			data = (uint32_t*)(thp ? RoundUp((size_t)raw, HugePageBytes) : (size_t)raw);
+#ifdef MADV_HUGEPAGE
+			if (thp)
+				madvise(data, RoundUp(bytes, HugePageBytes), MADV_HUGEPAGE);
+#endif
+		}
+		else
+			data = (uint32_t*)raw;
+		if (PinnedNode() >= 0) // before mlock, which faults every page in
+			PreferNode(data, RoundUp(bytes, page), PinnedNode());
+		if (flags & ScryptContext::LockMemory)
+			locked = mlock(data, bytes) == 0;
+#endif
+		RecordVAllocated(bytes);
+	}
+
+	BlockBuffer::~BlockBuffer()
+	{
+		Wipe(); // secure memory (or at least try)
+#if defined(_WIN32)
+		if (locked) VirtualUnlock(raw, size);
+		VirtualFree(raw, 0, MEM_RELEASE);
+#else
+		if (locked) munlock(data, words * sizeof(uint32_t));
+		munmap(raw, size);
+#endif
+		RecordVReleased(words * sizeof(uint32_t));
+	}
+
+	void BlockBuffer::Wipe()
+	{
+		StreamZero(data, words * sizeof(uint32_t));
+		RecordVWiped(words * sizeof(uint32_t));
+	}
+
+	MappedBuffer::MappedBuffer(uint64_t bytes, const char* Directory, bool Wipe) : raw(nullptr), size(bytes), wipe(Wipe), data(nullptr)
+	{
+		if (bytes > (uint64_t)(SIZE_MAX / 2))
+			throw std::bad_alloc(); // 32 bit address space
+#if defined(_WIN32)
+		file = nullptr;
+		mapping = nullptr;
+		if (Directory != nullptr)
+		{
+			char path[MAX_PATH];
+			if (GetTempFileNameA(Directory, "scr", 0, path) == 0)
+				throw std::runtime_error("Cannot create a scratch file in ScratchDirectory.");
+			HANDLE h = CreateFileA(path, GENERIC_READ | GENERIC_WRITE, 0, nullptr, CREATE_ALWAYS,
+				FILE_ATTRIBUTE_TEMPORARY | FILE_FLAG_DELETE_ON_CLOSE, nullptr);
+			if (h == INVALID_HANDLE_VALUE)
+			{
+				DeleteFileA(path);
+				throw std::runtime_error("Cannot create a scratch file in ScratchDirectory.");
+			}
+			file = h;
+			// extends the file to its full size, failing now when the disk is too small
+			mapping = CreateFileMappingA(h, nullptr, PAGE_READWRITE, (DWORD)(bytes >> 32), (DWORD)bytes, nullptr);
+			if (mapping != nullptr)
+				raw = MapViewOfFile(mapping, FILE_MAP_ALL_ACCESS, 0, 0, (SIZE_T)bytes);
+			if (raw == nullptr)
+			{
+				if (mapping != nullptr) CloseHandle(mapping);
+				CloseHandle(h);
+				throw std::runtime_error("Cannot map a scratch file of that size.");
+			}
+		}
+		else if ((raw = VirtualAlloc(nullptr, (SIZE_T)bytes, MEM_COMMIT | MEM_RESERVE, PAGE_READWRITE)) == nullptr)
+			throw std::bad_alloc();
+#else
+		fd = -1;
+		if (Directory != nullptr)
+		{
+#if defined(O_TMPFILE)
+			fd = open(Directory, O_TMPFILE | O_RDWR | O_EXCL | O_CLOEXEC, 0600); // never has a name
+#endif
+			if (fd < 0) // no O_TMPFILE here, or not on this file system
+			{
+				std::string path = std::string(Directory) + "/scrypt-XXXXXX";
+				fd = mkstemp(&path[0]);
+				if (fd >= 0)
+					unlink(path.c_str());
+			}
+			if (fd < 0)
+				throw std::system_error(errno, std::generic_category(), "Cannot create a scratch file in ScratchDirectory");
+#if defined(__APPLE__)
+			int error = ftruncate(fd, (off_t)bytes) == 0 ? 0 : errno; // sparse, no posix_fallocate
+#else
+			int error = posix_fallocate(fd, 0, (off_t)bytes);
+#endif
+			if (error == 0)
+				raw = mmap(nullptr, (size_t)bytes, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+			if (error != 0 || raw == MAP_FAILED)
+			{
+				if (error == 0)
+					error = errno;
+				close(fd);
+				throw std::system_error(error, std::generic_category(), "Cannot allocate the scratch file");
+			}
+		}
+		else
+		{
+			raw = mmap(nullptr, (size_t)bytes, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+			if (raw == MAP_FAILED)
+				throw std::bad_alloc();
+		}
+#endif
+		data = (uint32_t*)raw;
+		RecordVAllocated((size_t)bytes);
+	}
+
+	MappedBuffer::~MappedBuffer()
+	{
+		if (wipe)
+		{
+			StreamZero(data, (size_t)size);
+			RecordVWiped((size_t)size);
+		}
+#if defined(_WIN32)
+		if (mapping != nullptr)
+		{
+			UnmapViewOfFile(raw);
+			CloseHandle(mapping);
+			CloseHandle(file); // deletes it
+		}
+		else
+			VirtualFree(raw, 0, MEM_RELEASE);
+#else
+		munmap(raw, (size_t)size);
+		if (fd >= 0)
+			close(fd); // the last reference to an unlinked file, its blocks and dirty pages are dropped unwritten
+#endif
+		RecordVReleased((size_t)size);
+	}
+
+	void MappedBuffer::Sequential()
+	{
+#if defined(MADV_SEQUENTIAL)
+		madvise(raw, (size_t)size, MADV_SEQUENTIAL);
+#endif
+	}
+
+	void MappedBuffer::Random()
+	{
+#if defined(MADV_RANDOM)
+		madvise(raw, (size_t)size, MADV_RANDOM);
+#endif
+	}
+
+	void MappedBuffer::WriteBehind(uint64_t Offset, uint64_t Length)
+	{
+#if defined(_WIN32)
+		if (mapping != nullptr)
+			FlushViewOfFile((uint8_t*)raw + Offset, (SIZE_T)Length);
+#else
+		if (fd < 0)
+			return; // anonymous memory goes to swap when the kernel decides
+#if defined(__linux__) && defined(SYNC_FILE_RANGE_WRITE)
+		sync_file_range(fd, (off_t)Offset, (off_t)Length, SYNC_FILE_RANGE_WRITE);
+#else
+		size_t page = (size_t)sysconf(_SC_PAGESIZE);
+		uint64_t first = Offset / page * page;
+		msync((uint8_t*)raw + first, (size_t)(Offset + Length - first), MS_ASYNC);
+#endif
+#endif
+	}
+
+	void MappedBuffer::ReadAhead(uint64_t Offset, uint64_t Length)
+	{
+#if defined(MADV_WILLNEED)
+		size_t page = (size_t)sysconf(_SC_PAGESIZE);
+		uint64_t first = Offset / page * page;
+		madvise((uint8_t*)raw + first, (size_t)(Offset + Length - first), MADV_WILLNEED);
+#else
+		(void)Offset; (void)Length;
+#endif
+	}
+}
@@ -0,0 +1,89 @@
+#pragma once
+
+/* Copyright (c) 2017, Dustin J Sparks
+*
+* PUBLIC DOMAIN MARK
+*
+* While this work is free from any patent or intellectual property claims, the algorithm, pseudo-code, and test vectors were derived from
+* RFC 7914 "The scrypt Password-Based Key Derivation Function" (C. Percival, August 2016, ISSN: 2070-1721)
+*
+* From the RFC:
+* Copyright (c) 2016 IETF Trust and the persons identified as the
+* document authors. All rights reserved.
+* This document is subject to BCP 78 and the IETF Trusts Legal Provisions Relating to IETF Documents (http://trustee.ietf.org/license-info)
+* in effect on the date of publication of this document. Please review these documents carefully, as they describe your rights and restrictions
+* with respect to this document. Code Components extracted from this document must include Simplified BSD License text as described in Section 4.e of
+* the Trust Legal Provisions and are provided without warranty as described in the Simplified BSD License.
+*
+* Unless required by applicable law or agreed to in writing, software
+* distributed under the License is distributed on an "AS IS" BASIS,
+* WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+* See the License for the specific language governing permissions and
+* limitations under the License.
+*/
+
+#include "Common.h"
+
+namespace ScryptNative
+{
+	// Page backed, 64 byte aligned scratch for V/X/Y (mmap on POSIX, VirtualAlloc on Windows), wiped before it is released.
+	// Not zero filled on purpose: every word of V is written by ROMix before it is read.
+	// Flags are ScryptContext::HugePages and ScryptContext::LockMemory; both are best effort, see HugePages() and Locked().
+	// Without HugePages, buffers of 2 MiB and more are aligned for and advised to use transparent huge pages.
+	// A buffer allocated on a thread pinned to a NUMA node (NodePin, Numa.h) is bound to that node.
+	class BlockBuffer
+	{
+		void* raw;
+		size_t size;
+		bool huge;
+		bool locked;
+	public:
+		uint32_t* data;
+		size_t words;
+		explicit BlockBuffer(size_t words, uint32_t flags = 0);
+		~BlockBuffer();
+		BlockBuffer(const BlockBuffer&) = delete;
+		BlockBuffer& operator=(const BlockBuffer&) = delete;
+
+		// Zeroes all words with non-temporal stores, so a multi-MB wipe does not evict the caller's working set
+		void Wipe();
+		// True when backed by explicit huge pages (MAP_HUGETLB / MEM_LARGE_PAGES)
+		bool HugePages() const { return huge; }
+		// True when locked in RAM (mlock / VirtualLock), V then never reaches the swap file
+		bool Locked() const { return locked; }
+	};
+
+	// Scratch for one lane of Scrypt::ComputeDerivedHashLarge, sized in 64 bits and possibly larger than RAM: a mapping of an
+	// unnamed scratch file in Directory, allocated on disk up front so a full disk fails here instead of faulting in ROMix, or
+	// with Directory = nullptr an anonymous mapping that only swap backs.  The hints are no-ops where the platform has none.
+	// Wiped unless Wipe is false; the file has no name and disappears with the buffer either way.
+	class MappedBuffer
+	{
+		void* raw;
+		uint64_t size;
+		bool wipe;
+#if defined(_WIN32)
+		void* file;
+		void* mapping;
+#else
+		int fd;
+#endif
+	public:
+		uint32_t* data;
+		MappedBuffer(uint64_t bytes, const char* Directory, bool Wipe);
+		~MappedBuffer();
+		MappedBuffer(const MappedBuffer&) = delete;
+		MappedBuffer& operator=(const MappedBuffer&) = delete;
+
+		// Access pattern of what follows: written front to back, or read at random
+		void Sequential();
+		void Random();
+		// Bytes [Offset, Offset + Length) are final, starts writing them back to the file without waiting for it
+		void WriteBehind(uint64_t Offset, uint64_t Length);
+		// Bytes [Offset, Offset + Length) are read soon, starts reading them in without waiting for it
+		void ReadAhead(uint64_t Offset, uint64_t Length);
+	};
+
+	// Zeroes length bytes at data (64 byte aligned) bypassing the caches where the target has streaming stores
+	void StreamZero(void* data, size_t length);
+}
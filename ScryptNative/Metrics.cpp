@@ -0,0 +1,217 @@
+/* Copyright (c) 2017, Dustin J Sparks
+*
+* PUBLIC DOMAIN MARK
+*
+* While this work is free from any patent or intellectual property claims, the algorithm, pseudo-code, and test vectors were derived from
+* RFC 7914 "The scrypt Password-Based Key Derivation Function" (C. Percival, August 2016, ISSN: 2070-1721)
+*
+* From the RFC:
+* Copyright (c) 2016 IETF Trust and the persons identified as the
+* document authors. All rights reserved.
+* This document is subject to BCP 78 and the IETF Trusts Legal Provisions Relating to IETF Documents (http://trustee.ietf.org/license-info)
+* in effect on the date of publication of this document. Please review these documents carefully, as they describe your rights and restrictions
+* with respect to this document. Code Components extracted from this document must include Simplified BSD License text as described in Section 4.e of
+* the Trust Legal Provisions and are provided without warranty as described in the Simplified BSD License.
+*
+* Unless required by applicable law or agreed to in writing, software
+* distributed under the License is distributed on an "AS IS" BASIS,
+* WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+* See the License for the specific language governing permissions and
+* limitations under the License.
+*/
+
+#include <chrono>
+#include <mutex>
+#include "Instrument.h"
+#include "Salsa.h"
+#if defined(_MSC_VER)
+#include <intrin.h>
+#elif defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
+
+namespace ScryptNative
+{
+	std::atomic<bool> metricsEnabled(false);
+
+	static struct
+	{
+		std::atomic<uint64_t> calls, hashes, wall, blockMix, salsa, pbkdf2Calls, pbkdf2Ns;
+		std::atomic<uint64_t> ns[Metrics::PhaseCount], cycles[Metrics::PhaseCount];
+		std::atomic<uint64_t> vAllocated, vWiped, vInUse, vHighWater;
+		std::atomic<uint64_t> jobsQueued, queueNs, queueHighWater;
+	} totals;
+
+	static std::mutex callbackLock;
+	static Metrics::Callback callback = nullptr;
+	static void* callbackContext = nullptr;
+	static thread_local uint64_t queueWait = 0;
+
+	static void RaiseTo(std::atomic<uint64_t>& mark, uint64_t value)
+	{
+		uint64_t seen = mark.load(std::memory_order_relaxed);
+		while (value > seen && !mark.compare_exchange_weak(seen, value, std::memory_order_relaxed)) {}
+	}
+
+	Stamp Stamp::Now()
+	{
+		Stamp s;
+		s.ns = (uint64_t)std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+#if defined(_M_X64) || defined(_M_IX86) || defined(__x86_64__) || defined(__i386__)
+		s.cycles = __rdtsc();
+#else
+		s.cycles = 0;
+#endif
+		return s;
+	}
+
+	CallRecorder::CallRecorder(uint64_t N, uint32_t BlockSize, uint32_t Parallelism, uint64_t Hashes, uint32_t Threads, bool Batch, uint64_t VBytes)
+		: call(), start(Stamp::Now())
+	{
+		for (int p = 0; p < Metrics::PhaseCount; p++)
+		{
+			ns[p] = 0;
+			cycles[p] = 0;
+		}
+		call.CPUCost = N;
+		call.BlockSize = BlockSize;
+		call.Parallelism = Parallelism;
+		call.Threads = Threads;
+		call.Hashes = Hashes;
+		call.Batch = Batch;
+		call.VBytes = VBytes;
+		call.QueueNanoseconds = queueWait;
+		queueWait = 0;
+	}
+
+	Stamp CallRecorder::Add(Metrics::Phase Phase, const Stamp& From)
+	{
+		Stamp now = Stamp::Now();
+		ns[Phase].fetch_add(now.ns - From.ns, std::memory_order_relaxed);
+		cycles[Phase].fetch_add(now.cycles - From.cycles, std::memory_order_relaxed);
+		return now;
+	}
+
+	void CallRecorder::Finish()
+	{
+		call.WallNanoseconds = Stamp::Now().ns - start.ns;
+		for (int p = 0; p < Metrics::PhaseCount; p++)
+		{
+			call.Nanoseconds[p] = ns[p];
+			call.Cycles[p] = cycles[p];
+			totals.ns[p].fetch_add(call.Nanoseconds[p], std::memory_order_relaxed);
+			totals.cycles[p].fetch_add(call.Cycles[p], std::memory_order_relaxed);
+		}
+		// ROMix runs 2N BlockMix per lane, each of them 2r Salsa20/8
+		uint64_t blockMix = 2 * call.CPUCost * call.Parallelism * call.Hashes;
+		totals.calls.fetch_add(1, std::memory_order_relaxed);
+		totals.hashes.fetch_add(call.Hashes, std::memory_order_relaxed);
+		totals.wall.fetch_add(call.WallNanoseconds, std::memory_order_relaxed);
+		totals.blockMix.fetch_add(blockMix, std::memory_order_relaxed);
+		totals.salsa.fetch_add(blockMix * 2 * call.BlockSize, std::memory_order_relaxed);
+
+		Metrics::Callback function;
+		void* context;
+		{
+			std::lock_guard<std::mutex> guard(callbackLock);
+			function = callback;
+			context = callbackContext;
+		}
+		if (function != nullptr)
+			function(call, context);
+	}
+
+	void SetQueueWait(uint64_t Nanoseconds)
+	{
+		queueWait = Nanoseconds;
+		totals.queueNs.fetch_add(Nanoseconds, std::memory_order_relaxed);
+	}
+
+	void RecordVAllocated(size_t Bytes)
+	{
+		totals.vAllocated.fetch_add(Bytes, std::memory_order_relaxed);
+		RaiseTo(totals.vHighWater, totals.vInUse.fetch_add(Bytes, std::memory_order_relaxed) + Bytes);
+	}
+
+	void RecordVReleased(size_t Bytes)
+	{
+		totals.vInUse.fetch_sub(Bytes, std::memory_order_relaxed);
+	}
+
+	void RecordVWiped(size_t Bytes)
+	{
+		totals.vWiped.fetch_add(Bytes, std::memory_order_relaxed);
+	}
+
+	void RecordQueued(size_t Depth)
+	{
+		totals.jobsQueued.fetch_add(1, std::memory_order_relaxed);
+		RaiseTo(totals.queueHighWater, Depth);
+	}
+
+	void RecordPBKDF2(const Stamp& From)
+	{
+		totals.pbkdf2Calls.fetch_add(1, std::memory_order_relaxed);
+		totals.pbkdf2Ns.fetch_add(Stamp::Now().ns - From.ns, std::memory_order_relaxed);
+	}
+
+	void Metrics::Enable(bool On)
+	{
+		metricsEnabled = On;
+	}
+
+	bool Metrics::Enabled()
+	{
+		return MetricsOn();
+	}
+
+	Metrics::Counters Metrics::Snapshot()
+	{
+		Counters c;
+		c.Calls = totals.calls;
+		c.Hashes = totals.hashes;
+		for (int p = 0; p < PhaseCount; p++)
+		{
+			c.Nanoseconds[p] = totals.ns[p];
+			c.Cycles[p] = totals.cycles[p];
+		}
+		c.WallNanoseconds = totals.wall;
+		c.BlockMixCalls = totals.blockMix;
+		c.SalsaCalls = totals.salsa;
+		c.PBKDF2Calls = totals.pbkdf2Calls;
+		c.PBKDF2Nanoseconds = totals.pbkdf2Ns;
+		c.VBytesAllocated = totals.vAllocated;
+		c.VBytesWiped = totals.vWiped;
+		c.VBytesInUse = totals.vInUse;
+		c.VBytesHighWater = totals.vHighWater;
+		c.JobsQueued = totals.jobsQueued;
+		c.QueueNanoseconds = totals.queueNs;
+		c.QueueHighWater = totals.queueHighWater;
+		return c;
+	}
+
+	void Metrics::Reset()
+	{
+		totals.calls = 0; totals.hashes = 0; totals.wall = 0; totals.blockMix = 0; totals.salsa = 0;
+		totals.pbkdf2Calls = 0; totals.pbkdf2Ns = 0;
+		for (int p = 0; p < PhaseCount; p++)
+		{
+			totals.ns[p] = 0;
+			totals.cycles[p] = 0;
+		}
+		totals.vAllocated = 0; totals.vWiped = 0; totals.vHighWater = totals.vInUse.load();
+		totals.jobsQueued = 0; totals.queueNs = 0; totals.queueHighWater = 0;
+	}
+
+	void Metrics::SetCallback(Callback Function, void* Context)
+	{
+		std::lock_guard<std::mutex> guard(callbackLock);
+		callback = Function;
+		callbackContext = Context;
+	}
+
+	const char* Metrics::Kernel()
+	{
+		return salsaKernelName();
+	}
+}
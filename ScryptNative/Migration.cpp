@@ -0,0 +1,389 @@
+/* Copyright (c) 2017, Dustin J Sparks
+*
+* PUBLIC DOMAIN MARK
+*
+* While this work is free from any patent or intellectual property claims, the algorithm, pseudo-code, and test vectors were derived from
+* RFC 7914 "The scrypt Password-Based Key Derivation Function" (C. Percival, August 2016, ISSN: 2070-1721)
+*
+* From the RFC:
+* Copyright (c) 2016 IETF Trust and the persons identified as the
+* document authors. All rights reserved.
+* This document is subject to BCP 78 and the IETF Trusts Legal Provisions Relating to IETF Documents (http://trustee.ietf.org/license-info)
+* in effect on the date of publication of this document. Please review these documents carefully, as they describe your rights and restrictions
+* with respect to this document. Code Components extracted from this document must include Simplified BSD License text as described in Section 4.e of
+* the Trust Legal Provisions and are provided without warranty as described in the Simplified BSD License.
+*
+* Unless required by applicable law or agreed to in writing, software
+* distributed under the License is distributed on an "AS IS" BASIS,
+* WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+* See the License for the specific language governing permissions and
+* limitations under the License.
+*/
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <vector>
+#if defined(_WIN32)
+#include <windows.h>
+#include <io.h>
+#include <sys/stat.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+#include "ROMix.h"
+
+namespace ScryptNative
+{
+	// Read only view of a whole file, the pages are brought in by the kernel as the scan reaches them
+	class MappedInput
+	{
+	public:
+		const char* data = nullptr;
+		size_t size = 0;
+
+		explicit MappedInput(const char* path)
+		{
+#if defined(_WIN32)
+			file = CreateFileA(path, GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+			LARGE_INTEGER length;
+			if (file == INVALID_HANDLE_VALUE || !GetFileSizeEx(file, &length))
+				throw std::runtime_error("Cannot open the input file.");
+			size = (size_t)length.QuadPart;
+			if (size == 0)
+				return;
+			mapping = CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+			if (mapping != nullptr)
+				data = (const char*)MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+			if (data == nullptr)
+				throw std::runtime_error("Cannot map the input file.");
+#else
+			fd = open(path, O_RDONLY);
+			struct stat st;
+			if (fd < 0 || fstat(fd, &st) != 0)
+				throw std::runtime_error("Cannot open the input file.");
+			size = (size_t)st.st_size;
+			if (size == 0)
+				return;
+			void* view = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+			if (view == MAP_FAILED)
+				throw std::runtime_error("Cannot map the input file.");
+			madvise(view, size, MADV_SEQUENTIAL);
+			data = (const char*)view;
+#endif
+		}
+
+		~MappedInput()
+		{
+#if defined(_WIN32)
+			if (data != nullptr)
+				UnmapViewOfFile(data);
+			if (mapping != nullptr)
+				CloseHandle(mapping);
+			if (file != INVALID_HANDLE_VALUE)
+				CloseHandle(file);
+#else
+			if (data != nullptr)
+				munmap((void*)data, size);
+			if (fd >= 0)
+				close(fd);
+#endif
+		}
+
+		MappedInput(const MappedInput&) = delete;
+		MappedInput& operator=(const MappedInput&) = delete;
+
+	private:
+#if defined(_WIN32)
+		HANDLE file = INVALID_HANDLE_VALUE;
+		HANDLE mapping = nullptr;
+#else
+		int fd = -1;
+#endif
+	};
+
+	// Flushes f through the C library and the OS, so what was written is on disk before a checkpoint refers to it
+	static bool SyncFile(FILE* f)
+	{
+		if (fflush(f) != 0)
+			return false;
+#if defined(_WIN32)
+		return _commit(_fileno(f)) == 0;
+#else
+		return fsync(fileno(f)) == 0;
+#endif
+	}
+
+	// Makes a rename inside the directory of path durable (MOVEFILE_WRITE_THROUGH does this on Windows)
+	static bool SyncDirectory(const std::string& path)
+	{
+#if defined(_WIN32)
+		(void)path;
+		return true;
+#else
+		size_t slash = path.find_last_of('/');
+		std::string directory = slash == std::string::npos ? "." : slash == 0 ? "/" : path.substr(0, slash);
+		int fd = open(directory.c_str(), O_RDONLY);
+		if (fd < 0)
+			return false;
+		bool ok = fsync(fd) == 0;
+		close(fd);
+		return ok;
+#endif
+	}
+
+	// Cuts the output back to what the checkpoint covers.  A shorter file means the checkpoint got to disk and the output
+	// did not (never extended with zeros, that would turn a lost tail into silently corrupt records).
+	static void TruncateFile(const char* path, uint64_t length)
+	{
+#if defined(_WIN32)
+		struct _stat64 st;
+		bool present = _stat64(path, &st) == 0;
+#else
+		struct stat st;
+		bool present = stat(path, &st) == 0;
+#endif
+		if (!present || (uint64_t)st.st_size < length)
+			throw std::runtime_error("The output file is shorter than its checkpoint records, remove the checkpoint to start over.");
+#if defined(_WIN32)
+		FILE* f = fopen(path, "r+b");
+		bool ok = f != nullptr && _chsize_s(_fileno(f), (long long)length) == 0;
+		if (f != nullptr)
+			fclose(f);
+#else
+		bool ok = truncate(path, (off_t)length) == 0;
+#endif
+		if (!ok)
+			throw std::runtime_error("Cannot truncate the output file to the checkpoint.");
+	}
+
+	struct MigrationRecord
+	{
+		const char* text; // the line without its line break
+		size_t length;
+		std::string output;
+		bool changed;
+		bool failed;
+	};
+
+	// Everything a worker needs to turn one record into its output line
+	struct MigrationJob
+	{
+		HashMigration::Options opts;
+
+		// scrypt of Password with the record's own fields, compared in constant time
+		static bool Matches(const HashFields& h, const char* Password, size_t PasswordLength)
+		{
+			std::vector<uint8_t> computed(h.HashLength);
+			Scrypt::ComputeDerivedHash((const uint8_t*)Password, PasswordLength, h.Salt, h.SaltLength, h.CPUCost, h.BlockSize, h.Parallelism,
+				computed.data(), computed.size());
+			bool equal = Scrypt::SafeEquals(computed.data(), h.Hash, h.HashLength);
+			SecureZero(computed.data(), computed.size());
+			return equal;
+		}
+
+		std::string Encoded(const HashFields& h) const
+		{
+			std::string text(HashCodec::EncodedLength(h), '\0');
+			text.resize(HashCodec::Encode(h, &text[0], text.size()));
+			return text;
+		}
+
+		// $s2 with the target parameters, a fresh salt and HashLength bytes of scrypt(Password)
+		std::string EncodeNew(const char* Password, size_t PasswordLength, size_t HashLength) const
+		{
+			std::vector<uint8_t> salt(opts.SaltLength == 0 ? 32 : opts.SaltLength), hash(HashLength);
+			Scrypt::RandomSalt(salt.data(), salt.size());
+			Scrypt::ComputeDerivedHash((const uint8_t*)Password, PasswordLength, salt.data(), salt.size(), opts.CPUCost, opts.BlockSize,
+				opts.Parallelism, hash.data(), hash.size());
+			HashFields h = { 2, opts.CPUCost, opts.BlockSize, opts.Parallelism, salt.data(), salt.size(), hash.data(), hash.size() };
+			std::string text = Encoded(h);
+			SecureZero(hash.data(), hash.size());
+			return text;
+		}
+
+		void Process(MigrationRecord& rec) const
+		{
+			rec.changed = false;
+			rec.failed = false;
+			if (rec.length == 0)
+				return;
+			if (opts.Mode == HashMigration::Encode)
+			{
+				rec.output = EncodeNew(rec.text, rec.length, opts.HashLength == 0 ? 32 : opts.HashLength);
+				rec.changed = true;
+				return;
+			}
+			// the password (if any) follows the first tab and is never written out
+			const char* tab = (const char*)memchr(rec.text, '\t', rec.length);
+			size_t encodedLength = tab == nullptr ? rec.length : (size_t)(tab - rec.text);
+			const char* password = tab == nullptr ? nullptr : tab + 1;
+			size_t passwordLength = tab == nullptr ? 0 : rec.length - encodedLength - 1;
+			rec.output.assign(rec.text, encodedLength);
+			std::vector<uint8_t> storage(encodedLength);
+			HashFields h;
+			bool valid = HashCodec::Decode(rec.text, encodedLength, h, storage.data(), storage.size());
+			try
+			{
+				switch (opts.Mode)
+				{
+				case HashMigration::Upgrade:
+					rec.failed = !valid;
+					if (valid && h.Version != 2)
+					{
+						h.Version = 2;
+						rec.output = Encoded(h);
+						rec.changed = true;
+					}
+					break;
+				case HashMigration::Verify:
+					rec.failed = !valid || password == nullptr || !Matches(h, password, passwordLength);
+					rec.output += rec.failed ? "\t0" : "\t1";
+					break;
+				case HashMigration::Rehash:
+					rec.failed = !valid || password == nullptr || !Matches(h, password, passwordLength);
+					if (rec.failed || (h.Version == 2 && h.CPUCost == opts.CPUCost && h.BlockSize == opts.BlockSize &&
+						h.Parallelism == opts.Parallelism && (opts.HashLength == 0 || h.HashLength == opts.HashLength)))
+						break;
+					rec.output = EncodeNew(password, passwordLength, opts.HashLength == 0 ? h.HashLength : opts.HashLength);
+					rec.changed = true;
+					break;
+				default:
+					break;
+				}
+			}
+			catch (const std::exception&) // parameters in the record that scrypt rejects, or a V this host cannot allocate
+			{
+				rec.failed = true;
+				if (opts.Mode == HashMigration::Verify)
+					rec.output.assign(rec.text, encodedLength).append("\t0");
+			}
+		}
+	};
+
+	// Line 1 identifies the run, line 2 is the position after the last finished chunk
+	static std::string CheckpointSignature(const HashMigration::Options& o, uint64_t InputSize)
+	{
+		char line[192];
+		snprintf(line, sizeof(line), "scrypt-migration 1 %d %llu %u %u %zu %zu %llu", (int)o.Mode, (unsigned long long)o.CPUCost, o.BlockSize,
+			o.Parallelism, o.HashLength, o.SaltLength, (unsigned long long)InputSize);
+		return line;
+	}
+
+	static void WriteCheckpoint(const std::string& path, const std::string& signature, uint64_t Output, const HashMigration::Report& r)
+	{
+		std::string temp = path + ".tmp";
+		FILE* f = fopen(temp.c_str(), "w");
+		bool ok = f != nullptr && fprintf(f, "%s\n%llu %llu %llu %llu %llu\n", signature.c_str(), (unsigned long long)r.InputBytes,
+			(unsigned long long)Output, (unsigned long long)r.Records, (unsigned long long)r.Changed, (unsigned long long)r.Failed) > 0;
+		if (f != nullptr)
+		{
+			ok = SyncFile(f) && ok;
+			ok = fclose(f) == 0 && ok;
+		}
+#if defined(_WIN32)
+		ok = ok && MoveFileExA(temp.c_str(), path.c_str(), MOVEFILE_REPLACE_EXISTING | MOVEFILE_WRITE_THROUGH) != 0;
+#else
+		ok = ok && rename(temp.c_str(), path.c_str()) == 0 && SyncDirectory(path);
+#endif
+		if (!ok)
+			throw std::runtime_error("Cannot write the checkpoint file.");
+	}
+
+	HashMigration::Report HashMigration::Run(const char* InputPath, const char* OutputPath, const Options& Opts)
+	{
+		if (InputPath == nullptr || OutputPath == nullptr)
+			throw std::invalid_argument("Object not Initialized!");
+		if (Opts.Mode == Rehash || Opts.Mode == Encode)
+		{
+			const uint8_t salt = 0;
+			uint8_t output = 0;
+			ValidateParameters(nullptr, 0, &salt, 1, Opts.CPUCost, Opts.BlockSize, Opts.Parallelism, &output, Opts.HashLength == 0 ? 32 : Opts.HashLength);
+		}
+		auto start = std::chrono::steady_clock::now();
+		MappedInput input(InputPath);
+		Report report = {};
+		report.InputSize = input.size;
+		std::string checkpoint = std::string(OutputPath) + ".resume";
+		std::string signature = CheckpointSignature(Opts, input.size);
+		uint64_t written = 0;
+
+		FILE* saved = fopen(checkpoint.c_str(), "r");
+		bool resuming = saved != nullptr;
+		if (resuming)
+		{
+			char line[192] = {};
+			unsigned long long in, out, records, changed, failed;
+			bool same = fgets(line, sizeof(line), saved) != nullptr && signature + "\n" == line &&
+				fscanf(saved, "%llu %llu %llu %llu %llu", &in, &out, &records, &changed, &failed) == 5 && in <= input.size;
+			fclose(saved);
+			if (!same)
+				throw std::runtime_error("The checkpoint next to the output belongs to a different run, remove it to start over.");
+			TruncateFile(OutputPath, out);
+			report.InputBytes = in;
+			report.Records = records;
+			report.Changed = changed;
+			report.Failed = failed;
+			report.ResumedRecords = records;
+			report.ResumedBytes = in;
+			written = out;
+		}
+		std::unique_ptr<FILE, int (*)(FILE*)> output(fopen(OutputPath, resuming ? "ab" : "wb"), fclose);
+		if (!output)
+			throw std::runtime_error("Cannot open the output file.");
+
+		MigrationJob job = { Opts };
+		size_t chunk = Opts.ChunkRecords == 0 ? 1024 : Opts.ChunkRecords;
+		std::vector<MigrationRecord> records;
+		while (report.InputBytes < input.size)
+		{
+			// the next chunk of lines ('\n' or "\r\n", the last one may have neither)
+			records.clear();
+			uint64_t pos = report.InputBytes;
+			while (records.size() < chunk && pos < input.size)
+			{
+				const char* begin = input.data + pos;
+				const char* end = (const char*)memchr(begin, '\n', (size_t)(input.size - pos));
+				size_t length = end == nullptr ? (size_t)(input.size - pos) : (size_t)(end - begin);
+				pos += length + (end != nullptr);
+				if (length > 0 && begin[length - 1] == '\r')
+					length--;
+				records.push_back({ begin, length, std::string(), false, false });
+			}
+
+			RunWorkers(ResolveThreads(Opts.Threads, records.size()), records.size(), [&](std::atomic<size_t>& next) {
+				for (size_t i = next++; i < records.size(); i = next++)
+					job.Process(records[i]);
+			});
+
+			for (size_t i = 0; i < records.size(); i++)
+			{
+				MigrationRecord& rec = records[i];
+				rec.output += '\n';
+				if (fwrite(rec.output.data(), 1, rec.output.size(), output.get()) != rec.output.size())
+					throw std::runtime_error("Cannot write the output file.");
+				written += rec.output.size();
+				report.Records += rec.length > 0;
+				report.Changed += rec.changed;
+				report.Failed += rec.failed;
+			}
+			if (!SyncFile(output.get())) // on disk before the checkpoint says so
+				throw std::runtime_error("Cannot write the output file.");
+			report.InputBytes = pos;
+			WriteCheckpoint(checkpoint, signature, written, report);
+			report.Seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+			if (Opts.OnProgress != nullptr)
+				Opts.OnProgress(report, Opts.Context);
+		}
+		output.reset();
+		remove(checkpoint.c_str());
+		report.Seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+		return report;
+	}
+}
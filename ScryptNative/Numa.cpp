@@ -0,0 +1,240 @@
+/* Copyright (c) 2017, Dustin J Sparks
+*
+* PUBLIC DOMAIN MARK
+*
+* While this work is free from any patent or intellectual property claims, the algorithm, pseudo-code, and test vectors were derived from
+* RFC 7914 "The scrypt Password-Based Key Derivation Function" (C. Percival, August 2016, ISSN: 2070-1721)
+*
+* From the RFC:
+* Copyright (c) 2016 IETF Trust and the persons identified as the
+* document authors. All rights reserved.
+* This document is subject to BCP 78 and the IETF Trusts Legal Provisions Relating to IETF Documents (http://trustee.ietf.org/license-info)
+* in effect on the date of publication of this document. Please review these documents carefully, as they describe your rights and restrictions
+* with respect to this document. Code Components extracted from this document must include Simplified BSD License text as described in Section 4.e of
+* the Trust Legal Provisions and are provided without warranty as described in the Simplified BSD License.
+*
+* Unless required by applicable law or agreed to in writing, software
+* distributed under the License is distributed on an "AS IS" BASIS,
+* WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+* See the License for the specific language governing permissions and
+* limitations under the License.
+*/
+
+#include <algorithm>
+#include <atomic>
+#include <cstdio>
+#include <cstdlib>
+#include <vector>
+#if defined(_WIN32)
+#define NOMINMAX
+#include <windows.h>
+#elif defined(__linux__)
+#include <dirent.h>
+#include <pthread.h>
+#include <sched.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+#include "Numa.h"
+#include "ScryptNative.h"
+
+namespace ScryptNative
+{
+#if defined(_WIN32)
+	typedef GROUP_AFFINITY CpuSet;
+#elif defined(__linux__)
+	typedef cpu_set_t CpuSet;
+#else
+	typedef int CpuSet;
+#endif
+	static_assert(sizeof(CpuSet) <= 16 * sizeof(uint64_t), "NodePin::saved is too small");
+
+	struct Topology
+	{
+		std::vector<CpuSet> cpus; // the usable CPUs of each node
+		std::vector<uint32_t> ids; // kernel node id of each node
+	};
+
+#if defined(__linux__)
+	// "0-3,8-11" as written to /sys/devices/system/node/node*/cpulist
+	static void parseCpuList(const char* text, cpu_set_t& set)
+	{
+		CPU_ZERO(&set);
+		while (*text != 0 && *text != '\n')
+		{
+			char* end;
+			long first = strtol(text, &end, 10);
+			long last = first;
+			if (end == text)
+				break;
+			if (*end == '-')
+				last = strtol(end + 1, &end, 10);
+			for (long c = first; c <= last && c < CPU_SETSIZE; c++)
+				CPU_SET(c, &set);
+			text = *end == ',' ? end + 1 : end;
+		}
+	}
+#endif
+
+	static Topology detect()
+	{
+		Topology t;
+#if defined(_WIN32)
+		ULONG highest = 0;
+		if (GetNumaHighestNodeNumber(&highest))
+			for (ULONG n = 0; n <= highest; n++)
+			{
+				GROUP_AFFINITY mask = {};
+				if (GetNumaNodeProcessorMaskEx((USHORT)n, &mask) && mask.Mask != 0)
+				{
+					t.cpus.push_back(mask);
+					t.ids.push_back(n);
+				}
+			}
+#elif defined(__linux__)
+		cpu_set_t allowed;
+		if (sched_getaffinity(0, sizeof(allowed), &allowed) == 0)
+			if (DIR* dir = opendir("/sys/devices/system/node"))
+			{
+				std::vector<uint32_t> ids;
+				while (dirent* entry = readdir(dir))
+				{
+					unsigned id;
+					char tail;
+					if (sscanf(entry->d_name, "node%u%c", &id, &tail) == 1)
+						ids.push_back(id);
+				}
+				closedir(dir);
+				std::sort(ids.begin(), ids.end());
+				for (uint32_t id : ids)
+				{
+					char path[64], list[4096];
+					snprintf(path, sizeof(path), "/sys/devices/system/node/node%u/cpulist", id);
+					FILE* f = fopen(path, "r");
+					if (f == nullptr)
+						continue;
+					bool read = fgets(list, sizeof(list), f) != nullptr;
+					fclose(f);
+					cpu_set_t set;
+					if (!read)
+						continue;
+					parseCpuList(list, set);
+					CPU_AND(&set, &set, &allowed); // a taskset / cgroup may leave a node without CPUs for us
+					if (CPU_COUNT(&set) == 0)
+						continue;
+					t.cpus.push_back(set);
+					t.ids.push_back(id);
+				}
+			}
+#endif
+		return t;
+	}
+
+	static const Topology& topology()
+	{
+		static const Topology t = detect();
+		return t;
+	}
+
+	static std::atomic<bool> enabled(false);
+	static thread_local int pinned = -1;
+
+	uint32_t NUMA::Nodes()
+	{
+		return std::max((uint32_t)topology().cpus.size(), 1u);
+	}
+
+	void NUMA::Enable(bool On)
+	{
+		enabled.store(On, std::memory_order_relaxed);
+	}
+
+	bool NUMA::Enabled()
+	{
+		return enabled.load(std::memory_order_relaxed);
+	}
+
+	uint32_t NUMA::CurrentNode()
+	{
+		const Topology& t = topology();
+		if (pinned >= 0)
+			return (uint32_t)pinned;
+#if defined(_WIN32)
+		PROCESSOR_NUMBER cpu;
+		GetCurrentProcessorNumberEx(&cpu);
+		USHORT id;
+		if (GetNumaProcessorNodeEx(&cpu, &id))
+			for (size_t n = 0; n < t.ids.size(); n++)
+				if (t.ids[n] == id)
+					return (uint32_t)n;
+#elif defined(__linux__)
+		int cpu = sched_getcpu();
+		for (size_t n = 0; n < t.cpus.size(); n++)
+			if (cpu >= 0 && cpu < CPU_SETSIZE && CPU_ISSET(cpu, &t.cpus[n]))
+				return (uint32_t)n;
+#endif
+		(void)t;
+		return 0;
+	}
+
+	NodePin::NodePin(int Node) : node(-1), previous(pinned)
+	{
+		const Topology& t = topology();
+		if (Node < 0 || t.cpus.empty())
+			return;
+		Node %= (int)t.cpus.size();
+#if defined(_WIN32)
+		if (!SetThreadGroupAffinity(GetCurrentThread(), &t.cpus[Node], (GROUP_AFFINITY*)saved))
+			return;
+#elif defined(__linux__)
+		if (pthread_getaffinity_np(pthread_self(), sizeof(cpu_set_t), (cpu_set_t*)saved) != 0 ||
+			pthread_setaffinity_np(pthread_self(), sizeof(cpu_set_t), &t.cpus[Node]) != 0)
+			return;
+#else
+		return;
+#endif
+		node = Node;
+		pinned = Node;
+	}
+
+	NodePin::~NodePin()
+	{
+		if (node < 0)
+			return;
+#if defined(_WIN32)
+		SetThreadGroupAffinity(GetCurrentThread(), (GROUP_AFFINITY*)saved, nullptr);
+#elif defined(__linux__)
+		pthread_setaffinity_np(pthread_self(), sizeof(cpu_set_t), (cpu_set_t*)saved);
+#endif
+		pinned = previous;
+	}
+
+	int PinnedNode()
+	{
+		return pinned;
+	}
+
+	void PreferNode(void* Data, size_t Bytes, int Node)
+	{
+#if defined(__linux__) && defined(SYS_mbind)
+		const Topology& t = topology();
+		if (Node < 0 || Node >= (int)t.ids.size())
+			return;
+		const int MPOL_PREFERRED_ = 1; // a full node falls back to the others instead of failing the allocation
+		unsigned long mask[1024 / (8 * sizeof(unsigned long))] = {};
+		uint32_t id = t.ids[Node];
+		if (id >= 1024)
+			return;
+		mask[id / (8 * sizeof(unsigned long))] |= 1UL << (id % (8 * sizeof(unsigned long)));
+		syscall(SYS_mbind, Data, Bytes, MPOL_PREFERRED_, mask, (unsigned long)(8 * sizeof(mask)), 0);
+#else
+		(void)Data; (void)Bytes; (void)Node;
+#endif
+	}
+
+	uint32_t NodeId(int Node)
+	{
+		const Topology& t = topology();
+		return Node >= 0 && Node < (int)t.ids.size() ? t.ids[Node] : 0;
+	}
+}
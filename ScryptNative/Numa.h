@@ -0,0 +1,54 @@
+#pragma once
+
+/* Copyright (c) 2017, Dustin J Sparks
+*
+* PUBLIC DOMAIN MARK
+*
+* While this work is free from any patent or intellectual property claims, the algorithm, pseudo-code, and test vectors were derived from
+* RFC 7914 "The scrypt Password-Based Key Derivation Function" (C. Percival, August 2016, ISSN: 2070-1721)
+*
+* From the RFC:
+* Copyright (c) 2016 IETF Trust and the persons identified as the
+* document authors. All rights reserved.
+* This document is subject to BCP 78 and the IETF Trusts Legal Provisions Relating to IETF Documents (http://trustee.ietf.org/license-info)
+* in effect on the date of publication of this document. Please review these documents carefully, as they describe your rights and restrictions
+* with respect to this document. Code Components extracted from this document must include Simplified BSD License text as described in Section 4.e of
+* the Trust Legal Provisions and are provided without warranty as described in the Simplified BSD License.
+*
+* Unless required by applicable law or agreed to in writing, software
+* distributed under the License is distributed on an "AS IS" BASIS,
+* WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+* See the License for the specific language governing permissions and
+* limitations under the License.
+*/
+
+#include "Common.h"
+
+// NUMA placement behind the public NUMA class and ScryptContext::NUMALocal: node topology, per thread CPU pinning and the
+// node a new BlockBuffer is bound to (Memory.cpp).  Nodes are numbered 0 .. NUMA::Nodes() - 1, counting only nodes that
+// have CPUs this process may run on; the kernel's own node ids stay inside Numa.cpp.
+namespace ScryptNative
+{
+	// Pins the calling thread to the CPUs of Node for the lifetime of the object and restores its previous affinity
+	// afterwards.  Node < 0 (or a host without a NUMA API) does nothing.
+	class NodePin
+	{
+		int node;
+		int previous;
+		uint64_t saved[16]; // cpu_set_t / GROUP_AFFINITY of the thread before
+	public:
+		explicit NodePin(int Node);
+		~NodePin();
+		NodePin(const NodePin&) = delete;
+		NodePin& operator=(const NodePin&) = delete;
+	};
+
+	// Node the calling thread is pinned to by a NodePin, -1 when none
+	int PinnedNode();
+
+	// Prefers Node for the pages of [Data, Data + Bytes) that are not touched yet (Linux mbind, Data page aligned)
+	void PreferNode(void* Data, size_t Bytes, int Node);
+
+	// Kernel id of Node, for VirtualAllocExNuma
+	uint32_t NodeId(int Node);
+}
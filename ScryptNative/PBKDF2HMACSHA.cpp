@@ -0,0 +1,365 @@
+/* Copyright (c) 2017, Dustin J Sparks
+*
+* PUBLIC DOMAIN MARK
+*
+* While this work is free from any patent or intellectual property claims, the algorithm, pseudo-code, and test vectors were derived from
+* RFC 7914 "The scrypt Password-Based Key Derivation Function" (C. Percival, August 2016, ISSN: 2070-1721)
+*
+* From the RFC:
+* Copyright (c) 2016 IETF Trust and the persons identified as the
+* document authors. All rights reserved.
+* This document is subject to BCP 78 and the IETF Trusts Legal Provisions Relating to IETF Documents (http://trustee.ietf.org/license-info)
+* in effect on the date of publication of this document. Please review these documents carefully, as they describe your rights and restrictions
+* with respect to this document. Code Components extracted from this document must include Simplified BSD License text as described in Section 4.e of
+* the Trust Legal Provisions and are provided without warranty as described in the Simplified BSD License.
+*
+* Unless required by applicable law or agreed to in writing, software
+* distributed under the License is distributed on an "AS IS" BASIS,
+* WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+* See the License for the specific language governing permissions and
+* limitations under the License.
+*/
+
+#include <algorithm>
+#include <stdexcept>
+#include "Instrument.h"
+#include "ROMix.h"
+#include "Dispatch.h"
+
+namespace ScryptNative
+{
+	// below this many HMACs per thread the thread start up costs more than it saves
+	static const uint64_t PBKDF2HMACsPerThread = 4096;
+
+	// the core function of the PBKDF which does all the iterations
+	// per the spec section 5.2 step 3
+	// salted is keyed by the password (see HMAC::SetKey) and has absorbed the salt, which every block T shares
+	template <typename Hash>
+	static void _F(const HMAC<Hash>& salted, uint32_t TT, uint32_t I, uint8_t* bufferOut)
+	{
+		//NOTE: SPEC IS MISLEADING!!!
+		//THE HMAC FUNCTIONS ARE KEYED BY THE PASSWORD! NEVER THE SALT!
+		HMAC<Hash> hmac = salted;
+		uint8_t bufferU[Hash::OutputBytes];
+		uint8_t _int[4];
+		be32enc(_int, TT);
+		hmac.Update(_int, sizeof(_int));
+		hmac.Final(bufferU);
+		memcpy(bufferOut, bufferU, sizeof(bufferU));
+		for (uint32_t c = 1; c < I; c++)
+		{
+			hmac.Reset();
+			hmac.Update(bufferU, sizeof(bufferU));
+			hmac.Final(bufferU);
+			//Xor step
+			for (size_t i = 0; i < sizeof(bufferU); i++)
+				bufferOut[i] ^= bufferU[i];
+		}
+		SecureZero(bufferU, sizeof(bufferU));
+		hmac.Clear();
+	}
+
+	// HMAC-SHA256 iterations 2 .. I work on the two keyed midstates and 32 byte messages only, so the padding is fixed and
+	// each HMAC is exactly two compressions of ready made message words (no byte order or length bookkeeping per call)
+	template <>
+	void _F<SHA256>(const HMAC<SHA256>& salted, uint32_t TT, uint32_t I, uint8_t* bufferOut)
+	{
+		HMAC<SHA256> hmac = salted;
+		uint8_t bufferU[SHA256::OutputBytes];
+		uint8_t _int[4];
+		be32enc(_int, TT);
+		hmac.Update(_int, sizeof(_int));
+		hmac.Final(bufferU); // U1
+		memcpy(bufferOut, bufferU, sizeof(bufferU));
+		hmac.Clear();
+		if (I > 1)
+		{
+			uint32_t U[16], S[16], T[8];
+			for (int i = 0; i < 8; i++)
+				T[i] = U[i] = be32dec(bufferU + i * 4);
+			U[8] = S[8] = 0x80000000;
+			for (int i = 9; i < 15; i++)
+				U[i] = S[i] = 0;
+			U[15] = S[15] = (64 + 32) * 8; // bit length of ipad/opad block + message
+			for (uint32_t c = 1; c < I; c++)
+			{
+				memcpy(S, salted.InnerKeyed().state, sizeof(T));
+				SHA256CompressWords(S, U);
+				memcpy(U, salted.OuterKeyed().state, sizeof(T));
+				SHA256CompressWords(U, S);
+				for (int i = 0; i < 8; i++)
+					T[i] ^= U[i]; //Xor step
+			}
+			for (int i = 0; i < 8; i++)
+				be32enc(bufferOut + i * 4, T[i]);
+			SecureZero(U, sizeof(U)); SecureZero(S, sizeof(S)); SecureZero(T, sizeof(T));
+		}
+		SecureZero(bufferU, sizeof(bufferU));
+	}
+
+	// How many blocks T one multi-buffer F() call covers, 1 where there is no multi-buffer kernel for the hash
+	template <typename Hash>
+	struct PBKDF2Lanes
+	{
+		static const uint32_t MaxL = 1;
+		static uint32_t L(const LaneKernelSet*) { return 1; }
+		static void F(const LaneKernelSet*, const HMAC<Hash>&, uint32_t, uint32_t, uint8_t*) {}
+	};
+
+	template <>
+	struct PBKDF2Lanes<SHA256>
+	{
+		static const uint32_t MaxL = MaxBatchLanes;
+		static uint32_t L(const LaneKernelSet* Set) { return Set != nullptr ? Set->L : 1; }
+		// the blocks firstT .. firstT + L - 1, writing L * 32 bytes to out
+		static void F(const LaneKernelSet* Set, const HMAC<SHA256>& salted, uint32_t firstT, uint32_t I, uint8_t* out)
+		{
+			uint8_t tails[MaxBatchLanes][2 * 64];
+			uint32_t states[MaxBatchLanes * 8];
+			size_t blocks = 0;
+			for (uint32_t k = 0; k < Set->L; k++) // salt || INT(T), only the padded tail is left to compress
+			{
+				SHA256 inner = salted.Inner();
+				uint8_t _int[4];
+				be32enc(_int, firstT + k);
+				inner.Update(_int, sizeof(_int));
+				blocks = inner.Pad(tails[k]); // same for every lane, the messages have the same length
+				memcpy(states + k * 8, inner.state, 8 * sizeof(uint32_t));
+				SecureZero(&inner, sizeof(inner));
+			}
+			Set->PBKDF2F(salted.InnerKeyed().state, salted.OuterKeyed().state, states, &tails[0][0], blocks, I, out);
+			SecureZero(tails, sizeof(tails));
+			SecureZero(states, sizeof(states));
+		}
+	};
+
+	// Bytes [Offset, Offset + OutputByteCount) of the derived key, salted = keyed HMAC that has absorbed the salt.
+	// Only the blocks T covering that range are computed, so a long key can be produced piece by piece into the caller's buffers.
+	template <typename Hash>
+	static void _PBKDF2Range(const HMAC<Hash>& salted, uint32_t Iterations, uint64_t Offset,
+		uint8_t* Output, size_t OutputByteCount, uint32_t MaxThreads)
+	{
+		if (OutputByteCount == 0)
+			return;
+		if (Offset + OutputByteCount > 0xffffffffULL * Hash::OutputBytes)
+			throw std::out_of_range("OutputByteCount");
+		const LaneKernelSet* set = BatchKernels(); // read once, so every group of the call runs the same width
+		const uint32_t L = PBKDF2Lanes<Hash>::L(set);
+		uint64_t firstBlock = Offset / Hash::OutputBytes;
+		size_t totalBlocks = (size_t)((Offset + OutputByteCount + Hash::OutputBytes - 1) / Hash::OutputBytes - firstBlock);
+		size_t groups = (totalBlocks + L - 1) / L;
+		uint64_t work = (uint64_t)totalBlocks * Iterations;
+		uint32_t threads = ResolveThreads(MaxThreads, (size_t)std::min((uint64_t)groups, work / PBKDF2HMACsPerThread));
+
+		// the blocks are independent: groups of L run through the multi-buffer kernel (a short final group only when
+		// at least half of it is used), the rest one at a time, and the groups are spread over the worker threads
+		RunWorkers(threads, groups, [&](std::atomic<size_t>& nextGroup) {
+			uint8_t buffer[PBKDF2Lanes<Hash>::MaxL * Hash::OutputBytes];
+			for (size_t g = nextGroup++; g < groups; g = nextGroup++)
+			{
+				uint64_t first = firstBlock + g * L;
+				size_t count = std::min((size_t)L, totalBlocks - g * L);
+				if (L > 1 && count * 2 > L)
+					PBKDF2Lanes<Hash>::F(set, salted, (uint32_t)first + 1, Iterations, buffer);
+				else
+					for (size_t b = 0; b < count; b++)
+						_F(salted, (uint32_t)(first + b + 1), Iterations, buffer + b * Hash::OutputBytes);
+				// take only the part of these blocks that falls inside the requested range
+				uint64_t start = std::max(first * Hash::OutputBytes, Offset);
+				uint64_t end = std::min((first + count) * Hash::OutputBytes, Offset + OutputByteCount);
+				memcpy(Output + (start - Offset), buffer + (start - first * Hash::OutputBytes), (size_t)(end - start));
+			}
+			SecureZero(buffer, sizeof(buffer));
+		});
+	}
+
+	template <typename Hash>
+	static void _PBKDF2(const HMAC<Hash>& h, const uint8_t* Salt, size_t SaltLength, uint32_t Iterations,
+		uint8_t* Output, size_t OutputByteCount, uint32_t MaxThreads)
+	{
+		HMAC<Hash> salted = h;
+		salted.Reset();
+		salted.Update(Salt, SaltLength);
+		try
+		{
+			_PBKDF2Range(salted, Iterations, 0, Output, OutputByteCount, MaxThreads);
+		}
+		catch (...)
+		{
+			salted.Clear();
+			throw;
+		}
+		salted.Clear();
+	}
+
+	template <typename Hash>
+	static void _PBKDF2(const uint8_t* Password, size_t PasswordLength, const uint8_t* Salt, size_t SaltLength,
+		uint32_t Iterations, uint8_t* Output, size_t OutputByteCount, uint32_t MaxThreads)
+	{
+		if ((Salt == nullptr && SaltLength != 0) || (Password == nullptr && PasswordLength != 0) || Output == nullptr)
+			throw std::invalid_argument("Object not Initialized!");
+		if (Iterations < 1)
+			throw std::out_of_range("Iterations");
+		if (OutputByteCount < 1 || (uint64_t)OutputByteCount > 0xffffffffULL * Hash::OutputBytes)
+			throw std::out_of_range("OutputByteCount");
+
+		Stamp start = MetricsOn() ? Stamp::Now() : Stamp();
+		HMAC<Hash> h;
+		h.SetKey(Password, PasswordLength); // KEY BY THE PASSWORD!!! (once, for every block and iteration)
+		try
+		{
+			_PBKDF2(h, Salt, SaltLength, Iterations, Output, OutputByteCount, MaxThreads);
+		}
+		catch (...)
+		{
+			h.Clear();
+			throw;
+		}
+		h.Clear();
+		if (start.ns != 0)
+			RecordPBKDF2(start);
+	}
+
+	void PBKDF2SHA256Range(const HMAC<SHA256>& Salted, uint64_t Offset, uint8_t* Output, size_t OutputByteCount, uint32_t MaxThreads)
+	{
+		_PBKDF2Range(Salted, 1, Offset, Output, OutputByteCount, MaxThreads);
+	}
+
+	void PBKDF2SHA256(const HMAC<SHA256>& Keyed, const uint8_t* Salt, size_t SaltLength, uint8_t* Output, size_t OutputByteCount, uint32_t MaxThreads)
+	{
+		_PBKDF2(Keyed, Salt, SaltLength, 1, Output, OutputByteCount, MaxThreads);
+	}
+
+	void PBKDF2::HMACSHA1(const uint8_t* Password, size_t PasswordLength, const uint8_t* Salt, size_t SaltLength,
+		uint32_t Iterations, uint8_t* Output, size_t OutputByteCount)
+	{
+		_PBKDF2<SHA1>(Password, PasswordLength, Salt, SaltLength, Iterations, Output, OutputByteCount, 1);
+	}
+
+	void PBKDF2::HMACSHA1(const uint8_t* Password, size_t PasswordLength, const uint8_t* Salt, size_t SaltLength,
+		uint32_t Iterations, uint8_t* Output, size_t OutputByteCount, uint32_t MaxThreads)
+	{
+		_PBKDF2<SHA1>(Password, PasswordLength, Salt, SaltLength, Iterations, Output, OutputByteCount, MaxThreads);
+	}
+
+	void PBKDF2::HMACSHA256(const uint8_t* Password, size_t PasswordLength, const uint8_t* Salt, size_t SaltLength,
+		uint32_t Iterations, uint8_t* Output, size_t OutputByteCount)
+	{
+		_PBKDF2<SHA256>(Password, PasswordLength, Salt, SaltLength, Iterations, Output, OutputByteCount, 1);
+	}
+
+	void PBKDF2::HMACSHA256(const uint8_t* Password, size_t PasswordLength, const uint8_t* Salt, size_t SaltLength,
+		uint32_t Iterations, uint8_t* Output, size_t OutputByteCount, uint32_t MaxThreads)
+	{
+		_PBKDF2<SHA256>(Password, PasswordLength, Salt, SaltLength, Iterations, Output, OutputByteCount, MaxThreads);
+	}
+
+	void PBKDF2::HMACSHA512(const uint8_t* Password, size_t PasswordLength, const uint8_t* Salt, size_t SaltLength,
+		uint32_t Iterations, uint8_t* Output, size_t OutputByteCount)
+	{
+		_PBKDF2<SHA512>(Password, PasswordLength, Salt, SaltLength, Iterations, Output, OutputByteCount, 1);
+	}
+
+	void PBKDF2::HMACSHA512(const uint8_t* Password, size_t PasswordLength, const uint8_t* Salt, size_t SaltLength,
+		uint32_t Iterations, uint8_t* Output, size_t OutputByteCount, uint32_t MaxThreads)
+	{
+		_PBKDF2<SHA512>(Password, PasswordLength, Salt, SaltLength, Iterations, Output, OutputByteCount, MaxThreads);
+	}
+
+	// One HMAC state per hash, keyed and salted once for the life of the stream
+	struct PBKDF2Stream::State
+	{
+		virtual ~State() {}
+		virtual void ReadAt(uint64_t Offset, uint8_t* Output, size_t Length, uint32_t MaxThreads) = 0;
+	};
+
+	template <typename Hash>
+	struct PBKDF2StreamState : PBKDF2Stream::State
+	{
+		HMAC<Hash> salted;
+		uint32_t iterations;
+		uint64_t cachedBlock; // the block a read last ended inside of, so small sequential reads do not recompute it
+		uint8_t cache[Hash::OutputBytes];
+
+		PBKDF2StreamState(const uint8_t* Password, size_t PasswordLength, const uint8_t* Salt, size_t SaltLength, uint32_t Iterations)
+			: iterations(Iterations), cachedBlock(UINT64_MAX)
+		{
+			salted.SetKey(Password, PasswordLength);
+			salted.Reset();
+			salted.Update(Salt, SaltLength);
+		}
+
+		~PBKDF2StreamState()
+		{
+			salted.Clear();
+			SecureZero(cache, sizeof(cache));
+		}
+
+		void ReadAt(uint64_t Offset, uint8_t* Output, size_t Length, uint32_t MaxThreads) override
+		{
+			const size_t H = Hash::OutputBytes;
+			if (Offset + Length > 0xffffffffULL * H)
+				throw std::out_of_range("OutputByteCount");
+			if (Length > 0 && Offset / H == cachedBlock)
+			{
+				size_t n = std::min(H - (size_t)(Offset % H), Length);
+				memcpy(Output, cache + Offset % H, n);
+				Offset += n;
+				Output += n;
+				Length -= n;
+			}
+			if (Length == 0)
+				return;
+			// whole blocks go straight to Output, a block the range ends inside of goes through the cache
+			uint64_t end = Offset + Length;
+			uint64_t lastStart = end / H * H;
+			if (end % H != 0)
+			{
+				_PBKDF2Range(salted, iterations, lastStart, cache, H, 1);
+				cachedBlock = lastStart / H;
+				uint64_t from = std::max(Offset, lastStart);
+				memcpy(Output + (from - Offset), cache + (from - lastStart), (size_t)(end - from));
+			}
+			if (Offset < lastStart)
+				_PBKDF2Range(salted, iterations, Offset, Output, (size_t)(lastStart - Offset), MaxThreads);
+		}
+	};
+
+	PBKDF2Stream::PBKDF2Stream(uint32_t Hash, const uint8_t* Password, size_t PasswordLength, const uint8_t* Salt, size_t SaltLength, uint32_t Iterations)
+		: state(nullptr), position(0)
+	{
+		if ((Salt == nullptr && SaltLength != 0) || (Password == nullptr && PasswordLength != 0))
+			throw std::invalid_argument("Object not Initialized!");
+		if (Iterations < 1)
+			throw std::out_of_range("Iterations");
+		if (Hash == SHA1Hash)
+			state = new PBKDF2StreamState<SHA1>(Password, PasswordLength, Salt, SaltLength, Iterations);
+		else if (Hash == SHA256Hash)
+			state = new PBKDF2StreamState<SHA256>(Password, PasswordLength, Salt, SaltLength, Iterations);
+		else if (Hash == SHA512Hash)
+			state = new PBKDF2StreamState<SHA512>(Password, PasswordLength, Salt, SaltLength, Iterations);
+		else
+			throw std::invalid_argument("Hash must be 1, 256 or 512.");
+	}
+
+	PBKDF2Stream::~PBKDF2Stream()
+	{
+		delete state;
+	}
+
+	void PBKDF2Stream::Read(uint8_t* Output, size_t Length)
+	{
+		ReadAt(position, Output, Length, 1);
+		position += Length;
+	}
+
+	void PBKDF2Stream::ReadAt(uint64_t Offset, uint8_t* Output, size_t Length, uint32_t MaxThreads)
+	{
+		if (Output == nullptr && Length != 0)
+			throw std::invalid_argument("Object not Initialized!");
+		Stamp start = MetricsOn() ? Stamp::Now() : Stamp();
+		state->ReadAt(Offset, Output, Length, MaxThreads);
+		if (start.ns != 0)
+			RecordPBKDF2(start);
+	}
+}
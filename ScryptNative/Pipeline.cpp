@@ -0,0 +1,317 @@
+/* Copyright (c) 2017, Dustin J Sparks
+*
+* PUBLIC DOMAIN MARK
+*
+* While this work is free from any patent or intellectual property claims, the algorithm, pseudo-code, and test vectors were derived from
+* RFC 7914 "The scrypt Password-Based Key Derivation Function" (C. Percival, August 2016, ISSN: 2070-1721)
+*
+* From the RFC:
+* Copyright (c) 2016 IETF Trust and the persons identified as the
+* document authors. All rights reserved.
+* This document is subject to BCP 78 and the IETF Trusts Legal Provisions Relating to IETF Documents (http://trustee.ietf.org/license-info)
+* in effect on the date of publication of this document. Please review these documents carefully, as they describe your rights and restrictions
+* with respect to this document. Code Components extracted from this document must include Simplified BSD License text as described in Section 4.e of
+* the Trust Legal Provisions and are provided without warranty as described in the Simplified BSD License.
+*
+* Unless required by applicable law or agreed to in writing, software
+* distributed under the License is distributed on an "AS IS" BASIS,
+* WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+* See the License for the specific language governing permissions and
+* limitations under the License.
+*/
+
+#include <algorithm>
+#include <condition_variable>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <stdexcept>
+#include <thread>
+#include <vector>
+#include "Instrument.h"
+#include "Memory.h"
+#include "ROMix.h"
+
+namespace ScryptNative
+{
+	struct PipelineJob
+	{
+		std::vector<uint8_t> password;
+		std::vector<uint8_t> salt;
+		uint64_t cpuCost;
+		uint32_t blockSize;
+		uint32_t parallelism;
+		size_t outputLength;
+		ScryptPipeline::Completion done;
+		HMAC<SHA256> prf; // keyed by the first stage, used again by the last
+		std::vector<uint8_t> B;
+		std::exception_ptr error; // skips the stages still ahead
+		std::unique_ptr<CallRecorder> rec;
+
+		void Wipe()
+		{
+			SecureZero(password.data(), password.size());
+			SecureZero(B.data(), B.size());
+			prf.Clear();
+		}
+	};
+
+	struct ScryptPipeline::State
+	{
+		size_t depth;
+		mutable std::mutex lock;
+		std::condition_variable changed; // signalled whenever a job moves between queues, and on shutdown
+		std::deque<PipelineJob*> submitted; // waiting for PBKDF2 into B
+		std::deque<PipelineJob*> ready; // waiting for ROMix
+		std::deque<PipelineJob*> mixed; // waiting for PBKDF2 out of B
+		size_t mixing = 0;
+		bool starting = false; // the stage thread is deriving a B that goes to ready next
+		size_t inFlight = 0;
+		bool stopping = false;
+		std::thread stage;
+		std::vector<std::thread> workers;
+
+		// Both SHA-256 stages.  Finishing a hash comes first, it frees a worker's output slot and the caller is waiting on it;
+		// a new B is only derived while the ROMix queue has room for it.
+		void Stage()
+		{
+			std::unique_lock<std::mutex> guard(lock);
+			for (;;)
+			{
+				changed.wait(guard, [&]() { return !mixed.empty() || (!submitted.empty() && ready.size() < depth) ||
+					(stopping && ready.empty() && mixing == 0); });
+				if (!mixed.empty())
+				{
+					PipelineJob* job = mixed.front();
+					mixed.pop_front();
+					changed.notify_all();
+					guard.unlock();
+					Finish(job);
+					guard.lock();
+					inFlight--;
+					changed.notify_all();
+				}
+				else if (!submitted.empty() && ready.size() < depth)
+				{
+					PipelineJob* job = submitted.front();
+					submitted.pop_front();
+					starting = true;
+					guard.unlock();
+					Start(job);
+					guard.lock();
+					ready.push_back(job);
+					starting = false;
+					changed.notify_all();
+				}
+				else
+					return;
+			}
+		}
+
+		static void Start(PipelineJob* job)
+		{
+			Stamp t = job->rec ? Stamp::Now() : Stamp();
+			try
+			{
+				job->prf.SetKey(job->password.data(), job->password.size());
+				SecureZero(job->password.data(), job->password.size());
+				job->B.resize((size_t)job->parallelism * job->blockSize * 128);
+				PBKDF2SHA256(job->prf, job->salt.data(), job->salt.size(), job->B.data(), job->B.size(), 1);
+			}
+			catch (...)
+			{
+				job->error = std::current_exception();
+			}
+			if (job->rec)
+				job->rec->Add(Metrics::PBKDF2In, t);
+		}
+
+		static void Finish(PipelineJob* job)
+		{
+			std::vector<uint8_t> output;
+			if (!job->error)
+			{
+				Stamp t = job->rec ? Stamp::Now() : Stamp();
+				try
+				{
+					output.resize(job->outputLength);
+					PBKDF2SHA256(job->prf, job->B.data(), job->B.size(), output.data(), output.size(), 1);
+				}
+				catch (...)
+				{
+					job->error = std::current_exception();
+				}
+				if (job->rec)
+				{
+					job->rec->Add(Metrics::PBKDF2Out, t);
+					if (!job->error)
+						job->rec->Finish();
+				}
+			}
+			job->Wipe();
+			try { job->done(job->error ? nullptr : output.data(), job->error ? 0 : output.size(), job->error); }
+			catch (...) {} // a throwing completion must not take the stage thread down
+			SecureZero(output.data(), output.size());
+			delete job;
+		}
+
+		// One ROMix worker: its V/X/Y set is kept (wiped) from hash to hash and only reallocated when a hash needs a different size
+		void Work()
+		{
+			std::unique_ptr<BlockBuffer> scratch;
+			std::unique_lock<std::mutex> guard(lock);
+			for (;;)
+			{
+				changed.wait(guard, [&]() { return !ready.empty() || (stopping && !starting); });
+				if (ready.empty())
+					return;
+				PipelineJob* job = ready.front();
+				ready.pop_front();
+				mixing++;
+				changed.notify_all();
+				guard.unlock();
+
+				if (!job->error)
+				{
+					try
+					{
+						size_t r128 = (size_t)job->blockSize * 128;
+						size_t N = (size_t)job->cpuCost;
+						size_t words = (N + 2) * (r128 / 4);
+						if (!scratch || scratch->words != words)
+						{
+							scratch.reset();
+							scratch.reset(new BlockBuffer(words));
+						}
+						for (uint32_t lane = 0; lane < job->parallelism; lane++)
+						{
+							uint8_t* Bp = job->B.data() + lane * r128;
+							ROMixLanes(&Bp, 1, job->blockSize, N, scratch->data, job->rec.get());
+						}
+					}
+					catch (...)
+					{
+						job->error = std::current_exception();
+					}
+					if (scratch)
+						scratch->Wipe(); // no hash's V outlives it, as in ScryptContext
+				}
+
+				guard.lock();
+				// a full output queue holds the worker (and its V) back until the stage thread catches up
+				changed.wait(guard, [&]() { return mixed.size() < depth; });
+				mixed.push_back(job);
+				mixing--;
+				changed.notify_all();
+			}
+		}
+	};
+
+	ScryptPipeline::ScryptPipeline(uint32_t ROMixWorkers, size_t Depth) : state(new State())
+	{
+		if (Depth < 1)
+		{
+			delete state;
+			throw std::out_of_range("Depth must be at least 1.");
+		}
+		state->depth = Depth;
+		try
+		{
+			uint32_t threads = ROMixWorkers != 0 ? ROMixWorkers : std::max(1u, ResolveThreads(0, SIZE_MAX) - 1);
+			for (uint32_t t = 0; t < threads; t++)
+				state->workers.emplace_back([this]() { state->Work(); });
+			state->stage = std::thread([this]() { state->Stage(); });
+		}
+		catch (...)
+		{
+			{
+				std::lock_guard<std::mutex> guard(state->lock);
+				state->stopping = true;
+			}
+			state->changed.notify_all();
+			for (size_t t = 0; t < state->workers.size(); t++)
+				state->workers[t].join();
+			delete state;
+			throw;
+		}
+	}
+
+	ScryptPipeline::~ScryptPipeline()
+	{
+		std::deque<PipelineJob*> abandoned;
+		{
+			std::lock_guard<std::mutex> guard(state->lock);
+			state->stopping = true;
+			abandoned.swap(state->submitted);
+		}
+		state->changed.notify_all();
+		for (size_t t = 0; t < state->workers.size(); t++)
+			state->workers[t].join();
+		state->stage.join();
+		for (size_t i = 0; i < abandoned.size(); i++)
+		{
+			PipelineJob* job = abandoned[i];
+			job->Wipe();
+			try { job->done(nullptr, 0, std::make_exception_ptr(std::runtime_error("Pipeline shut down before the job could run."))); }
+			catch (...) {}
+			delete job;
+		}
+		delete state;
+	}
+
+	bool ScryptPipeline::Submit(const uint8_t* Password, size_t PasswordLength, const uint8_t* Salt, size_t SaltLength,
+		uint64_t CPUCost, uint32_t BlockSize, uint32_t Parallelism, size_t OutputByteLength, Completion Done)
+	{
+		uint8_t output = 0;
+		ValidateParameters(Password, PasswordLength, Salt, SaltLength, CPUCost, BlockSize, Parallelism, &output, OutputByteLength);
+		if (!Done)
+			throw std::invalid_argument("Object not Initialized!");
+		{
+			std::lock_guard<std::mutex> guard(state->lock);
+			if (state->submitted.size() >= state->depth)
+				return false;
+		}
+
+		PipelineJob* job = new PipelineJob();
+		job->password.assign(Password, Password + PasswordLength);
+		job->salt.assign(Salt, Salt + SaltLength);
+		job->cpuCost = CPUCost;
+		job->blockSize = BlockSize;
+		job->parallelism = Parallelism;
+		job->outputLength = OutputByteLength;
+		job->done = Done;
+		if (MetricsOn())
+			job->rec.reset(new CallRecorder(CPUCost, BlockSize, Parallelism, 1, 1, false, (CPUCost + 2) * BlockSize * 128));
+		{
+			std::lock_guard<std::mutex> guard(state->lock);
+			if (state->submitted.size() >= state->depth || state->stopping) // may have filled up while the job was built
+			{
+				job->Wipe();
+				delete job;
+				return false;
+			}
+			state->submitted.push_back(job);
+			state->inFlight++;
+			RecordQueued(state->submitted.size());
+		}
+		state->changed.notify_all();
+		return true;
+	}
+
+	void ScryptPipeline::Drain()
+	{
+		std::unique_lock<std::mutex> guard(state->lock);
+		state->changed.wait(guard, [&]() { return state->inFlight == 0; });
+	}
+
+	size_t ScryptPipeline::InFlight() const
+	{
+		std::lock_guard<std::mutex> guard(state->lock);
+		return state->inFlight;
+	}
+
+	uint32_t ScryptPipeline::ROMixWorkers() const
+	{
+		return (uint32_t)state->workers.size();
+	}
+}
@@ -0,0 +1,81 @@
+#pragma once
+
+/* Copyright (c) 2017, Dustin J Sparks
+*
+* PUBLIC DOMAIN MARK
+*
+* While this work is free from any patent or intellectual property claims, the algorithm, pseudo-code, and test vectors were derived from
+* RFC 7914 "The scrypt Password-Based Key Derivation Function" (C. Percival, August 2016, ISSN: 2070-1721)
+*
+* From the RFC:
+* Copyright (c) 2016 IETF Trust and the persons identified as the
+* document authors. All rights reserved.
+* This document is subject to BCP 78 and the IETF Trusts Legal Provisions Relating to IETF Documents (http://trustee.ietf.org/license-info)
+* in effect on the date of publication of this document. Please review these documents carefully, as they describe your rights and restrictions
+* with respect to this document. Code Components extracted from this document must include Simplified BSD License text as described in Section 4.e of
+* the Trust Legal Provisions and are provided without warranty as described in the Simplified BSD License.
+*
+* Unless required by applicable law or agreed to in writing, software
+* distributed under the License is distributed on an "AS IS" BASIS,
+* WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+* See the License for the specific language governing permissions and
+* limitations under the License.
+*/
+
+#include <atomic>
+#include <functional>
+#include "Common.h"
+#include "Memory.h"
+#include "ScryptNative.h"
+#include "SHA.h"
+
+// Internal pieces shared by the translation units of the native core, not part of the public API
+namespace ScryptNative
+{
+	// Throws with the same messages as the managed API if any scrypt parameter is out of range.
+	// MaxMemory caps one lane's V (N * r * 128 bytes), raised only by the large-memory mode.
+	void ValidateParameters(const uint8_t* Password, size_t PasswordLength, const uint8_t* Salt, size_t SaltLength,
+		uint64_t Iterations, uint32_t BlockSize, uint32_t Parallelism, const uint8_t* Output, size_t OutputByteLength,
+		uint64_t MaxMemory = 0x7fffffff);
+
+	// MaxThreads as passed to the public API (0 = one per hardware thread), capped to the amount of Work available
+	uint32_t ResolveThreads(uint32_t MaxThreads, size_t Work);
+
+	// Runs Worker on Threads threads (the calling thread included).  Workers pull work items by incrementing the shared
+	// counter until it reaches Count.  The first exception stops the other workers and is rethrown once all have joined.
+	// With PinNodes every worker runs pinned to one NUMA node, see NUMA::Enable.
+	void RunWorkers(uint32_t Threads, size_t Count, const std::function<void(std::atomic<size_t>&)>& Worker, bool PinNodes = false);
+
+	// PBKDF2-HMAC-SHA256 with one iteration (all scrypt ever uses) under an HMAC that is already keyed by the password,
+	// so scrypt's two PBKDF2 calls derive the ipad/opad midstates only once per password. MaxThreads as for the public API.
+	void PBKDF2SHA256(const HMAC<SHA256>& Keyed, const uint8_t* Salt, size_t SaltLength, uint8_t* Output, size_t OutputByteCount, uint32_t MaxThreads);
+
+	// Bytes [Offset, Offset + OutputByteCount) of the same one iteration PBKDF2, Salted = a keyed HMAC after Reset() and Update(Salt).
+	// Lets every ROMix lane derive its own r * 128 bytes of B right before it runs, on the thread that runs it.
+	void PBKDF2SHA256Range(const HMAC<SHA256>& Salted, uint64_t Offset, uint8_t* Output, size_t OutputByteCount, uint32_t MaxThreads);
+
+	// RFC 7914 section 5, runs one lane in place on Bp (r * 128 bytes).
+	// seqMem (N blocks) and XY (two blocks) are 64 byte aligned scratch owned by the caller, one set per thread.
+	void ROMix(uint8_t* Bp, uint32_t BlockSize, size_t N, uint32_t* seqMem, uint32_t* XY);
+
+	// The two halves of ROMix, so they can be timed apart: ROMixFill writes V from Bp and leaves X = H(V[N-1]) in XY,
+	// ROMixMix runs the N data dependent steps from there and writes X back to Bp.
+	void ROMixFill(const uint8_t* Bp, uint32_t BlockSize, size_t N, uint32_t* seqMem, uint32_t* XY);
+	void ROMixMix(uint8_t* Bp, uint32_t BlockSize, size_t N, const uint32_t* seqMem, uint32_t* XY);
+
+	// ROMixMix for Lanes (at most Scrypt::MaxInterleave) independent lanes on one thread, advanced round robin: as soon as a
+	// lane's next j is known its V[j] is prefetched, and the other lanes' BlockMix runs while that load is in flight.
+	// Lane k needs ROMixFill done on seqMem[k] with its XY right after V (seqMem[k] + N * r * 32), as ROMix lays it out.
+	void ROMixMixInterleaved(uint8_t* const* Bp, size_t Lanes, uint32_t BlockSize, size_t N, uint32_t* const* seqMem);
+
+	class CallRecorder; // Instrument.h
+
+	// ROMix on Lanes lanes with scratch holding Lanes consecutive V/X/Y sets: plain ROMix for one lane, otherwise every fill
+	// then ROMixMixInterleaved.  rec, when attached, gets the fill and mix time.
+	void ROMixLanes(uint8_t* const* Bp, size_t Lanes, uint32_t BlockSize, size_t N, uint32_t* scratch, CallRecorder* rec);
+
+	// Iterations [Begin, End) of either loop, so a lane can be run in slices.  The fill expects V[0] already loaded
+	// (shuffleIn) and leaves X in XY after its last iteration; the mix leaves X in XY after its last one (N is even).
+	void ROMixFillSteps(uint32_t BlockSize, size_t N, uint32_t* seqMem, uint32_t* XY, size_t Begin, size_t End);
+	void ROMixMixSteps(uint32_t BlockSize, size_t N, const uint32_t* seqMem, uint32_t* XY, size_t Begin, size_t End);
+}
@@ -0,0 +1,149 @@
+/* Copyright (c) 2017, Dustin J Sparks
+*
+* PUBLIC DOMAIN MARK
+*
+* While this work is free from any patent or intellectual property claims, the algorithm, pseudo-code, and test vectors were derived from
+* RFC 7914 "The scrypt Password-Based Key Derivation Function" (C. Percival, August 2016, ISSN: 2070-1721)
+*
+* From the RFC:
+* Copyright (c) 2016 IETF Trust and the persons identified as the
+* document authors. All rights reserved.
+* This document is subject to BCP 78 and the IETF Trusts Legal Provisions Relating to IETF Documents (http://trustee.ietf.org/license-info)
+* in effect on the date of publication of this document. Please review these documents carefully, as they describe your rights and restrictions
+* with respect to this document. Code Components extracted from this document must include Simplified BSD License text as described in Section 4.e of
+* the Trust Legal Provisions and are provided without warranty as described in the Simplified BSD License.
+*
+* Unless required by applicable law or agreed to in writing, software
+* distributed under the License is distributed on an "AS IS" BASIS,
+* WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+* See the License for the specific language governing permissions and
+* limitations under the License.
+*/
+
+#include "SHA.h"
+#include "Dispatch.h"
+#include <atomic>
+
+namespace ScryptNative
+{
+#define ROTL32(a,b) (((uint32_t)(a) << (b)) | ((uint32_t)(a) >> (32 - (b))))
+#define ROTR32(a,b) (((uint32_t)(a) >> (b)) | ((uint32_t)(a) << (32 - (b))))
+#define ROTR64(a,b) (((uint64_t)(a) >> (b)) | ((uint64_t)(a) << (64 - (b))))
+
+	const uint32_t K256[64] = {
+		0x428a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5, 0x3956c25b, 0x59f111f1, 0x923f82a4, 0xab1c5ed5,
+		0xd807aa98, 0x12835b01, 0x243185be, 0x550c7dc3, 0x72be5d74, 0x80deb1fe, 0x9bdc06a7, 0xc19bf174,
+		0xe49b69c1, 0xefbe4786, 0x0fc19dc6, 0x240ca1cc, 0x2de92c6f, 0x4a7484aa, 0x5cb0a9dc, 0x76f988da,
+		0x983e5152, 0xa831c66d, 0xb00327c8, 0xbf597fc7, 0xc6e00bf3, 0xd5a79147, 0x06ca6351, 0x14292967,
+		0x27b70a85, 0x2e1b2138, 0x4d2c6dfc, 0x53380d13, 0x650a7354, 0x766a0abb, 0x81c2c92e, 0x92722c85,
+		0xa2bfe8a1, 0xa81a664b, 0xc24b8b70, 0xc76c51a3, 0xd192e819, 0xd6990624, 0xf40e3585, 0x106aa070,
+		0x19a4c116, 0x1e376c08, 0x2748774c, 0x34b0bcb5, 0x391c0cb3, 0x4ed8aa4a, 0x5b9cca4f, 0x682e6ff3,
+		0x748f82ee, 0x78a5636f, 0x84c87814, 0x8cc70208, 0x90befffa, 0xa4506ceb, 0xbef9a3f7, 0xc67178f2 };
+
+	static const uint64_t K512[80] = {
+		0x428a2f98d728ae22ULL, 0x7137449123ef65cdULL, 0xb5c0fbcfec4d3b2fULL, 0xe9b5dba58189dbbcULL, 0x3956c25bf348b538ULL,
+		0x59f111f1b605d019ULL, 0x923f82a4af194f9bULL, 0xab1c5ed5da6d8118ULL, 0xd807aa98a3030242ULL, 0x12835b0145706fbeULL,
+		0x243185be4ee4b28cULL, 0x550c7dc3d5ffb4e2ULL, 0x72be5d74f27b896fULL, 0x80deb1fe3b1696b1ULL, 0x9bdc06a725c71235ULL,
+		0xc19bf174cf692694ULL, 0xe49b69c19ef14ad2ULL, 0xefbe4786384f25e3ULL, 0x0fc19dc68b8cd5b5ULL, 0x240ca1cc77ac9c65ULL,
+		0x2de92c6f592b0275ULL, 0x4a7484aa6ea6e483ULL, 0x5cb0a9dcbd41fbd4ULL, 0x76f988da831153b5ULL, 0x983e5152ee66dfabULL,
+		0xa831c66d2db43210ULL, 0xb00327c898fb213fULL, 0xbf597fc7beef0ee4ULL, 0xc6e00bf33da88fc2ULL, 0xd5a79147930aa725ULL,
+		0x06ca6351e003826fULL, 0x142929670a0e6e70ULL, 0x27b70a8546d22ffcULL, 0x2e1b21385c26c926ULL, 0x4d2c6dfc5ac42aedULL,
+		0x53380d139d95b3dfULL, 0x650a73548baf63deULL, 0x766a0abb3c77b2a8ULL, 0x81c2c92e47edaee6ULL, 0x92722c851482353bULL,
+		0xa2bfe8a14cf10364ULL, 0xa81a664bbc423001ULL, 0xc24b8b70d0f89791ULL, 0xc76c51a30654be30ULL, 0xd192e819d6ef5218ULL,
+		0xd69906245565a910ULL, 0xf40e35855771202aULL, 0x106aa07032bbd1b8ULL, 0x19a4c116b8d2d0c8ULL, 0x1e376c085141ab53ULL,
+		0x2748774cdf8eeb99ULL, 0x34b0bcb5e19b48a8ULL, 0x391c0cb3c5c95a63ULL, 0x4ed8aa4ae3418acbULL, 0x5b9cca4f7763e373ULL,
+		0x682e6ff3d6b2b8a3ULL, 0x748f82ee5defb2fcULL, 0x78a5636f43172f60ULL, 0x84c87814a1f0ab72ULL, 0x8cc702081a6439ecULL,
+		0x90befffa23631e28ULL, 0xa4506cebde82bde9ULL, 0xbef9a3f7b2c67915ULL, 0xc67178f2e372532bULL, 0xca273eceea26619cULL,
+		0xd186b8c721c0c207ULL, 0xeada7dd6cde0eb1eULL, 0xf57d4f7fee6ed178ULL, 0x06f067aa72176fbaULL, 0x0a637dc5a2c898a6ULL,
+		0x113f9804bef90daeULL, 0x1b710b35131c471bULL, 0x28db77f523047d84ULL, 0x32caab7b40c72493ULL, 0x3c9ebe0a15c9bebcULL,
+		0x431d67c49c100d4cULL, 0x4cc5d4becb3e42b6ULL, 0x597f299cfc657e2aULL, 0x5fcb6fab3ad6faecULL, 0x6c44198c4a475817ULL };
+
+	void SHA1Compress(uint32_t* state, const uint8_t* block)
+	{
+		uint32_t W[80];
+		for (int t = 0; t < 16; t++) W[t] = be32dec(block + t * 4);
+		for (int t = 16; t < 80; t++) W[t] = ROTL32(W[t - 3] ^ W[t - 8] ^ W[t - 14] ^ W[t - 16], 1);
+		uint32_t a = state[0], b = state[1], c = state[2], d = state[3], e = state[4], f, k, tmp;
+		for (int t = 0; t < 80; t++)
+		{
+			if (t < 20) { f = (b & c) | (~b & d); k = 0x5a827999; }
+			else if (t < 40) { f = b ^ c ^ d; k = 0x6ed9eba1; }
+			else if (t < 60) { f = (b & c) | (b & d) | (c & d); k = 0x8f1bbcdc; }
+			else { f = b ^ c ^ d; k = 0xca62c1d6; }
+			tmp = ROTL32(a, 5) + f + e + k + W[t];
+			e = d; d = c; c = ROTL32(b, 30); b = a; a = tmp;
+		}
+		state[0] += a; state[1] += b; state[2] += c; state[3] += d; state[4] += e;
+	}
+
+	// W holds the 16 message words on entry, the schedule is extended in place
+	static inline void compress256(uint32_t* state, uint32_t* W)
+	{
+		for (int t = 16; t < 64; t++)
+		{
+			uint32_t s0 = ROTR32(W[t - 15], 7) ^ ROTR32(W[t - 15], 18) ^ (W[t - 15] >> 3);
+			uint32_t s1 = ROTR32(W[t - 2], 17) ^ ROTR32(W[t - 2], 19) ^ (W[t - 2] >> 10);
+			W[t] = W[t - 16] + s0 + W[t - 7] + s1;
+		}
+		uint32_t a = state[0], b = state[1], c = state[2], d = state[3], e = state[4], f = state[5], g = state[6], h = state[7];
+		for (int t = 0; t < 64; t++)
+		{
+			uint32_t t1 = h + (ROTR32(e, 6) ^ ROTR32(e, 11) ^ ROTR32(e, 25)) + ((e & f) ^ (~e & g)) + K256[t] + W[t];
+			uint32_t t2 = (ROTR32(a, 2) ^ ROTR32(a, 13) ^ ROTR32(a, 22)) + ((a & b) ^ (a & c) ^ (b & c));
+			h = g; g = f; f = e; e = d + t1; d = c; c = b; b = a; a = t1 + t2;
+		}
+		state[0] += a; state[1] += b; state[2] += c; state[3] += d; state[4] += e; state[5] += f; state[6] += g; state[7] += h;
+	}
+
+	static void portableCompress256(uint32_t* state, const uint8_t* block)
+	{
+		uint32_t W[64];
+		for (int t = 0; t < 16; t++) W[t] = be32dec(block + t * 4);
+		compress256(state, W);
+	}
+
+	static void portableCompressWords256(uint32_t* state, const uint32_t* words)
+	{
+		uint32_t W[64];
+		memcpy(W, words, 16 * sizeof(uint32_t));
+		compress256(state, W);
+	}
+
+	static const SHA256Kernel portable256 = { "portable", portableCompress256, portableCompressWords256 };
+	// Constant initialized, so hashing during the static initialization of another unit still finds a kernel
+	static std::atomic<const SHA256Kernel*> sha256Kernel(&portable256);
+
+	const SHA256Kernel* SHA256KernelPortable() { return &portable256; }
+	const SHA256Kernel* BoundSHA256() { return sha256Kernel.load(std::memory_order_relaxed); }
+	void BindSHA256(const SHA256Kernel* Kernel) { sha256Kernel.store(Kernel, std::memory_order_relaxed); }
+
+	void SHA256Compress(uint32_t* state, const uint8_t* block)
+	{
+		sha256Kernel.load(std::memory_order_relaxed)->Compress(state, block);
+	}
+
+	void SHA256CompressWords(uint32_t* state, const uint32_t* W)
+	{
+		sha256Kernel.load(std::memory_order_relaxed)->CompressWords(state, W);
+	}
+
+	void SHA512Compress(uint64_t* state, const uint8_t* block)
+	{
+		uint64_t W[80];
+		for (int t = 0; t < 16; t++) W[t] = be64dec(block + t * 8);
+		for (int t = 16; t < 80; t++)
+		{
+			uint64_t s0 = ROTR64(W[t - 15], 1) ^ ROTR64(W[t - 15], 8) ^ (W[t - 15] >> 7);
+			uint64_t s1 = ROTR64(W[t - 2], 19) ^ ROTR64(W[t - 2], 61) ^ (W[t - 2] >> 6);
+			W[t] = W[t - 16] + s0 + W[t - 7] + s1;
+		}
+		uint64_t a = state[0], b = state[1], c = state[2], d = state[3], e = state[4], f = state[5], g = state[6], h = state[7];
+		for (int t = 0; t < 80; t++)
+		{
+			uint64_t t1 = h + (ROTR64(e, 14) ^ ROTR64(e, 18) ^ ROTR64(e, 41)) + ((e & f) ^ (~e & g)) + K512[t] + W[t];
+			uint64_t t2 = (ROTR64(a, 28) ^ ROTR64(a, 34) ^ ROTR64(a, 39)) + ((a & b) ^ (a & c) ^ (b & c));
+			h = g; g = f; f = e; e = d + t1; d = c; c = b; b = a; a = t1 + t2;
+		}
+		state[0] += a; state[1] += b; state[2] += c; state[3] += d; state[4] += e; state[5] += f; state[6] += g; state[7] += h;
+	}
+}
@@ -0,0 +1,210 @@
+#pragma once
+
+/* Copyright (c) 2017, Dustin J Sparks
+*
+* PUBLIC DOMAIN MARK
+*
+* While this work is free from any patent or intellectual property claims, the algorithm, pseudo-code, and test vectors were derived from
+* RFC 7914 "The scrypt Password-Based Key Derivation Function" (C. Percival, August 2016, ISSN: 2070-1721)
+*
+* From the RFC:
+* Copyright (c) 2016 IETF Trust and the persons identified as the
+* document authors. All rights reserved.
+* This document is subject to BCP 78 and the IETF Trusts Legal Provisions Relating to IETF Documents (http://trustee.ietf.org/license-info)
+* in effect on the date of publication of this document. Please review these documents carefully, as they describe your rights and restrictions
+* with respect to this document. Code Components extracted from this document must include Simplified BSD License text as described in Section 4.e of
+* the Trust Legal Provisions and are provided without warranty as described in the Simplified BSD License.
+*
+* Unless required by applicable law or agreed to in writing, software
+* distributed under the License is distributed on an "AS IS" BASIS,
+* WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+* See the License for the specific language governing permissions and
+* limitations under the License.
+*/
+
+#include "Common.h"
+
+namespace ScryptNative
+{
+#define SHA1BLOCKSIZE		20
+#define SHA256BLOCKSIZE		32
+#define SHA512BLOCKSIZE		64
+
+	// FIPS 180-4 Secure Hash Standard.  Each class is a plain value type (no heap) holding the chaining state,
+	// the total message length, and one partially filled input block.
+	// Initialize() -> Update() as many times as needed -> Final()
+	template <typename Word, size_t StateWords, size_t InputBlockBytes, size_t DigestBytes, size_t LengthBytes,
+		void(*CompressFunction)(Word*, const uint8_t*)>
+	class MDHash
+	{
+	public:
+		static const size_t BlockBytes = InputBlockBytes;
+		static const size_t OutputBytes = DigestBytes;
+
+		Word state[StateWords];
+		uint64_t count; // bytes processed so far
+		uint8_t buffer[InputBlockBytes];
+
+		void Update(const uint8_t* data, size_t length)
+		{
+			size_t used = (size_t)(count % InputBlockBytes);
+			count += length;
+			if (used != 0)
+			{
+				size_t take = InputBlockBytes - used;
+				if (take > length) take = length;
+				memcpy(buffer + used, data, take);
+				data += take; length -= take; used += take;
+				if (used < InputBlockBytes)
+					return;
+				CompressFunction(state, buffer);
+			}
+			for (; length >= InputBlockBytes; data += InputBlockBytes, length -= InputBlockBytes)
+				CompressFunction(state, data);
+			if (length != 0)
+				memcpy(buffer, data, length);
+		}
+
+		// Writes the padded tail of the message (the buffered bytes, 0x80, zeros and the bit length) to blocks and returns
+		// how many input blocks that is (1 or 2).  The state is left alone, Final() and the multi-buffer code compress them.
+		size_t Pad(uint8_t* blocks) const
+		{
+			size_t used = (size_t)(count % InputBlockBytes);
+			size_t total = used + 1 + LengthBytes > InputBlockBytes ? 2 * InputBlockBytes : InputBlockBytes;
+			memcpy(blocks, buffer, used);
+			blocks[used++] = 0x80;
+			memset(blocks + used, 0, total - used);
+			be64enc(blocks + total - 8, count << 3); // lengths wider than 64 bits are never produced here
+			return total / InputBlockBytes;
+		}
+
+		void Final(uint8_t* digest)
+		{
+			uint8_t blocks[2 * InputBlockBytes];
+			size_t n = Pad(blocks);
+			for (size_t b = 0; b < n; b++)
+				CompressFunction(state, blocks + b * InputBlockBytes);
+			SecureZero(blocks, sizeof(blocks));
+			for (size_t i = 0; i < DigestBytes / sizeof(Word); i++)
+			{
+				if (sizeof(Word) == 4) be32enc(digest + i * 4, (uint32_t)state[i]);
+				else be64enc(digest + i * 8, (uint64_t)state[i]);
+			}
+			SecureZero(buffer, sizeof(buffer));
+		}
+	};
+
+	extern const uint32_t K256[64]; // SHA-256 round constants, shared with the multi-buffer kernels in SHALanes.h
+
+	void SHA1Compress(uint32_t* state, const uint8_t* block);
+	void SHA256Compress(uint32_t* state, const uint8_t* block);
+	void SHA256CompressWords(uint32_t* state, const uint32_t* W); // 16 message words in host order
+	void SHA512Compress(uint64_t* state, const uint8_t* block);
+
+	class SHA1 : public MDHash<uint32_t, 5, 64, SHA1BLOCKSIZE, 8, SHA1Compress>
+	{
+	public:
+		void Initialize()
+		{
+			state[0] = 0x67452301; state[1] = 0xefcdab89; state[2] = 0x98badcfe; state[3] = 0x10325476; state[4] = 0xc3d2e1f0;
+			count = 0;
+		}
+	};
+
+	class SHA256 : public MDHash<uint32_t, 8, 64, SHA256BLOCKSIZE, 8, SHA256Compress>
+	{
+	public:
+		void Initialize()
+		{
+			state[0] = 0x6a09e667; state[1] = 0xbb67ae85; state[2] = 0x3c6ef372; state[3] = 0xa54ff53a;
+			state[4] = 0x510e527f; state[5] = 0x9b05688c; state[6] = 0x1f83d9ab; state[7] = 0x5be0cd19;
+			count = 0;
+		}
+	};
+
+	class SHA512 : public MDHash<uint64_t, 8, 128, SHA512BLOCKSIZE, 16, SHA512Compress>
+	{
+	public:
+		void Initialize()
+		{
+			state[0] = 0x6a09e667f3bcc908ULL; state[1] = 0xbb67ae8584caa73bULL; state[2] = 0x3c6ef372fe94f82bULL; state[3] = 0xa54ff53a5f1d36f1ULL;
+			state[4] = 0x510e527fade682d1ULL; state[5] = 0x9b05688c2b3e6c1fULL; state[6] = 0x1f83d9abfb41bd6bULL; state[7] = 0x5be0cd19137e2179ULL;
+			count = 0;
+		}
+	};
+
+	// RFC 2104 keyed hash, functionally equivalent to System::Security::Cryptography::HMACSHA*
+	// SetKey() hashes the padded key once into the ipad/opad midstates; every Reset() after that is a plain copy of those,
+	// so PBKDF2 pays two compressions per HMAC instead of four, and one keyed object can serve any number of messages.
+	template <typename Hash>
+	class HMAC
+	{
+		Hash innerKeyed;
+		Hash outerKeyed;
+		Hash inner;
+		Hash outer;
+	public:
+		static const size_t OutputBytes = Hash::OutputBytes;
+
+		void SetKey(const uint8_t* key, size_t keyLength)
+		{
+			uint8_t pad[Hash::BlockBytes];
+			uint8_t keyHash[Hash::OutputBytes];
+			if (keyLength > Hash::BlockBytes) // long keys are hashed first, per the spec
+			{
+				innerKeyed.Initialize();
+				innerKeyed.Update(key, keyLength);
+				innerKeyed.Final(keyHash);
+				key = keyHash;
+				keyLength = Hash::OutputBytes;
+			}
+			memset(pad, 0x36, sizeof(pad));
+			for (size_t i = 0; i < keyLength; i++) pad[i] ^= key[i];
+			innerKeyed.Initialize();
+			innerKeyed.Update(pad, sizeof(pad));
+			memset(pad, 0x5c, sizeof(pad));
+			for (size_t i = 0; i < keyLength; i++) pad[i] ^= key[i];
+			outerKeyed.Initialize();
+			outerKeyed.Update(pad, sizeof(pad));
+			SecureZero(pad, sizeof(pad));
+			SecureZero(keyHash, sizeof(keyHash));
+		}
+
+		// The keyed midstates and the running inner hash, for the multi-buffer PBKDF2 kernels
+		const Hash& InnerKeyed() const { return innerKeyed; }
+		const Hash& OuterKeyed() const { return outerKeyed; }
+		const Hash& Inner() const { return inner; }
+
+		// Starts a new message under the current key
+		void Reset()
+		{
+			inner = innerKeyed;
+			outer = outerKeyed;
+		}
+
+		void Initialize(const uint8_t* key, size_t keyLength)
+		{
+			SetKey(key, keyLength);
+			Reset();
+		}
+
+		void Update(const uint8_t* data, size_t length)
+		{
+			inner.Update(data, length);
+		}
+
+		void Final(uint8_t* digest)
+		{
+			uint8_t innerHash[Hash::OutputBytes];
+			inner.Final(innerHash);
+			outer.Update(innerHash, sizeof(innerHash));
+			outer.Final(digest);
+			SecureZero(innerHash, sizeof(innerHash));
+		}
+
+		void Clear()
+		{
+			SecureZero(this, sizeof(*this));
+		}
+	};
+}
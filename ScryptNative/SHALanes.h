@@ -0,0 +1,116 @@
+#pragma once
+
+/* Copyright (c) 2017, Dustin J Sparks
+*
+* PUBLIC DOMAIN MARK
+*
+* While this work is free from any patent or intellectual property claims, the algorithm, pseudo-code, and test vectors were derived from
+* RFC 7914 "The scrypt Password-Based Key Derivation Function" (C. Percival, August 2016, ISSN: 2070-1721)
+*
+* From the RFC:
+* Copyright (c) 2016 IETF Trust and the persons identified as the
+* document authors. All rights reserved.
+* This document is subject to BCP 78 and the IETF Trusts Legal Provisions Relating to IETF Documents (http://trustee.ietf.org/license-info)
+* in effect on the date of publication of this document. Please review these documents carefully, as they describe your rights and restrictions
+* with respect to this document. Code Components extracted from this document must include Simplified BSD License text as described in Section 4.e of
+* the Trust Legal Provisions and are provided without warranty as described in the Simplified BSD License.
+*
+* Unless required by applicable law or agreed to in writing, software
+* distributed under the License is distributed on an "AS IS" BASIS,
+* WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+* See the License for the specific language governing permissions and
+* limitations under the License.
+*/
+
+#include "SHA.h"
+
+// Multi-buffer SHA-256 for PBKDF2: L independent messages, one per 32 bit element of a vector register, in the same
+// transposed layout as the Salsa lanes (state word i is one vector holding word i of every lane).
+// PBKDF2 blocks T are independent, so L of them run through the HMAC iterations together.
+// Instantiated only by the Lanes*.cpp units, each with its own Lanes type (see SalsaLanes.h).
+
+namespace ScryptNative
+{
+	template <typename Lanes>
+	struct SHA256Lanes
+	{
+		typedef typename Lanes::V V;
+		static const uint32_t L = Lanes::L;
+
+		// SHA256Compress() for every lane, W holds the 16 big endian message words and is used as the schedule ring
+		static inline void Compress(V* state, V* W)
+		{
+#define LROTR(x, n) Lanes::template rotl<32 - n>(x)
+			V a = state[0], b = state[1], c = state[2], d = state[3], e = state[4], f = state[5], g = state[6], h = state[7];
+			for (int t = 0; t < 64; t++)
+			{
+				if (t >= 16)
+				{
+					V w15 = W[(t - 15) & 15], w2 = W[(t - 2) & 15];
+					V s0 = Lanes::xor_(Lanes::xor_(LROTR(w15, 7), LROTR(w15, 18)), Lanes::template shr<3>(w15));
+					V s1 = Lanes::xor_(Lanes::xor_(LROTR(w2, 17), LROTR(w2, 19)), Lanes::template shr<10>(w2));
+					W[t & 15] = Lanes::add(Lanes::add(W[t & 15], s0), Lanes::add(W[(t - 7) & 15], s1));
+				}
+				V S1 = Lanes::xor_(Lanes::xor_(LROTR(e, 6), LROTR(e, 11)), LROTR(e, 25));
+				V ch = Lanes::xor_(Lanes::and_(e, f), Lanes::andnot(e, g));
+				V t1 = Lanes::add(Lanes::add(Lanes::add(h, S1), Lanes::add(ch, Lanes::set1(K256[t]))), W[t & 15]);
+				V S0 = Lanes::xor_(Lanes::xor_(LROTR(a, 2), LROTR(a, 13)), LROTR(a, 22));
+				V maj = Lanes::xor_(Lanes::and_(a, b), Lanes::and_(c, Lanes::xor_(a, b)));
+				h = g; g = f; f = e; e = Lanes::add(d, t1); d = c; c = b; b = a; a = Lanes::add(t1, Lanes::add(S0, maj));
+			}
+#undef LROTR
+			state[0] = Lanes::add(state[0], a); state[1] = Lanes::add(state[1], b); state[2] = Lanes::add(state[2], c); state[3] = Lanes::add(state[3], d);
+			state[4] = Lanes::add(state[4], e); state[5] = Lanes::add(state[5], f); state[6] = Lanes::add(state[6], g); state[7] = Lanes::add(state[7], h);
+		}
+
+		// state = midstate (a keyed ipad/opad hash, 64 bytes in) extended by a 32 byte message held as 8 words per lane
+		static inline void hash32(V* state, const uint32_t* midstate, const V* message)
+		{
+			V W[16];
+			for (int i = 0; i < 8; i++) W[i] = message[i];
+			W[8] = Lanes::set1(0x80000000);
+			for (int i = 9; i < 15; i++) W[i] = Lanes::set1(0);
+			W[15] = Lanes::set1((64 + 32) * 8); // bit length of ipad/opad block + message
+			for (int i = 0; i < 8; i++) state[i] = Lanes::set1(midstate[i]);
+			Compress(state, W);
+		}
+
+		// PBKDF2 F() for L blocks T, writing L * 32 bytes to Out.  Lane k's inner hash of salt || INT(T) is States[k * 8 ..]
+		// with only its padded tail, Tails[k * 128 ..] (Blocks of 64 bytes, the same count for every lane), left to compress.
+		// InnerKeyed / OuterKeyed are the password keyed HMAC midstates.  Takes no hash objects, see Dispatch.h.
+		static void F(const uint32_t* InnerKeyed, const uint32_t* OuterKeyed, const uint32_t* States, const uint8_t* Tails,
+			size_t Blocks, uint32_t Iterations, uint8_t* Out)
+		{
+			// lanes are (un)transposed through a plain word array and vector loads / stores: reading the words of a V
+			// object through a uint32_t pointer breaks strict aliasing, and GCC's loop vectorizer does act on that
+			alignas(64) uint32_t words[16 * L];
+			V W[16], S[8], U[8], T[8];
+			for (uint32_t k = 0; k < L; k++)
+				for (int i = 0; i < 8; i++)
+					words[i * L + k] = States[k * 8 + i];
+			for (int i = 0; i < 8; i++) S[i] = Lanes::load((const V*)words + i);
+			for (size_t b = 0; b < Blocks; b++)
+			{
+				for (int i = 0; i < 16; i++)
+					for (uint32_t k = 0; k < L; k++)
+						words[i * L + k] = be32dec(Tails + k * 128 + b * 64 + i * 4);
+				for (int i = 0; i < 16; i++) W[i] = Lanes::load((const V*)words + i);
+				Compress(S, W);
+			}
+			hash32(U, OuterKeyed, S); // U1
+			for (int i = 0; i < 8; i++) T[i] = U[i];
+			for (uint32_t c = 1; c < Iterations; c++)
+			{
+				hash32(S, InnerKeyed, U);
+				hash32(U, OuterKeyed, S);
+				for (int i = 0; i < 8; i++) T[i] = Lanes::xor_(T[i], U[i]); //Xor step
+			}
+			for (int i = 0; i < 8; i++) Lanes::store((V*)words + i, T[i]);
+			for (uint32_t k = 0; k < L; k++)
+				for (int i = 0; i < 8; i++)
+					be32enc(Out + k * 32 + i * 4, words[i * L + k]);
+			SecureZero(words, sizeof(words));
+			SecureZero(W, sizeof(W)); SecureZero(S, sizeof(S)); SecureZero(U, sizeof(U)); SecureZero(T, sizeof(T));
+		}
+	};
+}
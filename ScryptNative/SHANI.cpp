@@ -0,0 +1,98 @@
+/* Copyright (c) 2017, Dustin J Sparks
+*
+* PUBLIC DOMAIN MARK
+*
+* While this work is free from any patent or intellectual property claims, the algorithm, pseudo-code, and test vectors were derived from
+* RFC 7914 "The scrypt Password-Based Key Derivation Function" (C. Percival, August 2016, ISSN: 2070-1721)
+*
+* From the RFC:
+* Copyright (c) 2016 IETF Trust and the persons identified as the
+* document authors. All rights reserved.
+* This document is subject to BCP 78 and the IETF Trusts Legal Provisions Relating to IETF Documents (http://trustee.ietf.org/license-info)
+* in effect on the date of publication of this document. Please review these documents carefully, as they describe your rights and restrictions
+* with respect to this document. Code Components extracted from this document must include Simplified BSD License text as described in Section 4.e of
+* the Trust Legal Provisions and are provided without warranty as described in the Simplified BSD License.
+*
+* Unless required by applicable law or agreed to in writing, software
+* distributed under the License is distributed on an "AS IS" BASIS,
+* WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+* See the License for the specific language governing permissions and
+* limitations under the License.
+*/
+
+#include "Dispatch.h"
+#include "SHA.h"
+#if defined(__SHA__) || (defined(_MSC_VER) && (defined(_M_X64) || defined(_M_IX86)))
+#include <immintrin.h>
+
+// SHA-256 compression with the SHA extensions (SHA-NI): SHA256RNDS2 does two rounds, SHA256MSG1 / SHA256MSG2 the
+// message schedule.  Built with -msse4.1 -msha (CMakeLists.txt), run only when cpuid reports SHA, SSSE3 and SSE4.1.
+
+namespace ScryptNative
+{
+	// Rounds 4 * i .. 4 * i + 3, and the schedule words they feed: M[i % 4] holds W[4 * i .. 4 * i + 3]
+	template <int i>
+	static inline void quad(__m128i& state0, __m128i& state1, __m128i* M)
+	{
+		__m128i msg = _mm_add_epi32(M[i & 3], _mm_loadu_si128((const __m128i*)(K256 + 4 * i)));
+		state1 = _mm_sha256rnds2_epu32(state1, state0, msg);
+		if (i >= 3 && i <= 14)
+		{
+			__m128i tmp = _mm_alignr_epi8(M[i & 3], M[(i - 1) & 3], 4);
+			M[(i + 1) & 3] = _mm_sha256msg2_epu32(_mm_add_epi32(M[(i + 1) & 3], tmp), M[i & 3]);
+		}
+		msg = _mm_shuffle_epi32(msg, 0x0E);
+		state0 = _mm_sha256rnds2_epu32(state0, state1, msg);
+		if (i >= 1 && i <= 12)
+			M[(i - 1) & 3] = _mm_sha256msg1_epu32(M[(i - 1) & 3], M[i & 3]);
+	}
+
+	static inline void compress(uint32_t* state, __m128i* M)
+	{
+		// state words ABCD EFGH -> the ABEF / CDGH register pair the round instructions take
+		__m128i tmp = _mm_shuffle_epi32(_mm_loadu_si128((const __m128i*)state), 0xB1); // CDAB
+		__m128i state1 = _mm_shuffle_epi32(_mm_loadu_si128((const __m128i*)(state + 4)), 0x1B); // EFGH
+		__m128i state0 = _mm_alignr_epi8(tmp, state1, 8); // ABEF
+		state1 = _mm_blend_epi16(state1, tmp, 0xF0); // CDGH
+		__m128i save0 = state0, save1 = state1;
+
+		quad<0>(state0, state1, M); quad<1>(state0, state1, M); quad<2>(state0, state1, M); quad<3>(state0, state1, M);
+		quad<4>(state0, state1, M); quad<5>(state0, state1, M); quad<6>(state0, state1, M); quad<7>(state0, state1, M);
+		quad<8>(state0, state1, M); quad<9>(state0, state1, M); quad<10>(state0, state1, M); quad<11>(state0, state1, M);
+		quad<12>(state0, state1, M); quad<13>(state0, state1, M); quad<14>(state0, state1, M); quad<15>(state0, state1, M);
+
+		state0 = _mm_add_epi32(state0, save0);
+		state1 = _mm_add_epi32(state1, save1);
+		tmp = _mm_shuffle_epi32(state0, 0x1B); // FEBA
+		state1 = _mm_shuffle_epi32(state1, 0xB1); // DCHG
+		_mm_storeu_si128((__m128i*)state, _mm_blend_epi16(tmp, state1, 0xF0)); // DCBA
+		_mm_storeu_si128((__m128i*)(state + 4), _mm_alignr_epi8(state1, tmp, 8)); // HGFE
+	}
+
+	static void compressBlock(uint32_t* state, const uint8_t* block)
+	{
+		const __m128i byteSwap = _mm_set_epi64x(0x0c0d0e0f08090a0bULL, 0x0405060700010203ULL);
+		__m128i M[4];
+		for (int i = 0; i < 4; i++)
+			M[i] = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i*)(block + i * 16)), byteSwap);
+		compress(state, M);
+	}
+
+	static void compressWords(uint32_t* state, const uint32_t* W)
+	{
+		__m128i M[4];
+		for (int i = 0; i < 4; i++)
+			M[i] = _mm_loadu_si128((const __m128i*)(W + i * 4));
+		compress(state, M);
+	}
+
+	static const SHA256Kernel kernel = { "SHA-NI", compressBlock, compressWords };
+
+	const SHA256Kernel* SHA256KernelSHANI() { return &kernel; }
+}
+#else
+namespace ScryptNative
+{
+	const SHA256Kernel* SHA256KernelSHANI() { return nullptr; }
+}
+#endif
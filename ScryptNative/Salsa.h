@@ -0,0 +1,234 @@
+#pragma once
+
+/* Copyright (c) 2017, Dustin J Sparks
+*
+* PUBLIC DOMAIN MARK
+*
+* While this work is free from any patent or intellectual property claims, the algorithm, pseudo-code, and test vectors were derived from
+* RFC 7914 "The scrypt Password-Based Key Derivation Function" (C. Percival, August 2016, ISSN: 2070-1721)
+*
+* From the RFC:
+* Copyright (c) 2016 IETF Trust and the persons identified as the
+* document authors. All rights reserved.
+* This document is subject to BCP 78 and the IETF Trusts Legal Provisions Relating to IETF Documents (http://trustee.ietf.org/license-info)
+* in effect on the date of publication of this document. Please review these documents carefully, as they describe your rights and restrictions
+* with respect to this document. Code Components extracted from this document must include Simplified BSD License text as described in Section 4.e of
+* the Trust Legal Provisions and are provided without warranty as described in the Simplified BSD License.
+*
+* Unless required by applicable law or agreed to in writing, software
+* distributed under the License is distributed on an "AS IS" BASIS,
+* WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+* See the License for the specific language governing permissions and
+* limitations under the License.
+*/
+
+#include "Common.h"
+
+// Kernel selection is done at compile time from the target flags (see SCRYPT_ARCH in CMakeLists.txt); the multi-buffer
+// kernels in SalsaLanes.h are picked at run time instead (Dispatch.h).
+// SSE2 is part of every x64 target, AVX-512VL adds a native 32 bit rotate (VPROLD), and when AVX2 is enabled
+// the same intrinsics are emitted in their 3 operand VEX forms.
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define SCRYPT_SSE2 1
+#include <emmintrin.h>
+#endif
+#if defined(__AVX2__)
+#define SCRYPT_AVX2 1
+#include <immintrin.h>
+#endif
+#if defined(__AVX512F__) && defined(__AVX512VL__)
+#define SCRYPT_AVX512 1
+#include <immintrin.h>
+#endif
+
+namespace ScryptNative
+{
+#define R32(a,b) (((uint32_t)(a) << (b)) | ((a) >> (32 - (b))))
+
+	// Inside ROMix every 64 byte sub-block is kept in "diagonal-shuffled" order: shuffled word i holds RFC word (i * 5) % 16.
+	// That puts the diagonals of the 4x4 Salsa matrix in the four 128 bit rows
+	//   {0,5,10,15} {4,9,14,3} {8,13,2,7} {12,1,6,11}
+	// so each quarter-round step is a single vector operation.  The permutation is only applied when B is loaded from
+	// and stored back to the PBKDF2 output (shuffleIn / shuffleOut), never inside BlockMix or ROMix.
+	static inline void shuffleIn(uint32_t* X, const uint8_t* B, size_t words)
+	{
+		for (size_t k = 0; k < words; k += 16)
+			for (size_t i = 0; i < 16; i++)
+				X[k + i] = le32dec(B + (k + (i * 5) % 16) * 4);
+	}
+
+	static inline void shuffleOut(uint8_t* B, const uint32_t* X, size_t words)
+	{
+		for (size_t k = 0; k < words; k += 16)
+			for (size_t i = 0; i < 16; i++)
+				le32enc(B + (k + (i * 5) % 16) * 4, X[k + i]);
+	}
+
+	static inline void salsa20_8(uint32_t* data)
+	{
+		// from Dan Bernstein, adapted direct from the RFC document
+		// RFC word k lives at shuffled index (k * 13) % 16
+		uint32_t x0 = data[0], x1 = data[13], x2 = data[10], x3 = data[7], x4 = data[4], x5 = data[1], x6 = data[14], x7 = data[11],
+			x8 = data[8], x9 = data[5], xA = data[2], xB = data[15], xC = data[12], xD = data[9], xE = data[6], xF = data[3];
+		for (int i = 8; i > 0; i -= 2) {
+			x4 ^= R32(x0 + xC, 7); x8 ^= R32(x4 + x0, 9);
+			xC ^= R32(x8 + x4, 13); x0 ^= R32(xC + x8, 18);
+			x9 ^= R32(x5 + x1, 7); xD ^= R32(x9 + x5, 9);
+			x1 ^= R32(xD + x9, 13); x5 ^= R32(x1 + xD, 18);
+			xE ^= R32(xA + x6, 7); x2 ^= R32(xE + xA, 9);
+			x6 ^= R32(x2 + xE, 13); xA ^= R32(x6 + x2, 18);
+			x3 ^= R32(xF + xB, 7); x7 ^= R32(x3 + xF, 9);
+			xB ^= R32(x7 + x3, 13); xF ^= R32(xB + x7, 18);
+			x1 ^= R32(x0 + x3, 7); x2 ^= R32(x1 + x0, 9);
+			x3 ^= R32(x2 + x1, 13); x0 ^= R32(x3 + x2, 18);
+			x6 ^= R32(x5 + x4, 7); x7 ^= R32(x6 + x5, 9);
+			x4 ^= R32(x7 + x6, 13); x5 ^= R32(x4 + x7, 18);
+			xB ^= R32(xA + x9, 7); x8 ^= R32(xB + xA, 9);
+			x9 ^= R32(x8 + xB, 13); xA ^= R32(x9 + x8, 18);
+			xC ^= R32(xF + xE, 7); xD ^= R32(xC + xF, 9);
+			xE ^= R32(xD + xC, 13); xF ^= R32(xE + xD, 18);
+		}
+		data[0] += x0; data[13] += x1; data[10] += x2; data[7] += x3; data[4] += x4; data[1] += x5; data[14] += x6; data[11] += x7;
+		data[8] += x8; data[5] += x9; data[2] += xA; data[15] += xB; data[12] += xC; data[9] += xD; data[6] += xE; data[3] += xF;
+	}
+
+#if SCRYPT_SSE2
+#if SCRYPT_AVX512
+#define ROTL_EPI32(T, n) _mm_rol_epi32((T), (n))
+#else
+#define ROTL_EPI32(T, n) _mm_xor_si128(_mm_slli_epi32((T), (n)), _mm_srli_epi32((T), 32 - (n)))
+#endif
+
+	// Salsa20/8 with the whole state in four registers (one shuffled row each), same result as salsa20_8() above
+	static inline void salsa20_8(__m128i& X0, __m128i& X1, __m128i& X2, __m128i& X3)
+	{
+		__m128i Y0 = X0, Y1 = X1, Y2 = X2, Y3 = X3;
+		for (int i = 8; i > 0; i -= 2) {
+			// columns
+			Y1 = _mm_xor_si128(Y1, ROTL_EPI32(_mm_add_epi32(Y0, Y3), 7));
+			Y2 = _mm_xor_si128(Y2, ROTL_EPI32(_mm_add_epi32(Y1, Y0), 9));
+			Y3 = _mm_xor_si128(Y3, ROTL_EPI32(_mm_add_epi32(Y2, Y1), 13));
+			Y0 = _mm_xor_si128(Y0, ROTL_EPI32(_mm_add_epi32(Y3, Y2), 18));
+			// rotate the rows so the same operations work on the "rows" of the matrix
+			Y1 = _mm_shuffle_epi32(Y1, 0x93);
+			Y2 = _mm_shuffle_epi32(Y2, 0x4e);
+			Y3 = _mm_shuffle_epi32(Y3, 0x39);
+			// rows
+			Y3 = _mm_xor_si128(Y3, ROTL_EPI32(_mm_add_epi32(Y0, Y1), 7));
+			Y2 = _mm_xor_si128(Y2, ROTL_EPI32(_mm_add_epi32(Y3, Y0), 9));
+			Y1 = _mm_xor_si128(Y1, ROTL_EPI32(_mm_add_epi32(Y2, Y3), 13));
+			Y0 = _mm_xor_si128(Y0, ROTL_EPI32(_mm_add_epi32(Y1, Y2), 18));
+			// and back
+			Y1 = _mm_shuffle_epi32(Y1, 0x39);
+			Y2 = _mm_shuffle_epi32(Y2, 0x4e);
+			Y3 = _mm_shuffle_epi32(Y3, 0x93);
+		}
+		X0 = _mm_add_epi32(X0, Y0); X1 = _mm_add_epi32(X1, Y1); X2 = _mm_add_epi32(X2, Y2); X3 = _mm_add_epi32(X3, Y3);
+	}
+#endif
+
+	// data, data2 and dataOut are 2 * blocksize shuffled sub-blocks of 16 words each.
+	// With XorInput the input block is (data xor data2), which is never written anywhere: each 64 byte piece is combined
+	// on the way into the Salsa state.  dataOut must not overlap either input.
+	template <bool XorInput>
+	static inline void blockMixT(const uint32_t* data, const uint32_t* data2, uint32_t* dataOut, uint32_t blocksize)
+	{
+		// NOTE that the output is written as:
+		// B'={Y[0],Y[2],...Y[2*r-2],Y[1],Y[3]...Y[2*r-1]}
+		// The first Salsa operation is written starting from the "front" of B',
+		//   while the second Salsa operation is written starting from the "middle".
+		// This is per the spec, and the reason for separate input and output arrays.
+#if SCRYPT_SSE2
+		const __m128i* in = (const __m128i*)data;
+		const __m128i* in2 = (const __m128i*)data2;
+		__m128i* out = (__m128i*)dataOut;
+#define LOADIN(k) (XorInput ? _mm_xor_si128(_mm_loadu_si128(in + (k)), _mm_loadu_si128(in2 + (k))) : _mm_loadu_si128(in + (k)))
+		size_t last = (2 * (size_t)blocksize - 1) * 4;
+		// 1. X = B[2r-1], kept in registers for the whole call
+		__m128i X0 = LOADIN(last), X1 = LOADIN(last + 1), X2 = LOADIN(last + 2), X3 = LOADIN(last + 3);
+		for (uint32_t i = 0; i < blocksize; i++, in += 8, in2 += 8)
+		{
+			// 2.  T= X xor B[i], X = Salsa T, Y[i] = X for all even I
+			X0 = _mm_xor_si128(X0, LOADIN(0)); X1 = _mm_xor_si128(X1, LOADIN(1));
+			X2 = _mm_xor_si128(X2, LOADIN(2)); X3 = _mm_xor_si128(X3, LOADIN(3));
+			salsa20_8(X0, X1, X2, X3);
+			__m128i* even = out + i * 4;
+			_mm_storeu_si128(even, X0); _mm_storeu_si128(even + 1, X1); _mm_storeu_si128(even + 2, X2); _mm_storeu_si128(even + 3, X3);
+			// and again for all odd I
+			X0 = _mm_xor_si128(X0, LOADIN(4)); X1 = _mm_xor_si128(X1, LOADIN(5));
+			X2 = _mm_xor_si128(X2, LOADIN(6)); X3 = _mm_xor_si128(X3, LOADIN(7));
+			salsa20_8(X0, X1, X2, X3);
+			__m128i* odd = out + (blocksize + i) * 4;
+			_mm_storeu_si128(odd, X0); _mm_storeu_si128(odd + 1, X1); _mm_storeu_si128(odd + 2, X2); _mm_storeu_si128(odd + 3, X3);
+		}
+#undef LOADIN
+#else
+		uint32_t scratch[16];
+		const uint32_t* last = data + (2 * (size_t)blocksize - 1) * 16;
+		const uint32_t* last2 = data2 + (2 * (size_t)blocksize - 1) * 16;
+		for (int x = 0; x < 16; x++) { scratch[x] = XorInput ? last[x] ^ last2[x] : last[x]; } // 1. X = B
+		for (uint32_t i = 0; i < (2 * blocksize); i += 2)
+		{
+			const uint32_t* b = data + i * 16;
+			const uint32_t* b2 = data2 + i * 16;
+			for (int x = 0; x < 16; x++) { scratch[x] ^= XorInput ? b[x] ^ b2[x] : b[x]; } // 2.  T= X xor B[i]
+			salsa20_8(scratch); // X = Salsa T
+			memcpy(dataOut + i * 8, scratch, 64); // Y[i] = X for all even I
+
+			for (int x = 0; x < 16; x++) { scratch[x] ^= XorInput ? b[16 + x] ^ b2[16 + x] : b[16 + x]; } // 2.  T= X xor B[i]
+			salsa20_8(scratch); // X = Salsa T
+			memcpy(dataOut + i * 8 + blocksize * 16, scratch, 64); // Y[i] = X for all odd I
+		}
+		SecureZero(scratch, sizeof(scratch));
+#endif
+	}
+
+	// dataOut = BlockMix(data)
+	static inline void blockMix(const uint32_t* data, uint32_t* dataOut, uint32_t blocksize)
+	{
+		blockMixT<false>(data, data, dataOut, blocksize);
+	}
+
+	// dataOut = BlockMix(data xor data2), the ROMix "X = H(X xor V[j])" step without a temporary block
+	static inline void blockMixXor(const uint32_t* data, const uint32_t* data2, uint32_t* dataOut, uint32_t blocksize)
+	{
+		blockMixT<true>(data, data2, dataOut, blocksize);
+	}
+
+	// works on the shuffled layout: RFC words 0 and 1 of the last sub-block sit at shuffled indexes 0 and 13
+	static inline uint64_t integerify(const uint32_t* data, uint32_t blocksize)
+	{
+		uint32_t j = ((2 * blocksize) - 1) * 16;
+		return ((uint64_t)(data[j + 13]) << 32) | data[j];
+	}
+
+	// Asks for the 2 * blocksize cache lines of one block without waiting for them (a hint, never faults)
+	static inline void prefetchBlock(const uint32_t* block, uint32_t blocksize)
+	{
+		const char* p = (const char*)block;
+		for (uint32_t line = 0; line < 2 * blocksize; line++)
+		{
+#if SCRYPT_SSE2
+			_mm_prefetch(p + line * 64, _MM_HINT_T0);
+#elif defined(__GNUC__)
+			__builtin_prefetch(p + line * 64);
+#else
+			(void)p;
+#endif
+		}
+	}
+
+	// Name of the Salsa20/8 kernel compiled in, for diagnostics
+	static inline const char* salsaKernelName()
+	{
+#if SCRYPT_AVX512
+		return "AVX-512VL";
+#elif SCRYPT_AVX2
+		return "AVX2";
+#elif SCRYPT_SSE2
+		return "SSE2";
+#else
+		return "Scalar";
+#endif
+	}
+}
@@ -0,0 +1,158 @@
+#pragma once
+
+/* Copyright (c) 2017, Dustin J Sparks
+*
+* PUBLIC DOMAIN MARK
+*
+* While this work is free from any patent or intellectual property claims, the algorithm, pseudo-code, and test vectors were derived from
+* RFC 7914 "The scrypt Password-Based Key Derivation Function" (C. Percival, August 2016, ISSN: 2070-1721)
+*
+* From the RFC:
+* Copyright (c) 2016 IETF Trust and the persons identified as the
+* document authors. All rights reserved.
+* This document is subject to BCP 78 and the IETF Trusts Legal Provisions Relating to IETF Documents (http://trustee.ietf.org/license-info)
+* in effect on the date of publication of this document. Please review these documents carefully, as they describe your rights and restrictions
+* with respect to this document. Code Components extracted from this document must include Simplified BSD License text as described in Section 4.e of
+* the Trust Legal Provisions and are provided without warranty as described in the Simplified BSD License.
+*
+* Unless required by applicable law or agreed to in writing, software
+* distributed under the License is distributed on an "AS IS" BASIS,
+* WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+* See the License for the specific language governing permissions and
+* limitations under the License.
+*/
+
+#include "Common.h"
+
+// Multi-buffer Salsa20/8: L independent ROMix instances run in lockstep, one per 32 bit element of a vector register.
+// Unlike Salsa.h the working blocks X and Y are "transposed": word w of a block is one vector holding word w of all L instances,
+// in plain RFC word order (each quarter-round is then the scalar reference code with vector operations).
+// V is laid out per register width (Lanes::VStride is the distance in words between word w and w + 1 of one lane's block):
+//  - VStride == L: V is transposed like X, so storing V[i] is a plain vector store (SSE2, where 4 lanes share each cache line),
+//  - VStride == 1: slot i holds the L blocks V[i] one after the other, so the random V[j] read of a lane stays inside
+//    r * 128 contiguous bytes.  A transposed V would touch L lines per word and starve the AVX2/AVX-512 gathers.
+// Each Lanes type (the vector operations used below: add, xor_, rotl, gather ...) lives in its own unit, LanesSSE2.cpp,
+// LanesAVX2.cpp and LanesAVX512.cpp, built for that instruction set and picked at run time (Dispatch.h).
+
+namespace ScryptNative
+{
+	template <typename Lanes>
+	struct LaneKernels
+	{
+		typedef typename Lanes::V V;
+		static const uint32_t L = Lanes::L;
+
+		// Salsa20/8 on 16 vectors of RFC ordered words, same operations as salsa20_8() in Salsa.h
+		static inline void salsa20_8(V* data)
+		{
+#define LQR(a, b, c, n) a = Lanes::xor_(a, Lanes::template rotl<n>(Lanes::add(b, c)))
+			V x0 = data[0], x1 = data[1], x2 = data[2], x3 = data[3], x4 = data[4], x5 = data[5], x6 = data[6], x7 = data[7],
+				x8 = data[8], x9 = data[9], xA = data[10], xB = data[11], xC = data[12], xD = data[13], xE = data[14], xF = data[15];
+			for (int i = 8; i > 0; i -= 2) {
+				LQR(x4, x0, xC, 7); LQR(x8, x4, x0, 9); LQR(xC, x8, x4, 13); LQR(x0, xC, x8, 18);
+				LQR(x9, x5, x1, 7); LQR(xD, x9, x5, 9); LQR(x1, xD, x9, 13); LQR(x5, x1, xD, 18);
+				LQR(xE, xA, x6, 7); LQR(x2, xE, xA, 9); LQR(x6, x2, xE, 13); LQR(xA, x6, x2, 18);
+				LQR(x3, xF, xB, 7); LQR(x7, x3, xF, 9); LQR(xB, x7, x3, 13); LQR(xF, xB, x7, 18);
+				LQR(x1, x0, x3, 7); LQR(x2, x1, x0, 9); LQR(x3, x2, x1, 13); LQR(x0, x3, x2, 18);
+				LQR(x6, x5, x4, 7); LQR(x7, x6, x5, 9); LQR(x4, x7, x6, 13); LQR(x5, x4, x7, 18);
+				LQR(xB, xA, x9, 7); LQR(x8, xB, xA, 9); LQR(x9, x8, xB, 13); LQR(xA, x9, x8, 18);
+				LQR(xC, xF, xE, 7); LQR(xD, xC, xF, 9); LQR(xE, xD, xC, 13); LQR(xF, xE, xD, 18);
+			}
+#undef LQR
+			data[0] = Lanes::add(data[0], x0); data[1] = Lanes::add(data[1], x1); data[2] = Lanes::add(data[2], x2); data[3] = Lanes::add(data[3], x3);
+			data[4] = Lanes::add(data[4], x4); data[5] = Lanes::add(data[5], x5); data[6] = Lanes::add(data[6], x6); data[7] = Lanes::add(data[7], x7);
+			data[8] = Lanes::add(data[8], x8); data[9] = Lanes::add(data[9], x9); data[10] = Lanes::add(data[10], xA); data[11] = Lanes::add(data[11], xB);
+			data[12] = Lanes::add(data[12], xC); data[13] = Lanes::add(data[13], xD); data[14] = Lanes::add(data[14], xE); data[15] = Lanes::add(data[15], xF);
+		}
+
+		static const uint32_t VStride = Lanes::VStride;
+
+		// Offset of word 0 of lane k's block in V slot i
+		static inline uint32_t laneOffset(size_t i, uint32_t k, size_t r32)
+		{
+			return (uint32_t)(VStride == 1 ? (i * L + k) * r32 : i * r32 * L + k);
+		}
+
+		// dataOut = BlockMix(data), or with Gather dataOut = BlockMix(data xor V[j]) where lane k's V[j] word w is
+		// seqMem[idx[k] + w * VStride] (idx[k] = laneOffset(j_k, k))
+		template <bool Gather>
+		static inline void blockMixT(const V* data, const uint32_t* seqMem, const uint32_t* idx, V* dataOut, uint32_t blocksize)
+		{
+#define LLOAD(w) (Gather ? Lanes::xor_(Lanes::load(data + (w)), Lanes::gather(seqMem + (size_t)(w) * VStride, idx)) : Lanes::load(data + (w)))
+			V X[16];
+			size_t last = (2 * (size_t)blocksize - 1) * 16;
+			for (int w = 0; w < 16; w++) X[w] = LLOAD(last + w); // 1. X = B[2r-1]
+			for (uint32_t i = 0; i < blocksize; i++)
+			{
+				size_t even = (size_t)i * 32;
+				for (int w = 0; w < 16; w++) X[w] = Lanes::xor_(X[w], LLOAD(even + w)); // 2. T = X xor B[i]
+				salsa20_8(X);
+				for (int w = 0; w < 16; w++) Lanes::store(dataOut + (size_t)i * 16 + w, X[w]); // Y[i] = X for all even I
+				for (int w = 0; w < 16; w++) X[w] = Lanes::xor_(X[w], LLOAD(even + 16 + w));
+				salsa20_8(X);
+				for (int w = 0; w < 16; w++) Lanes::store(dataOut + ((size_t)blocksize + i) * 16 + w, X[w]); // Y[i] = X for all odd I
+			}
+#undef LLOAD
+		}
+
+		// RFC 7914 section 5 for L lanes at once, in the two halves of the single lane kernel.  Bp[k] is lane k's
+		// r * 128 bytes of B, updated in place.  seqMem holds N slots of L blocks and XY two more transposed blocks,
+		// all 64 byte aligned.  N is even, so X is back in XY[0] after each loop.
+		static void ROMixFill(uint8_t* const* Bp, uint32_t BlockSize, size_t N, V* seqMem, V* XY)
+		{
+			size_t r32 = (size_t)BlockSize * 32; // words (vectors) per block
+			V* X = XY;
+			V* Y = XY + r32;
+			uint32_t* v = (uint32_t*)seqMem;
+			uint32_t* x = (uint32_t*)X;
+			for (size_t w = 0; w < r32; w++) // X = B[p], transposed
+				for (uint32_t k = 0; k < L; k++)
+					x[w * L + k] = le32dec(Bp[k] + w * 4);
+
+			uint32_t idx[L];
+			for (uint32_t k = 0; k < L; k++)
+				idx[k] = laneOffset(0, k, r32);
+			for (size_t i = 0; i < N; i++) // data independant iterations, Vi = X, X = H(X)
+			{
+				uint32_t* slot = v + i * r32 * L;
+				for (size_t w = 0; w < r32; w++)
+					Lanes::scatter(slot + w * VStride, idx, Lanes::load(X + w));
+				blockMixT<false>(X, nullptr, nullptr, Y, BlockSize);
+				V* swap = X; X = Y; Y = swap;
+			}
+		}
+
+		static void ROMixMix(uint8_t* const* Bp, uint32_t BlockSize, size_t N, V* seqMem, V* XY)
+		{
+			size_t r32 = (size_t)BlockSize * 32;
+			V* X = XY;
+			V* Y = XY + r32;
+			uint32_t* v = (uint32_t*)seqMem;
+			uint32_t idx[L];
+			for (size_t i = 0; i < N; i++) // data dependant iterations, every lane reads its own V[j]
+			{
+				const uint32_t* j = (const uint32_t*)(X + (2 * (size_t)BlockSize - 1) * 16); // word 0 of the last sub-block, integerify
+				for (uint32_t k = 0; k < L; k++)
+					idx[k] = laneOffset(j[k] & (uint32_t)(N - 1), k, r32);
+				blockMixT<true>(X, v, idx, Y, BlockSize);
+				V* swap = X; X = Y; Y = swap;
+			}
+
+			uint32_t* x = (uint32_t*)X;
+			for (size_t w = 0; w < r32; w++) // B[p] = X
+				for (uint32_t k = 0; k < L; k++)
+					le32enc(Bp[k] + w * 4, x[w * L + k]);
+		}
+
+		// LaneKernelSet entry points, Scratch is seqMem followed by XY
+		static void Fill(uint8_t* const* Bp, uint32_t BlockSize, size_t N, uint32_t* Scratch)
+		{
+			ROMixFill(Bp, BlockSize, N, (V*)Scratch, (V*)Scratch + N * BlockSize * 32);
+		}
+
+		static void Mix(uint8_t* const* Bp, uint32_t BlockSize, size_t N, uint32_t* Scratch)
+		{
+			ROMixMix(Bp, BlockSize, N, (V*)Scratch, (V*)Scratch + N * BlockSize * 32);
+		}
+	};
+}
@@ -0,0 +1,221 @@
+/* Copyright (c) 2017, Dustin J Sparks
+*
+* PUBLIC DOMAIN MARK
+*
+* While this work is free from any patent or intellectual property claims, the algorithm, pseudo-code, and test vectors were derived from
+* RFC 7914 "The scrypt Password-Based Key Derivation Function" (C. Percival, August 2016, ISSN: 2070-1721)
+*
+* From the RFC:
+* Copyright (c) 2016 IETF Trust and the persons identified as the
+* document authors. All rights reserved.
+* This document is subject to BCP 78 and the IETF Trusts Legal Provisions Relating to IETF Documents (http://trustee.ietf.org/license-info)
+* in effect on the date of publication of this document. Please review these documents carefully, as they describe your rights and restrictions
+* with respect to this document. Code Components extracted from this document must include Simplified BSD License text as described in Section 4.e of
+* the Trust Legal Provisions and are provided without warranty as described in the Simplified BSD License.
+*
+* Unless required by applicable law or agreed to in writing, software
+* distributed under the License is distributed on an "AS IS" BASIS,
+* WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+* See the License for the specific language governing permissions and
+* limitations under the License.
+*/
+
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <stdexcept>
+#include <thread>
+#include <vector>
+#include "Instrument.h"
+#include "ROMix.h"
+
+namespace ScryptNative
+{
+	struct ScryptJob
+	{
+		std::vector<uint8_t> password;
+		std::vector<uint8_t> salt;
+		uint64_t cpuCost;
+		uint32_t blockSize;
+		uint32_t parallelism;
+		size_t outputLength;
+		uint64_t footprint;
+		std::chrono::steady_clock::time_point queued;
+		ScryptScheduler::Completion done;
+	};
+
+	struct ScryptScheduler::State
+	{
+		uint64_t budget;
+		size_t maxQueued;
+		mutable std::mutex lock;
+		std::condition_variable admit; // signalled when the queue grows, memory is released, or on shutdown
+		std::deque<ScryptJob*> queue;
+		uint64_t inUse = 0;
+		size_t running = 0;
+		bool stopping = false;
+		std::vector<std::thread> workers;
+
+		void Work()
+		{
+			std::unique_lock<std::mutex> guard(lock);
+			for (;;)
+			{
+				// strict FIFO: a big job at the head is never starved by smaller ones behind it
+				admit.wait(guard, [&]() { return stopping || (!queue.empty() && queue.front()->footprint <= budget - inUse); });
+				if (stopping)
+					return;
+				ScryptJob* job = queue.front();
+				queue.pop_front();
+				inUse += job->footprint;
+				running++;
+				guard.unlock();
+
+				Run(job);
+
+				guard.lock();
+				inUse -= job->footprint;
+				running--;
+				admit.notify_all();
+				delete job;
+			}
+		}
+
+		static void Run(ScryptJob* job)
+		{
+			std::vector<uint8_t> output(job->outputLength);
+			std::exception_ptr error;
+			SetQueueWait((uint64_t)std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - job->queued).count());
+			try
+			{
+				Scrypt::ComputeDerivedHash(job->password.data(), job->password.size(), job->salt.data(), job->salt.size(),
+					job->cpuCost, job->blockSize, job->parallelism, output.data(), output.size(), 1);
+			}
+			catch (...)
+			{
+				error = std::current_exception();
+			}
+			SecureZero(job->password.data(), job->password.size());
+			try { job->done(error ? nullptr : output.data(), error ? 0 : output.size(), error); }
+			catch (...) {} // a throwing completion must not take the worker (and the process) down
+			SecureZero(output.data(), output.size());
+		}
+	};
+
+	uint64_t ScryptScheduler::Footprint(uint64_t CPUCost, uint32_t BlockSize, uint32_t Parallelism, size_t OutputByteLength)
+	{
+		uint64_t r128 = (uint64_t)BlockSize * 128;
+		return (CPUCost + 2) * r128 + Parallelism * r128 + OutputByteLength;
+	}
+
+	ScryptScheduler::ScryptScheduler(uint32_t Workers, uint64_t MemoryBudget, size_t MaxQueued) : state(new State())
+	{
+		state->budget = MemoryBudget;
+		state->maxQueued = MaxQueued;
+		try
+		{
+			uint32_t threads = ResolveThreads(Workers, SIZE_MAX);
+			for (uint32_t t = 0; t < threads; t++)
+				state->workers.emplace_back([this]() { state->Work(); });
+		}
+		catch (...)
+		{
+			{
+				std::lock_guard<std::mutex> guard(state->lock);
+				state->stopping = true;
+			}
+			state->admit.notify_all();
+			for (size_t t = 0; t < state->workers.size(); t++)
+				state->workers[t].join();
+			delete state;
+			throw;
+		}
+	}
+
+	ScryptScheduler::~ScryptScheduler()
+	{
+		std::deque<ScryptJob*> abandoned;
+		{
+			std::lock_guard<std::mutex> guard(state->lock);
+			state->stopping = true;
+			abandoned.swap(state->queue);
+		}
+		state->admit.notify_all();
+		for (size_t t = 0; t < state->workers.size(); t++)
+			state->workers[t].join();
+		for (size_t i = 0; i < abandoned.size(); i++)
+		{
+			ScryptJob* job = abandoned[i];
+			SecureZero(job->password.data(), job->password.size());
+			try { job->done(nullptr, 0, std::make_exception_ptr(std::runtime_error("Scheduler shut down before the job could run."))); }
+			catch (...) {}
+			delete job;
+		}
+		delete state;
+	}
+
+	bool ScryptScheduler::Submit(const uint8_t* Password, size_t PasswordLength, const uint8_t* Salt, size_t SaltLength,
+		uint64_t CPUCost, uint32_t BlockSize, uint32_t Parallelism, size_t OutputByteLength, Completion Done)
+	{
+		uint8_t output = 0;
+		ValidateParameters(Password, PasswordLength, Salt, SaltLength, CPUCost, BlockSize, Parallelism, &output, OutputByteLength);
+		if (!Done)
+			throw std::invalid_argument("Object not Initialized!");
+		uint64_t footprint = Footprint(CPUCost, BlockSize, Parallelism, OutputByteLength);
+		if (footprint > state->budget)
+			throw std::length_error("The job needs more memory than the scheduler's whole budget.");
+		{
+			std::lock_guard<std::mutex> guard(state->lock);
+			if (state->queue.size() >= state->maxQueued)
+				return false;
+		}
+
+		ScryptJob* job = new ScryptJob();
+		job->password.assign(Password, Password + PasswordLength);
+		job->salt.assign(Salt, Salt + SaltLength);
+		job->cpuCost = CPUCost;
+		job->blockSize = BlockSize;
+		job->parallelism = Parallelism;
+		job->outputLength = OutputByteLength;
+		job->footprint = footprint;
+		job->done = Done;
+		job->queued = std::chrono::steady_clock::now();
+		{
+			std::lock_guard<std::mutex> guard(state->lock);
+			if (state->queue.size() >= state->maxQueued || state->stopping) // may have filled up while the job was built
+			{
+				SecureZero(job->password.data(), job->password.size());
+				delete job;
+				return false;
+			}
+			state->queue.push_back(job);
+			RecordQueued(state->queue.size());
+		}
+		state->admit.notify_all();
+		return true;
+	}
+
+	uint64_t ScryptScheduler::MemoryBudget() const
+	{
+		return state->budget;
+	}
+
+	uint64_t ScryptScheduler::MemoryInUse() const
+	{
+		std::lock_guard<std::mutex> guard(state->lock);
+		return state->inUse;
+	}
+
+	size_t ScryptScheduler::Queued() const
+	{
+		std::lock_guard<std::mutex> guard(state->lock);
+		return state->queue.size();
+	}
+
+	size_t ScryptScheduler::Running() const
+	{
+		std::lock_guard<std::mutex> guard(state->lock);
+		return state->running;
+	}
+}
@@ -0,0 +1,201 @@
+/* Copyright (c) 2017, Dustin J Sparks
+*
+* PUBLIC DOMAIN MARK
+*
+* While this work is free from any patent or intellectual property claims, the algorithm, pseudo-code, and test vectors were derived from
+* RFC 7914 "The scrypt Password-Based Key Derivation Function" (C. Percival, August 2016, ISSN: 2070-1721)
+*
+* From the RFC:
+* Copyright (c) 2016 IETF Trust and the persons identified as the
+* document authors. All rights reserved.
+* This document is subject to BCP 78 and the IETF Trusts Legal Provisions Relating to IETF Documents (http://trustee.ietf.org/license-info)
+* in effect on the date of publication of this document. Please review these documents carefully, as they describe your rights and restrictions
+* with respect to this document. Code Components extracted from this document must include Simplified BSD License text as described in Section 4.e of
+* the Trust Legal Provisions and are provided without warranty as described in the Simplified BSD License.
+*
+* Unless required by applicable law or agreed to in writing, software
+* distributed under the License is distributed on an "AS IS" BASIS,
+* WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+* See the License for the specific language governing permissions and
+* limitations under the License.
+*/
+
+#include <algorithm>
+#include <memory>
+#include <stdexcept>
+#include <vector>
+#include "Instrument.h"
+#include "ROMix.h"
+#include "Dispatch.h"
+
+namespace ScryptNative
+{
+	uint32_t Scrypt::BatchLanes()
+	{
+		const LaneKernelSet* set = BatchKernels();
+		return set != nullptr ? set->L : 1;
+	}
+
+	uint64_t Scrypt::BatchFootprint(uint64_t CPUCost, uint32_t BlockSize, uint32_t Parallelism, size_t Count, uint32_t MaxThreads)
+	{
+		// the same split as ROMixInstances below
+		uint64_t r128 = (uint64_t)BlockSize * 128;
+		uint64_t instances = (uint64_t)Count * Parallelism;
+		uint64_t width = BatchLanes();
+		uint64_t L = width;
+		if (L > 1 && CPUCost * (r128 / 4) * L >= 0x80000000ULL)
+			L = 1;
+		uint64_t groups = L > 1 ? instances / L : 0;
+		uint64_t tail = instances - groups * L;
+		if (L > 1 && tail * 4 > L)
+		{
+			groups++;
+			tail = 0;
+		}
+		uint64_t perRun = std::min((uint64_t)MaxInterleave, width);
+		uint64_t runs = (tail + perRun - 1) / perRun;
+		uint64_t threads = ResolveThreads(MaxThreads, (size_t)(groups + runs));
+		// a thread keeps the scratch of a group and of a run of single lanes once it has needed each
+		uint64_t lanes = std::min(threads, groups) * L + std::min(threads, runs) * perRun;
+		return lanes * (CPUCost + 2) * r128 + instances * r128;
+	}
+
+	// Runs ROMix on Instances lanes of r * 128 bytes each, laid out back to back in B.
+	// Whole groups of BatchLanes() go through the multi-buffer kernel; a short tail group is padded with copies of its
+	// last lane (those results are identical and simply written twice) unless it is small enough that the single-stream
+	// kernel is cheaper.  Single-stream lanes run interleaved (ROMixMixInterleaved), up to as many at once as a group holds,
+	// so they never need more scratch than a group.  Groups and runs of single lanes are spread over the worker threads.
+	// rec, when attached, gets the fill and mix time of every group and single lane.
+	static void ROMixInstances(uint8_t* B, size_t Instances, uint32_t BlockSize, size_t N, uint32_t MaxThreads, CallRecorder* rec)
+	{
+		size_t r128 = (size_t)BlockSize * 128;
+		size_t r32 = r128 / 4;
+		const LaneKernelSet* set = BatchKernels(); // read once, so every group of the call runs the same width
+		size_t width = set != nullptr ? set->L : 1;
+		size_t L = width;
+		// the gather indexes are 32 bit, so a group's V must stay under 2^31 words
+		if (L > 1 && (uint64_t)N * r32 * L >= 0x80000000ULL)
+			L = 1;
+		size_t groups = L > 1 ? Instances / L : 0;
+		size_t tail = Instances - groups * L;
+		if (L > 1 && tail * 4 > L) // a padded group beats tail single-stream runs
+		{
+			groups++;
+			tail = 0;
+		}
+		size_t singles = tail;
+		size_t firstSingle = Instances - singles;
+		size_t perRun = std::min((size_t)Scrypt::MaxInterleave, width);
+		size_t runs = (singles + perRun - 1) / perRun;
+
+		RunWorkers(ResolveThreads(MaxThreads, groups + runs), groups + runs, [&](std::atomic<size_t>& next) {
+			BlockBuffer* laneScratch = nullptr;
+			BlockBuffer* scratch = nullptr;
+			try
+			{
+				for (size_t u = next++; u < groups + runs; u = next++)
+				{
+					if (u < groups)
+					{
+						if (laneScratch == nullptr)
+							laneScratch = new BlockBuffer((N + 2) * r32 * L); // V, then X and Y
+						uint8_t* Bp[MaxBatchLanes];
+						for (size_t k = 0; k < L; k++)
+							Bp[k] = B + std::min(u * L + k, Instances - 1) * r128;
+						Stamp t = rec != nullptr ? Stamp::Now() : Stamp();
+						set->ROMixFill(Bp, BlockSize, N, laneScratch->data);
+						if (rec != nullptr)
+							t = rec->Add(Metrics::ROMixFill, t);
+						set->ROMixMix(Bp, BlockSize, N, laneScratch->data);
+						if (rec != nullptr)
+							rec->Add(Metrics::ROMixMix, t);
+						continue;
+					}
+					if (scratch == nullptr)
+						scratch = new BlockBuffer(perRun * (N + 2) * r32);
+					size_t first = firstSingle + (u - groups) * perRun;
+					size_t count = std::min(perRun, Instances - first);
+					uint8_t* Bp[Scrypt::MaxInterleave];
+					for (size_t k = 0; k < count; k++)
+						Bp[k] = B + (first + k) * r128;
+					ROMixLanes(Bp, count, BlockSize, N, scratch->data, rec);
+				}
+			}
+			catch (...)
+			{
+				delete laneScratch;
+				delete scratch;
+				throw;
+			}
+			delete laneScratch;
+			delete scratch;
+		}, NUMA::Enabled());
+	}
+
+	void Scrypt::ComputeDerivedHashBatch(const uint8_t* const* Passwords, const size_t* PasswordLengths,
+		const uint8_t* const* Salts, const size_t* SaltLengths, size_t Count,
+		uint64_t CPUCost, uint32_t BlockSize, uint32_t Parallelism, uint8_t* const* Outputs, size_t OutputByteLength, uint32_t MaxThreads)
+	{
+		if (Count == 0)
+			return;
+		if (Passwords == nullptr || PasswordLengths == nullptr || Salts == nullptr || SaltLengths == nullptr || Outputs == nullptr)
+			throw std::invalid_argument("Object not Initialized!");
+		for (size_t i = 0; i < Count; i++)
+			ValidateParameters(Passwords[i], PasswordLengths[i], Salts[i], SaltLengths[i], CPUCost, BlockSize, Parallelism, Outputs[i], OutputByteLength);
+		size_t pr128 = (size_t)Parallelism * BlockSize * 128;
+
+		std::vector<uint8_t> B(Count * pr128);
+		std::vector<HMAC<SHA256>> prf(Count); // one keyed HMAC per password, shared by its two PBKDF2 calls
+		uint32_t threads = ResolveThreads(MaxThreads, (Count * Parallelism + BatchLanes() - 1) / BatchLanes());
+		// the V/X/Y scratch is what BatchFootprint charges beyond B, so the two figures agree
+		std::unique_ptr<CallRecorder> rec(MetricsOn() ?
+			new CallRecorder(CPUCost, BlockSize, Parallelism, Count, threads, BatchLanes() > 1, BatchFootprint(CPUCost, BlockSize, Parallelism, Count, MaxThreads) - B.size()) : nullptr);
+		try
+		{
+			Stamp t = rec != nullptr ? Stamp::Now() : Stamp();
+			for (size_t i = 0; i < Count; i++)
+			{
+				prf[i].SetKey(Passwords[i], PasswordLengths[i]);
+				PBKDF2SHA256(prf[i], Salts[i], SaltLengths[i], B.data() + i * pr128, pr128, MaxThreads);
+			}
+			if (rec != nullptr)
+				rec->Add(Metrics::PBKDF2In, t);
+			ROMixInstances(B.data(), Count * Parallelism, BlockSize, (size_t)CPUCost, MaxThreads, rec.get());
+			if (rec != nullptr)
+				t = Stamp::Now();
+			for (size_t i = 0; i < Count; i++)
+				PBKDF2SHA256(prf[i], B.data() + i * pr128, pr128, Outputs[i], OutputByteLength, MaxThreads);
+			if (rec != nullptr)
+				rec->Add(Metrics::PBKDF2Out, t);
+		}
+		catch (...)
+		{
+			SecureZero(B.data(), B.size());
+			SecureZero(prf.data(), prf.size() * sizeof(HMAC<SHA256>));
+			throw;
+		}
+		SecureZero(B.data(), B.size());
+		SecureZero(prf.data(), prf.size() * sizeof(HMAC<SHA256>));
+		if (rec != nullptr)
+			rec->Finish();
+	}
+
+	void Scrypt::CompareBatch(const uint8_t* const* Passwords, const size_t* PasswordLengths,
+		const uint8_t* const* Salts, const size_t* SaltLengths, size_t Count,
+		uint64_t CPUCost, uint32_t BlockSize, uint32_t Parallelism, const uint8_t* const* ExpectedHashes, size_t HashByteLength,
+		bool* Results, uint32_t MaxThreads)
+	{
+		if (Count == 0)
+			return;
+		if (ExpectedHashes == nullptr || Results == nullptr || HashByteLength == 0)
+			throw std::invalid_argument("Object not Initialized!");
+		std::vector<uint8_t> computed(Count * HashByteLength);
+		std::vector<uint8_t*> outputs(Count);
+		for (size_t i = 0; i < Count; i++)
+			outputs[i] = computed.data() + i * HashByteLength;
+		ComputeDerivedHashBatch(Passwords, PasswordLengths, Salts, SaltLengths, Count, CPUCost, BlockSize, Parallelism, outputs.data(), HashByteLength, MaxThreads);
+		for (size_t i = 0; i < Count; i++)
+			Results[i] = ExpectedHashes[i] != nullptr && SafeEquals(outputs[i], ExpectedHashes[i], HashByteLength);
+		SecureZero(computed.data(), computed.size());
+	}
+}
@@ -0,0 +1,202 @@
+/* Copyright (c) 2017, Dustin J Sparks
+*
+* PUBLIC DOMAIN MARK
+*
+* While this work is free from any patent or intellectual property claims, the algorithm, pseudo-code, and test vectors were derived from
+* RFC 7914 "The scrypt Password-Based Key Derivation Function" (C. Percival, August 2016, ISSN: 2070-1721)
+*
+* From the RFC:
+* Copyright (c) 2016 IETF Trust and the persons identified as the
+* document authors. All rights reserved.
+* This document is subject to BCP 78 and the IETF Trusts Legal Provisions Relating to IETF Documents (http://trustee.ietf.org/license-info)
+* in effect on the date of publication of this document. Please review these documents carefully, as they describe your rights and restrictions
+* with respect to this document. Code Components extracted from this document must include Simplified BSD License text as described in Section 4.e of
+* the Trust Legal Provisions and are provided without warranty as described in the Simplified BSD License.
+*
+* Unless required by applicable law or agreed to in writing, software
+* distributed under the License is distributed on an "AS IS" BASIS,
+* WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+* See the License for the specific language governing permissions and
+* limitations under the License.
+*/
+
+#include <algorithm>
+#include <atomic>
+#include <memory>
+#include <stdexcept>
+#include <vector>
+#include "Instrument.h"
+#include "ROMix.h"
+#include "Salsa.h"
+
+namespace ScryptNative
+{
+	struct ScryptComputation::State
+	{
+		HMAC<SHA256> prf; // keyed by the password
+		HMAC<SHA256> salted; // prf after Update(Salt), for the PBKDF2 that fills B
+		size_t N;
+		uint32_t blockSize;
+		uint32_t parallelism;
+		std::vector<uint8_t> B;
+		std::vector<uint8_t> output;
+		std::unique_ptr<BlockBuffer> scratch; // V, then X and Y; one lane at a time
+		std::unique_ptr<CallRecorder> rec;
+		size_t lane = 0;
+		uint64_t step = 0; // within the lane, [0, N) fill and [N, 2N) mix
+		Status status = Running;
+		std::atomic<bool> cancel;
+
+		// Wipes every secret but the finished output
+		void Release()
+		{
+			scratch.reset(); // wiped by BlockBuffer
+			SecureZero(B.data(), B.size());
+			prf.Clear();
+			salted.Clear();
+		}
+
+		void Run(uint64_t MaxSteps)
+		{
+			size_t r128 = (size_t)blockSize * 128;
+			size_t r32 = r128 / 4;
+			while (MaxSteps > 0 && lane < parallelism)
+			{
+				if (!scratch)
+					scratch.reset(new BlockBuffer((N + 2) * r32));
+				uint8_t* Bp = B.data() + lane * r128;
+				uint32_t* XY = scratch->data + N * r32;
+				Stamp t = rec ? Stamp::Now() : Stamp();
+				if (step == 0)
+				{
+					PBKDF2SHA256Range(salted, lane * r128, Bp, r128, 1);
+					shuffleIn(scratch->data, Bp, r32); // V0 = X = B[p]
+					if (rec)
+						t = rec->Add(Metrics::PBKDF2In, t);
+				}
+				uint64_t end = std::min((uint64_t)2 * N, step + MaxSteps);
+				if (step < N)
+				{
+					uint64_t fillEnd = std::min((uint64_t)N, end);
+					ROMixFillSteps(blockSize, N, scratch->data, XY, (size_t)step, (size_t)fillEnd);
+					if (rec)
+						t = rec->Add(Metrics::ROMixFill, t);
+					MaxSteps -= fillEnd - step;
+					step = fillEnd;
+				}
+				else
+				{
+					ROMixMixSteps(blockSize, N, scratch->data, XY, (size_t)(step - N), (size_t)(end - N));
+					if (rec)
+						rec->Add(Metrics::ROMixMix, t);
+					MaxSteps -= end - step;
+					step = end;
+				}
+				if (step == 2 * N)
+				{
+					shuffleOut(Bp, XY, r32); // B[p] = X
+					lane++;
+					step = 0;
+				}
+			}
+			if (lane < parallelism)
+				return;
+			scratch.reset(); // V is not needed for PBKDF2 out, give it back first
+			Stamp t = rec ? Stamp::Now() : Stamp();
+			PBKDF2SHA256(prf, B.data(), B.size(), output.data(), output.size(), 1);
+			if (rec)
+			{
+				rec->Add(Metrics::PBKDF2Out, t);
+				rec->Finish();
+			}
+			Release();
+			status = Done;
+		}
+	};
+
+	ScryptComputation::ScryptComputation(const uint8_t* Password, size_t PasswordLength, const uint8_t* Salt, size_t SaltLength,
+		uint64_t CPUCost, uint32_t BlockSize, uint32_t Parallelism, size_t OutputByteLength) : state(nullptr)
+	{
+		uint8_t output = 0;
+		ValidateParameters(Password, PasswordLength, Salt, SaltLength, CPUCost, BlockSize, Parallelism, &output, OutputByteLength);
+		std::unique_ptr<State> s(new State());
+		s->N = (size_t)CPUCost;
+		s->blockSize = BlockSize;
+		s->parallelism = Parallelism;
+		s->cancel = false;
+		s->B.resize((size_t)Parallelism * BlockSize * 128);
+		s->output.resize(OutputByteLength);
+		s->prf.SetKey(Password, PasswordLength);
+		s->salted = s->prf;
+		s->salted.Reset();
+		s->salted.Update(Salt, SaltLength);
+		state = s.release();
+	}
+
+	ScryptComputation::~ScryptComputation()
+	{
+		state->Release();
+		SecureZero(state->output.data(), state->output.size());
+		delete state;
+	}
+
+	ScryptComputation::Status ScryptComputation::Step(uint64_t MaxSteps)
+	{
+		if (state->status != Running)
+			return state->status;
+		if (state->cancel.load())
+		{
+			state->Release();
+			return state->status = Cancelled;
+		}
+		try
+		{
+			if (!state->rec && MetricsOn())
+				state->rec.reset(new CallRecorder(state->N, state->blockSize, state->parallelism, 1, 1, false, (state->N + 2) * state->blockSize * 128));
+			state->Run(MaxSteps);
+		}
+		catch (...)
+		{
+			state->Release();
+			state->status = Cancelled;
+			throw;
+		}
+		return state->status;
+	}
+
+	void ScryptComputation::Cancel()
+	{
+		state->cancel = true;
+	}
+
+	ScryptComputation::Status ScryptComputation::CurrentStatus() const
+	{
+		return state->status;
+	}
+
+	uint64_t ScryptComputation::StepsDone() const
+	{
+		if (state->status == Done)
+			return Steps();
+		return (uint64_t)state->lane * 2 * state->N + state->step;
+	}
+
+	uint64_t ScryptComputation::Steps() const
+	{
+		return (uint64_t)state->parallelism * 2 * state->N;
+	}
+
+	size_t ScryptComputation::OutputByteLength() const
+	{
+		return state->output.size();
+	}
+
+	void ScryptComputation::Result(uint8_t* Output, size_t OutputByteLength) const
+	{
+		if (state->status != Done)
+			throw std::logic_error("The computation has not finished.");
+		if (Output == nullptr || OutputByteLength != state->output.size())
+			throw std::out_of_range("OutputByteLength must match the length the computation was created with.");
+		std::copy(state->output.begin(), state->output.end(), Output);
+	}
+}
@@ -0,0 +1,490 @@
+/* Copyright (c) 2017, Dustin J Sparks
+*
+* PUBLIC DOMAIN MARK
+*
+* While this work is free from any patent or intellectual property claims, the algorithm, pseudo-code, and test vectors were derived from
+* RFC 7914 "The scrypt Password-Based Key Derivation Function" (C. Percival, August 2016, ISSN: 2070-1721)
+*
+* From the RFC:
+* Copyright (c) 2016 IETF Trust and the persons identified as the
+* document authors. All rights reserved.
+* This document is subject to BCP 78 and the IETF Trusts Legal Provisions Relating to IETF Documents (http://trustee.ietf.org/license-info)
+* in effect on the date of publication of this document. Please review these documents carefully, as they describe your rights and restrictions
+* with respect to this document. Code Components extracted from this document must include Simplified BSD License text as described in Section 4.e of
+* the Trust Legal Provisions and are provided without warranty as described in the Simplified BSD License.
+*
+* Unless required by applicable law or agreed to in writing, software
+* distributed under the License is distributed on an "AS IS" BASIS,
+* WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+* See the License for the specific language governing permissions and
+* limitations under the License.
+*/
+
+#include <algorithm>
+#include <cstdint>
+#include <cstdio>
+#include <exception>
+#include <memory>
+#include <stdexcept>
+#include <thread>
+#include <vector>
+#if defined(_WIN32)
+#define NOMINMAX
+#include <windows.h>
+#include <bcrypt.h>
+#pragma comment(lib, "bcrypt.lib")
+#endif
+#include "Instrument.h"
+#include "Memory.h"
+#include "Numa.h"
+#include "ROMix.h"
+#include "Salsa.h"
+
+namespace ScryptNative
+{
+	bool Scrypt::SafeEquals(const uint8_t* a, const uint8_t* b, size_t length)
+	{
+		uint8_t diff = 0;
+		for (size_t i = 0; i < length; i++)
+			diff |= a[i] ^ b[i];
+		return diff == 0;
+	}
+
+	void Scrypt::RandomSalt(uint8_t* Salt, size_t Length)
+	{
+#if defined(_WIN32)
+		if (BCryptGenRandom(nullptr, Salt, (ULONG)Length, BCRYPT_USE_SYSTEM_PREFERRED_RNG) != 0)
+			throw std::runtime_error("No random source for the salt.");
+#else
+		FILE* f = fopen("/dev/urandom", "rb");
+		bool ok = f != nullptr && fread(Salt, 1, Length, f) == Length;
+		if (f != nullptr)
+			fclose(f);
+		if (!ok)
+			throw std::runtime_error("No random source for the salt.");
+#endif
+	}
+
+	void ValidateParameters(const uint8_t* Password, size_t PasswordLength, const uint8_t* Salt, size_t SaltLength,
+		uint64_t Iterations, uint32_t BlockSize, uint32_t Parallelism, const uint8_t* Output, size_t OutputByteLength,
+		uint64_t MaxMemory)
+	{
+		if (Salt == nullptr || SaltLength == 0)
+			throw std::invalid_argument("Salt cannot be null or zero length.");
+		if (Password == nullptr && PasswordLength != 0)
+			throw std::invalid_argument("Password cannot be null unless its length is zero.");
+		if (Iterations < 2 || (Iterations & (Iterations - 1)) != 0)
+			throw std::out_of_range("Iterations must be a power of 2, and greater than 1.");
+		if (BlockSize < 1 || Parallelism < 1 ||
+			(uint64_t)BlockSize * (uint64_t)Parallelism > 1 << 30 ||
+			BlockSize > 0x7fffffff / 128 / Parallelism ||
+			BlockSize > 0x7fffffff / 256 ||
+			Iterations > MaxMemory / 128 / BlockSize)
+			throw std::out_of_range("Combined Parameter Values are too large.");
+		if (Output == nullptr || OutputByteLength == 0)
+			throw std::out_of_range("OutputByteLength must be greater than 0.");
+		if ((uint64_t)OutputByteLength > 0xffffffffULL * SHA256BLOCKSIZE)
+			throw std::out_of_range("OutputByteCount");
+	}
+
+	uint32_t ResolveThreads(uint32_t MaxThreads, size_t Work)
+	{
+		if (MaxThreads == 0)
+			MaxThreads = std::max(1u, std::thread::hardware_concurrency());
+		return (uint32_t)std::min((size_t)MaxThreads, std::max((size_t)1, Work));
+	}
+
+	void RunWorkers(uint32_t Threads, size_t Count, const std::function<void(std::atomic<size_t>&)>& Worker, bool PinNodes)
+	{
+		std::atomic<size_t> next(0);
+		std::vector<std::thread> workers;
+		std::vector<std::exception_ptr> errors(Threads);
+		// worker t on node home + t: the calling thread stays where it is, the others fill the nodes round robin
+		uint32_t nodes = PinNodes ? NUMA::Nodes() : 1;
+		uint32_t home = PinNodes ? NUMA::CurrentNode() : 0;
+		for (uint32_t t = 1; t < Threads; t++) // the calling thread is worker 0
+		{
+			workers.emplace_back([&, t]() {
+				try { NodePin pin(PinNodes ? (int)((home + t) % nodes) : -1); Worker(next); }
+				catch (...) { errors[t] = std::current_exception(); next = Count; }
+			});
+		}
+		try { NodePin pin(PinNodes ? (int)home : -1); Worker(next); }
+		catch (...) { errors[0] = std::current_exception(); next = Count; }
+		for (size_t t = 0; t < workers.size(); t++)
+			workers[t].join();
+		for (size_t t = 0; t < errors.size(); t++)
+			if (errors[t])
+				std::rethrow_exception(errors[t]);
+	}
+
+	void ROMixFillSteps(uint32_t BlockSize, size_t N, uint32_t* seqMem, uint32_t* XY, size_t Begin, size_t End)
+	{
+		size_t r32 = (size_t)BlockSize * 32; // words per block
+		size_t last = std::min(End, N - 1);
+		for (size_t i = Begin; i < last; i++) // data independant iterations
+			blockMix(&seqMem[i * r32], &seqMem[(i + 1) * r32], BlockSize); // Vi+1 = X = H(Vi)
+		if (End == N && Begin < N)
+			blockMix(&seqMem[(N - 1) * r32], XY, BlockSize); // X = H(VN-1)
+	}
+
+	void ROMixMixSteps(uint32_t BlockSize, size_t N, const uint32_t* seqMem, uint32_t* XY, size_t Begin, size_t End)
+	{
+		size_t r32 = (size_t)BlockSize * 32;
+		uint32_t* X = (Begin & 1) == 0 ? XY : XY + r32; // X and Y trade places every iteration
+		uint32_t* Y = (Begin & 1) == 0 ? XY + r32 : XY;
+		for (size_t i = Begin; i < End; i++) // data dependant iterations, blocks called out by the J value will get an extra mix
+		{
+			size_t J = (size_t)(integerify(X, BlockSize) & (N - 1));
+			blockMixXor(X, &seqMem[J * r32], Y, BlockSize); // X = H(X xor V[j])
+			uint32_t* swap = X; X = Y; Y = swap;
+		}
+	}
+
+	void ROMixMixInterleaved(uint8_t* const* Bp, size_t Lanes, uint32_t BlockSize, size_t N, uint32_t* const* seqMem)
+	{
+		size_t r32 = (size_t)BlockSize * 32;
+		uint32_t* X[Scrypt::MaxInterleave];
+		uint32_t* Y[Scrypt::MaxInterleave];
+		const uint32_t* Vj[Scrypt::MaxInterleave];
+		for (size_t k = 0; k < Lanes; k++)
+		{
+			X[k] = seqMem[k] + N * r32;
+			Y[k] = X[k] + r32;
+			Vj[k] = &seqMem[k][(size_t)(integerify(X[k], BlockSize) & (N - 1)) * r32];
+			prefetchBlock(Vj[k], BlockSize);
+		}
+		for (size_t i = 0; i < N; i++)
+		{
+			for (size_t k = 0; k < Lanes; k++)
+			{
+				blockMixXor(X[k], Vj[k], Y[k], BlockSize); // X = H(X xor V[j])
+				uint32_t* swap = X[k]; X[k] = Y[k]; Y[k] = swap;
+				Vj[k] = &seqMem[k][(size_t)(integerify(X[k], BlockSize) & (N - 1)) * r32];
+				prefetchBlock(Vj[k], BlockSize); // lands while the other lanes mix
+			}
+		}
+		for (size_t k = 0; k < Lanes; k++)
+			shuffleOut(Bp[k], X[k], r32); // B[p] = X
+	}
+
+	// Memory traffic is one sequential write of V and one random read of V[j] per step, nothing is copied:
+	//  - B[p] is loaded straight into V[0] and every BlockMix writes its result into the next V slot,
+	//  - the mix loop computes BlockMix(X xor V[j]) without ever storing X xor V[j], ping-ponging between X and Y.
+	void ROMix(uint8_t* Bp, uint32_t BlockSize, size_t N, uint32_t* seqMem, uint32_t* XY)
+	{
+		ROMixFill(Bp, BlockSize, N, seqMem, XY);
+		ROMixMix(Bp, BlockSize, N, seqMem, XY);
+	}
+
+	void ROMixFill(const uint8_t* Bp, uint32_t BlockSize, size_t N, uint32_t* seqMem, uint32_t* XY)
+	{
+		shuffleIn(seqMem, Bp, (size_t)BlockSize * 32); // V0 = X = B[p]
+		ROMixFillSteps(BlockSize, N, seqMem, XY, 0, N);
+	}
+
+	void ROMixMix(uint8_t* Bp, uint32_t BlockSize, size_t N, const uint32_t* seqMem, uint32_t* XY)
+	{
+		ROMixMixSteps(BlockSize, N, seqMem, XY, 0, N);
+		shuffleOut(Bp, XY, (size_t)BlockSize * 32); // B[p] = X
+	}
+
+	void ROMixLanes(uint8_t* const* Bp, size_t Lanes, uint32_t BlockSize, size_t N, uint32_t* scratch, CallRecorder* rec)
+	{
+		size_t set = (N + 2) * BlockSize * 32; // words of V, X and Y
+		uint32_t* seqMem[Scrypt::MaxInterleave] = {};
+		for (size_t k = 0; k < Lanes; k++)
+			seqMem[k] = scratch + k * set;
+		Stamp t = rec != nullptr ? Stamp::Now() : Stamp();
+		for (size_t k = 0; k < Lanes; k++)
+			ROMixFill(Bp[k], BlockSize, N, seqMem[k], seqMem[k] + N * BlockSize * 32);
+		if (rec != nullptr)
+			t = rec->Add(Metrics::ROMixFill, t);
+		if (Lanes == 1)
+			ROMixMix(Bp[0], BlockSize, N, seqMem[0], seqMem[0] + N * BlockSize * 32);
+		else
+			ROMixMixInterleaved(Bp, Lanes, BlockSize, N, seqMem);
+		if (rec != nullptr)
+			rec->Add(Metrics::ROMixMix, t);
+	}
+
+	void Scrypt::ComputeDerivedHash(const uint8_t* Password, size_t PasswordLength, const uint8_t* Salt, size_t SaltLength,
+		uint64_t Iterations, uint32_t BlockSize, uint32_t Parallelism, uint8_t* Output, size_t OutputByteLength)
+	{
+		ComputeDerivedHash(Password, PasswordLength, Salt, SaltLength, Iterations, BlockSize, Parallelism, Output, OutputByteLength, 1);
+	}
+
+	// Lanes [First, First + Count) of B: their r * 128 bytes from PBKDF2, then ROMix (interleaved when Count > 1),
+	// each phase timed when a recorder is attached.  scratch holds Count V/X/Y sets.
+	static void RunLanes(const HMAC<SHA256>& salted, uint8_t* B, size_t First, size_t Count, uint32_t BlockSize, size_t N, uint32_t* scratch, CallRecorder* rec)
+	{
+		size_t r128 = (size_t)BlockSize * 128;
+		uint8_t* Bp[Scrypt::MaxInterleave];
+		Stamp t = rec != nullptr ? Stamp::Now() : Stamp();
+		for (size_t k = 0; k < Count; k++)
+		{
+			Bp[k] = B + (First + k) * r128;
+			PBKDF2SHA256Range(salted, (First + k) * r128, Bp[k], r128, 1);
+		}
+		if (rec != nullptr)
+			rec->Add(Metrics::PBKDF2In, t);
+		ROMixLanes(Bp, Count, BlockSize, N, scratch, rec);
+	}
+
+	// Lanes(salted) runs ROMix on every lane of B, each lane first deriving its own r * 128 bytes with PBKDF2SHA256Range
+	// (the PBKDF2 blocks are independent, so lane k can start as soon as its bytes exist), then PBKDF2 out of B.
+	// B is wiped before this returns or throws.
+	static void DeriveHash(const uint8_t* Password, size_t PasswordLength, const uint8_t* Salt, size_t SaltLength,
+		uint8_t* B, size_t BLength, uint8_t* Output, size_t OutputByteLength, uint32_t MaxThreads, CallRecorder* rec,
+		const std::function<void(const HMAC<SHA256>&)>& Lanes)
+	{
+		HMAC<SHA256> prf; // keyed once, both PBKDF2 passes below reuse its midstates
+		prf.SetKey(Password, PasswordLength);
+		HMAC<SHA256> salted = prf;
+		salted.Reset();
+		salted.Update(Salt, SaltLength);
+		try
+		{
+			Lanes(salted);
+			Stamp t = rec != nullptr ? Stamp::Now() : Stamp();
+			PBKDF2SHA256(prf, B, BLength, Output, OutputByteLength, MaxThreads);
+			if (rec != nullptr)
+				rec->Add(Metrics::PBKDF2Out, t);
+		}
+		catch (...)
+		{
+			SecureZero(B, BLength);
+			prf.Clear();
+			salted.Clear();
+			throw;
+		}
+		SecureZero(B, BLength);
+		prf.Clear();
+		salted.Clear();
+		if (rec != nullptr)
+			rec->Finish();
+	}
+
+	void Scrypt::ComputeDerivedHash(const uint8_t* Password, size_t PasswordLength, const uint8_t* Salt, size_t SaltLength,
+		uint64_t Iterations, uint32_t BlockSize, uint32_t Parallelism, uint8_t* Output, size_t OutputByteLength, uint32_t MaxThreads)
+	{
+		ComputeDerivedHash(Password, PasswordLength, Salt, SaltLength, Iterations, BlockSize, Parallelism, Output, OutputByteLength, MaxThreads, 1);
+	}
+
+	void Scrypt::ComputeDerivedHash(const uint8_t* Password, size_t PasswordLength, const uint8_t* Salt, size_t SaltLength,
+		uint64_t Iterations, uint32_t BlockSize, uint32_t Parallelism, uint8_t* Output, size_t OutputByteLength, uint32_t MaxThreads,
+		uint32_t Interleave)
+	{
+		ValidateParameters(Password, PasswordLength, Salt, SaltLength, Iterations, BlockSize, Parallelism, Output, OutputByteLength);
+		if (Interleave < 1 || Interleave > MaxInterleave)
+			throw std::out_of_range("Interleave must be between 1 and 4.");
+		uint32_t threads = ResolveThreads(MaxThreads, Parallelism);
+		// only the lanes a thread would run one after the other anyway are interleaved
+		size_t perUnit = std::min((size_t)Interleave, ((size_t)Parallelism + threads - 1) / threads);
+		size_t units = (Parallelism + perUnit - 1) / perUnit;
+		threads = ResolveThreads(threads, units);
+		size_t r128 = (size_t)BlockSize * 128;
+		size_t N = (size_t)Iterations;
+
+		std::vector<uint8_t> B(Parallelism * r128);
+		std::unique_ptr<CallRecorder> rec(MetricsOn() ? new CallRecorder(N, BlockSize, Parallelism, 1, threads, false, threads * perUnit * (N + 2) * r128) : nullptr);
+		// Each worker owns perUnit complete V/X/Y sets and pulls units of lanes until none are left, writing each result back into
+		// its own slot of B.  Lanes never share memory, so the output is bit-identical to the serial loop however they are scheduled.
+		DeriveHash(Password, PasswordLength, Salt, SaltLength, B.data(), B.size(), Output, OutputByteLength, MaxThreads, rec.get(), [&](const HMAC<SHA256>& salted) {
+			RunWorkers(threads, units, [&](std::atomic<size_t>& nextUnit) {
+				BlockBuffer scratch(perUnit * (N + 2) * (r128 / 4)); // V, then X and Y, per lane
+				for (size_t u = nextUnit++; u < units; u = nextUnit++)
+					RunLanes(salted, B.data(), u * perUnit, std::min(perUnit, Parallelism - u * perUnit), BlockSize, N, scratch.data, rec.get());
+			}, NUMA::Enabled());
+		});
+	}
+
+	static const uint64_t DefaultWindowBytes = 64ULL << 20;
+
+	// ROMix on Count lanes whose V/X/Y sets are mapped buffers.  The fill runs Window blocks at a time and hands every finished
+	// window to write back, so dirty pages never pile up beyond what the kernel has already started writing.  The mix is
+	// stepped round robin when Count > 1, each lane's next V[j] announced as soon as it is known.  rec, when attached, gets
+	// the fill and mix time as from ROMixLanes.
+	static void LargeLanes(uint8_t* const* Bp, size_t Count, uint32_t BlockSize, size_t N, MappedBuffer* const* V, size_t Window, CallRecorder* rec)
+	{
+		size_t r32 = (size_t)BlockSize * 32;
+		uint64_t r128 = (uint64_t)BlockSize * 128;
+		Stamp t = rec != nullptr ? Stamp::Now() : Stamp();
+		for (size_t k = 0; k < Count; k++)
+		{
+			uint32_t* XY = V[k]->data + N * r32;
+			V[k]->Sequential();
+			shuffleIn(V[k]->data, Bp[k], r32); // V0 = X = B[p]
+			for (size_t begin = 0; begin < N; begin += Window)
+			{
+				size_t end = std::min(N, begin + Window);
+				ROMixFillSteps(BlockSize, N, V[k]->data, XY, begin, end);
+				V[k]->WriteBehind(begin * r128, (end - begin) * r128);
+			}
+			V[k]->Random();
+		}
+		if (rec != nullptr)
+			t = rec->Add(Metrics::ROMixFill, t);
+		if (Count == 1)
+		{
+			ROMixMix(Bp[0], BlockSize, N, V[0]->data, V[0]->data + N * r32);
+			if (rec != nullptr)
+				rec->Add(Metrics::ROMixMix, t);
+			return;
+		}
+		for (size_t i = 0; i < N; i++)
+		{
+			for (size_t k = 0; k < Count; k++)
+			{
+				uint32_t* XY = V[k]->data + N * r32;
+				ROMixMixSteps(BlockSize, N, V[k]->data, XY, i, i + 1);
+				const uint32_t* X = ((i + 1) & 1) == 0 ? XY : XY + r32; // where step i + 1 starts
+				V[k]->ReadAhead((integerify(X, BlockSize) & (N - 1)) * r128, r128);
+			}
+		}
+		for (size_t k = 0; k < Count; k++)
+			shuffleOut(Bp[k], V[k]->data + N * r32, r32); // B[p] = X
+		if (rec != nullptr)
+			rec->Add(Metrics::ROMixMix, t);
+	}
+
+	void Scrypt::ComputeDerivedHashLarge(const uint8_t* Password, size_t PasswordLength, const uint8_t* Salt, size_t SaltLength,
+		uint64_t Iterations, uint32_t BlockSize, uint32_t Parallelism, uint8_t* Output, size_t OutputByteLength, const LargeMemoryOptions& Options)
+	{
+		ValidateParameters(Password, PasswordLength, Salt, SaltLength, Iterations, BlockSize, Parallelism, Output, OutputByteLength, MaxLargeMemory);
+		uint32_t interleave = Options.Interleave == 0 ? 1 : Options.Interleave;
+		if (interleave > MaxInterleave)
+			throw std::out_of_range("Interleave must be between 1 and 4.");
+		uint64_t bytes = (Iterations + 2) * BlockSize * 128; // V, X and Y of one lane
+		if (bytes > (uint64_t)(SIZE_MAX / 2))
+			throw std::bad_alloc();
+		size_t perUnit = std::min((size_t)interleave, (size_t)Parallelism);
+		size_t units = (Parallelism + perUnit - 1) / perUnit;
+		uint32_t threads = ResolveThreads(Options.MaxThreads, units);
+		size_t r128 = (size_t)BlockSize * 128;
+		size_t N = (size_t)Iterations;
+		uint64_t windowBytes = Options.WindowBytes == 0 ? DefaultWindowBytes : Options.WindowBytes;
+		size_t window = (size_t)std::max<uint64_t>(1, std::min<uint64_t>(Iterations, windowBytes / r128));
+
+		std::vector<uint8_t> B(Parallelism * r128);
+		std::unique_ptr<CallRecorder> rec(MetricsOn() ? new CallRecorder(N, BlockSize, Parallelism, 1, threads, false, threads * perUnit * bytes) : nullptr);
+		DeriveHash(Password, PasswordLength, Salt, SaltLength, B.data(), B.size(), Output, OutputByteLength, Options.MaxThreads, rec.get(), [&](const HMAC<SHA256>& salted) {
+			RunWorkers(threads, units, [&](std::atomic<size_t>& nextUnit) {
+				for (size_t u = nextUnit++; u < units; u = nextUnit++)
+				{
+					size_t first = u * perUnit, count = std::min(perUnit, Parallelism - first);
+					std::unique_ptr<MappedBuffer> scratch[MaxInterleave];
+					MappedBuffer* V[MaxInterleave];
+					uint8_t* Bp[MaxInterleave];
+					for (size_t k = 0; k < count; k++)
+					{
+						scratch[k].reset(new MappedBuffer(bytes, Options.ScratchDirectory, !Options.SkipWipe));
+						V[k] = scratch[k].get();
+					}
+					Stamp t = rec ? Stamp::Now() : Stamp();
+					for (size_t k = 0; k < count; k++)
+					{
+						Bp[k] = B.data() + (first + k) * r128;
+						PBKDF2SHA256Range(salted, (first + k) * r128, Bp[k], r128, 1);
+					}
+					if (rec)
+						rec->Add(Metrics::PBKDF2In, t);
+					LargeLanes(Bp, count, BlockSize, N, V, window, rec.get());
+				}
+			});
+		});
+	}
+
+	ScryptContext::ScryptContext(uint64_t CPUCost, uint32_t BlockSize, uint32_t Workers, uint32_t Flags)
+		: cpuCost(CPUCost), blockSize(BlockSize), workers(ResolveThreads(Workers, SIZE_MAX)), scratch(nullptr),
+		numa((Flags & NUMALocal) != 0), b(nullptr), bCapacity(0)
+	{
+		const uint8_t salt = 0;
+		uint8_t output = 0;
+		ValidateParameters(nullptr, 0, &salt, 1, CPUCost, BlockSize, 1, &output, 1);
+		size_t words = ((size_t)CPUCost + 2) * BlockSize * 32; // V, then X and Y
+		scratch = new BlockBuffer*[workers]();
+		try
+		{
+			for (uint32_t w = 0; w < workers; w++)
+			{
+				NodePin pin(numa ? (int)(w % NUMA::Nodes()) : -1); // binds the buffer, the pages are touched by the worker
+				scratch[w] = new BlockBuffer(words, Flags);
+			}
+		}
+		catch (...)
+		{
+			for (uint32_t w = 0; w < workers; w++)
+				delete scratch[w];
+			delete[] scratch;
+			throw;
+		}
+	}
+
+	ScryptContext::~ScryptContext()
+	{
+		for (uint32_t w = 0; w < workers; w++)
+			delete scratch[w];
+		delete[] scratch;
+		delete[] b; // wiped after every call
+	}
+
+	bool ScryptContext::UsesHugePages() const
+	{
+		for (uint32_t w = 0; w < workers; w++)
+			if (!scratch[w]->HugePages())
+				return false;
+		return true;
+	}
+
+	bool ScryptContext::IsLocked() const
+	{
+		for (uint32_t w = 0; w < workers; w++)
+			if (!scratch[w]->Locked())
+				return false;
+		return true;
+	}
+
+	void ScryptContext::ComputeDerivedHash(const uint8_t* Password, size_t PasswordLength, const uint8_t* Salt, size_t SaltLength,
+		uint32_t Parallelism, uint8_t* Output, size_t OutputByteLength)
+	{
+		ValidateParameters(Password, PasswordLength, Salt, SaltLength, cpuCost, blockSize, Parallelism, Output, OutputByteLength);
+		size_t r128 = (size_t)blockSize * 128;
+		size_t N = (size_t)cpuCost;
+		size_t length = Parallelism * r128;
+		if (length > bCapacity)
+		{
+			delete[] b;
+			b = nullptr;
+			bCapacity = 0;
+			b = new uint8_t[length];
+			bCapacity = length;
+		}
+
+		uint32_t threads = ResolveThreads(workers, Parallelism);
+		std::unique_ptr<CallRecorder> rec(MetricsOn() ? new CallRecorder(N, blockSize, Parallelism, 1, threads, false, threads * (N + 2) * r128) : nullptr);
+		// same scheduling as Scrypt::ComputeDerivedHash, but each worker borrows one of the preallocated V/X/Y sets
+		// and wipes it (streaming stores, nothing is freed) once its lanes are done
+		DeriveHash(Password, PasswordLength, Salt, SaltLength, b, length, Output, OutputByteLength, workers, rec.get(), [&](const HMAC<SHA256>& salted) {
+			std::atomic<uint32_t> nextWorker(0);
+			RunWorkers(threads, Parallelism, [&](std::atomic<size_t>& nextLane) {
+				uint32_t w = nextWorker++;
+				BlockBuffer& s = *scratch[w];
+				NodePin pin(numa ? (int)(w % NUMA::Nodes()) : -1);
+				bool used = false;
+				try
+				{
+					for (size_t p = nextLane++; p < Parallelism; p = nextLane++, used = true)
+						RunLanes(salted, b, p, 1, blockSize, N, s.data, rec.get());
+				}
+				catch (...)
+				{
+					s.Wipe();
+					throw;
+				}
+				if (used)
+					s.Wipe();
+			});
+		});
+	}
+}
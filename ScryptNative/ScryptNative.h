@@ -0,0 +1,597 @@
+#pragma once
+
+/* Copyright (c) 2017, Dustin J Sparks
+*
+* PUBLIC DOMAIN MARK
+*
+* While this work is free from any patent or intellectual property claims, the algorithm, pseudo-code, and test vectors were derived from
+* RFC 7914 "The scrypt Password-Based Key Derivation Function" (C. Percival, August 2016, ISSN: 2070-1721)
+*
+* From the RFC:
+* Copyright (c) 2016 IETF Trust and the persons identified as the
+* document authors. All rights reserved.
+* This document is subject to BCP 78 and the IETF Trusts Legal Provisions Relating to IETF Documents (http://trustee.ietf.org/license-info)
+* in effect on the date of publication of this document. Please review these documents carefully, as they describe your rights and restrictions
+* with respect to this document. Code Components extracted from this document must include Simplified BSD License text as described in Section 4.e of
+* the Trust Legal Provisions and are provided without warranty as described in the Simplified BSD License.
+*
+* Unless required by applicable law or agreed to in writing, software
+* distributed under the License is distributed on an "AS IS" BASIS,
+* WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+* See the License for the specific language governing permissions and
+* limitations under the License.
+*/
+
+#include <cstddef>
+#include <cstdint>
+#include <exception>
+#include <functional>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+// Portable native core of ScryptManaged.  Everything here works on raw pointers and lengths, never allocates
+// on the managed heap, and builds with any C++17 compiler (see CMakeLists.txt in the repository root).
+// The C++/CLI classes in ScryptManaged are thin pinning wrappers over these.
+// Invalid parameters throw std::invalid_argument or std::out_of_range with the same messages the managed API uses.
+namespace ScryptNative
+{
+	class BlockBuffer; // Memory.h
+
+	class PBKDF2
+	{
+	public:
+		// RFC 2898 Password Based Key Derivation Function # 2, using SHA1 in an HMAC configuration.
+		static void HMACSHA1(const uint8_t* Password, size_t PasswordLength, const uint8_t* Salt, size_t SaltLength,
+			uint32_t Iterations, uint8_t* Output, size_t OutputByteCount);
+		// RFC 2898 Password Based Key Derivation Function # 2, using SHA256 in an HMAC configuration. SCRYPT Uses this operation internally
+		static void HMACSHA256(const uint8_t* Password, size_t PasswordLength, const uint8_t* Salt, size_t SaltLength,
+			uint32_t Iterations, uint8_t* Output, size_t OutputByteCount);
+		// RFC 2898 Password Based Key Derivation Function # 2, using SHA512 in an HMAC configuration.
+		static void HMACSHA512(const uint8_t* Password, size_t PasswordLength, const uint8_t* Salt, size_t SaltLength,
+			uint32_t Iterations, uint8_t* Output, size_t OutputByteCount);
+		// Same as above, but the output blocks (which are independent) are computed on up to MaxThreads threads (0 = one per
+		// hardware thread).  Threads are only started when there are enough blocks * Iterations to pay for them.
+		// HMACSHA256 also runs the blocks through the multi-buffer SHA-256 kernel, Scrypt::BatchLanes() blocks at a time.
+		static void HMACSHA1(const uint8_t* Password, size_t PasswordLength, const uint8_t* Salt, size_t SaltLength,
+			uint32_t Iterations, uint8_t* Output, size_t OutputByteCount, uint32_t MaxThreads);
+		static void HMACSHA256(const uint8_t* Password, size_t PasswordLength, const uint8_t* Salt, size_t SaltLength,
+			uint32_t Iterations, uint8_t* Output, size_t OutputByteCount, uint32_t MaxThreads);
+		static void HMACSHA512(const uint8_t* Password, size_t PasswordLength, const uint8_t* Salt, size_t SaltLength,
+			uint32_t Iterations, uint8_t* Output, size_t OutputByteCount, uint32_t MaxThreads);
+	};
+
+	// PBKDF2 output produced on demand.  The HMAC is keyed by the password and has absorbed the salt once, after that any
+	// range of the derived key is computed straight into the caller's buffer: only the blocks covering it are run, and there
+	// is never a dkLen sized intermediate.  Read continues where the last Read stopped, ReadAt takes an absolute offset.
+	// Output is identical to the PBKDF2 functions above.  The key state is wiped by the destructor.
+	class PBKDF2Stream
+	{
+	public:
+		static const uint32_t SHA1Hash = 1;
+		static const uint32_t SHA256Hash = 256;
+		static const uint32_t SHA512Hash = 512;
+
+		// Hash is SHA1Hash, SHA256Hash or SHA512Hash
+		PBKDF2Stream(uint32_t Hash, const uint8_t* Password, size_t PasswordLength, const uint8_t* Salt, size_t SaltLength, uint32_t Iterations);
+		~PBKDF2Stream();
+		PBKDF2Stream(const PBKDF2Stream&) = delete;
+		PBKDF2Stream& operator=(const PBKDF2Stream&) = delete;
+
+		void Read(uint8_t* Output, size_t Length);
+		// Blocks are spread over up to MaxThreads threads (0 = one per hardware thread) when the range is large enough
+		void ReadAt(uint64_t Offset, uint8_t* Output, size_t Length, uint32_t MaxThreads);
+		uint64_t Position() const { return position; }
+
+		struct State;
+	private:
+		State* state;
+		uint64_t position;
+	};
+
+	class Scrypt
+	{
+	public:
+		// RFC 7914 The scrypt Password-Based Key Derivation Function
+		// Password=password('P', may be null when PasswordLength is 0), Salt=salt ('S', cannot be null or empty), CPUCost=Iterations('N'),
+		// BlockSize=Blocks used Internally('r', memory cost), Parallelism=Number of lanes ('p', also a memory cost)
+		// Output receives OutputByteLength bytes ('dkLen')
+		static void ComputeDerivedHash(const uint8_t* Password, size_t PasswordLength, const uint8_t* Salt, size_t SaltLength,
+			uint64_t CPUCost, uint32_t BlockSize, uint32_t Parallelism, uint8_t* Output, size_t OutputByteLength);
+		// Same as above, but runs the 'p' ROMix lanes on up to MaxThreads threads (including the calling thread).
+		// Every thread allocates its own N * r * 128 bytes of scratch, so memory use grows with the thread count.
+		// MaxThreads=1 is the serial path, MaxThreads=0 uses one thread per hardware thread. Output is identical either way.
+		static void ComputeDerivedHash(const uint8_t* Password, size_t PasswordLength, const uint8_t* Salt, size_t SaltLength,
+			uint64_t CPUCost, uint32_t BlockSize, uint32_t Parallelism, uint8_t* Output, size_t OutputByteLength, uint32_t MaxThreads);
+		// Same again, but when there are more lanes than threads each thread advances up to Interleave (1 to MaxInterleave) of its
+		// lanes round robin, prefetching every lane's next V[j] while the others compute, which hides much of the memory latency
+		// once V outgrows the caches.  Each thread then holds Interleave sets of scratch.  Interleave=1 is the overload above.
+		static void ComputeDerivedHash(const uint8_t* Password, size_t PasswordLength, const uint8_t* Salt, size_t SaltLength,
+			uint64_t CPUCost, uint32_t BlockSize, uint32_t Parallelism, uint8_t* Output, size_t OutputByteLength, uint32_t MaxThreads,
+			uint32_t Interleave);
+		static const uint32_t MaxInterleave = 4;
+		// Computes Count independent hashes that share CPUCost, BlockSize, Parallelism and OutputByteLength.
+		// Passwords[i]/PasswordLengths[i], Salts[i]/SaltLengths[i] and Outputs[i] describe hash i; the results are identical to
+		// calling ComputeDerivedHash once per hash.  The Count * Parallelism ROMix lanes run in lockstep, BatchLanes() at a time
+		// (one per 32 bit element of the widest vector register compiled in), spread over up to MaxThreads threads (0 = all).
+		// Every running group needs BatchLanes() * CPUCost * BlockSize * 128 bytes.
+		static void ComputeDerivedHashBatch(const uint8_t* const* Passwords, const size_t* PasswordLengths,
+			const uint8_t* const* Salts, const size_t* SaltLengths, size_t Count,
+			uint64_t CPUCost, uint32_t BlockSize, uint32_t Parallelism, uint8_t* const* Outputs, size_t OutputByteLength, uint32_t MaxThreads);
+		// Batch verification: recomputes every hash as above and compares it with ExpectedHashes[i] in constant time.
+		// Results[i] is true when password i matches.
+		static void CompareBatch(const uint8_t* const* Passwords, const size_t* PasswordLengths,
+			const uint8_t* const* Salts, const size_t* SaltLengths, size_t Count,
+			uint64_t CPUCost, uint32_t BlockSize, uint32_t Parallelism, const uint8_t* const* ExpectedHashes, size_t HashByteLength,
+			bool* Results, uint32_t MaxThreads);
+		// Number of independent ROMix instances the batch functions interleave (1 when no vector kernel is compiled in)
+		static uint32_t BatchLanes();
+		// Most bytes ComputeDerivedHashBatch holds at once for these arguments: B of every lane, plus V/X/Y of the group and
+		// of the run of single-stream lanes each thread works on
+		static uint64_t BatchFootprint(uint64_t CPUCost, uint32_t BlockSize, uint32_t Parallelism, size_t Count, uint32_t MaxThreads);
+
+		// Large-memory mode, for one-off derivations (a vault or backup master key) whose V may be larger than RAM.
+		// ComputeDerivedHash caps V at 2 GiB; here N * r * 128 may reach MaxLargeMemory.  Every running lane maps its own V,
+		// from a scratch file or anonymous (swap backed) memory, the fill writes it back window by window as it goes, and the
+		// mix tells the kernel which pages it reads next.  Output is identical to ComputeDerivedHash.
+		struct LargeMemoryOptions
+		{
+			const char* ScratchDirectory; // directory for the unnamed scratch files, nullptr = anonymous mappings
+			uint32_t MaxThreads; // lanes that run (and hold a V) at once, 0 = one per hardware thread
+			uint32_t Interleave; // lanes one thread advances round robin (1 to MaxInterleave, 0 = 1), see below
+			uint64_t WindowBytes; // how much of V the fill writes before starting its write back, 0 = 64 MiB
+			bool SkipWipe; // release V without zeroing it first (saves one more pass over a file backed V)
+		};
+		// With Interleave > 1 a thread keeps that many lanes in flight and asks for each lane's next V[j] to be read in while the
+		// others compute, which overlaps the page faults when V is mostly on disk (and only costs time when it is not).
+		static void ComputeDerivedHashLarge(const uint8_t* Password, size_t PasswordLength, const uint8_t* Salt, size_t SaltLength,
+			uint64_t CPUCost, uint32_t BlockSize, uint32_t Parallelism, uint8_t* Output, size_t OutputByteLength, const LargeMemoryOptions& Options);
+		static const uint64_t MaxLargeMemory = 1ULL << 44;
+
+		// Parameters chosen by Calibrate, with what they cost on this host
+		struct Calibration
+		{
+			uint64_t CPUCost;
+			uint32_t BlockSize;
+			uint32_t Parallelism;
+			uint32_t MaxThreads; // to pass to ComputeDerivedHash, the lanes are spread over this many threads
+			uint64_t MemoryBytes; // V/X/Y of every thread plus B, for one hash
+			double Milliseconds; // measured latency of one ComputeDerivedHash call
+			double HashesPerSecond; // one call at a time
+			double NodeHashesPerSecond; // estimate with every hardware thread busy (ignores memory bandwidth limits)
+		};
+		// Times short runs of the ROMix kernel on this host and returns the strongest parameters whose hash takes at most
+		// TargetMilliseconds and needs at most MaxMemoryBytes.  BlockSize stays at 8 (RFC 7914's recommendation): CPUCost is the
+		// largest power of 2 one lane can finish in time, then Parallelism adds lanes (MaxThreads at a time, 0 = all) to use
+		// what is left of the target.  The result is checked with real ComputeDerivedHash calls and scaled back if needed.
+		// Throws std::out_of_range when not even CPUCost=16 fits.
+		static Calibration Calibrate(double TargetMilliseconds, uint64_t MaxMemoryBytes, uint32_t MaxThreads);
+		// Fills Salt with Length bytes from the OS CSPRNG (BCryptGenRandom, /dev/urandom), std::runtime_error if none is available
+		static void RandomSalt(uint8_t* Salt, size_t Length);
+		// Checks if two buffers are equal. Compares every byte to prevent timing attacks. Returns True if both are equal
+		static bool SafeEquals(const uint8_t* a, const uint8_t* b, size_t length);
+	};
+
+	// Fields of one stored scrypt hash.  Salt and Hash point into whatever buffer the fields were decoded into or read from.
+	struct HashFields
+	{
+		uint32_t Version; // 2 for "$s2$cc$b$p$<salt>$<hash>", 0 or 1 for the deprecated "$s1$<hex 0c0b0p>$<salt>$<hash>"
+		uint64_t CPUCost;
+		uint32_t BlockSize;
+		uint32_t Parallelism;
+		const uint8_t* Salt;
+		size_t SaltLength;
+		const uint8_t* Hash;
+		size_t HashLength;
+	};
+
+	// Codec for the text form written by the managed Scrypt::Encode, and a fixed size binary record holding the same fields.
+	// Nothing here allocates or throws: malformed input, fields that do not fit and short buffers return false / 0.
+	// Scrypt parameters are not range checked here, ComputeDerivedHash does that when the hash is used.
+	class HashCodec
+	{
+	public:
+		// Record layout, little endian: Version, log2(CPUCost), SaltLength and HashLength (1 byte each), BlockSize and
+		// Parallelism (4 bytes each), 4 zero bytes, then the salt and the hash, each zero padded to its maximum.
+		static const size_t RecordSize = 128;
+		static const size_t RecordMaxSalt = 48;
+		static const size_t RecordMaxHash = 64;
+
+		// Parses TextLength chars of Text (no terminator needed).  The salt and hash are base64 decoded back to back into
+		// Storage, StorageCapacity = TextLength is always enough.
+		static bool Decode(const char* Text, size_t TextLength, HashFields& Fields, uint8_t* Storage, size_t StorageCapacity);
+		// Exact number of chars Encode writes for Fields
+		static size_t EncodedLength(const HashFields& Fields);
+		// Writes the text form (no terminator) and returns its length, 0 when TextCapacity is too small or Fields cannot be
+		// written in its Version (the deprecated form holds 8 bit CPUCost/BlockSize/Parallelism only).  An empty salt or hash
+		// is written as an empty field, as the managed Header always did (Decode does not accept it back).
+		static size_t Encode(const HashFields& Fields, char* Text, size_t TextCapacity);
+
+		// CPUCost must be a power of 2, the salt and hash must fit their slots
+		static bool WriteRecord(const HashFields& Fields, uint8_t* Record);
+		// Salt and Hash point into Record
+		static bool ReadRecord(const uint8_t* Record, HashFields& Fields);
+		// Count records back to back in Records, Valid[i] tells whether Fields[i] was read.  Returns how many were.
+		static size_t ReadRecords(const uint8_t* Records, size_t Count, HashFields* Fields, bool* Valid);
+	};
+
+	// Bulk migration of stored hashes: a text file with one record per line is memory mapped and read in order, chunks of
+	// records are processed on all cores, and results are written in input order, one line per input line.
+	// After every chunk a checkpoint (OutputPath + ".resume") records how far input and output got, so running again with the
+	// same arguments after an interruption continues from there; the checkpoint is removed once the run completes.
+	class HashMigration
+	{
+	public:
+		enum Operation
+		{
+			Upgrade, // "<encoded>": deprecated $s0/$s1 headers rewritten as $s2, the hash itself is kept
+			Verify, // "<encoded>\t<password>": "<encoded>\t1" when the password matches, "<encoded>\t0" when not
+			Rehash, // "<encoded>\t<password>": verified, then encoded again with the new parameters and a fresh salt
+			Encode // "<password>": encoded with the new parameters and a fresh salt (imports)
+		};
+
+		// Totals of a run (including the part done before a resume)
+		struct Report
+		{
+			uint64_t Records; // non empty lines processed
+			uint64_t Changed; // lines written differently from how they were read (upgraded, rehashed, encoded)
+			uint64_t Failed; // malformed records and, for Verify/Rehash, wrong passwords: written back unchanged (Verify: "\t0")
+			uint64_t InputBytes; // of the input consumed so far
+			uint64_t InputSize; // of the whole input
+			double Seconds; // this run only
+			uint64_t ResumedRecords; // Records and InputBytes done before this run resumed, 0 for a fresh run
+			uint64_t ResumedBytes;
+		};
+
+		// Called after every chunk; (Records - ResumedRecords) / Seconds is the throughput.  Throwing from it stops the run, resumably.
+		typedef void (*Progress)(const Report& SoFar, void* Context);
+
+		struct Options
+		{
+			Operation Mode;
+			uint64_t CPUCost; // target parameters for Rehash and Encode; Rehash copies records that already use them
+			uint32_t BlockSize;
+			uint32_t Parallelism;
+			size_t HashLength; // 0 keeps the record's own length (Rehash) or uses 32 (Encode)
+			size_t SaltLength; // 0 = 32 bytes, as the managed Encode
+			uint32_t Threads; // 0 = one per hardware thread
+			size_t ChunkRecords; // records per chunk and checkpoint, 0 = 1024
+			Progress OnProgress; // may be null
+			void* Context;
+		};
+
+		// Throws std::runtime_error for I/O failures or a checkpoint left by a run with different options,
+		// and like Scrypt::ComputeDerivedHash for bad target parameters
+		static Report Run(const char* InputPath, const char* OutputPath, const Options& Opts);
+	};
+
+	// Host wide hashing service for multi-process servers (POSIX only, std::runtime_error elsewhere).  Worker processes send
+	// encode and verify requests over a Unix domain socket; requests that share CPUCost, BlockSize, Parallelism and hash length
+	// are merged into one Scrypt::ComputeDerivedHashBatch call, and a batch only starts once its BatchFootprint fits in what the
+	// running batches leave of MemoryBudget, so the whole host holds one bounded set of V buffers.
+	//
+	// Protocol, little endian, any number of requests in flight per connection (answers may come back out of order, match Id):
+	//   request:  uint32 Length (bytes after this field), uint32 Id, uint8 Op, uint8 log2(CPUCost), uint16 BlockSize,
+	//             uint16 Parallelism, uint16 HashLength, uint16 PasswordLength, uint16 EncodedLength, then EncodedLength
+	//             chars of the encoded hash (Verify, its header gives the parameters) and PasswordLength password bytes
+	//   response: uint32 Length, uint32 Id, uint8 Status, 3 zero bytes, then the encoded hash (Encode) or an error message
+	// Busy (queue full, shutting down) is worth retrying; Failed (the daemon could not compute the hash: no memory for V,
+	// no random salt) and Invalid are not.
+	class HashDaemon
+	{
+	public:
+		enum Operation { Encode = 1, Verify = 2 };
+		enum Status { Ok = 0, Mismatch = 1, Busy = 2, Invalid = 3, Failed = 4 };
+		static const size_t RequestHeader = 20; // Length through EncodedLength
+		static const size_t ResponseHeader = 12;
+		static const size_t MaxFrame = 65536;
+
+		struct Options
+		{
+			const char* SocketPath; // replaced if a stale socket file is left there
+			uint32_t Threads; // batches running at once, 0 = one per hardware thread
+			uint64_t MemoryBudget; // bytes all running batches may hold together, 0 = 1 GiB
+			size_t MaxQueued; // requests waiting for a batch before new ones get Busy, 0 = 4096
+			size_t MaxBatch; // requests merged into one batch, 0 = 4 * Scrypt::BatchLanes()
+			uint32_t BatchWindowMicroseconds; // how long a lone request may wait for others to share its batch
+			size_t SaltLength; // for Encode, 0 = 32 bytes as the managed Encode
+		};
+
+		// Binds and listens, std::runtime_error if the socket cannot be created
+		explicit HashDaemon(const Options& Opts);
+		// Answers the requests still queued with Busy and joins the workers
+		~HashDaemon();
+		HashDaemon(const HashDaemon&) = delete;
+		HashDaemon& operator=(const HashDaemon&) = delete;
+
+		// Serves connections on the calling thread until Stop
+		void Run();
+		// Makes Run return; async signal safe, so it may be called from a SIGTERM handler
+		void Stop();
+
+		uint64_t Requests() const;
+		uint64_t Batches() const;
+		uint64_t MemoryInUse() const;
+
+	private:
+		struct State;
+		State* state;
+	};
+
+	// Blocking client for one connection to a HashDaemon, one request at a time.  Not thread safe: one per worker thread.
+	class HashDaemonClient
+	{
+	public:
+		// std::runtime_error if the daemon is not listening
+		explicit HashDaemonClient(const char* SocketPath);
+		~HashDaemonClient();
+		HashDaemonClient(const HashDaemonClient&) = delete;
+		HashDaemonClient& operator=(const HashDaemonClient&) = delete;
+
+		// The daemon answered Busy: it is at capacity or shutting down, the request may be retried
+		struct BusyError : std::runtime_error
+		{
+			explicit BusyError(const std::string& Message) : std::runtime_error(Message) {}
+		};
+
+		// $s2 text with a fresh salt.  std::invalid_argument for parameters the daemon rejects, BusyError when it is Busy,
+		// std::runtime_error when it failed to compute the hash or the connection is lost.
+		std::string Encode(const uint8_t* Password, size_t PasswordLength, uint64_t CPUCost, uint32_t BlockSize, uint32_t Parallelism, size_t HashLength);
+		// True when Password reproduces the encoded hash, throws like Encode (std::invalid_argument for a malformed hash)
+		bool Verify(const char* Encoded, size_t EncodedLength, const uint8_t* Password, size_t PasswordLength);
+
+	private:
+		int fd;
+		uint32_t nextId;
+		uint8_t Call(std::vector<uint8_t>& Frame, std::string& Text);
+	};
+
+	// Optional NUMA placement for multi-socket hosts, where the random V[j] reads of ROMix run up to twice as slow from a
+	// remote node.  Process wide and off by default.  While on, Scrypt::ComputeDerivedHash, ComputeDerivedHashBatch and
+	// CompareBatch pin each of their worker threads to one node for the whole call: the calling thread to the node it is
+	// running on, the others round robin from there.  Each worker's V/X/Y scratch is then bound to and first touched on
+	// its node, and every lane it pulls runs there to the end.  The calling thread gets its affinity back afterwards.
+	// ScryptContext has its own switch (NUMALocal) since its scratch outlives the calls.
+	class NUMA
+	{
+	public:
+		// Nodes with CPUs this process may run on (1 on single node hosts and where the OS has no NUMA API)
+		static uint32_t Nodes();
+		static void Enable(bool On);
+		static bool Enabled();
+		// Node (0 .. Nodes() - 1) the calling thread is running on, or is pinned to
+		static uint32_t CurrentNode();
+	};
+
+	// Reusable scratch for many scrypt calls with the same CPUCost ('N') and BlockSize ('r').
+	// The V/X/Y buffers of Workers threads (0 = one per hardware thread) are allocated once, page backed and optionally on
+	// huge pages and locked in RAM, and are wiped with streaming stores after every call instead of being freed.
+	// B is kept too and only grows.  One call at a time per context: give each server thread its own.
+	class ScryptContext
+	{
+	public:
+		// Back V with explicit huge pages (MAP_HUGETLB, or MEM_LARGE_PAGES with SeLockMemoryPrivilege), falling back to
+		// transparent huge pages / normal pages when none are available.  Cuts the TLB misses of the random V[j] reads.
+		static const uint32_t HugePages = 1;
+		// mlock / VirtualLock the scratch so V never reaches the swap file (best effort, subject to RLIMIT_MEMLOCK)
+		static const uint32_t LockMemory = 2;
+		// Spread the workers' scratch over the NUMA nodes (worker w on node w % NUMA::Nodes()) and run each worker's lanes
+		// on a thread pinned to the node of its scratch
+		static const uint32_t NUMALocal = 4;
+
+		ScryptContext(uint64_t CPUCost, uint32_t BlockSize, uint32_t Workers, uint32_t Flags);
+		~ScryptContext();
+		ScryptContext(const ScryptContext&) = delete;
+		ScryptContext& operator=(const ScryptContext&) = delete;
+
+		// Same as Scrypt::ComputeDerivedHash with this context's CPUCost and BlockSize, the 'p' lanes run on up to Workers threads
+		void ComputeDerivedHash(const uint8_t* Password, size_t PasswordLength, const uint8_t* Salt, size_t SaltLength,
+			uint32_t Parallelism, uint8_t* Output, size_t OutputByteLength);
+
+		uint64_t CPUCost() const { return cpuCost; }
+		uint32_t BlockSize() const { return blockSize; }
+		uint32_t Workers() const { return workers; }
+		// True when every worker's scratch got explicit huge pages / was locked in RAM
+		bool UsesHugePages() const;
+		bool IsLocked() const;
+
+	private:
+		uint64_t cpuCost;
+		uint32_t blockSize;
+		uint32_t workers;
+		BlockBuffer** scratch; // one V/X/Y set per worker
+		bool numa; // NUMALocal: scratch[w] lives on node w % NUMA::Nodes()
+		uint8_t* b;
+		size_t bCapacity;
+	};
+
+	// One scrypt hash computed in slices, so an event loop can interleave many hashes fairly and drop abandoned ones early.
+	// Each lane is N fill then N mix iterations (Steps() = 2 * N * p in all); Step runs at most MaxSteps of them on the calling
+	// thread and returns, the PBKDF2 passes ride along with the first step of a lane and the last step of the hash.
+	// The password and salt are only read by the constructor.  V is allocated on the first Step and freed as soon as the last
+	// lane is mixed or the computation is cancelled.  The result is identical to Scrypt::ComputeDerivedHash.
+	// Cancel may be called from any thread at any time; everything else one thread at a time.
+	class ScryptComputation
+	{
+	public:
+		enum Status { Running, Done, Cancelled };
+
+		ScryptComputation(const uint8_t* Password, size_t PasswordLength, const uint8_t* Salt, size_t SaltLength,
+			uint64_t CPUCost, uint32_t BlockSize, uint32_t Parallelism, size_t OutputByteLength);
+		~ScryptComputation();
+		ScryptComputation(const ScryptComputation&) = delete;
+		ScryptComputation& operator=(const ScryptComputation&) = delete;
+
+		// Runs up to MaxSteps ROMix iterations, or wipes everything and gives up when Cancel was called since the last slice.
+		// If it throws (std::bad_alloc for V) the computation is wiped and Cancelled.
+		Status Step(uint64_t MaxSteps);
+		// Seen by the next Step (a running one finishes its slice first)
+		void Cancel();
+		Status CurrentStatus() const;
+		uint64_t StepsDone() const;
+		uint64_t Steps() const;
+		size_t OutputByteLength() const;
+		// Copies the derived hash (OutputByteLength as constructed), throws std::logic_error unless Done
+		void Result(uint8_t* Output, size_t OutputByteLength) const;
+
+	private:
+		struct State;
+		State* state;
+	};
+
+	// Bounded worker pool for scrypt jobs with admission control against a global memory budget.
+	// Each job runs on one worker (its 'p' lanes serially) and holds Footprint() bytes while it runs; the job at the head of the
+	// queue only starts once that fits in what the running jobs leave of MemoryBudget, so a burst queues instead of swapping.
+	// Jobs start in submission order.  Password, salt and output are copied into the job, so callers need not keep them alive.
+	class ScryptScheduler
+	{
+	public:
+		// Receives the derived hash (Output, OutputByteLength bytes, wiped right after the call) or the exception that stopped it.
+		// Runs on a worker thread and must not throw.
+		typedef std::function<void(const uint8_t* Output, size_t OutputByteLength, std::exception_ptr Error)> Completion;
+
+		// Workers=threads (0 = one per hardware thread), MemoryBudget=bytes all running jobs may hold together,
+		// MaxQueued=jobs allowed to wait for admission before Submit pushes back
+		ScryptScheduler(uint32_t Workers, uint64_t MemoryBudget, size_t MaxQueued);
+		// Fails the jobs still queued with std::runtime_error, then waits for the running ones
+		~ScryptScheduler();
+		ScryptScheduler(const ScryptScheduler&) = delete;
+		ScryptScheduler& operator=(const ScryptScheduler&) = delete;
+
+		// Bytes one job holds while running: V and X/Y for one lane, plus B for all of them
+		static uint64_t Footprint(uint64_t CPUCost, uint32_t BlockSize, uint32_t Parallelism, size_t OutputByteLength);
+
+		// Validates and queues one hash.  Returns false when MaxQueued jobs are already waiting (backpressure, nothing is queued).
+		// Throws like Scrypt::ComputeDerivedHash for bad parameters, and std::length_error when the job alone exceeds MemoryBudget.
+		bool Submit(const uint8_t* Password, size_t PasswordLength, const uint8_t* Salt, size_t SaltLength,
+			uint64_t CPUCost, uint32_t BlockSize, uint32_t Parallelism, size_t OutputByteLength, Completion Done);
+
+		uint64_t MemoryBudget() const;
+		// Bytes held by the running jobs right now, never more than MemoryBudget()
+		uint64_t MemoryInUse() const;
+		size_t Queued() const;
+		size_t Running() const;
+
+	private:
+		struct State;
+		State* state;
+	};
+
+	// Streaming scrypt with the phases of consecutive hashes overlapped.  A hash passes three stages joined by bounded queues:
+	// PBKDF2 into B, ROMix of its lanes, PBKDF2 out of B.  Both SHA-256 stages run on one stage thread, ROMix on ROMixWorkers
+	// threads, so the final PBKDF2 of one hash and the first PBKDF2 of the next run while the workers' mix loops wait on V[j]
+	// (on a core of its own, or best on the SMT sibling of a ROMix worker).  Each worker holds one lane's V/X/Y and runs the
+	// lanes of a hash one after the other.  Results are identical to Scrypt::ComputeDerivedHash; with more than one worker
+	// hashes may complete out of submission order.  Password, salt and output are copied, as for ScryptScheduler.
+	class ScryptPipeline
+	{
+	public:
+		// Called on the stage thread, so it should be quick; must not throw
+		typedef ScryptScheduler::Completion Completion;
+
+		// ROMixWorkers=threads of the ROMix stage (0 = one per hardware thread but one, at least 1),
+		// Depth=hashes each stage may have waiting for the next one, and also for the first (1 or more)
+		ScryptPipeline(uint32_t ROMixWorkers, size_t Depth);
+		// Fails the hashes that have not started with std::runtime_error, finishes the others
+		~ScryptPipeline();
+		ScryptPipeline(const ScryptPipeline&) = delete;
+		ScryptPipeline& operator=(const ScryptPipeline&) = delete;
+
+		// Validates and queues one hash.  Returns false when Depth hashes already wait for the first stage (nothing is queued).
+		// Throws like Scrypt::ComputeDerivedHash for bad parameters.
+		bool Submit(const uint8_t* Password, size_t PasswordLength, const uint8_t* Salt, size_t SaltLength,
+			uint64_t CPUCost, uint32_t BlockSize, uint32_t Parallelism, size_t OutputByteLength, Completion Done);
+		// Blocks until every hash submitted so far has completed
+		void Drain();
+		// Hashes submitted and not yet completed
+		size_t InFlight() const;
+		uint32_t ROMixWorkers() const;
+
+	private:
+		struct State;
+		State* state;
+	};
+
+	// Opt-in instrumentation of the scrypt and PBKDF2 hot paths, off by default.  While off, a call costs one relaxed atomic
+	// load; while on, every phase of every lane reads the clock (and the time stamp counter) twice.  Nothing is counted
+	// inside the BlockMix / Salsa20/8 loops, those counts follow from N, r and p.  V allocations and scheduler queueing are
+	// always counted (once per buffer or job, never per block).  Counters are process wide and safe to read at any time.
+	class Metrics
+	{
+	public:
+		enum Phase { PBKDF2In, ROMixFill, ROMixMix, PBKDF2Out, PhaseCount };
+
+		// One scrypt call (or batch call) as passed to the callback.  Phase times are summed over every thread that worked on it.
+		struct Call
+		{
+			uint64_t CPUCost;
+			uint32_t BlockSize;
+			uint32_t Parallelism;
+			uint32_t Threads;
+			uint64_t Hashes; // 1, or the Count of a batch call
+			bool Batch; // run on the multi-buffer lanes
+			uint64_t Nanoseconds[PhaseCount];
+			uint64_t Cycles[PhaseCount]; // time stamp counter ticks, 0 where the target has none
+			uint64_t WallNanoseconds;
+			uint64_t QueueNanoseconds; // time spent waiting in a ScryptScheduler queue before the call started
+			uint64_t VBytes; // V/X/Y scratch the call used (all threads)
+		};
+
+		struct Counters
+		{
+			uint64_t Calls;
+			uint64_t Hashes;
+			uint64_t Nanoseconds[PhaseCount];
+			uint64_t Cycles[PhaseCount];
+			uint64_t WallNanoseconds;
+			uint64_t BlockMixCalls;
+			uint64_t SalsaCalls;
+			uint64_t PBKDF2Calls; // the public PBKDF2 functions and PBKDF2Stream reads
+			uint64_t PBKDF2Nanoseconds;
+			uint64_t VBytesAllocated;
+			uint64_t VBytesWiped;
+			uint64_t VBytesInUse;
+			uint64_t VBytesHighWater;
+			uint64_t JobsQueued; // ScryptScheduler
+			uint64_t QueueNanoseconds;
+			uint64_t QueueHighWater;
+		};
+
+		typedef void (*Callback)(const Call& Record, void* Context);
+
+		static void Enable(bool On);
+		static bool Enabled();
+		static Counters Snapshot();
+		// Zeroes the counters, except VBytesInUse (it describes buffers that are still alive) which also restarts the high water mark
+		static void Reset();
+		// Called with every instrumented scrypt call on the thread that made it, nullptr removes it.  Must not throw.
+		static void SetCallback(Callback Function, void* Context);
+		// Name of the Salsa20/8 kernel compiled in ("Scalar", "SSE2", "AVX2" or "AVX-512VL"), see also Scrypt::BatchLanes
+		static const char* Kernel();
+	};
+
+	// Run time choice of the multi-buffer kernels (the batch functions and PBKDF2-HMAC-SHA256) and of the SHA-256
+	// compression, made once from cpuid, so one binary uses AVX2, AVX-512 or the SHA extensions wherever the CPU has them.
+	// The single-stream Salsa20/8 kernel stays a compile time choice (Metrics::Kernel).  The environment variable
+	// SCRYPT_KERNEL caps the cpuid choice: "portable", "sse2", "avx2" or "avx512", optionally with ",nosha".
+	// Force() and Reset() are meant for tests and benchmarks, call them while no hash is being computed.
+	class Dispatch
+	{
+	public:
+		enum Level { Portable, SSE2, AVX2, AVX512 };
+
+		// Widest level this CPU and this build support, and whether the SHA extensions can be used
+		static Level HostLevel();
+		static bool HostSHAExtensions();
+		// Level and SHA-256 kernel in use
+		static Level CurrentLevel();
+		static bool SHAExtensions();
+		// Binds the widest supported level up to MaxLevel (Portable = no multi-buffer kernel), and the SHA extensions when
+		// UseSHAExtensions is set and the CPU has them.  Returns the level bound.
+		static Level Force(Level MaxLevel, bool UseSHAExtensions);
+		// Back to the cpuid choice, SCRYPT_KERNEL included
+		static void Reset();
+		// e.g. "batch AVX-512 x16, SHA-256 SHA-NI, Salsa20/8 SSE2"
+		static std::string Describe();
+	};
+}
@@ -0,0 +1,338 @@
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <map>
+#include <string>
+#include <thread>
+#include <tuple>
+#include <vector>
+#include "ROMix.h"
+#include "Salsa.h"
+
+using namespace ScryptNative;
+
+typedef std::chrono::steady_clock Clock;
+
+static double Ms(Clock::time_point start, Clock::time_point end)
+{
+	return std::chrono::duration<double, std::milli>(end - start).count();
+}
+
+struct Config
+{
+	uint64_t N;
+	uint32_t r, p;
+	size_t outLen;
+	uint32_t threads;
+	uint32_t interleave;
+};
+
+struct Result
+{
+	Config c;
+	size_t runs;
+	double hashesPerSecond, p50, p95, p99;
+	double vBytesPerSecond; // V written once and read once per step, see Measure
+	double pbkdf2In, fill, mix, pbkdf2Out; // ms, single threaded
+};
+
+typedef std::tuple<uint64_t, uint32_t, uint32_t, size_t, uint32_t, uint32_t> Key;
+
+static Key KeyOf(const Config& c)
+{
+	return Key(c.N, c.r, c.p, c.outLen, c.threads, c.interleave);
+}
+
+// nearest rank percentile of sorted samples
+static double Percentile(const std::vector<double>& sorted, double pct)
+{
+	size_t rank = (size_t)(pct / 100.0 * sorted.size() + 0.999999);
+	return sorted[std::min(sorted.size(), std::max((size_t)1, rank)) - 1];
+}
+
+// One hash through the same pieces Scrypt::ComputeDerivedHash uses, on one thread, timing each phase
+static void Phases(const Config& c, const std::vector<uint8_t>& P, const std::vector<uint8_t>& S, double* ms)
+{
+	size_t r128 = (size_t)c.r * 128;
+	std::vector<uint8_t> B(c.p * r128), out(c.outLen);
+	BlockBuffer scratch(((size_t)c.N + 2) * (r128 / 4));
+	HMAC<SHA256> prf;
+	auto t0 = Clock::now();
+	prf.SetKey(P.data(), P.size());
+	PBKDF2SHA256(prf, S.data(), S.size(), B.data(), B.size(), 1);
+	auto t1 = Clock::now();
+	ms[0] += Ms(t0, t1);
+	for (uint32_t lane = 0; lane < c.p; lane++)
+	{
+		t0 = Clock::now();
+		ROMixFill(B.data() + lane * r128, c.r, (size_t)c.N, scratch.data, scratch.data + c.N * (r128 / 4));
+		t1 = Clock::now();
+		ROMixMix(B.data() + lane * r128, c.r, (size_t)c.N, scratch.data, scratch.data + c.N * (r128 / 4));
+		auto t2 = Clock::now();
+		ms[1] += Ms(t0, t1);
+		ms[2] += Ms(t1, t2);
+	}
+	t0 = Clock::now();
+	PBKDF2SHA256(prf, B.data(), B.size(), out.data(), out.size(), 1);
+	ms[3] += Ms(t0, Clock::now());
+	prf.Clear();
+}
+
+// Runs Scrypt::ComputeDerivedHash until both MinRuns and Seconds are reached (after one warm up call),
+// then a few single threaded runs split into phases
+static Result Measure(const Config& c, size_t MinRuns, double Seconds)
+{
+	std::vector<uint8_t> P(8, 'p'), S(16, 's'), out(c.outLen);
+	Scrypt::ComputeDerivedHash(P.data(), P.size(), S.data(), S.size(), c.N, c.r, c.p, out.data(), out.size(), c.threads, c.interleave);
+
+	std::vector<double> samples;
+	double total = 0;
+	while (samples.size() < MinRuns || total < Seconds * 1000)
+	{
+		auto start = Clock::now();
+		Scrypt::ComputeDerivedHash(P.data(), P.size(), S.data(), S.size(), c.N, c.r, c.p, out.data(), out.size(), c.threads, c.interleave);
+		double ms = Ms(start, Clock::now());
+		samples.push_back(ms);
+		total += ms;
+	}
+	std::sort(samples.begin(), samples.end());
+
+	Result res;
+	res.c = c;
+	res.runs = samples.size();
+	res.hashesPerSecond = samples.size() * 1000.0 / total;
+	res.p50 = Percentile(samples, 50);
+	res.p95 = Percentile(samples, 95);
+	res.p99 = Percentile(samples, 99);
+	// the fill writes every block of V once, the mix reads N of them (at random), per lane
+	res.vBytesPerSecond = 2.0 * (double)c.N * c.r * 128 * c.p * res.hashesPerSecond;
+
+	const int phaseRuns = 3;
+	double ms[4] = { 0, 0, 0, 0 };
+	for (int i = 0; i < phaseRuns; i++)
+		Phases(c, P, S, ms);
+	res.pbkdf2In = ms[0] / phaseRuns;
+	res.fill = ms[1] / phaseRuns;
+	res.mix = ms[2] / phaseRuns;
+	res.pbkdf2Out = ms[3] / phaseRuns;
+	return res;
+}
+
+// Sustained hashes/s of a stream: Submit is retried while it pushes back, for Seconds, then the stream is drained
+template <typename Submit>
+static double Stream(Submit submit, std::atomic<size_t>& completed, double Seconds)
+{
+	size_t submitted = 0;
+	completed = 0;
+	auto start = Clock::now();
+	while (Ms(start, Clock::now()) < Seconds * 1000)
+	{
+		if (submit())
+			submitted++;
+		else
+			std::this_thread::sleep_for(std::chrono::microseconds(100));
+	}
+	while (completed < submitted)
+		std::this_thread::sleep_for(std::chrono::microseconds(100));
+	return completed * 1000.0 / Ms(start, Clock::now());
+}
+
+// The same stream of hashes through ScryptScheduler (every worker runs the three phases back to back) and through
+// ScryptPipeline (as many ROMix workers, plus the stage thread running both PBKDF2 phases alongside them)
+static void MeasurePipeline(const Config& c, double Seconds, double* scheduled, double* pipelined)
+{
+	std::vector<uint8_t> P(8, 'p'), S(16, 's');
+	std::atomic<size_t> completed(0);
+	auto done = [&](const uint8_t*, size_t, std::exception_ptr) { completed++; };
+	{
+		ScryptScheduler scheduler(c.threads, UINT64_MAX, 2 * std::max(1u, c.threads));
+		*scheduled = Stream([&]() { return scheduler.Submit(P.data(), P.size(), S.data(), S.size(), c.N, c.r, c.p, c.outLen, done); },
+			completed, Seconds);
+	}
+	{
+		ScryptPipeline pipeline(c.threads, 2);
+		*pipelined = Stream([&]() { return pipeline.Submit(P.data(), P.size(), S.data(), S.size(), c.N, c.r, c.p, c.outLen, done); },
+			completed, Seconds);
+	}
+}
+
+static const char* CsvHeader = "N,r,p,outLen,threads,runs,hashes_per_s,p50_ms,p95_ms,p99_ms,v_bytes_per_s,pbkdf2_in_ms,romix_fill_ms,romix_mix_ms,pbkdf2_out_ms,interleave";
+
+static void WriteCsv(FILE* f, const Result& r)
+{
+	fprintf(f, "%llu,%u,%u,%zu,%u,%zu,%.3f,%.3f,%.3f,%.3f,%.0f,%.4f,%.4f,%.4f,%.4f,%u\n",
+		(unsigned long long)r.c.N, r.c.r, r.c.p, r.c.outLen, r.c.threads, r.runs, r.hashesPerSecond, r.p50, r.p95, r.p99,
+		r.vBytesPerSecond, r.pbkdf2In, r.fill, r.mix, r.pbkdf2Out, r.c.interleave);
+}
+
+// Reads a file written by --csv (comment lines and the header are skipped, files from before --interleave mean interleave 1)
+static std::map<Key, Result> ReadCsv(const char* path)
+{
+	std::map<Key, Result> results;
+	FILE* f = fopen(path, "r");
+	if (f == nullptr)
+	{
+		fprintf(stderr, "cannot open baseline %s\n", path);
+		exit(2);
+	}
+	char line[512];
+	while (fgets(line, sizeof(line), f) != nullptr)
+	{
+		Result r;
+		unsigned long long N;
+		r.c.interleave = 1;
+		if (line[0] == '#' || sscanf(line, "%llu,%u,%u,%zu,%u,%zu,%lf,%lf,%lf,%lf,%lf,%lf,%lf,%lf,%lf,%u",
+			&N, &r.c.r, &r.c.p, &r.c.outLen, &r.c.threads, &r.runs, &r.hashesPerSecond, &r.p50, &r.p95, &r.p99,
+			&r.vBytesPerSecond, &r.pbkdf2In, &r.fill, &r.mix, &r.pbkdf2Out, &r.c.interleave) < 15)
+			continue;
+		r.c.N = N;
+		results[KeyOf(r.c)] = r;
+	}
+	fclose(f);
+	return results;
+}
+
+static std::vector<uint64_t> ParseList(const char* s)
+{
+	std::vector<uint64_t> values;
+	for (char* end; *s != 0; s = *end == ',' ? end + 1 : end)
+	{
+		values.push_back(strtoull(s, &end, 0));
+		if (end == s)
+			break;
+	}
+	return values;
+}
+
+static void Usage()
+{
+	printf("ScryptNativeBench [options]\n"
+		"  --N list         CPU costs, e.g. 1024,16384 (default 1024,16384,131072)\n"
+		"  --r list         block sizes (default 1,8)\n"
+		"  --p list         parallelism (default 1,4)\n"
+		"  --len list       output lengths (default 32,64)\n"
+		"  --threads list   MaxThreads, 0 = all hardware threads (default 1)\n"
+		"  --interleave list lanes a thread advances round robin with V[j] prefetch, 1-4 (default 1)\n"
+		"  --runs n         minimum timed runs per configuration (default 10)\n"
+		"  --seconds s      minimum timed seconds per configuration (default 1)\n"
+		"  --quick          N=1024,16384 r=8 p=1 len=64, 5 runs, 0.2 seconds\n"
+		"  --numa           pin the worker threads and their V to NUMA nodes (NUMA::Enable)\n"
+		"  --pipeline       also compare streams of hashes, ScryptScheduler against ScryptPipeline (threads = workers)\n"
+		"  --csv file       write the results as CSV\n"
+		"  --baseline file  compare against an earlier --csv file\n"
+		"  --tolerance pct  hashes/s drop counted as a regression (default 5)\n"
+		"Exit code 3 if any configuration regressed against the baseline.\n");
+}
+
+// Sweeps N, r, p, output length, thread count and interleave over the scalar single-stream path.  Prints a table, optionally writes
+// CSV, and optionally compares hashes/s with a stored baseline so kernel and threading changes can be measured.
+int main(int argc, char** argv)
+{
+	std::vector<uint64_t> Ns = { 1024, 16384, 131072 }, rs = { 1, 8 }, ps = { 1, 4 }, lens = { 32, 64 }, threads = { 1 }, interleaves = { 1 };
+	size_t minRuns = 10;
+	double seconds = 1;
+	const char* csv = nullptr;
+	const char* baselinePath = nullptr;
+	double tolerance = 5;
+	bool pipeline = false;
+	for (int a = 1; a < argc; a++)
+	{
+		bool hasValue = a + 1 < argc;
+		if (strcmp(argv[a], "--quick") == 0) { Ns = { 1024, 16384 }; rs = { 8 }; ps = { 1 }; lens = { 64 }; minRuns = 5; seconds = 0.2; }
+		else if (strcmp(argv[a], "--numa") == 0) NUMA::Enable(true);
+		else if (strcmp(argv[a], "--pipeline") == 0) pipeline = true;
+		else if (strcmp(argv[a], "--N") == 0 && hasValue) Ns = ParseList(argv[++a]);
+		else if (strcmp(argv[a], "--r") == 0 && hasValue) rs = ParseList(argv[++a]);
+		else if (strcmp(argv[a], "--p") == 0 && hasValue) ps = ParseList(argv[++a]);
+		else if (strcmp(argv[a], "--len") == 0 && hasValue) lens = ParseList(argv[++a]);
+		else if (strcmp(argv[a], "--threads") == 0 && hasValue) threads = ParseList(argv[++a]);
+		else if (strcmp(argv[a], "--interleave") == 0 && hasValue) interleaves = ParseList(argv[++a]);
+		else if (strcmp(argv[a], "--runs") == 0 && hasValue) minRuns = (size_t)strtoull(argv[++a], nullptr, 0);
+		else if (strcmp(argv[a], "--seconds") == 0 && hasValue) seconds = atof(argv[++a]);
+		else if (strcmp(argv[a], "--csv") == 0 && hasValue) csv = argv[++a];
+		else if (strcmp(argv[a], "--baseline") == 0 && hasValue) baselinePath = argv[++a];
+		else if (strcmp(argv[a], "--tolerance") == 0 && hasValue) tolerance = atof(argv[++a]);
+		else { Usage(); return strcmp(argv[a], "--help") == 0 ? 0 : 2; }
+	}
+	minRuns = std::max((size_t)1, minRuns);
+
+	std::map<Key, Result> baseline;
+	if (baselinePath != nullptr)
+		baseline = ReadCsv(baselinePath);
+	FILE* out = nullptr;
+	if (csv != nullptr && (out = fopen(csv, "w")) == nullptr)
+	{
+		fprintf(stderr, "cannot write %s\n", csv);
+		return 2;
+	}
+	if (out != nullptr)
+		fprintf(out, "# salsa=%s batch_lanes=%u kernels=%s\n%s\n", salsaKernelName(), Scrypt::BatchLanes(), Dispatch::Describe().c_str(), CsvHeader);
+
+	printf("Kernels: %s, batch lanes: %u, NUMA placement %s (%u nodes)\n", Dispatch::Describe().c_str(), Scrypt::BatchLanes(),
+		NUMA::Enabled() ? "on" : "off", NUMA::Nodes());
+	printf("%9s %3s %3s %4s %3s %2s %6s %9s %9s %9s %9s %9s  %-27s%s\n", "N", "r", "p", "len", "thr", "il", "runs", "hash/s",
+		"p50 ms", "p95 ms", "p99 ms", "V MB/s", "in/fill/mix/out %", baseline.empty() ? "" : "  vs baseline");
+	int regressions = 0;
+	for (uint64_t N : Ns) for (uint64_t r : rs) for (uint64_t p : ps) for (uint64_t len : lens) for (uint64_t t : threads) for (uint64_t il : interleaves)
+	{
+		Config c = { N, (uint32_t)r, (uint32_t)p, (size_t)len, (uint32_t)t, (uint32_t)il };
+		Result res;
+		try
+		{
+			res = Measure(c, minRuns, seconds);
+		}
+		catch (const std::exception& ex)
+		{
+			printf("%9llu %3u %3u %4zu %3u %2u  skipped: %s\n", (unsigned long long)N, c.r, c.p, c.outLen, c.threads, c.interleave, ex.what());
+			continue;
+		}
+		double phases = res.pbkdf2In + res.fill + res.mix + res.pbkdf2Out;
+		char split[64];
+		snprintf(split, sizeof(split), "%.1f/%.1f/%.1f/%.1f", 100 * res.pbkdf2In / phases, 100 * res.fill / phases,
+			100 * res.mix / phases, 100 * res.pbkdf2Out / phases);
+		printf("%9llu %3u %3u %4zu %3u %2u %6zu %9.2f %9.3f %9.3f %9.3f %9.0f  %-27s", (unsigned long long)N, c.r, c.p, c.outLen, c.threads,
+			c.interleave, res.runs, res.hashesPerSecond, res.p50, res.p95, res.p99, res.vBytesPerSecond / 1e6, split);
+		auto base = baseline.find(KeyOf(c));
+		if (base != baseline.end())
+		{
+			double change = 100 * (res.hashesPerSecond / base->second.hashesPerSecond - 1);
+			bool regressed = change < -tolerance;
+			regressions += regressed;
+			printf("  %+.1f%% hash/s, p50 %.3f -> %.3f%s", change, base->second.p50, res.p50, regressed ? "  REGRESSION" : "");
+		}
+		else if (!baseline.empty())
+			printf("  (not in baseline)");
+		printf("\n");
+		if (out != nullptr)
+			WriteCsv(out, res);
+	}
+	if (out != nullptr)
+		fclose(out);
+	if (pipeline)
+	{
+		printf("\nStreams of hashes, %.1f s each: phases back to back per worker, and pipelined\n", seconds);
+		printf("%9s %3s %3s %4s %3s %12s %12s %8s\n", "N", "r", "p", "len", "thr", "sched hash/s", "pipe hash/s", "change");
+		for (uint64_t N : Ns) for (uint64_t r : rs) for (uint64_t p : ps) for (uint64_t len : lens) for (uint64_t t : threads)
+		{
+			Config c = { N, (uint32_t)r, (uint32_t)p, (size_t)len, (uint32_t)t, 1 };
+			double scheduled, pipelined;
+			try
+			{
+				MeasurePipeline(c, seconds, &scheduled, &pipelined);
+			}
+			catch (const std::exception& ex)
+			{
+				printf("%9llu %3u %3u %4zu %3u  skipped: %s\n", (unsigned long long)N, c.r, c.p, c.outLen, c.threads, ex.what());
+				continue;
+			}
+			printf("%9llu %3u %3u %4zu %3u %12.2f %12.2f %+7.1f%%\n", (unsigned long long)N, c.r, c.p, c.outLen, c.threads,
+				scheduled, pipelined, 100 * (pipelined / scheduled - 1));
+		}
+	}
+	if (!baseline.empty())
+		printf("%d regression(s) beyond %.1f%%\n", regressions, tolerance);
+	return regressions == 0 ? 0 : 3;
+}
@@ -0,0 +1,73 @@
+#include <csignal>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <exception>
+#include "ScryptNative.h"
+
+using namespace ScryptNative;
+
+static HashDaemon* running = nullptr;
+
+static void OnSignal(int)
+{
+	if (running != nullptr)
+		running->Stop();
+}
+
+static void Usage()
+{
+	printf("ScryptNativeDaemon <socket path> [options]\n"
+		"  --threads n      batches running at once, 0 = all hardware threads (default 0)\n"
+		"  --memory MiB     scratch all running batches may hold together (default 1024)\n"
+		"  --queue n        requests waiting for a batch before clients get Busy (default 4096)\n"
+		"  --batch n        requests merged into one batch (default 4 x the SIMD lanes)\n"
+		"  --window us      how long a lone request waits for others to share its batch (default 200)\n"
+		"  --salt n         salt bytes for encode requests (default 32)\n"
+		"Serves encode and verify requests from local processes (see HashDaemon in ScryptNative.h for the protocol)\n"
+		"until SIGINT or SIGTERM.\n");
+}
+
+int main(int argc, char** argv)
+{
+	if (argc < 2 || argv[1][0] == '-')
+	{
+		Usage();
+		return argc == 2 && strcmp(argv[1], "--help") == 0 ? 0 : 2;
+	}
+	HashDaemon::Options opts = {};
+	opts.SocketPath = argv[1];
+	opts.MemoryBudget = 1024ULL << 20;
+	opts.BatchWindowMicroseconds = 200;
+	for (int a = 2; a < argc; a++)
+	{
+		bool hasValue = a + 1 < argc;
+		if (strcmp(argv[a], "--threads") == 0 && hasValue) opts.Threads = (uint32_t)strtoul(argv[++a], nullptr, 0);
+		else if (strcmp(argv[a], "--memory") == 0 && hasValue) opts.MemoryBudget = strtoull(argv[++a], nullptr, 0) << 20;
+		else if (strcmp(argv[a], "--queue") == 0 && hasValue) opts.MaxQueued = (size_t)strtoull(argv[++a], nullptr, 0);
+		else if (strcmp(argv[a], "--batch") == 0 && hasValue) opts.MaxBatch = (size_t)strtoull(argv[++a], nullptr, 0);
+		else if (strcmp(argv[a], "--window") == 0 && hasValue) opts.BatchWindowMicroseconds = (uint32_t)strtoul(argv[++a], nullptr, 0);
+		else if (strcmp(argv[a], "--salt") == 0 && hasValue) opts.SaltLength = (size_t)strtoull(argv[++a], nullptr, 0);
+		else { Usage(); return 2; }
+	}
+
+	try
+	{
+		HashDaemon daemon(opts);
+		running = &daemon;
+		signal(SIGINT, OnSignal);
+		signal(SIGTERM, OnSignal);
+		fprintf(stderr, "listening on %s, %u lanes per batch kernel (%s)\n", opts.SocketPath, Scrypt::BatchLanes(), Metrics::Kernel());
+		daemon.Run();
+		signal(SIGINT, SIG_DFL);
+		signal(SIGTERM, SIG_DFL);
+		running = nullptr;
+		fprintf(stderr, "%llu requests in %llu batches\n", (unsigned long long)daemon.Requests(), (unsigned long long)daemon.Batches());
+	}
+	catch (const std::exception& ex)
+	{
+		fprintf(stderr, "%s\n", ex.what());
+		return 2;
+	}
+	return 0;
+}
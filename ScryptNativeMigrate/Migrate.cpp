@@ -0,0 +1,83 @@
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <exception>
+#include "ScryptNative.h"
+
+using namespace ScryptNative;
+
+static void Usage()
+{
+	printf("ScryptNativeMigrate <mode> <input> <output> [options]\n"
+		"  upgrade          <encoded> per line: $s0/$s1 headers rewritten as $s2, hashes kept\n"
+		"  verify           <encoded>\\t<password> per line: writes <encoded>\\t1 or <encoded>\\t0\n"
+		"  rehash           <encoded>\\t<password> per line: verified, then encoded with the new parameters\n"
+		"  encode           <password> per line: encoded with the new parameters (imports)\n"
+		"  --N n            CPU cost for rehash/encode (default 16384)\n"
+		"  --r n            block size (default 8)\n"
+		"  --p n            parallelism (default 1)\n"
+		"  --len n          hash bytes, 0 keeps the record's length when rehashing (default 0, 32 for encode)\n"
+		"  --salt n         salt bytes (default 32)\n"
+		"  --threads n      0 = all hardware threads (default 0)\n"
+		"  --chunk n        records per chunk and checkpoint (default 1024)\n"
+		"Interrupted runs continue from <output>.resume when started again with the same arguments.\n"
+		"Exit code 1 if any record failed (malformed, or a wrong password), 2 for usage or I/O errors.\n");
+}
+
+static void ShowProgress(const HashMigration::Report& r, void*)
+{
+	double done = r.InputSize == 0 ? 1 : (double)r.InputBytes / r.InputSize;
+	double seconds = r.Seconds > 0 ? r.Seconds : 1e-9;
+	double rate = (r.Records - r.ResumedRecords) / seconds;
+	double left = rate > 0 ? (r.InputSize - r.InputBytes) / ((r.InputBytes - r.ResumedBytes) / seconds) : 0;
+	fprintf(stderr, "\r%llu records, %.1f%%, %.1f records/s, %.2f MB/s, %.0f s left      ", (unsigned long long)r.Records, 100 * done, rate,
+		(r.InputBytes - r.ResumedBytes) / seconds / 1e6, left);
+	fflush(stderr);
+}
+
+// Streams a hash file through HashMigration::Run on all cores, printing progress and throughput to stderr
+int main(int argc, char** argv)
+{
+	if (argc < 4)
+	{
+		Usage();
+		return argc == 2 && strcmp(argv[1], "--help") == 0 ? 0 : 2;
+	}
+	HashMigration::Options opts = {};
+	if (strcmp(argv[1], "upgrade") == 0) opts.Mode = HashMigration::Upgrade;
+	else if (strcmp(argv[1], "verify") == 0) opts.Mode = HashMigration::Verify;
+	else if (strcmp(argv[1], "rehash") == 0) opts.Mode = HashMigration::Rehash;
+	else if (strcmp(argv[1], "encode") == 0) opts.Mode = HashMigration::Encode;
+	else { Usage(); return 2; }
+	opts.CPUCost = 16384;
+	opts.BlockSize = 8;
+	opts.Parallelism = 1;
+	opts.OnProgress = ShowProgress;
+	for (int a = 4; a < argc; a++)
+	{
+		bool hasValue = a + 1 < argc;
+		if (strcmp(argv[a], "--N") == 0 && hasValue) opts.CPUCost = strtoull(argv[++a], nullptr, 0);
+		else if (strcmp(argv[a], "--r") == 0 && hasValue) opts.BlockSize = (uint32_t)strtoul(argv[++a], nullptr, 0);
+		else if (strcmp(argv[a], "--p") == 0 && hasValue) opts.Parallelism = (uint32_t)strtoul(argv[++a], nullptr, 0);
+		else if (strcmp(argv[a], "--len") == 0 && hasValue) opts.HashLength = (size_t)strtoull(argv[++a], nullptr, 0);
+		else if (strcmp(argv[a], "--salt") == 0 && hasValue) opts.SaltLength = (size_t)strtoull(argv[++a], nullptr, 0);
+		else if (strcmp(argv[a], "--threads") == 0 && hasValue) opts.Threads = (uint32_t)strtoul(argv[++a], nullptr, 0);
+		else if (strcmp(argv[a], "--chunk") == 0 && hasValue) opts.ChunkRecords = (size_t)strtoull(argv[++a], nullptr, 0);
+		else { Usage(); return 2; }
+	}
+
+	HashMigration::Report r;
+	try
+	{
+		r = HashMigration::Run(argv[2], argv[3], opts);
+	}
+	catch (const std::exception& ex)
+	{
+		fprintf(stderr, "\n%s\n", ex.what());
+		return 2;
+	}
+	fprintf(stderr, "\n%s%llu records, %llu changed, %llu failed, %.1f MB in %.2f s\n", r.ResumedBytes > 0 ? "resumed, " : "",
+		(unsigned long long)r.Records, (unsigned long long)r.Changed, (unsigned long long)r.Failed, r.InputSize / 1e6, r.Seconds);
+	return r.Failed == 0 ? 0 : 1;
+}
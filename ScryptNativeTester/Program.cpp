@@ -0,0 +1,739 @@
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <exception>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+#include "ScryptNative.h"
+#include "TestCases.h"
+#if defined(__linux__)
+#include <sched.h>
+#include <sys/resource.h>
+#include <unistd.h>
+#endif
+
+using namespace ScryptNative;
+using namespace ScryptNativeTester;
+
+static std::string BytesToString(const std::vector<uint8_t>& data)
+{
+	if (data.empty()) return "[NULL]";
+	std::string s;
+	char hex[4];
+	for (size_t i = 0; i < data.size(); i++)
+	{
+		snprintf(hex, sizeof(hex), i == 0 ? "%02x" : " %02x", data[i]);
+		s += hex;
+	}
+	return s;
+}
+
+static int Report(bool pass, std::chrono::steady_clock::time_point start)
+{
+	double ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+	printf("%s (%.1f ms)\n", pass ? "---PASS---" : "***FAIL!***", ms);
+	return pass ? 0 : 1;
+}
+
+// Runs the known answer tests, returns the number of failures so ctest can pick it up
+int main(int argc, char** argv)
+{
+	bool large = false;
+	for (int a = 1; a < argc; a++)
+		if (strcmp(argv[a], "--large") == 0) large = true;
+
+	TestCases tc;
+	int failures = 0;
+	for (size_t i = 0; i < tc.PBKDF2Cases.size(); i++)
+	{
+		const PBKDF2TestCase& c = tc.PBKDF2Cases[i];
+		printf("PBKDF2-HMAC-SHA%d c=%u, outLen = %zu\n", c.Hash, c.C, c.Result.size());
+		auto start = std::chrono::steady_clock::now();
+		std::vector<uint8_t> result(c.Result.size());
+		if (c.Hash == 1)
+			PBKDF2::HMACSHA1(c.P.data(), c.P.size(), c.S.data(), c.S.size(), c.C, result.data(), result.size());
+		else if (c.Hash == 256)
+			PBKDF2::HMACSHA256(c.P.data(), c.P.size(), c.S.data(), c.S.size(), c.C, result.data(), result.size());
+		else
+			PBKDF2::HMACSHA512(c.P.data(), c.P.size(), c.S.data(), c.S.size(), c.C, result.data(), result.size());
+		failures += Report(result == c.Result, start);
+
+		// many blocks on all threads: full multi-buffer groups, a short tail and thread hand-off, the vector is the prefix
+		// (9 blocks is still more than half of the widest 16 lane group, and keeps the 80000 iteration vector quick)
+		size_t blockCount = c.C > 4096 ? 9 : 33;
+		printf("PBKDF2-HMAC-SHA%d c=%u, outLen = %zu, %zu blocks on all threads\n", c.Hash, c.C, c.Result.size(), blockCount);
+		start = std::chrono::steady_clock::now();
+		std::vector<uint8_t> blocks((c.Hash == 1 ? 20 : c.Hash / 8) * blockCount);
+		if (c.Hash == 1)
+			PBKDF2::HMACSHA1(c.P.data(), c.P.size(), c.S.data(), c.S.size(), c.C, blocks.data(), blocks.size(), 0);
+		else if (c.Hash == 256)
+			PBKDF2::HMACSHA256(c.P.data(), c.P.size(), c.S.data(), c.S.size(), c.C, blocks.data(), blocks.size(), 0);
+		else
+			PBKDF2::HMACSHA512(c.P.data(), c.P.size(), c.S.data(), c.S.size(), c.C, blocks.data(), blocks.size(), 0);
+		failures += Report(std::equal(c.Result.begin(), c.Result.end(), blocks.begin()), start);
+
+		// streamed in odd sized pieces and read back at an offset straddling a block boundary, must match the one shot output
+		printf("PBKDF2-HMAC-SHA%d c=%u, %zu blocks streamed\n", c.Hash, c.C, blockCount);
+		start = std::chrono::steady_clock::now();
+		PBKDF2Stream stream(c.Hash, c.P.data(), c.P.size(), c.S.data(), c.S.size(), c.C);
+		std::vector<uint8_t> streamed(blocks.size());
+		for (size_t offset = 0; offset < streamed.size(); offset += 13)
+			stream.Read(streamed.data() + offset, std::min((size_t)13, streamed.size() - offset));
+		std::vector<uint8_t> middle(45);
+		stream.ReadAt(7, middle.data(), middle.size(), 0);
+		failures += Report(streamed == blocks && stream.Position() == blocks.size() && std::equal(middle.begin(), middle.end(), blocks.begin() + 7), start);
+	}
+
+	for (size_t i = 0; i < tc.Cases.size(); i++)
+	{
+		const TestCase& c = tc.Cases[i];
+		if (c.Large && !large)
+			continue;
+		printf("N=%llu, r=%u, p=%u, outLen = %zu\n", (unsigned long long)c.N, c.r, c.p, c.OutLen);
+		auto start = std::chrono::steady_clock::now();
+		std::vector<uint8_t> result(c.OutLen);
+		try
+		{
+			Scrypt::ComputeDerivedHash(c.P.data(), c.P.size(), c.S.data(), c.S.size(), c.N, c.r, c.p, result.data(), result.size());
+		}
+		catch (const std::exception& ex)
+		{
+			printf("Exception: %s\n", ex.what());
+			result.clear();
+		}
+		printf("%s\n", BytesToString(result).c_str());
+		failures += Report(result == c.Result, start);
+
+		if (c.Result.empty() || c.p < 2)
+			continue;
+		printf("N=%llu, r=%u, p=%u, outLen = %zu, 4 threads\n", (unsigned long long)c.N, c.r, c.p, c.OutLen);
+		start = std::chrono::steady_clock::now();
+		std::vector<uint8_t> threaded(c.OutLen);
+		Scrypt::ComputeDerivedHash(c.P.data(), c.P.size(), c.S.data(), c.S.size(), c.N, c.r, c.p, threaded.data(), threaded.size(), 4);
+		failures += Report(threaded == c.Result, start);
+
+		// interleaved lanes, with a short last unit (p = 16 is not a multiple of 3) and with two threads
+		printf("N=%llu, r=%u, p=%u, outLen = %zu, interleave 2/3/4\n", (unsigned long long)c.N, c.r, c.p, c.OutLen);
+		start = std::chrono::steady_clock::now();
+		bool pass = true;
+		for (uint32_t il = 2; il <= Scrypt::MaxInterleave; il++)
+		{
+			std::vector<uint8_t> interleaved(c.OutLen);
+			Scrypt::ComputeDerivedHash(c.P.data(), c.P.size(), c.S.data(), c.S.size(), c.N, c.r, c.p, interleaved.data(), interleaved.size(), il == 2 ? 2 : 1, il);
+			pass = pass && interleaved == c.Result;
+		}
+		failures += Report(pass, start);
+	}
+	// Reusable context: the same scratch serves repeated calls (and may or may not get huge pages / locking on this host)
+	for (size_t i = 0; i < tc.Cases.size(); i++)
+	{
+		const TestCase& c = tc.Cases[i];
+		if (c.Large || c.Result.empty())
+			continue;
+		auto start = std::chrono::steady_clock::now();
+		ScryptContext context(c.N, c.r, 2, ScryptContext::HugePages | ScryptContext::LockMemory);
+		printf("N=%llu, r=%u, p=%u, outLen = %zu, context x3 (huge pages %s, locked %s)\n", (unsigned long long)c.N, c.r, c.p, c.OutLen,
+			context.UsesHugePages() ? "yes" : "no", context.IsLocked() ? "yes" : "no");
+		bool pass = true;
+		for (int n = 0; n < 3; n++)
+		{
+			std::vector<uint8_t> result(c.OutLen);
+			context.ComputeDerivedHash(c.P.data(), c.P.size(), c.S.data(), c.S.size(), c.p, result.data(), result.size());
+			pass = pass && result == c.Result;
+		}
+		failures += Report(pass, start);
+	}
+	// Batch API: the case's own vector plus two other passwords, every result must match the single-stream path
+	for (size_t i = 0; i < tc.Cases.size(); i++)
+	{
+		const TestCase& c = tc.Cases[i];
+		if (c.Large || c.Result.empty())
+			continue;
+		printf("N=%llu, r=%u, p=%u, outLen = %zu, batch of 3 (%u lanes)\n", (unsigned long long)c.N, c.r, c.p, c.OutLen, Scrypt::BatchLanes());
+		auto start = std::chrono::steady_clock::now();
+		std::vector<uint8_t> passwords[3] = { c.P, c.P, StringToBytes("batch") };
+		passwords[1].push_back('!');
+		std::vector<uint8_t> results[3], expected[3];
+		const uint8_t* p[3]; const uint8_t* s[3]; size_t pl[3], sl[3]; uint8_t* out[3]; const uint8_t* exp[3];
+		for (int b = 0; b < 3; b++)
+		{
+			results[b].resize(c.OutLen);
+			expected[b].resize(c.OutLen);
+			Scrypt::ComputeDerivedHash(passwords[b].data(), passwords[b].size(), c.S.data(), c.S.size(), c.N, c.r, c.p, expected[b].data(), c.OutLen);
+			p[b] = passwords[b].data(); pl[b] = passwords[b].size(); s[b] = c.S.data(); sl[b] = c.S.size(); out[b] = results[b].data(); exp[b] = expected[b].data();
+		}
+		Scrypt::ComputeDerivedHashBatch(p, pl, s, sl, 3, c.N, c.r, c.p, out, c.OutLen, 0);
+		bool pass = results[0] == c.Result && results[1] == expected[1] && results[2] == expected[2];
+		bool matches[3];
+		expected[2][0] ^= 1; // must not verify
+		Scrypt::CompareBatch(p, pl, s, sl, 3, c.N, c.r, c.p, exp, c.OutLen, matches, 1);
+		pass = pass && matches[0] && matches[1] && !matches[2];
+		failures += Report(pass, start);
+	}
+
+	// Block sizes without an RFC vector: the single-stream kernel (r=2, 3, 4, 5, 16) must agree
+	// with the multi-buffer kernel, which is written independently, for a whole group of lanes
+	{
+		printf("Block sizes 2, 3, 4, 5, 16 against the batch kernel\n");
+		auto start = std::chrono::steady_clock::now();
+		bool pass = true;
+		for (uint32_t r : { 2u, 3u, 4u, 5u, 16u })
+		{
+			size_t count = Scrypt::BatchLanes();
+			std::vector<std::vector<uint8_t>> results(count, std::vector<uint8_t>(32));
+			std::vector<const uint8_t*> p(count), s(count);
+			std::vector<size_t> pl(count), sl(count);
+			std::vector<uint8_t*> out(count);
+			std::vector<uint8_t> password = StringToBytes("block size"), salt = StringToBytes("kernels");
+			for (size_t b = 0; b < count; b++)
+			{
+				p[b] = password.data(); pl[b] = password.size() - b % 2; s[b] = salt.data(); sl[b] = salt.size(); out[b] = results[b].data();
+			}
+			Scrypt::ComputeDerivedHashBatch(p.data(), pl.data(), s.data(), sl.data(), count, 64, r, 2, out.data(), 32, 1);
+			for (size_t b = 0; b < count; b++)
+			{
+				std::vector<uint8_t> single(32);
+				Scrypt::ComputeDerivedHash(p[b], pl[b], s[b], sl[b], 64, r, 2, single.data(), single.size());
+				pass = pass && single == results[b];
+			}
+		}
+		failures += Report(pass, start);
+	}
+
+	// Run time dispatch: every level this CPU has, with and without the SHA extensions, must reproduce the portable results
+	// for a batch of one 16 lane group plus a padded tail, and for PBKDF2-HMAC-SHA256 over many blocks
+	{
+		printf("Dispatch levels against portable (%s)\n", Dispatch::Describe().c_str());
+		auto start = std::chrono::steady_clock::now();
+		const size_t count = 21;
+		std::vector<std::vector<uint8_t>> passwords(count);
+		std::vector<const uint8_t*> p(count), s(count);
+		std::vector<size_t> pl(count), sl(count);
+		std::vector<uint8_t> salt = StringToBytes("levels");
+		for (size_t b = 0; b < count; b++)
+		{
+			passwords[b] = StringToBytes("dispatch");
+			passwords[b].push_back((uint8_t)('a' + b));
+			p[b] = passwords[b].data(); pl[b] = passwords[b].size(); s[b] = salt.data(); sl[b] = salt.size();
+		}
+		auto run = [&](std::vector<uint8_t>& hashes, std::vector<uint8_t>& pbkdf2) {
+			hashes.assign(count * 32, 0);
+			std::vector<uint8_t*> out(count);
+			for (size_t b = 0; b < count; b++)
+				out[b] = hashes.data() + b * 32;
+			Scrypt::ComputeDerivedHashBatch(p.data(), pl.data(), s.data(), sl.data(), count, 64, 2, 1, out.data(), 32, 0);
+			pbkdf2.assign(33 * 32, 0);
+			PBKDF2::HMACSHA256(p[0], pl[0], s[0], sl[0], 3, pbkdf2.data(), pbkdf2.size(), 0);
+		};
+		std::vector<uint8_t> expectedHashes, expectedPBKDF2, hashes, pbkdf2;
+		Dispatch::Force(Dispatch::Portable, false);
+		bool pass = Dispatch::CurrentLevel() == Dispatch::Portable && !Dispatch::SHAExtensions() && Scrypt::BatchLanes() == 1;
+		run(expectedHashes, expectedPBKDF2);
+		for (int level = Dispatch::Portable; level <= Dispatch::AVX512; level++)
+			for (int sha = 0; sha < 2; sha++)
+			{
+				Dispatch::Level bound = Dispatch::Force((Dispatch::Level)level, sha != 0);
+				pass = pass && bound == std::min((Dispatch::Level)level, Dispatch::HostLevel()) &&
+					Dispatch::SHAExtensions() == (sha != 0 && Dispatch::HostSHAExtensions());
+				run(hashes, pbkdf2);
+				pass = pass && hashes == expectedHashes && pbkdf2 == expectedPBKDF2;
+			}
+		Dispatch::Reset();
+		failures += Report(pass, start);
+	}
+
+	// NUMA placement only moves threads and pages: pinned workers (threaded, batch and a NUMALocal context) must give the
+	// unpinned results, and the calling thread must get its affinity back
+	{
+		printf("NUMA placement on %u node(s)\n", NUMA::Nodes());
+		auto start = std::chrono::steady_clock::now();
+		std::vector<uint8_t> password = StringToBytes("numa"), salt = StringToBytes("nodes");
+		const uint8_t* p[5]; const uint8_t* s[5]; size_t pl[5], sl[5]; uint8_t* out[5];
+		std::vector<uint8_t> expected(32), expectedBatch(5 * 32), threaded(32), batch(5 * 32), pooled(32);
+		for (int b = 0; b < 5; b++)
+		{
+			p[b] = password.data(); pl[b] = password.size() - b % 3; s[b] = salt.data(); sl[b] = salt.size();
+		}
+		Scrypt::ComputeDerivedHash(p[0], pl[0], s[0], sl[0], 1024, 2, 4, expected.data(), 32, 1);
+		for (int b = 0; b < 5; b++) out[b] = expectedBatch.data() + b * 32;
+		Scrypt::ComputeDerivedHashBatch(p, pl, s, sl, 5, 1024, 2, 1, out, 32, 1);
+#if defined(__linux__)
+		cpu_set_t before, after;
+		sched_getaffinity(0, sizeof(before), &before);
+#endif
+		NUMA::Enable(true);
+		Scrypt::ComputeDerivedHash(p[0], pl[0], s[0], sl[0], 1024, 2, 4, threaded.data(), 32, 0);
+		for (int b = 0; b < 5; b++) out[b] = batch.data() + b * 32;
+		Scrypt::ComputeDerivedHashBatch(p, pl, s, sl, 5, 1024, 2, 1, out, 32, 0);
+		NUMA::Enable(false);
+		ScryptContext context(1024, 2, 2, ScryptContext::NUMALocal);
+		context.ComputeDerivedHash(p[0], pl[0], s[0], sl[0], 4, pooled.data(), 32);
+		bool pass = threaded == expected && batch == expectedBatch && pooled == expected && NUMA::CurrentNode() < NUMA::Nodes();
+#if defined(__linux__)
+		sched_getaffinity(0, sizeof(after), &after);
+		pass = pass && CPU_EQUAL(&before, &after);
+#endif
+		failures += Report(pass, start);
+	}
+
+	// Large-memory mode: file backed and anonymous V, with and without interleaving, and windows smaller than V must all give
+	// the ComputeDerivedHash results; V past 2 GiB is refused there and accepted up to MaxLargeMemory here
+	{
+		printf("Large-memory mode against ComputeDerivedHash\n");
+		auto start = std::chrono::steady_clock::now();
+		std::vector<uint8_t> password = StringToBytes("pleaseletmein"), salt = StringToBytes("SodiumChloride");
+		std::vector<uint8_t> expected(64), rfc(64), large(64);
+		Scrypt::ComputeDerivedHash(password.data(), password.size(), salt.data(), salt.size(), 1024, 2, 5, expected.data(), 64, 1);
+		Scrypt::ComputeDerivedHash(password.data(), password.size(), salt.data(), salt.size(), 16384, 8, 1, rfc.data(), 64, 1);
+		bool pass = true;
+		const char* directories[] = { nullptr, "." };
+		for (const char* directory : directories)
+		{
+			for (uint32_t interleave = 0; interleave <= 3; interleave++)
+			{
+				Scrypt::LargeMemoryOptions options = { directory, interleave == 3 ? 1u : 2u, interleave, interleave == 2 ? 4096u * 3 : 0u, interleave == 1 };
+				std::fill(large.begin(), large.end(), 0);
+				Scrypt::ComputeDerivedHashLarge(password.data(), password.size(), salt.data(), salt.size(), 1024, 2, 5, large.data(), 64, options);
+				pass = pass && large == expected;
+			}
+			Scrypt::LargeMemoryOptions options = { directory, 1, 1, 1 << 20, false };
+			Scrypt::ComputeDerivedHashLarge(password.data(), password.size(), salt.data(), salt.size(), 16384, 8, 1, large.data(), 64, options);
+			pass = pass && large == rfc;
+		}
+		// recorded like every other entry point, fill and mix included
+		Metrics::Reset();
+		Metrics::Enable(true);
+		Scrypt::LargeMemoryOptions recorded = { nullptr, 1, 2, 0, false };
+		Scrypt::ComputeDerivedHashLarge(password.data(), password.size(), salt.data(), salt.size(), 1024, 2, 5, large.data(), 64, recorded);
+		Metrics::Enable(false);
+		Metrics::Counters counters = Metrics::Snapshot();
+		pass = pass && large == expected && counters.Calls == 1 && counters.Hashes == 1 &&
+			counters.Nanoseconds[Metrics::ROMixFill] > 0 && counters.Nanoseconds[Metrics::ROMixMix] > 0;
+		bool refused = false, refusedLarge = false;
+		try { Scrypt::ComputeDerivedHash(password.data(), password.size(), salt.data(), salt.size(), 1 << 21, 8, 1, large.data(), 64); }
+		catch (const std::out_of_range&) { refused = true; }
+		Scrypt::LargeMemoryOptions options = {};
+		try { Scrypt::ComputeDerivedHashLarge(password.data(), password.size(), salt.data(), salt.size(), 1ULL << 40, 32, 1, large.data(), 64, options); }
+		catch (const std::out_of_range&) { refusedLarge = true; }
+		failures += Report(pass && refused && refusedLarge, start);
+	}
+
+	// Encoded hashes: the managed format round trips through text and binary records, malformed input is rejected
+	{
+		printf("HashCodec: %zu encoded vectors, records, deprecated format\n", tc.EncodedCases.size());
+		auto start = std::chrono::steady_clock::now();
+		bool pass = true;
+		std::vector<uint8_t> records(tc.EncodedCases.size() * HashCodec::RecordSize);
+		for (size_t i = 0; i < tc.EncodedCases.size(); i++)
+		{
+			const std::string& text = tc.EncodedCases[i].Encoded;
+			const TestCase& c = tc.Cases[tc.EncodedCases[i].Case];
+			HashFields f;
+			uint8_t storage[256];
+			char encoded[256];
+			pass = pass && HashCodec::Decode(text.data(), text.size(), f, storage, sizeof(storage)) && f.Version == 2 && f.CPUCost == c.N &&
+				f.BlockSize == c.r && f.Parallelism == c.p && std::equal(f.Salt, f.Salt + f.SaltLength, c.S.begin(), c.S.end()) &&
+				std::equal(f.Hash, f.Hash + f.HashLength, c.Result.begin(), c.Result.end()) &&
+				HashCodec::Encode(f, encoded, sizeof(encoded)) == text.size() && text.compare(0, text.size(), encoded, text.size()) == 0 &&
+				HashCodec::EncodedLength(f) == text.size() && HashCodec::Encode(f, encoded, text.size() - 1) == 0 &&
+				HashCodec::WriteRecord(f, records.data() + i * HashCodec::RecordSize);
+		}
+		std::vector<HashFields> fields(tc.EncodedCases.size());
+		bool valid[3];
+		pass = pass && HashCodec::ReadRecords(records.data(), 3, fields.data(), valid) == 3;
+		for (size_t i = 0; pass && i < fields.size(); i++)
+		{
+			const TestCase& c = tc.Cases[tc.EncodedCases[i].Case];
+			pass = valid[i] && fields[i].CPUCost == c.N && fields[i].BlockSize == c.r && fields[i].Parallelism == c.p &&
+				std::equal(fields[i].Hash, fields[i].Hash + fields[i].HashLength, c.Result.begin(), c.Result.end());
+		}
+		records[HashCodec::RecordSize + 1] = 0; // log2(N) = 0 is not a valid record
+		pass = pass && HashCodec::ReadRecords(records.data(), 3, fields.data(), valid) == 2 && !valid[1];
+
+		const TestCase& small = tc.Cases[3];
+		HashFields legacy = { 1, small.N, small.r, small.p, small.S.data(), small.S.size(), small.Result.data(), small.Result.size() };
+		char text[256];
+		uint8_t storage[256];
+		size_t length = HashCodec::Encode(legacy, text, sizeof(text));
+		HashFields back;
+		pass = pass && length > 0 && strncmp(text, "$s1$100101$", 11) == 0 && HashCodec::Decode(text, length, back, storage, sizeof(storage)) &&
+			back.Version == 1 && back.CPUCost == small.N && back.BlockSize == small.r && back.Parallelism == small.p;
+		legacy.CPUCost = 1024; // too large for the deprecated form
+		pass = pass && HashCodec::Encode(legacy, text, sizeof(text)) == 0;
+		const uint8_t someHash[3] = { 1, 2, 3 };
+		HashFields unsalted = { 2, 16, 1, 1, nullptr, 0, someHash, sizeof(someHash) }; // written as the managed Header always did
+		length = HashCodec::Encode(unsalted, text, sizeof(text));
+		pass = pass && std::string(text, length) == "$s2$16$1$1$$AQID" && !HashCodec::Decode(text, length, back, storage, sizeof(storage));
+
+		const char* bad[] = { "", "$s2$1024$8$16$TmFDbA==", "$s2$1024$8$16$TmFDbA=$AAAA", "$s2$1x24$8$16$TmFDbA==$AAAA",
+			"$s3$1024$8$16$TmFDbA==$AAAA", "s2$1024$8$16$TmFDbA==$AAAA", "$s2$1024$8$16$TmFDbA==$AAAA$", "$s2$1024$8$16$Tm=DbA==$AAAA" };
+		for (const char* b : bad)
+			pass = pass && !HashCodec::Decode(b, strlen(b), back, storage, sizeof(storage));
+		failures += Report(pass, start);
+	}
+
+	// Migration: a legacy record is upgraded with its hash intact and still verifies, an interrupted import resumes
+	// from its checkpoint and ends up with the same records as an uninterrupted one would
+	{
+		printf("HashMigration: upgrade, verify, interrupted encode\n");
+		auto start = std::chrono::steady_clock::now();
+		auto writeFile = [](const char* path, const std::string& text) {
+			FILE* f = fopen(path, "wb");
+			fwrite(text.data(), 1, text.size(), f);
+			fclose(f);
+		};
+		auto readFile = [](const char* path) {
+			std::string text;
+			FILE* f = fopen(path, "rb");
+			for (int ch; f != nullptr && (ch = fgetc(f)) != EOF;)
+				text += (char)ch;
+			if (f != nullptr)
+				fclose(f);
+			return text;
+		};
+		const TestCase& small = tc.Cases[3];
+		HashFields legacy = { 1, small.N, small.r, small.p, small.S.data(), small.S.size(), small.Result.data(), small.Result.size() };
+		char text[256];
+		std::string s1(text, HashCodec::Encode(legacy, text, sizeof(text)));
+		writeFile("migrate_in.txt", s1 + "\r\nnot a hash\n" + tc.EncodedCases[0].Encoded + "\n");
+		HashMigration::Options opts = {};
+		opts.Mode = HashMigration::Upgrade;
+		HashMigration::Report r = HashMigration::Run("migrate_in.txt", "migrate_out.txt", opts);
+		std::string upgraded = readFile("migrate_out.txt");
+		legacy.Version = 2;
+		std::string s2(text, HashCodec::Encode(legacy, text, sizeof(text)));
+		bool pass = r.Records == 3 && r.Changed == 1 && r.Failed == 1 &&
+			upgraded == s2 + "\nnot a hash\n" + tc.EncodedCases[0].Encoded + "\n";
+
+		writeFile("migrate_in.txt", s2 + "\t\n" + s2 + "\twrong\n"); // the vector's password is empty
+		opts.Mode = HashMigration::Verify;
+		r = HashMigration::Run("migrate_in.txt", "migrate_out.txt", opts);
+		pass = pass && r.Failed == 1 && readFile("migrate_out.txt") == s2 + "\t1\n" + s2 + "\t0\n";
+
+#if defined(__linux__)
+		// a record whose V (1 GiB) passes the parameter checks but cannot be allocated fails alone, the run goes on
+		std::vector<uint8_t> hugeHash(32, 1);
+		HashFields huge = { 2, 1 << 20, 8, 1, small.S.data(), small.S.size(), hugeHash.data(), hugeHash.size() };
+		std::string s3(text, HashCodec::Encode(huge, text, sizeof(text)));
+		writeFile("migrate_in.txt", s3 + "\tpw\n" + s2 + "\t\n");
+		unsigned long long pages = 0;
+		FILE* statm = fopen("/proc/self/statm", "r");
+		if (statm != nullptr)
+		{
+			if (fscanf(statm, "%llu", &pages) != 1) pages = 0;
+			fclose(statm);
+		}
+		struct rlimit limit, capped;
+		getrlimit(RLIMIT_AS, &limit);
+		capped = limit;
+		capped.rlim_cur = (rlim_t)(pages * sysconf(_SC_PAGESIZE) + (256ULL << 20)); // room for everything but V
+		opts.Threads = 1;
+		bool capOk = pages != 0 && setrlimit(RLIMIT_AS, &capped) == 0;
+		r = HashMigration::Run("migrate_in.txt", "migrate_out.txt", opts);
+		setrlimit(RLIMIT_AS, &limit);
+		opts.Threads = 0;
+		pass = pass && capOk && r.Records == 2 && r.Failed == 1 && readFile("migrate_out.txt") == s3 + "\t0\n" + s2 + "\t1\n";
+#endif
+
+		writeFile("migrate_in.txt", "one\ntwo\nthree\nfour\nfive");
+		opts.Mode = HashMigration::Encode;
+		opts.CPUCost = 16;
+		opts.BlockSize = 1;
+		opts.Parallelism = 1;
+		opts.ChunkRecords = 2;
+		opts.OnProgress = [](const HashMigration::Report& soFar, void*) {
+			if (soFar.ResumedRecords == 0 && soFar.Records == 4)
+				throw std::runtime_error("interrupted");
+		};
+		bool interrupted = false;
+		try { HashMigration::Run("migrate_in.txt", "migrate_out.txt", opts); }
+		catch (const std::runtime_error&) { interrupted = true; }
+		r = HashMigration::Run("migrate_in.txt", "migrate_out.txt", opts);
+		std::string encoded = readFile("migrate_out.txt");
+		pass = pass && interrupted && r.Records == 5 && r.ResumedRecords == 4 && r.Changed == 5 && readFile("migrate_out.txt.resume").empty();
+
+		// the encoded records verify against their passwords, in input order
+		std::string check;
+		const char* passwords[] = { "one", "two", "three", "four", "five" };
+		for (size_t i = 0, line = 0; i < 5; i++, line = encoded.find('\n', line) + 1)
+			check += encoded.substr(line, encoded.find('\n', line) - line) + "\t" + passwords[i] + "\n";
+		writeFile("migrate_in.txt", check);
+		opts.Mode = HashMigration::Verify;
+		opts.OnProgress = nullptr;
+		r = HashMigration::Run("migrate_in.txt", "migrate_out.txt", opts);
+		pass = pass && r.Records == 5 && r.Failed == 0;
+		remove("migrate_in.txt");
+		remove("migrate_out.txt");
+		failures += Report(pass, start);
+	}
+
+	// Scheduler: a burst of jobs against a budget for two at a time and a short queue, every admitted job must match its vector
+	{
+		const TestCase& c = tc.Cases[0];
+		uint64_t footprint = ScryptScheduler::Footprint(c.N, c.r, c.p, c.OutLen);
+		printf("Scheduler: N=%llu, r=%u, p=%u, 4 workers, budget for 2 jobs, queue of 6\n", (unsigned long long)c.N, c.r, c.p);
+		auto start = std::chrono::steady_clock::now();
+		std::atomic<int> matched(0), completed(0);
+		std::atomic<bool> overBudget(false);
+		int accepted = 0, rejected = 0;
+		{
+			ScryptScheduler scheduler(4, footprint * 2 + footprint / 2, 6);
+			for (int j = 0; j < 12; j++)
+			{
+				bool queued = scheduler.Submit(c.P.data(), c.P.size(), c.S.data(), c.S.size(), c.N, c.r, c.p, c.OutLen,
+					[&](const uint8_t* out, size_t length, std::exception_ptr error) {
+						if (scheduler.MemoryInUse() > scheduler.MemoryBudget())
+							overBudget = true;
+						if (!error && std::equal(out, out + length, c.Result.begin(), c.Result.end()))
+							matched++;
+						completed++;
+					});
+				queued ? accepted++ : rejected++;
+			}
+			while (completed < accepted)
+				std::this_thread::sleep_for(std::chrono::milliseconds(1));
+		}
+		bool threw = false;
+		try { ScryptScheduler(1, footprint - 1, 1).Submit(c.P.data(), c.P.size(), c.S.data(), c.S.size(), c.N, c.r, c.p, c.OutLen, [](const uint8_t*, size_t, std::exception_ptr) {}); }
+		catch (const std::length_error&) { threw = true; }
+		printf("%d accepted, %d pushed back, %d matched\n", accepted, rejected, (int)matched);
+		failures += Report(accepted >= 6 && matched == accepted && !overBudget && threw, start);
+	}
+
+	// Pipeline: a stream of mixed shapes (so workers resize their V) through short queues must match the vectors, and a pipeline
+	// destroyed with hashes still queued completes every accepted one exactly once, with a result or the shut down error
+	{
+		const size_t cases[] = { 0, 1, 3 };
+		printf("Pipeline: 2 ROMix workers, depth 2, 12 hashes of 3 shapes, shutdown with hashes queued\n");
+		auto start = std::chrono::steady_clock::now();
+		std::atomic<int> matched(0), completed(0), abandoned(0);
+		bool pass;
+		{
+			ScryptPipeline pipeline(2, 2);
+			for (int j = 0; j < 12; j++)
+			{
+				const TestCase& c = tc.Cases[cases[j % 3]];
+				auto done = [&, j](const uint8_t* out, size_t length, std::exception_ptr error) {
+					const TestCase& expected = tc.Cases[cases[j % 3]];
+					if (!error && std::equal(out, out + length, expected.Result.begin(), expected.Result.end()))
+						matched++;
+					completed++;
+				};
+				while (!pipeline.Submit(c.P.data(), c.P.size(), c.S.data(), c.S.size(), c.N, c.r, c.p, c.OutLen, done))
+					std::this_thread::sleep_for(std::chrono::milliseconds(1));
+			}
+			pipeline.Drain();
+			pass = completed == 12 && pipeline.InFlight() == 0 && pipeline.ROMixWorkers() == 2;
+		}
+		int accepted = 0;
+		{
+			const TestCase& c = tc.Cases[1];
+			ScryptPipeline pipeline(1, 1);
+			while (pipeline.Submit(c.P.data(), c.P.size(), c.S.data(), c.S.size(), c.N, c.r, c.p, c.OutLen,
+				[&](const uint8_t* out, size_t length, std::exception_ptr error) {
+					if (!error && std::equal(out, out + length, c.Result.begin(), c.Result.end()))
+						matched++;
+					else if (error)
+						abandoned++;
+					completed++;
+				}))
+				accepted++;
+		}
+		printf("%d matched, %d of %d abandoned at shutdown\n", (int)matched, (int)abandoned, accepted);
+		failures += Report(pass && matched + abandoned == 12 + accepted && completed == 12 + accepted && accepted >= 1, start);
+	}
+
+#if !defined(_WIN32)
+	// Daemon: clients on several threads verify and encode through one daemon, requests of the same shape share batches,
+	// wrong passwords do not verify and a malformed request is answered with an error on a connection that stays usable
+	{
+		const TestCase& c = tc.Cases[3];
+		printf("HashDaemon: 4 clients, verify N=%llu, r=%u, p=%u, encode N=16, r=1, p=1\n", (unsigned long long)c.N, c.r, c.p);
+		auto start = std::chrono::steady_clock::now();
+		HashFields h = { 2, c.N, c.r, c.p, c.S.data(), c.S.size(), c.Result.data(), c.Result.size() };
+		char text[256];
+		std::string encoded(text, HashCodec::Encode(h, text, sizeof(text)));
+		HashDaemon::Options opts = {};
+		opts.SocketPath = "scrypt_daemon_test.sock";
+		opts.Threads = 2;
+		opts.MemoryBudget = 64 << 20;
+		opts.BatchWindowMicroseconds = 20000;
+		std::atomic<int> good(0);
+		bool pass = false;
+		try
+		{
+			HashDaemon daemon(opts);
+			std::thread server([&] { daemon.Run(); });
+			std::vector<std::thread> clients;
+			for (int t = 0; t < 4; t++)
+				clients.emplace_back([&, t] {
+					try
+					{
+						HashDaemonClient client(opts.SocketPath);
+						const uint8_t wrong[] = { 'x' };
+						bool ok = client.Verify(encoded.data(), encoded.size(), c.P.data(), c.P.size());
+						ok = !client.Verify(encoded.data(), encoded.size(), wrong, 1) && ok;
+						std::string password = "password" + std::to_string(t);
+						std::string mine = client.Encode((const uint8_t*)password.data(), password.size(), 16, 1, 1, 32);
+						ok = client.Verify(mine.data(), mine.size(), (const uint8_t*)password.data(), password.size()) && ok;
+						bool rejected = false;
+						try { client.Verify("$s2$16$1$1$", 11, wrong, 1); }
+						catch (const std::invalid_argument&) { rejected = true; }
+						ok = client.Verify(mine.data(), mine.size(), (const uint8_t*)password.data(), password.size()) && rejected && ok;
+						if (ok)
+							good++;
+					}
+					catch (const std::exception& ex)
+					{
+						printf("Exception: %s\n", ex.what());
+					}
+				});
+			for (std::thread& t : clients)
+				t.join();
+			daemon.Stop();
+			server.join();
+			printf("%llu requests in %llu batches\n", (unsigned long long)daemon.Requests(), (unsigned long long)daemon.Batches());
+			pass = good == 4 && daemon.Requests() == 24 && daemon.Batches() <= 12;
+		}
+		catch (const std::exception& ex)
+		{
+			printf("Exception: %s\n", ex.what());
+		}
+#if defined(__linux__)
+		// a batch that cannot get its V is answered Failed, not Busy: the client must not be told to retry it
+		try
+		{
+			opts.SocketPath = "scrypt_daemon_fail.sock";
+			opts.Threads = 1;
+			opts.MemoryBudget = 1ULL << 40; // admitted, the address space limit below is what stops it
+			opts.BatchWindowMicroseconds = 0;
+			HashDaemon daemon(opts);
+			std::thread server([&] { daemon.Run(); });
+			HashDaemonClient client(opts.SocketPath);
+			unsigned long long pages = 0;
+			FILE* statm = fopen("/proc/self/statm", "r");
+			if (statm != nullptr)
+			{
+				if (fscanf(statm, "%llu", &pages) != 1) pages = 0;
+				fclose(statm);
+			}
+			struct rlimit limit, capped;
+			getrlimit(RLIMIT_AS, &limit);
+			capped = limit;
+			capped.rlim_cur = (rlim_t)(pages * sysconf(_SC_PAGESIZE) + (256ULL << 20)); // room for everything but V
+			bool capOk = pages != 0 && setrlimit(RLIMIT_AS, &capped) == 0;
+			bool busy = false, failed = false;
+			try { client.Encode((const uint8_t*)"pw", 2, 1 << 20, 8, 1, 32); }
+			catch (const HashDaemonClient::BusyError&) { busy = true; }
+			catch (const std::runtime_error&) { failed = true; }
+			catch (const std::exception&) {} // Invalid, neither
+			setrlimit(RLIMIT_AS, &limit);
+			daemon.Stop();
+			server.join();
+			pass = pass && capOk && failed && !busy;
+		}
+		catch (const std::exception& ex)
+		{
+			printf("Exception: %s\n", ex.what());
+			pass = false;
+		}
+#endif
+		failures += Report(pass, start);
+	}
+#endif
+
+	// Metrics: nothing is recorded while disabled, one call and one batch are recorded with consistent counts once enabled
+	{
+		const TestCase& c = tc.Cases[0];
+		printf("Metrics: N=%llu, r=%u, p=%u, kernel %s\n", (unsigned long long)c.N, c.r, c.p, Metrics::Kernel());
+		auto start = std::chrono::steady_clock::now();
+		std::vector<uint8_t> out(c.OutLen);
+		Metrics::Reset();
+		Scrypt::ComputeDerivedHash(c.P.data(), c.P.size(), c.S.data(), c.S.size(), c.N, c.r, c.p, out.data(), out.size(), 2);
+		bool pass = Metrics::Snapshot().Calls == 0 && Metrics::Snapshot().VBytesAllocated > 0;
+
+		struct Seen { int calls; uint64_t lastN; uint64_t fill; uint64_t lastV; } seen = { 0, 0, 0, 0 };
+		Metrics::SetCallback([](const Metrics::Call& call, void* context) {
+			Seen* s = (Seen*)context;
+			s->calls++;
+			s->lastN = call.CPUCost;
+			s->fill += call.Nanoseconds[Metrics::ROMixFill];
+			s->lastV = call.VBytes;
+		}, &seen);
+		Metrics::Enable(true);
+		Scrypt::ComputeDerivedHash(c.P.data(), c.P.size(), c.S.data(), c.S.size(), c.N, c.r, c.p, out.data(), out.size(), 2);
+		const uint8_t* p[2] = { c.P.data(), c.P.data() }; const uint8_t* s[2] = { c.S.data(), c.S.data() };
+		size_t pl[2] = { c.P.size(), c.P.size() }, sl[2] = { c.S.size(), c.S.size() };
+		std::vector<uint8_t> o1(c.OutLen), o2(c.OutLen);
+		uint8_t* o[2] = { o1.data(), o2.data() };
+		Scrypt::ComputeDerivedHashBatch(p, pl, s, sl, 2, c.N, c.r, c.p, o, c.OutLen, 1);
+		Metrics::Enable(false);
+		Metrics::SetCallback(nullptr, nullptr);
+		Scrypt::ComputeDerivedHash(c.P.data(), c.P.size(), c.S.data(), c.S.size(), c.N, c.r, c.p, out.data(), out.size(), 1);
+
+		Metrics::Counters m = Metrics::Snapshot();
+		printf("%llu calls, %llu hashes, %llu BlockMix, fill %.2f ms, mix %.2f ms, V high water %.1f MiB\n", (unsigned long long)m.Calls,
+			(unsigned long long)m.Hashes, (unsigned long long)m.BlockMixCalls, m.Nanoseconds[Metrics::ROMixFill] / 1e6,
+			m.Nanoseconds[Metrics::ROMixMix] / 1e6, m.VBytesHighWater / 1048576.0);
+		pass = pass && m.Calls == 2 && m.Hashes == 3 && m.BlockMixCalls == 3 * 2 * c.N * c.p && m.SalsaCalls == m.BlockMixCalls * 2 * c.r &&
+			m.Nanoseconds[Metrics::ROMixFill] > 0 && m.Nanoseconds[Metrics::ROMixMix] > 0 && m.Nanoseconds[Metrics::PBKDF2In] > 0 &&
+			m.Nanoseconds[Metrics::PBKDF2Out] > 0 && m.WallNanoseconds > 0 && m.VBytesWiped >= m.VBytesAllocated &&
+			seen.calls == 2 && seen.lastN == c.N && seen.lastV == Scrypt::BatchFootprint(c.N, c.r, c.p, 2, 1) - 2ULL * c.p * c.r * 128 && seen.fill == m.Nanoseconds[Metrics::ROMixFill] && o1 == c.Result && o2 == c.Result;
+		failures += Report(pass, start);
+	}
+
+	// Stepwise computation: odd sized slices give the same hash as one call, a cancelled one stops and has no result
+	{
+		printf("ScryptComputation: slices of N/3 + 1 steps\n");
+		auto start = std::chrono::steady_clock::now();
+		bool pass = true;
+		for (size_t i = 0; i < tc.Cases.size(); i++)
+		{
+			const TestCase& c = tc.Cases[i];
+			if (c.Large || c.Result.empty())
+				continue;
+			ScryptComputation sc(c.P.data(), c.P.size(), c.S.data(), c.S.size(), c.N, c.r, c.p, c.OutLen);
+			int slices = 0;
+			while (sc.Step(c.N / 3 + 1) == ScryptComputation::Running)
+				slices++;
+			std::vector<uint8_t> out(c.OutLen);
+			sc.Result(out.data(), out.size());
+			pass = pass && out == c.Result && sc.StepsDone() == sc.Steps() && slices >= 5;
+		}
+		const TestCase& c = tc.Cases[0];
+		ScryptComputation sc(c.P.data(), c.P.size(), c.S.data(), c.S.size(), c.N, c.r, c.p, c.OutLen);
+		sc.Step(c.N + 5);
+		uint64_t done = sc.StepsDone();
+		sc.Cancel();
+		bool threw = false;
+		std::vector<uint8_t> out(c.OutLen);
+		try { sc.Result(out.data(), out.size()); }
+		catch (const std::logic_error&) { threw = true; }
+		pass = pass && done == c.N + 5 && sc.Step(1000) == ScryptComputation::Cancelled && sc.StepsDone() == done &&
+			sc.CurrentStatus() == ScryptComputation::Cancelled && threw;
+		failures += Report(pass, start);
+	}
+
+	// Calibration: whatever it picks must fit the targets and hash correctly, an impossible memory ceiling must throw
+	{
+		printf("Calibrate: 50 ms, 64 MiB, 2 threads\n");
+		auto start = std::chrono::steady_clock::now();
+		Scrypt::Calibration cal = Scrypt::Calibrate(50, 64 << 20, 2);
+		printf("N=%llu, r=%u, p=%u, %u threads, %.1f MiB, %.2f ms, %.1f hash/s (node %.1f)\n", (unsigned long long)cal.CPUCost,
+			cal.BlockSize, cal.Parallelism, cal.MaxThreads, cal.MemoryBytes / 1048576.0, cal.Milliseconds, cal.HashesPerSecond, cal.NodeHashesPerSecond);
+		uint8_t out[32];
+		Scrypt::ComputeDerivedHash((const uint8_t*)"p", 1, (const uint8_t*)"s", 1, cal.CPUCost, cal.BlockSize, cal.Parallelism, out, sizeof(out), cal.MaxThreads);
+		bool threw = false;
+		try { Scrypt::Calibrate(50, 1024, 1); }
+		catch (const std::out_of_range&) { threw = true; }
+		failures += Report(cal.CPUCost >= 16 && (cal.CPUCost & (cal.CPUCost - 1)) == 0 && cal.Parallelism >= 1 &&
+			cal.MemoryBytes <= (64 << 20) && cal.Milliseconds <= 50 && threw, start);
+	}
+
+	printf("%d failure(s)\n", failures);
+	return failures == 0 ? 0 : 1;
+}
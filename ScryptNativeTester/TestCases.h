@@ -0,0 +1,106 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace ScryptNativeTester
+{
+	static std::vector<uint8_t> HexToBytes(const char* hex)
+	{
+		std::vector<uint8_t> result;
+		for (; hex[0] != 0 && hex[1] != 0; hex += 2)
+		{
+			unsigned int b = 0;
+			for (int i = 0; i < 2; i++)
+				b = (b << 4) | (unsigned int)(hex[i] <= '9' ? hex[i] - '0' : (hex[i] | 0x20) - 'a' + 10);
+			result.push_back((uint8_t)b);
+		}
+		return result;
+	}
+
+	static std::vector<uint8_t> StringToBytes(const char* s)
+	{
+		return std::vector<uint8_t>(s, s + std::char_traits<char>::length(s));
+	}
+
+	// Same vectors as ScryptTester/TestCases.cs (RFC 7914 section 12 plus a few extras)
+	struct TestCase
+	{
+		std::vector<uint8_t> P;
+		std::vector<uint8_t> S;
+		uint64_t N;
+		uint32_t r;
+		uint32_t p;
+		size_t OutLen;
+		std::vector<uint8_t> Result; // empty means the call is expected to throw
+		bool Large; // only run with --large, these need a lot of memory and time
+	};
+
+	// RFC 7914 section 11 and RFC 6070 style vectors for the PBKDF2 functions
+	struct PBKDF2TestCase
+	{
+		int Hash; // 1, 256 or 512
+		std::vector<uint8_t> P;
+		std::vector<uint8_t> S;
+		uint32_t C;
+		std::vector<uint8_t> Result;
+	};
+
+	// Encoded forms from TestCases.cs, Case is the index of the matching entry in Cases
+	struct EncodedTestCase
+	{
+		size_t Case;
+		std::string Encoded;
+	};
+
+	class TestCases
+	{
+	public:
+		std::vector<TestCase> Cases;
+		std::vector<PBKDF2TestCase> PBKDF2Cases;
+		std::vector<EncodedTestCase> EncodedCases;
+
+		TestCases()
+		{
+			Cases.push_back({ StringToBytes("password"), StringToBytes("NaCl"), 1024, 8, 16, 64, HexToBytes(
+				"fdbabe1c9d3472007856e7190d01e9fe7c6ad7cbc8237830e77376634b373162"
+				"2eaf30d92e22a3886ff109279d9830dac727afb94a83ee6d8360cbdfa2cc0640"), false });
+			Cases.push_back({ StringToBytes("pleaseletmein"), StringToBytes("SodiumChloride"), 16384, 8, 1, 64, HexToBytes(
+				"7023bdcb3afd7348461c06cd81fd38ebfda8fbba904f8e3ea9b543f6545da1f2"
+				"d5432955613f0fcf62d49705242a9af9e61e85dc0d651e40dfcf017b45575887"), false });
+			Cases.push_back({ std::vector<uint8_t>(32, 0), StringToBytes("miliLock+test1@mailinator.com"), 131072, 8, 1, 32, HexToBytes(
+				"8da65199a6eaf2d08367bf8995e23f83d89407c784ba3952421c96a3390664fd"), false });
+			// NOTE: TestCases.cs pairs this salt with the RFC's empty salt vector (77 d6 57 62 ...), that case is expected to fail there
+			Cases.push_back({ StringToBytes(""), StringToBytes("nopassword"), 16, 1, 1, 64, HexToBytes(
+				"92713ee30ab1b19dbaa1307455cc1b1d05dc089867b23722559dbdc0c3580b98"
+				"b84cc6dc27bd284d61c2c29fd2791f14daa34661c707b4e6ce359aabb9a8a38c"), false });
+			Cases.push_back({ StringToBytes("pleaseletmein"), StringToBytes("SodiumChloride"), 1048576, 8, 1, 64, HexToBytes(
+				"2101cb9b6a511aaeaddbbe09cf70f881ec568d574a2ffd4dabe5ee9820adaa47"
+				"8e56fd8f4ba5d09ffa1c6d927c40f4c337304049e8a952fbcbf45c6fa77a41a4"), true });
+			Cases.push_back({ StringToBytes(""), StringToBytes(""), 16, 1, 1, 64, std::vector<uint8_t>(), false }); // THIS WILL THROW A "NULL SALT" EXCEPTION!
+
+			EncodedCases.push_back({ 0, "$s2$1024$8$16$TmFDbA==$/bq+HJ00cgB4VucZDQHp/nxq18vII3gw53N2Y0s3MWIurzDZLiKjiG/xCSedmDDaxyevuUqD7m2DYMvfoswGQA==" });
+			EncodedCases.push_back({ 1, "$s2$16384$8$1$U29kaXVtQ2hsb3JpZGU=$cCO9yzr9c0hGHAbNgf046/2o+7qQT44+qbVD9lRdofLVQylVYT8Pz2LUlwUkKpr55h6F3A1lHkDfzwF7RVdYhw==" });
+			EncodedCases.push_back({ 2, "$s2$131072$8$1$bWlsaUxvY2srdGVzdDFAbWFpbGluYXRvci5jb20=$jaZRmabq8tCDZ7+JleI/g9iUB8eEujlSQhyWozkGZP0=" });
+
+			PBKDF2Cases.push_back({ 256, StringToBytes("passwd"), StringToBytes("salt"), 1, HexToBytes(
+				"55ac046e56e3089fec1691c22544b605f94185216dde0465e68b9d57c20dacbc"
+				"49ca9cccf179b645991664b39d77ef317c71b845b1e30bd509112041d3a19783") });
+			PBKDF2Cases.push_back({ 256, StringToBytes("Password"), StringToBytes("NaCl"), 80000, HexToBytes(
+				"4ddcd8f60b98be21830cee5ef22701f9641a4418d04c0414aeff08876b34ab56"
+				"a1d425a1225833549adb841b51c9b3176a272bdebba1d078478f62b397f33c8d") });
+			PBKDF2Cases.push_back({ 1, StringToBytes("password"), StringToBytes("salt"), 1, HexToBytes(
+				"0c60c80f961f0e71f3a9b524af6012062fe037a6") });
+			PBKDF2Cases.push_back({ 1, StringToBytes("passwordPASSWORDpassword"), StringToBytes("saltSALTsaltSALTsaltSALTsaltSALTsalt"), 4096, HexToBytes(
+				"3d2eec4fe41c849b80c8d83662c0e44a8b291a964cf2f07038") });
+			PBKDF2Cases.push_back({ 512, StringToBytes("password"), StringToBytes("salt"), 1, HexToBytes(
+				"867f70cf1ade02cff3752599a3a53dc4af34c7a669815ae5d513554e1c8cf252"
+				"c02d470a285a0501bad999bfe943c08f050235d7d68b1da55e63f73b60a57fce") });
+			PBKDF2Cases.push_back({ 512, StringToBytes("passwordPASSWORDpassword"), StringToBytes("saltSALTsaltSALTsaltSALTsaltSALTsalt"), 4096, HexToBytes(
+				"8c0511f4c6e597c6ac6315d8f0362e225f3c501495ba23b868c005174dc4ee71"
+				"115b59f9e60cd9532fa33e0f75aefe30225c583a186cd82bd4daea9724a3d3b8"
+				"04f75bdd41494fa324cab24bcc680fb3") });
+		}
+	};
+}